@@ -0,0 +1,331 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/benchmark.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/pe_fuzz.hpp>
+#include <hadesmem/detail/pe_samples.hpp>
+#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/find_pattern.hpp>
+#include <hadesmem/find_procedure.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_snapshot.hpp>
+#include <hadesmem/pelib/export.hpp>
+#include <hadesmem/pelib/export_list.hpp>
+#include <hadesmem/pelib/import_table.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/pelib/relocation_table.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+#include "main.hpp"
+#include "strings.hpp"
+
+// Every file in the corpus is parsed from a buffer (the same as a file on
+// disk once it's been read in), so IO doesn't factor into any of the timings.
+// Names are "<group>/<what>/<file>", so --benchmark-filter can pick out a
+// group, a component or a file.
+
+namespace
+{
+std::chrono::nanoseconds GetThreadCpuTime()
+{
+  FILETIME creation_time{};
+  FILETIME exit_time{};
+  FILETIME kernel_time{};
+  FILETIME user_time{};
+  if (!::GetThreadTimes(::GetCurrentThread(),
+                        &creation_time,
+                        &exit_time,
+                        &kernel_time,
+                        &user_time))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(hadesmem::Error{}
+                                    << hadesmem::ErrorString{
+                                         "GetThreadTimes failed."}
+                                    << hadesmem::ErrorCodeWinLast{last_error});
+  }
+
+  auto const to_ticks = [](FILETIME const& ft) {
+    return (static_cast<std::uint64_t>(ft.dwHighDateTime) << 32) |
+           ft.dwLowDateTime;
+  };
+  // FILETIME is in 100ns units.
+  return std::chrono::nanoseconds{
+    static_cast<std::chrono::nanoseconds::rep>(
+      (to_ticks(kernel_time) + to_ticks(user_time)) * 100)};
+}
+
+// Spread evenly over the image, so every section gets its share.
+std::vector<DWORD> GetBenchmarkRvas(hadesmem::Process const& process,
+                                    hadesmem::PeFile const& pe_file)
+{
+  std::size_t const kNumRvas = 0x1000;
+  hadesmem::NtHeaders const nt_headers{process, pe_file};
+  DWORD const size_of_image = nt_headers.GetSizeOfImage();
+  std::vector<DWORD> rvas;
+  rvas.reserve(kNumRvas);
+  for (std::size_t i = 0; i < kNumRvas; ++i)
+  {
+    rvas.push_back(static_cast<DWORD>(
+      static_cast<std::uint64_t>(size_of_image) * i / kNumRvas));
+  }
+  return rvas;
+}
+
+// A sample of the names, rather than all of them, so the many_exports file
+// doesn't take quadratic time.
+std::vector<std::string> GetBenchmarkExportNames(
+  hadesmem::Process const& process, hadesmem::PeFile const& pe_file)
+{
+  std::size_t const kMaxNames = 0x10;
+  std::vector<std::string> names;
+  try
+  {
+    hadesmem::ExportList const exports{process, pe_file};
+    for (auto const& e : exports)
+    {
+      if (e.ByName())
+      {
+        names.push_back(e.GetName());
+      }
+    }
+  }
+  catch (hadesmem::Error const& /*e*/)
+  {
+    return names;
+  }
+
+  if (names.size() <= kMaxNames)
+  {
+    return names;
+  }
+
+  std::vector<std::string> sample;
+  for (std::size_t i = 0; i < kMaxNames; ++i)
+  {
+    sample.push_back(names[(names.size() - 1) * i / (kMaxNames - 1)]);
+  }
+  return sample;
+}
+
+// Same lookup as detail::GetProcAddressInternal, but over a file.
+bool FindExportByName(hadesmem::Process const& process,
+                      hadesmem::PeFile const& pe_file,
+                      std::string const& name)
+{
+  hadesmem::ExportList const exports{process, pe_file};
+  auto const iter = std::find_if(
+    std::begin(exports), std::end(exports), [&](hadesmem::Export const& e) {
+      return e.ByName() && e.GetName() == name;
+    });
+  return iter != std::end(exports);
+}
+
+void RunFileBenchmarks(hadesmem::detail::BenchmarkRunner& runner,
+                       hadesmem::Process const& process,
+                       hadesmem::detail::PeSample const& sample)
+{
+  std::vector<std::uint8_t> buf{sample.data};
+  hadesmem::PeFile const pe_file{process,
+                                 buf.data(),
+                                 hadesmem::PeFileType::kData,
+                                 static_cast<DWORD>(buf.size())};
+  std::uint64_t const size = buf.size();
+
+  // Nothing in the corpus is malformed, so an error here is a bug rather than
+  // something to measure. The budget is only there because the fuzz targets
+  // want one.
+  hadesmem::detail::PeFuzzBudget const unlimited{
+    (std::numeric_limits<std::size_t>::max)(), std::chrono::hours{24}};
+  for (auto const& target : hadesmem::detail::GetPeFuzzTargets())
+  {
+    runner.Run(std::string{"parse/"} + target.name + "/" + sample.name,
+               1,
+               size,
+               [&]() {
+                 hadesmem::detail::PeFuzzCounter counter{unlimited};
+                 target.func(process, pe_file, counter);
+               });
+  }
+
+  // Everything ImportDirList and ImportThunkList would give, in one go.
+  runner.Run("parse/import_table/" + sample.name, 1, size, [&]() {
+    hadesmem::ImportTable const imports{process, pe_file};
+    for (std::size_t i = 0; i < imports.GetNumModules(); ++i)
+    {
+      (void)imports.GetModuleName(i);
+      for (std::size_t j = 0; j < imports.GetNumThunks(i); ++j)
+      {
+        if (!imports.ByOrdinal(i, j))
+        {
+          (void)imports.GetName(i, j);
+        }
+      }
+    }
+  });
+
+  // Everything RelocationBlockList and RelocationList would give, in one go.
+  runner.Run("parse/relocation_table/" + sample.name, 1, size, [&]() {
+    hadesmem::RelocationTable const relocs{process, pe_file};
+    (void)relocs.GetNumEntries();
+  });
+
+  std::wstring const path =
+    hadesmem::detail::MultiByteToWideChar(sample.name);
+  runner.Run("dump/DumpPeFile/" + sample.name, 1, size, [&]() {
+    DumpPeFile(process, pe_file, path);
+  });
+
+  runner.Run("dump/DumpStrings/" + sample.name, 1, size, [&]() {
+    DumpStrings(process, pe_file);
+  });
+
+  auto const rvas = GetBenchmarkRvas(process, pe_file);
+  runner.Run("lookup/RvaToVa/" + sample.name, rvas.size(), 0, [&]() {
+    for (auto const rva : rvas)
+    {
+      (void)hadesmem::RvaToVa(process, pe_file, rva);
+    }
+  });
+
+  auto const names = GetBenchmarkExportNames(process, pe_file);
+  if (!names.empty())
+  {
+    runner.Run("lookup/export_by_name/" + sample.name, names.size(), 0, [&]() {
+      for (auto const& name : names)
+      {
+        if (!FindExportByName(process, pe_file, name))
+        {
+          HADESMEM_DETAIL_THROW_EXCEPTION(
+            hadesmem::Error{} << hadesmem::ErrorString{"Missing export."});
+        }
+      }
+    });
+  }
+
+  runner.Run("lookup/FindImport/" + sample.name, 1, 0, [&]() {
+    hadesmem::ImportTable const imports{process, pe_file};
+    (void)imports.FindImport("user32.dll", "MessageBoxA");
+  });
+
+  // Not in any of the files, so every byte gets looked at.
+  std::wstring const pattern = L"DE AD ?? BE EF ?? 13 37";
+  runner.Run("scan/Find/" + sample.name, 1, size, [&]() {
+    (void)hadesmem::Find(process, buf.data(), buf.size(), pattern, 0, 0);
+  });
+}
+}
+
+void RunBenchmarks(std::string const& filter,
+                   std::chrono::milliseconds min_time,
+                   std::wstring const& json_path)
+{
+  hadesmem::detail::BenchmarkRunner runner{min_time, &GetThreadCpuTime};
+  runner.SetFilter(filter);
+  runner.SetLog(&std::cout);
+
+  hadesmem::Process const process{::GetCurrentProcessId()};
+  for (auto const& sample : hadesmem::detail::GetPeBenchmarkCorpus())
+  {
+    RunFileBenchmarks(runner, process, sample);
+  }
+
+  // For comparison with the file based lookups above.
+  hadesmem::ModuleSnapshot const modules{process};
+  hadesmem::Module const& kernel32 =
+    hadesmem::detail::GetSnapshotModule(modules, L"kernel32.dll");
+  runner.Run("lookup/FindProcedure/kernel32", 1, 0, [&]() {
+    (void)hadesmem::FindProcedure(process, kernel32, "GetProcAddress");
+  });
+
+  // Nothing in the corpus has enough relocations to be worth applying, so
+  // rebase a copy of a real image instead. The delta alternates sign, so the
+  // copy doesn't drift.
+  hadesmem::Module const& ntdll =
+    hadesmem::detail::GetSnapshotModule(modules, L"ntdll.dll");
+  hadesmem::PeFile const ntdll_pe_file{
+    process, ntdll.GetHandle(), hadesmem::PeFileType::kImage, 0};
+  hadesmem::RelocationTable const ntdll_relocs{process, ntdll_pe_file};
+  auto ntdll_image = hadesmem::ReadVector<std::uint8_t>(
+    process, ntdll.GetHandle(), ntdll.GetSize());
+  std::uint64_t ntdll_delta = 0x10000;
+  runner.Run("apply/ApplyRelocations/ntdll",
+             ntdll_relocs.GetNumEntries(),
+             0,
+             [&]() {
+               (void)ntdll_relocs.ApplyRelocations(
+                 ntdll_image.data(), ntdll_image.size(), ntdll_delta);
+               ntdll_delta = 0 - ntdll_delta;
+             });
+
+  if (json_path.empty())
+  {
+    return;
+  }
+
+  std::unique_ptr<std::fstream> const file{
+    hadesmem::detail::OpenFile<char>(json_path, std::ios::out)};
+  if (!*file)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{}
+      << hadesmem::ErrorString{"Failed to open benchmark output file."});
+  }
+
+  std::vector<std::pair<std::string, std::string>> const context = {
+    {"library_version", HADESMEM_VERSION_STRING},
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+    {"arch", "x64"},
+#else
+    {"arch", "x86"},
+#endif
+#if defined(_DEBUG)
+    {"library_build_type", "debug"},
+#else
+    {"library_build_type", "release"},
+#endif
+    {"min_time_ms", std::to_string(min_time.count())}};
+  runner.WriteJson(*file, context);
+}
+
+void WriteBenchmarkCorpus(std::wstring const& dir)
+{
+  if (!hadesmem::detail::DoesDirectoryExist(dir))
+  {
+    hadesmem::detail::CreateDirectoryWrapper(dir);
+  }
+
+  auto const corpus = hadesmem::detail::GetPeBenchmarkCorpus();
+  for (auto const& sample : corpus)
+  {
+    hadesmem::detail::BufferToFile(
+      hadesmem::detail::CombinePath(
+        dir, hadesmem::detail::MultiByteToWideChar(sample.name) + L".exe"),
+      sample.data.data(),
+      static_cast<std::streamsize>(sample.data.size()));
+  }
+
+  std::wcout << L"Wrote " << corpus.size() << L" files to " << dir << L".\n";
+}
@@ -0,0 +1,15 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// Runs the PeLib and dump benchmarks over the synthetic corpus. Results are
+// printed as they're done, and written as JSON if there's a path for them.
+void RunBenchmarks(std::string const& filter,
+                   std::chrono::milliseconds min_time,
+                   std::wstring const& json_path);
+
+void WriteBenchmarkCorpus(std::wstring const& dir);
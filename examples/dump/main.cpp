@@ -9,6 +9,7 @@
 #include "main.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <ctime>
 #include <fstream>
 #include <iostream>
@@ -47,6 +48,7 @@
 #include <hadesmem/thread_list.hpp>
 #include <hadesmem/thread_entry.hpp>
 
+#include "benchmark.hpp"
 #include "bound_imports.hpp"
 #include "exports.hpp"
 #include "filesystem.hpp"
@@ -560,7 +562,21 @@ int main(int argc, char* argv[])
     TCLAP::MultiArg<std::string> path_arg(
       "", "path", "Target path (file or directory)", false, "string");
     TCLAP::SwitchArg all_arg("", "all", "No target, dump everything");
-    std::vector<TCLAP::Arg*> xor_args{&pid_arg, &name_arg, &path_arg, &all_arg};
+    TCLAP::SwitchArg benchmark_arg(
+      "", "benchmark", "No target, benchmark against the synthetic corpus");
+    TCLAP::ValueArg<std::string> benchmark_write_corpus_arg(
+      "",
+      "benchmark-write-corpus",
+      "No target, write the benchmark corpus to a directory",
+      false,
+      "",
+      "string");
+    std::vector<TCLAP::Arg*> xor_args{&pid_arg,
+                                      &name_arg,
+                                      &path_arg,
+                                      &all_arg,
+                                      &benchmark_arg,
+                                      &benchmark_write_corpus_arg};
     cmd.xorAdd(xor_args);
     TCLAP::SwitchArg warned_arg(
       "", "warned", "Dump list of files which cause warnings", cmd);
@@ -610,6 +626,11 @@ int main(int argc, char* argv[])
       "Add new section to contain reconstructed imports (as opposed to being "
       "appended to the existing last section)",
       cmd);
+    TCLAP::SwitchArg scan_stripped_headers_arg(
+      "",
+      "scan-stripped-headers",
+      "Also look for modules whose DOS header has been erased",
+      cmd);
     TCLAP::ValueArg<std::string> module_name_arg(
       "", "module-name", "Module to dump", false, "", "string", cmd);
     TCLAP::ValueArg<std::uintptr_t> module_base_arg(
@@ -626,6 +647,30 @@ int main(int argc, char* argv[])
       0,
       "DWORD",
       cmd);
+    TCLAP::ValueArg<std::string> benchmark_filter_arg(
+      "",
+      "benchmark-filter",
+      "Only run benchmarks whose names match this regex",
+      false,
+      "",
+      "string",
+      cmd);
+    TCLAP::ValueArg<std::string> benchmark_out_arg(
+      "",
+      "benchmark-out",
+      "Write benchmark results to this file as JSON",
+      false,
+      "",
+      "string",
+      cmd);
+    TCLAP::ValueArg<std::size_t> benchmark_min_time_arg(
+      "",
+      "benchmark-min-time",
+      "Minimum time to run each benchmark for (in ms)",
+      false,
+      500,
+      "size_t",
+      cmd);
     // TODO: Add --force-module-path to override the module path detection and
     // allow us to attempt to dump a PE file even if we don't have in-memory
     // headers or a file mapping backing the memory region.
@@ -648,6 +693,9 @@ int main(int argc, char* argv[])
     g_flags |= add_new_section_arg.isSet()
                  ? hadesmem::detail::DumpFlags::kAddNewSection
                  : 0;
+    g_flags |= scan_stripped_headers_arg.isSet()
+                 ? hadesmem::detail::DumpFlags::kScanStrippedHeaders
+                 : 0;
     g_oep = oep_arg.getValue();
     g_module_name =
       hadesmem::detail::MultiByteToWideChar(module_name_arg.getValue());
@@ -718,6 +766,27 @@ int main(int argc, char* argv[])
       break;
     }
 
+    if (benchmark_write_corpus_arg.isSet())
+    {
+      WriteBenchmarkCorpus(hadesmem::detail::MultiByteToWideChar(
+        benchmark_write_corpus_arg.getValue()));
+      return 0;
+    }
+
+    if (benchmark_arg.isSet())
+    {
+      // Only the parsing is being measured, not the console.
+      g_quiet = true;
+      std::chrono::milliseconds const min_time{
+        static_cast<std::chrono::milliseconds::rep>(
+          benchmark_min_time_arg.getValue())};
+      RunBenchmarks(
+        benchmark_filter_arg.getValue(),
+        min_time,
+        hadesmem::detail::MultiByteToWideChar(benchmark_out_arg.getValue()));
+      return 0;
+    }
+
     try
     {
       hadesmem::GetSeDebugPrivilege();
@@ -0,0 +1,416 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <io.h>
+#include <stdio.h>
+#include <windows.h>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <tclap/CmdLine.h>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/pe_fuzz.hpp>
+#include <hadesmem/detail/pe_samples.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/error.hpp>
+
+// Fuzz driver for PeLib.
+//
+// Built with HADESMEM_PEFUZZ_LIBFUZZER defined (and -fsanitize=fuzzer under
+// clang-cl) this is a libFuzzer target, and libFuzzer's own -timeout and
+// -rss_limit_mb flags provide the per-input budgets. Components can be picked
+// with -pe_component=<name> (libFuzzer warns about the unknown flag but
+// passes it through).
+//
+// Otherwise it's a standalone replay tool, which also works as an AFL target
+// ("pefuzz.exe --crash-on-failure @@", or with no inputs it reads stdin).
+// Each input gets a time budget, enforced both cooperatively and by a
+// watchdog which aborts if PeLib gets stuck in a single call, and the whole
+// process runs in a job with a memory limit.
+//
+// Either way a crash, an assert, an unexpected exception type or running out
+// of budget is a finding. PeLib throwing hadesmem::Error is not.
+
+namespace
+{
+std::uint32_t ParseComponent(std::string const& name)
+{
+  for (auto const& target : hadesmem::detail::GetPeFuzzTargets())
+  {
+    if (name == target.name)
+    {
+      return target.component;
+    }
+  }
+
+  HADESMEM_DETAIL_THROW_EXCEPTION(
+    hadesmem::Error{} << hadesmem::ErrorString{"Unknown component."});
+}
+
+std::uint32_t g_components = hadesmem::detail::PeFuzzComponent::kAll;
+}
+
+#if defined(HADESMEM_PEFUZZ_LIBFUZZER)
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+  std::string const prefix = "-pe_component=";
+  std::uint32_t components = hadesmem::detail::PeFuzzComponent::kNone;
+  for (int i = 1; i < *argc; ++i)
+  {
+    std::string const arg = (*argv)[i];
+    if (!arg.compare(0, prefix.size(), prefix))
+    {
+      components |= ParseComponent(arg.substr(prefix.size()));
+    }
+  }
+
+  if (components)
+  {
+    g_components = components;
+  }
+
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(std::uint8_t const* data,
+                                      std::size_t size)
+{
+  auto const result = hadesmem::detail::FuzzPeBuffer(
+    data, size, hadesmem::detail::GetDefaultPeFuzzBudget(), g_components);
+  if (result.budget_exhausted)
+  {
+    std::cerr << "Budget exhausted after " << result.num_items << " items.\n";
+    std::abort();
+  }
+
+  return 0;
+}
+
+#else
+
+namespace
+{
+// Aborts the process if an input takes too long. PeFuzzBudget can only
+// stop PeLib between items, so this catches a single call which never
+// returns.
+class Watchdog
+{
+public:
+  explicit Watchdog(std::chrono::milliseconds timeout) : timeout_(timeout)
+  {
+    thread_ = std::thread{[this]() { Main(); }};
+  }
+
+  Watchdog(Watchdog const& other) = delete;
+
+  Watchdog& operator=(Watchdog const& other) = delete;
+
+  ~Watchdog()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    condition_.notify_all();
+
+    try
+    {
+      thread_.join();
+    }
+    catch (...)
+    {
+    }
+  }
+
+  void Start(std::wstring const& name)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      name_ = name;
+      deadline_ = std::chrono::steady_clock::now() + timeout_;
+      armed_ = true;
+    }
+    condition_.notify_all();
+  }
+
+  void Stop()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    armed_ = false;
+  }
+
+private:
+  void Main()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+      if (!armed_)
+      {
+        condition_.wait(lock);
+        continue;
+      }
+
+      if (condition_.wait_until(lock, deadline_) == std::cv_status::timeout &&
+          armed_ && std::chrono::steady_clock::now() >= deadline_)
+      {
+        std::wcerr << L"Timeout: " << name_ << L"\n";
+        std::abort();
+      }
+    }
+  }
+
+  std::chrono::milliseconds timeout_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::chrono::steady_clock::time_point deadline_;
+  std::wstring name_;
+  bool armed_{};
+  bool running_{true};
+  std::thread thread_;
+};
+
+hadesmem::detail::SmartHandle SetMemoryLimit(std::size_t limit_mb)
+{
+  hadesmem::detail::SmartHandle job{::CreateJobObjectW(nullptr, nullptr)};
+  if (!job.IsValid())
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << hadesmem::ErrorString{"CreateJobObjectW failed."}
+                        << hadesmem::ErrorCodeWinLast{last_error});
+  }
+
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION info{};
+  info.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+  info.ProcessMemoryLimit = limit_mb * 1024 * 1024;
+  if (!::SetInformationJobObject(job.GetHandle(),
+                                 JobObjectExtendedLimitInformation,
+                                 &info,
+                                 sizeof(info)))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << hadesmem::ErrorString{
+                             "SetInformationJobObject failed."}
+                        << hadesmem::ErrorCodeWinLast{last_error});
+  }
+
+  if (!::AssignProcessToJobObject(job.GetHandle(), ::GetCurrentProcess()))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << hadesmem::ErrorString{
+                             "AssignProcessToJobObject failed."}
+                        << hadesmem::ErrorCodeWinLast{last_error});
+  }
+
+  return job;
+}
+
+// Returns false if the input found a bug.
+bool RunInput(std::wstring const& name,
+              std::vector<char> const& data,
+              hadesmem::detail::PeFuzzBudget const& budget,
+              Watchdog& watchdog)
+{
+  watchdog.Start(name);
+
+  bool ok = true;
+  try
+  {
+    auto const result = hadesmem::detail::FuzzPeBuffer(
+      data.data(), data.size(), budget, g_components);
+    if (result.budget_exhausted)
+    {
+      std::wcerr << L"Budget exhausted: " << name << L" ("
+                 << result.num_items << L" items)\n";
+      ok = false;
+    }
+  }
+  catch (...)
+  {
+    std::wcerr << L"Unexpected exception: " << name << L"\n";
+    std::cerr << boost::current_exception_diagnostic_information() << '\n';
+    ok = false;
+  }
+
+  watchdog.Stop();
+  return ok;
+}
+
+std::vector<char> ReadStdin()
+{
+  ::_setmode(::_fileno(stdin), _O_BINARY);
+
+  std::vector<char> data;
+  char buf[0x1000];
+  while (std::cin.read(buf, sizeof(buf)) || std::cin.gcount())
+  {
+    data.insert(std::end(data), buf, buf + std::cin.gcount());
+  }
+  return data;
+}
+
+void WriteSeeds(std::wstring const& dir)
+{
+  if (!hadesmem::detail::DoesDirectoryExist(dir))
+  {
+    hadesmem::detail::CreateDirectoryWrapper(dir);
+  }
+
+  auto const corpus = hadesmem::detail::GetPeSamples();
+  for (auto const& sample : corpus)
+  {
+    hadesmem::detail::BufferToFile(
+      hadesmem::detail::CombinePath(
+        dir, hadesmem::detail::MultiByteToWideChar(sample.name)),
+      sample.data.data(),
+      static_cast<std::streamsize>(sample.data.size()));
+  }
+
+  std::wcout << L"Wrote " << corpus.size() << L" seeds to " << dir << L".\n";
+}
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    TCLAP::CmdLine cmd{"PeLib fuzz driver", ' ', HADESMEM_VERSION_STRING};
+    TCLAP::ValueArg<std::string> write_seeds_arg{
+      "", "write-seeds", "Write the seed corpus here", false, "", "path", cmd};
+    TCLAP::SwitchArg regression_arg{
+      "", "regression", "Replay the built in regression corpus", cmd};
+    TCLAP::MultiArg<std::string> component_arg{
+      "", "component", "Only fuzz this component", false, "name", cmd};
+    TCLAP::SwitchArg crash_arg{
+      "", "crash-on-failure", "Abort on the first failure (for AFL)", cmd};
+    TCLAP::ValueArg<std::size_t> timeout_arg{
+      "", "timeout-ms", "Time budget per input", false, 1000, "ms", cmd};
+    TCLAP::ValueArg<std::size_t> memory_arg{
+      "", "memory-mb", "Memory limit for the process", false, 1024, "MB", cmd};
+    TCLAP::UnlabeledMultiArg<std::string> inputs_arg{
+      "inputs", "Files or directories to replay", false, "path", cmd};
+    cmd.parse(argc, argv);
+
+    if (write_seeds_arg.isSet())
+    {
+      WriteSeeds(
+        hadesmem::detail::MultiByteToWideChar(write_seeds_arg.getValue()));
+      return 0;
+    }
+
+    if (component_arg.isSet())
+    {
+      g_components = hadesmem::detail::PeFuzzComponent::kNone;
+      for (auto const& name : component_arg.getValue())
+      {
+        g_components |= ParseComponent(name);
+      }
+    }
+
+    auto const job = SetMemoryLimit(memory_arg.getValue());
+
+    hadesmem::detail::PeFuzzBudget budget =
+      hadesmem::detail::GetDefaultPeFuzzBudget();
+    budget.max_time = std::chrono::milliseconds{timeout_arg.getValue()};
+    // Give the cooperative budget a chance before the watchdog steps in.
+    Watchdog watchdog{budget.max_time * 2};
+
+    std::size_t num_inputs = 0;
+    std::size_t num_failures = 0;
+    auto const run = [&](std::wstring const& name,
+                         std::vector<char> const& data) {
+      ++num_inputs;
+      if (!RunInput(name, data, budget, watchdog))
+      {
+        // AFL only looks for crashes and hangs, so make it look like one.
+        if (crash_arg.isSet())
+        {
+          std::abort();
+        }
+        ++num_failures;
+      }
+    };
+
+    if (regression_arg.isSet())
+    {
+      for (auto const& sample : hadesmem::detail::GetPeRegressionCorpus(64))
+      {
+        run(hadesmem::detail::MultiByteToWideChar(sample.name),
+            std::vector<char>(std::begin(sample.data), std::end(sample.data)));
+      }
+    }
+
+    auto const run_file = [&](std::wstring const& path) {
+      std::vector<char> data;
+      try
+      {
+        data = hadesmem::detail::FileToBuffer(path);
+      }
+      catch (hadesmem::Error const& /*e*/)
+      {
+        // Empty files are fine inputs, they're just not interesting.
+        return;
+      }
+      run(path, data);
+    };
+
+    for (auto const& input : inputs_arg.getValue())
+    {
+      auto const path = hadesmem::detail::MultiByteToWideChar(input);
+      if (hadesmem::detail::IsDirectory(path))
+      {
+        hadesmem::detail::EnumDir(path, [&](std::wstring const& file) {
+          auto const file_path = hadesmem::detail::CombinePath(path, file);
+          if (!hadesmem::detail::IsDirectory(file_path))
+          {
+            run_file(file_path);
+          }
+          return true;
+        });
+      }
+      else
+      {
+        run_file(path);
+      }
+    }
+
+    if (!regression_arg.isSet() && !inputs_arg.isSet())
+    {
+      run(L"<stdin>", ReadStdin());
+    }
+
+    std::wcout << num_inputs << L" inputs, " << num_failures
+               << L" failures.\n";
+
+    return num_failures ? 1 : 0;
+  }
+  catch (...)
+  {
+    std::cerr << "\nError!\n";
+    std::cerr << boost::current_exception_diagnostic_information() << '\n';
+
+    return 1;
+  }
+}
+
+#endif
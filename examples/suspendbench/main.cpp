@@ -0,0 +1,240 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+#include <tlhelp32.h>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <tclap/CmdLine.h>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/optional.hpp>
+#include <hadesmem/detail/self_path.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/toolhelp.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/thread_helpers.hpp>
+#include <hadesmem/thread_list.hpp>
+
+// Benchmark for process suspension (which every detour Apply/Remove does) and
+// per-process thread enumeration, as the number of threads in the rest of the
+// system grows. The target is this process (with a configurable number of
+// idle threads), and the other threads live in a child process.
+
+namespace
+{
+DWORD WINAPI IdleThread(LPVOID /*param*/)
+{
+  ::Sleep(INFINITE);
+  return 0;
+}
+
+std::vector<hadesmem::detail::SmartHandle> CreateIdleThreads(std::size_t num)
+{
+  std::vector<hadesmem::detail::SmartHandle> threads;
+  threads.reserve(num);
+  for (std::size_t i = 0; i < num; ++i)
+  {
+    // Keep the stacks small so we can have lots of threads in a 32-bit
+    // process.
+    HANDLE const thread = ::CreateThread(nullptr,
+                                         0x10000,
+                                         &IdleThread,
+                                         nullptr,
+                                         STACK_SIZE_PARAM_IS_A_RESERVATION,
+                                         nullptr);
+    if (!thread)
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error{} << hadesmem::ErrorString{"CreateThread failed."}
+                          << hadesmem::ErrorCodeWinLast{last_error});
+    }
+    threads.emplace_back(thread);
+  }
+  return threads;
+}
+
+std::size_t CountThreads(DWORD pid)
+{
+  hadesmem::ThreadList const threads{pid};
+  return static_cast<std::size_t>(
+    std::distance(std::begin(threads), std::end(threads)));
+}
+
+// Launches a copy of ourselves which creates the given number of threads
+// and then waits to be killed.
+hadesmem::detail::SmartHandle LaunchNoiseProcess(std::size_t num_threads)
+{
+  std::wstring command_line = L"\"" + hadesmem::detail::GetSelfPath() +
+                              L"\" --noise-child " +
+                              std::to_wstring(num_threads);
+  STARTUPINFOW start_info{};
+  start_info.cb = static_cast<DWORD>(sizeof(start_info));
+  PROCESS_INFORMATION proc_info{};
+  if (!::CreateProcessW(nullptr,
+                        &command_line[0],
+                        nullptr,
+                        nullptr,
+                        FALSE,
+                        0,
+                        nullptr,
+                        nullptr,
+                        &start_info,
+                        &proc_info))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error{} << hadesmem::ErrorString{"CreateProcess failed."}
+                        << hadesmem::ErrorCodeWinLast{last_error});
+  }
+
+  hadesmem::detail::SmartHandle process{proc_info.hProcess};
+  hadesmem::detail::SmartHandle const thread{proc_info.hThread};
+
+  // Wait for all the threads to have been created.
+  auto const start = std::chrono::steady_clock::now();
+  while (CountThreads(proc_info.dwProcessId) < num_threads)
+  {
+    if (::WaitForSingleObject(process.GetHandle(), 0) == WAIT_OBJECT_0 ||
+        std::chrono::steady_clock::now() - start > std::chrono::seconds(60))
+    {
+      ::TerminateProcess(process.GetHandle(), 0);
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error{}
+        << hadesmem::ErrorString{"Failed to start noise process."});
+    }
+    ::Sleep(10);
+  }
+
+  return process;
+}
+
+template <typename Func>
+double AverageMilliseconds(std::size_t iterations, Func const& func)
+{
+  auto const start = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i)
+  {
+    func();
+  }
+  auto const end = std::chrono::high_resolution_clock::now();
+  auto const elapsed =
+    std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+      end - start);
+  return elapsed.count() / iterations;
+}
+
+void RunBenchmark(hadesmem::Process const& process,
+                  std::size_t noise_threads,
+                  std::size_t iterations)
+{
+  hadesmem::detail::SmartHandle noise_process;
+  if (noise_threads)
+  {
+    noise_process = LaunchNoiseProcess(noise_threads);
+  }
+
+  DWORD const pid = process.GetId();
+
+  // What ThreadList and SuspendedProcess used to cost.
+  double const toolhelp_ms = AverageMilliseconds(iterations, [&]() {
+    hadesmem::detail::SmartSnapHandle const snap{
+      hadesmem::detail::CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0)};
+    std::size_t num = 0;
+    for (auto entry = hadesmem::detail::Thread32First(snap.GetHandle());
+         entry;
+         entry = hadesmem::detail::Thread32Next(snap.GetHandle()))
+    {
+      num += entry->th32OwnerProcessID == pid;
+    }
+    (void)num;
+  });
+
+  double const thread_list_ms =
+    AverageMilliseconds(iterations, [&]() { CountThreads(pid); });
+
+  double const suspend_pid_ms = AverageMilliseconds(iterations, [&]() {
+    hadesmem::SuspendedProcess const suspended{pid};
+  });
+
+  double const suspend_process_ms = AverageMilliseconds(iterations, [&]() {
+    hadesmem::SuspendedProcess const suspended{process};
+  });
+
+  std::cout << "System Threads: " << CountThreads(static_cast<DWORD>(-1))
+            << ", Target Threads: " << CountThreads(pid)
+            << "\n  Toolhelp Enum (ms): " << toolhelp_ms
+            << "\n  ThreadList Enum (ms): " << thread_list_ms
+            << "\n  SuspendedProcess by PID (ms): " << suspend_pid_ms
+            << "\n  SuspendedProcess by Handle (ms): " << suspend_process_ms
+            << "\n";
+
+  if (noise_process.IsValid())
+  {
+    ::TerminateProcess(noise_process.GetHandle(), 0);
+    ::WaitForSingleObject(noise_process.GetHandle(), INFINITE);
+  }
+}
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    TCLAP::CmdLine cmd{
+      "Process suspension benchmark", ' ', HADESMEM_VERSION_STRING};
+    TCLAP::ValueArg<std::size_t> iterations_arg{
+      "", "iterations", "Runs per measurement", false, 20, "size_t", cmd};
+    TCLAP::ValueArg<std::size_t> target_threads_arg{
+      "", "target-threads", "Idle threads in target", false, 16, "size_t", cmd};
+    TCLAP::MultiArg<std::size_t> noise_arg{
+      "", "noise", "Threads elsewhere in the system", false, "size_t", cmd};
+    TCLAP::ValueArg<std::size_t> noise_child_arg{
+      "", "noise-child", "Internal", false, 0, "size_t", cmd};
+    cmd.parse(argc, argv);
+
+    if (noise_child_arg.isSet())
+    {
+      auto const threads = CreateIdleThreads(noise_child_arg.getValue());
+      ::Sleep(INFINITE);
+      return 0;
+    }
+
+    std::cout << "HadesMem Suspension Benchmark [" << HADESMEM_VERSION_STRING
+              << "]\n";
+
+    auto const idle_threads = CreateIdleThreads(target_threads_arg.getValue());
+
+    hadesmem::Process const process{::GetCurrentProcessId()};
+
+    std::vector<std::size_t> noise = noise_arg.getValue();
+    if (noise.empty())
+    {
+      noise = {0, 2000, 10000};
+    }
+
+    for (auto const noise_threads : noise)
+    {
+      RunBenchmark(process, noise_threads, iterations_arg.getValue());
+    }
+
+    return 0;
+  }
+  catch (...)
+  {
+    std::cerr << "\nError!\n";
+    std::cerr << boost::current_exception_diagnostic_information() << '\n';
+
+    return 1;
+  }
+}
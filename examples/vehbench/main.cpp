@@ -0,0 +1,123 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <tclap/CmdLine.h>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/flush.hpp>
+#include <hadesmem/patcher.hpp>
+#include <hadesmem/process.hpp>
+
+// Micro-benchmark for the VEH based hooks. Measures how many hooked calls
+// (i.e. exceptions) per second we can dispatch with varying numbers of hooks
+// installed, which is dominated by the cost of the exception handler lookup.
+
+namespace
+{
+using BenchFuncT = void(__cdecl*)();
+
+// Each target is a run of NOPs followed by a RET, so the hook only ever has to
+// relocate a single NOP into the trampoline.
+std::size_t const kTargetSize = 16;
+
+void BenchDetour(hadesmem::PatchDetourBase* patch)
+{
+  patch->GetTrampolineT<BenchFuncT>()();
+}
+
+template <typename PatchT>
+void RunBenchmark(hadesmem::Process const& process,
+                  char const* name,
+                  std::size_t num_hooks,
+                  std::size_t iterations)
+{
+  hadesmem::Allocator const code{process, num_hooks * kTargetSize};
+  auto const code_beg = static_cast<std::uint8_t*>(code.GetBase());
+  for (std::size_t i = 0; i < num_hooks; ++i)
+  {
+    auto const target = code_beg + i * kTargetSize;
+    std::fill(target, target + kTargetSize - 1, static_cast<std::uint8_t>(0x90));
+    target[kTargetSize - 1] = 0xC3;
+  }
+  hadesmem::FlushInstructionCache(process, code.GetBase(), code.GetSize());
+
+  std::vector<std::unique_ptr<PatchT>> hooks;
+  hooks.reserve(num_hooks);
+  for (std::size_t i = 0; i < num_hooks; ++i)
+  {
+    auto const target =
+      reinterpret_cast<BenchFuncT>(code_beg + i * kTargetSize);
+    hooks.emplace_back(std::make_unique<PatchT>(process, target, &BenchDetour));
+    hooks.back()->Apply();
+  }
+
+  auto const start = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < iterations; ++i)
+  {
+    // Spread the calls over all the hooks so we're measuring lookups across
+    // the whole table rather than one hot slot.
+    auto const target = reinterpret_cast<BenchFuncT>(
+      code_beg + (i % num_hooks) * kTargetSize);
+    target();
+  }
+  auto const end = std::chrono::high_resolution_clock::now();
+
+  hooks.clear();
+
+  auto const elapsed =
+    std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
+  std::cout << name << " Hooks: " << num_hooks
+            << ", Exceptions/s: " << (iterations / elapsed.count())
+            << ", ns/Exception: "
+            << (elapsed.count() * 1000000000.0 / iterations) << "\n";
+}
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    std::cout << "HadesMem VEH Benchmark [" << HADESMEM_VERSION_STRING
+              << "]\n";
+
+    TCLAP::CmdLine cmd{"VEH hook benchmark", ' ', HADESMEM_VERSION_STRING};
+    TCLAP::ValueArg<std::size_t> iterations_arg{
+      "", "iterations", "Calls per run", false, 100000, "size_t", cmd};
+    cmd.parse(argc, argv);
+
+    auto const iterations = iterations_arg.getValue();
+
+    hadesmem::Process const process{::GetCurrentProcessId()};
+
+    for (std::size_t const num_hooks : {1, 10, 1000})
+    {
+      RunBenchmark<hadesmem::PatchInt3<BenchFuncT>>(
+        process, "INT3", num_hooks, iterations);
+    }
+
+    // Only one DR hook per thread is currently supported.
+    RunBenchmark<hadesmem::PatchDr<BenchFuncT>>(process, "DR", 1, iterations);
+
+    return 0;
+  }
+  catch (...)
+  {
+    std::cerr << "\nError!\n";
+    std::cerr << boost::current_exception_diagnostic_information() << '\n';
+
+    return 1;
+  }
+}
@@ -8,6 +8,9 @@
 #include <cstdint>
 #include <cstring>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -28,6 +31,7 @@
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/call_stub_cache.hpp>
 #include <hadesmem/detail/remote_thread.hpp>
 #include <hadesmem/detail/smart_handle.hpp>
 #include <hadesmem/detail/static_assert.hpp>
@@ -37,15 +41,15 @@
 #include <hadesmem/find_procedure.hpp>
 #include <hadesmem/flush.hpp>
 #include <hadesmem/module.hpp>
+#include <hadesmem/module_snapshot.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
+#include <hadesmem/remote_heap.hpp>
 #include <hadesmem/write.hpp>
 
-// TODO: Rewrite to use a static binary blob insted of a JIT. The design will
-// need to change to pull data from an external source instead of being
-// regenerated for every call.
-
-// TODO: Consolidate memory allocations where possible.
+// TODO: Rewrite to use a static binary blob insted of a JIT. The stubs only
+// depend on the call signature now, so this would just mean pregenerating the
+// common ones.
 
 // TODO: Add support for 'custom' calling conventions (e.g. in PGO-generated
 // code, 'private' functions, obfuscated code, etc).
@@ -390,485 +394,601 @@ private:
 
 namespace detail
 {
-inline std::uint32_t GetLow32(std::uint64_t i)
+// Kernel32 exports used by the generated call stubs, resolved in the target.
+struct CallStubImports
+{
+  DWORD_PTR get_last_error;
+  DWORD_PTR set_last_error;
+  DWORD_PTR is_debugger_present;
+  DWORD_PTR debug_break;
+};
+
+inline CallStubImports GetCallStubImports(Process const& process,
+                                          Module const& kernel32)
+{
+  CallStubImports imports;
+  imports.get_last_error = reinterpret_cast<DWORD_PTR>(
+    FindProcedure(process, kernel32, "GetLastError"));
+  imports.set_last_error = reinterpret_cast<DWORD_PTR>(
+    FindProcedure(process, kernel32, "SetLastError"));
+  imports.is_debugger_present = reinterpret_cast<DWORD_PTR>(
+    FindProcedure(process, kernel32, "IsDebuggerPresent"));
+  imports.debug_break =
+    reinterpret_cast<DWORD_PTR>(FindProcedure(process, kernel32, "DebugBreak"));
+  return imports;
+}
+
+// For callers which need kernel32.dll (or other modules) for more than the
+// call stubs, so the loader list is only walked once.
+inline CallStubImports GetCallStubImports(Process const& process,
+                                          ModuleSnapshot const& modules)
 {
-  return static_cast<std::uint32_t>(i & 0xFFFFFFFFUL);
+  return GetCallStubImports(process,
+                            GetSnapshotModule(modules, L"kernel32.dll"));
 }
 
-inline std::uint32_t GetHigh32(std::uint64_t i)
+inline CallStubImports GetCallStubImports(Process const& process)
 {
-  return static_cast<std::uint32_t>((i >> 32) & 0xFFFFFFFFUL);
+  return GetCallStubImports(process, Module{process, L"kernel32.dll"});
 }
 
-class ArgVisitor32
+HADESMEM_DETAIL_STATIC_ASSERT(sizeof(CallResultRemote) <=
+                              CallDataLayout::kResultSize);
+
+class ArgKindVisitor
 {
 public:
-  ArgVisitor32(asmjit::X86Assembler* assembler,
-               std::size_t num_args,
-               CallConv call_conv) noexcept : assembler_{assembler},
-                                              cur_arg_{num_args},
-                                              call_conv_{call_conv}
+  explicit ArgKindVisitor(CallArgKind* kind) noexcept : kind_{kind}
   {
   }
 
-  void operator()(std::uint32_t arg) noexcept
+  void operator()(std::uint32_t /*arg*/) noexcept
   {
-    asmjit::GpReg const regs[] = {asmjit::x86::ecx, asmjit::x86::edx};
-    auto const num_reg_args =
-      (call_conv_ == CallConv::kThisCall || call_conv_ == CallConv::kFastCall)
-        ? ((call_conv_ == CallConv::kThisCall) ? 1UL : 2UL)
-        : 0UL;
-    if (cur_arg_ > 0 && cur_arg_ <= num_reg_args)
-    {
-      assembler_->mov(regs[cur_arg_ - 1], asmjit::imm_u(arg));
-    }
-    else
-    {
-      assembler_->mov(asmjit::x86::eax, asmjit::imm_u(arg));
-      assembler_->push(asmjit::x86::eax);
-    }
-
-    --cur_arg_;
+    *kind_ = CallArgKind::kInt32;
   }
 
-  void operator()(std::uint64_t arg) noexcept
+  void operator()(std::uint64_t /*arg*/) noexcept
   {
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(GetHigh32(arg)));
-    assembler_->push(asmjit::x86::eax);
-
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(GetLow32(arg)));
-    assembler_->push(asmjit::x86::eax);
-
-    --cur_arg_;
+    *kind_ = CallArgKind::kInt64;
   }
 
-  void operator()(float arg) noexcept
+  void operator()(float /*arg*/) noexcept
   {
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(float) == 4);
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(float) == sizeof(std::uint32_t));
-
-    auto const arg_conv = AliasCast<std::uint32_t>(arg);
-
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(arg_conv));
-    assembler_->push(asmjit::x86::eax);
-
-    --cur_arg_;
+    *kind_ = CallArgKind::kFloat32;
   }
 
-  void operator()(double arg) noexcept
+  void operator()(double /*arg*/) noexcept
   {
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(double) == 8);
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(double) == sizeof(std::uint64_t));
-
-    auto const arg_conv = AliasCast<std::uint64_t>(arg);
-
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(GetHigh32(arg_conv)));
-    assembler_->push(asmjit::x86::eax);
-
-    assembler_->mov(asmjit::x86::eax, asmjit::imm_u(GetLow32(arg_conv)));
-    assembler_->push(asmjit::x86::eax);
-
-    --cur_arg_;
+    *kind_ = CallArgKind::kFloat64;
   }
 
 private:
-  asmjit::X86Assembler* assembler_;
-  std::size_t cur_arg_;
-  CallConv call_conv_;
+  CallArgKind* kind_;
 };
 
-class ArgVisitor64
+class ArgPackVisitor
 {
 public:
-  ArgVisitor64(asmjit::X86Assembler* assembler, std::size_t num_args) noexcept
-    : assembler_{assembler},
-      num_args_{num_args},
-      cur_arg_{num_args}
+  explicit ArgPackVisitor(void* data, std::size_t offset) noexcept
+    : data_{data},
+      offset_{offset}
   {
   }
 
-  void operator()(std::uint32_t arg) noexcept
+  template <typename T> void operator()(T arg) noexcept
   {
-    return (*this)(static_cast<std::uint64_t>(arg));
+    WriteCallDataSlot(data_, offset_, &arg, sizeof(arg));
   }
 
-  void operator()(std::uint64_t arg) noexcept
-  {
-    std::int32_t const stack_offs =
-      static_cast<std::int32_t>((cur_arg_ - 1) * 8);
-
-    if (cur_arg_ > 0 && cur_arg_ <= 4)
-    {
-      asmjit::GpReg const regs[] = {
-        asmjit::x86::rcx, asmjit::x86::rdx, asmjit::x86::r8, asmjit::x86::r9};
-      assembler_->mov(regs[cur_arg_ - 1], asmjit::imm_u(arg));
-    }
-    else
-    {
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs),
-                      asmjit::imm_u(GetLow32(arg)));
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs + 4),
-                      asmjit::imm_u(GetHigh32(arg)));
-    }
-
-    --cur_arg_;
-  }
+private:
+  void* data_;
+  std::size_t offset_;
+};
 
-  void operator()(float arg) noexcept
+template <typename ConvForwardIterator, typename ArgsForwardIterator>
+inline CallSignature MakeCallSignature(std::size_t num_calls,
+                                       ConvForwardIterator call_convs_beg,
+                                       ArgsForwardIterator args_full_beg)
+{
+  CallSignature signature;
+  for (std::size_t i = 0; i < num_calls; ++i, ++call_convs_beg, ++args_full_beg)
   {
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(float) == 4);
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(float) == sizeof(std::uint32_t));
-
-    auto const arg_conv = AliasCast<std::uint32_t>(arg);
-
-    std::int32_t const scratch_offs = static_cast<std::int32_t>(num_args_ * 8);
-    std::int32_t const stack_offs =
-      static_cast<std::int32_t>((cur_arg_ - 1) * 8);
-
-    if (cur_arg_ > 0 && cur_arg_ <= 4)
+    signature.AddCall(static_cast<std::uint32_t>(*call_convs_beg));
+    for (auto const& arg : *args_full_beg)
     {
-      asmjit::XmmReg const regs[] = {asmjit::x86::xmm0,
-                                     asmjit::x86::xmm1,
-                                     asmjit::x86::xmm2,
-                                     asmjit::x86::xmm3};
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, scratch_offs),
-                      asmjit::imm_u(arg_conv));
-      assembler_->movss(regs[cur_arg_ - 1],
-                        asmjit::x86::dword_ptr(asmjit::x86::rsp, scratch_offs));
+      CallArgKind kind{};
+      arg.Apply(ArgKindVisitor{&kind});
+      signature.AddArg(kind);
     }
-    else
-    {
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs),
-                      asmjit::imm_u(arg_conv));
-    }
-
-    --cur_arg_;
   }
+  return signature;
+}
 
-  void operator()(double arg) noexcept
+template <typename AddressesForwardIterator, typename ArgsForwardIterator>
+inline void PackCallData(CallDataLayout const& layout,
+                         std::size_t num_calls,
+                         AddressesForwardIterator addresses_beg,
+                         ArgsForwardIterator args_full_beg,
+                         void* data)
+{
+  for (std::size_t i = 0; i < num_calls; ++i, ++addresses_beg, ++args_full_beg)
   {
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(double) == 8);
-    HADESMEM_DETAIL_STATIC_ASSERT(sizeof(double) == sizeof(std::uint64_t));
+    auto const address =
+      static_cast<std::uint64_t>(reinterpret_cast<DWORD_PTR>(*addresses_beg));
+    WriteCallDataSlot(
+      data, layout.GetAddressOffset(i), &address, sizeof(address));
 
-    auto const arg_conv = AliasCast<std::uint64_t>(arg);
-
-    std::int32_t const scratch_offs = static_cast<std::int32_t>(num_args_ * 8);
-    std::int32_t const stack_offs =
-      static_cast<std::int32_t>((cur_arg_ - 1) * 8);
-
-    if (cur_arg_ > 0 && cur_arg_ <= 4)
-    {
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, scratch_offs),
-                      asmjit::imm_u(GetLow32(arg_conv)));
-      assembler_->mov(
-        asmjit::x86::dword_ptr(asmjit::x86::rsp, scratch_offs + 4),
-        asmjit::imm_u(GetHigh32(arg_conv)));
-      asmjit::XmmReg const regs[] = {asmjit::x86::xmm0,
-                                     asmjit::x86::xmm1,
-                                     asmjit::x86::xmm2,
-                                     asmjit::x86::xmm3};
-      assembler_->movsd(regs[cur_arg_ - 1],
-                        asmjit::x86::qword_ptr(asmjit::x86::rsp, scratch_offs));
-    }
-    else
+    std::size_t j = 0;
+    for (auto const& arg : *args_full_beg)
     {
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs),
-                      asmjit::imm_u(GetLow32(arg_conv)));
-      assembler_->mov(asmjit::x86::dword_ptr(asmjit::x86::rsp, stack_offs + 4),
-                      asmjit::imm_u(GetHigh32(arg_conv)));
+      arg.Apply(ArgPackVisitor{data, layout.GetArgOffset(i, j++)});
     }
-
-    --cur_arg_;
   }
+}
 
-private:
-  asmjit::X86Assembler* assembler_;
-  std::size_t num_args_;
-  std::size_t cur_arg_;
-};
+inline CallResultRemote UnpackCallResult(CallDataLayout const& layout,
+                                         std::size_t call,
+                                         void const* data) noexcept
+{
+  CallResultRemote result;
+  std::memcpy(&result,
+              static_cast<std::uint8_t const*>(data) +
+                layout.GetResultOffset(call),
+              sizeof(result));
+  return result;
+}
 
-template <typename AddressesForwardIterator,
-          typename ConvForwardIterator,
-          typename ArgsForwardIterator>
-inline void GenerateCallCode32(asmjit::X86Assembler* assembler,
-                               AddressesForwardIterator addresses_beg,
-                               AddressesForwardIterator addresses_end,
-                               ConvForwardIterator call_convs_beg,
-                               ArgsForwardIterator args_full_beg,
-                               DWORD_PTR get_last_error,
-                               DWORD_PTR set_last_error,
-                               DWORD_PTR is_debugger_present,
-                               DWORD_PTR debug_break,
-                               PVOID return_values_remote)
+inline std::int32_t ToDisp(std::size_t offset) noexcept
 {
-  HADESMEM_DETAIL_TRACE_A("GenerateCallCode32 called.");
+  return static_cast<std::int32_t>(offset);
+}
+
+// The addresses and arguments are read from the data block passed as the only
+// (stdcall) parameter, so the code only depends on the signature.
+inline void GenerateCallStub32(asmjit::X86Assembler* assembler,
+                               CallSignature const& signature,
+                               CallStubImports const& imports)
+{
+  HADESMEM_DETAIL_TRACE_A("GenerateCallStub32 called.");
+
+  CallDataLayout const layout{signature};
 
   asmjit::Label label_nodebug(assembler->newLabel());
 
   assembler->push(asmjit::x86::ebp);
   assembler->mov(asmjit::x86::ebp, asmjit::x86::esp);
+  assembler->push(asmjit::x86::esi);
+  assembler->mov(asmjit::x86::esi, asmjit::x86::dword_ptr(asmjit::x86::ebp, 8));
 
-  assembler->mov(asmjit::x86::eax, asmjit::imm_u(is_debugger_present));
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.is_debugger_present));
   assembler->call(asmjit::x86::eax);
 
   assembler->test(asmjit::x86::eax, asmjit::x86::eax);
   assembler->jz(label_nodebug);
 
-  assembler->mov(asmjit::x86::eax, asmjit::imm_u(debug_break));
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.debug_break));
   assembler->call(asmjit::x86::eax);
 
   assembler->bind(label_nodebug);
 
   assembler->push(0x0);
-  assembler->mov(asmjit::x86::eax, asmjit::imm_u(set_last_error));
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.set_last_error));
   assembler->call(asmjit::x86::eax);
 
-  for (std::size_t i = 0; addresses_beg != addresses_end;
-       ++addresses_beg, ++call_convs_beg, ++args_full_beg, ++i)
+  for (std::size_t i = 0; i < signature.GetNumCalls(); ++i)
   {
-    void* const address = *addresses_beg;
-    CallConv const call_conv = *call_convs_beg;
-    // TODO: Remove dependency on ArgsForwardIterator being an iterator with
-    // value_type of std::vector<CallArg> (or rather, any container supporting
-    // size() and rbegin()/rend(), but there's no good reason to use anything
-    // but vector even if it's technically supported).
-    auto const& args = *args_full_beg;
-    std::size_t const num_args = args.size();
-
-    ArgVisitor32 arg_visitor{assembler, num_args, call_conv};
-    std::for_each(args.rbegin(), args.rend(), [&](CallArg const& arg) {
-      arg.Apply(std::ref(arg_visitor));
-    });
-
-    assembler->mov(asmjit::x86::eax,
-                   asmjit::imm_u(reinterpret_cast<std::uintptr_t>(address)));
-    assembler->call(asmjit::x86::eax);
+    auto const call_conv = static_cast<CallConv>(signature.GetCallConv(i));
+    std::size_t const num_args = signature.GetNumArgs(i);
+    std::size_t const num_reg_args =
+      (call_conv == CallConv::kThisCall)
+        ? 1
+        : ((call_conv == CallConv::kFastCall) ? 2 : 0);
+    asmjit::GpReg const regs[] = {asmjit::x86::ecx, asmjit::x86::edx};
 
-    DWORD_PTR const current_return_value_remote =
-      reinterpret_cast<DWORD_PTR>(return_values_remote) +
-      i * sizeof(detail::CallResultRemote);
+    std::size_t stack_size = 0;
+    for (std::size_t j = num_args; j-- > 0;)
+    {
+      std::int32_t const arg = ToDisp(layout.GetArgOffset(i, j));
+      switch (signature.GetArg(i, j))
+      {
+      case CallArgKind::kInt32:
+        if (j < num_reg_args)
+        {
+          assembler->mov(regs[j],
+                         asmjit::x86::dword_ptr(asmjit::x86::esi, arg));
+          break;
+        }
+      // Fall through.
+      case CallArgKind::kFloat32:
+        assembler->push(asmjit::x86::dword_ptr(asmjit::x86::esi, arg));
+        stack_size += 4;
+        break;
+      case CallArgKind::kInt64:
+      case CallArgKind::kFloat64:
+        assembler->push(asmjit::x86::dword_ptr(asmjit::x86::esi, arg + 4));
+        assembler->push(asmjit::x86::dword_ptr(asmjit::x86::esi, arg));
+        stack_size += 8;
+        break;
+      }
+    }
 
     assembler->mov(
-      asmjit::x86::ecx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_i64)));
-    assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::ecx), asmjit::x86::eax);
-    assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::ecx, 4),
-                   asmjit::x86::edx);
+      asmjit::x86::eax,
+      asmjit::x86::dword_ptr(asmjit::x86::esi,
+                             ToDisp(layout.GetAddressOffset(i))));
+    assembler->call(asmjit::x86::eax);
 
+    std::int32_t const result = ToDisp(layout.GetResultOffset(i));
     assembler->mov(
-      asmjit::x86::ecx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_float)));
-    assembler->fst(asmjit::x86::dword_ptr(asmjit::x86::ecx));
-
+      asmjit::x86::dword_ptr(
+        asmjit::x86::esi,
+        result + ToDisp(offsetof(CallResultRemote, return_i64))),
+      asmjit::x86::eax);
     assembler->mov(
-      asmjit::x86::ecx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_double)));
-    assembler->fst(asmjit::x86::qword_ptr(asmjit::x86::ecx));
-
-    assembler->mov(asmjit::x86::eax, asmjit::imm_u(get_last_error));
+      asmjit::x86::dword_ptr(
+        asmjit::x86::esi,
+        result + ToDisp(offsetof(CallResultRemote, return_i64)) + 4),
+      asmjit::x86::edx);
+    assembler->fst(asmjit::x86::dword_ptr(
+      asmjit::x86::esi,
+      result + ToDisp(offsetof(CallResultRemote, return_float))));
+    assembler->fst(asmjit::x86::qword_ptr(
+      asmjit::x86::esi,
+      result + ToDisp(offsetof(CallResultRemote, return_double))));
+
+    assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.get_last_error));
     assembler->call(asmjit::x86::eax);
 
     assembler->mov(
-      asmjit::x86::ecx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, last_error)));
-    assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::ecx), asmjit::x86::eax);
+      asmjit::x86::dword_ptr(
+        asmjit::x86::esi,
+        result + ToDisp(offsetof(CallResultRemote, last_error))),
+      asmjit::x86::eax);
 
-    if (call_conv == CallConv::kDefault || call_conv == CallConv::kCdecl)
+    if ((call_conv == CallConv::kDefault || call_conv == CallConv::kCdecl) &&
+        stack_size)
     {
-      assembler->add(asmjit::x86::esp, asmjit::imm_u(num_args * sizeof(void*)));
+      assembler->add(asmjit::x86::esp, asmjit::imm_u(stack_size));
     }
   }
 
+  assembler->mov(asmjit::x86::esi,
+                 asmjit::x86::dword_ptr(asmjit::x86::ebp, -4));
   assembler->mov(asmjit::x86::esp, asmjit::x86::ebp);
   assembler->pop(asmjit::x86::ebp);
 
   assembler->ret(0x4);
 }
 
-struct ContainerSizeComparer
+// The addresses and arguments are read from the data block passed in rcx, so
+// the code only depends on the signature.
+inline void GenerateCallStub64(asmjit::X86Assembler* assembler,
+                               CallSignature const& signature,
+                               CallStubImports const& imports)
 {
-  template <typename C1, typename C2>
-  bool operator()(C1 const& lhs, C2 const& rhs)
-  {
-    return lhs.size() < rhs.size();
-  }
-};
+  HADESMEM_DETAIL_TRACE_A("GenerateCallStub64 called.");
 
-template <typename AddressesForwardIterator,
-          typename ConvForwardIterator,
-          typename ArgsForwardIterator>
-inline void GenerateCallCode64(asmjit::X86Assembler* assembler,
-                               AddressesForwardIterator addresses_beg,
-                               AddressesForwardIterator addresses_end,
-                               ConvForwardIterator call_convs_beg,
-                               ArgsForwardIterator args_full_beg,
-                               DWORD_PTR get_last_error,
-                               DWORD_PTR set_last_error,
-                               DWORD_PTR is_debugger_present,
-                               DWORD_PTR debug_break,
-                               PVOID return_values_remote)
-{
-  HADESMEM_DETAIL_TRACE_A("GenerateCallCode64 called.");
+  CallDataLayout const layout{signature};
 
   asmjit::Label label_nodebug(assembler->newLabel());
 
-  std::size_t const num_addresses = std::distance(addresses_beg, addresses_end);
-  auto const max_args_list = std::max_element(
-    args_full_beg, args_full_beg + num_addresses, ContainerSizeComparer());
-  std::size_t const max_num_args = max_args_list->size();
-
-  std::size_t const stack_offset = [&]() {
-    // Minimum 0x20 bytes of ghost space for spilling args.
-    std::size_t const ghost_size = 0x20UL;
-    std::size_t stack_offs_tmp = (std::max)(ghost_size, max_num_args * 0x8);
-    // Add scratch space for use when converting args etc.
-    stack_offs_tmp += 16;
-    // Align the stack for the return address.
-    stack_offs_tmp += (stack_offs_tmp % 16) ? 0 : 8;
-    return stack_offs_tmp;
-  }();
+  // Minimum 0x20 bytes of ghost space for spilling args. We push rbx, so the
+  // stack is already aligned on entry to the prologue's sub.
+  std::size_t stack_offset =
+    (std::max)(std::size_t{0x20}, signature.GetMaxNumArgs() * 0x8);
+  stack_offset += (stack_offset % 16) ? 8 : 0;
 
+  assembler->push(asmjit::x86::rbx);
   assembler->sub(asmjit::x86::rsp, asmjit::imm_u(stack_offset));
+  assembler->mov(asmjit::x86::rbx, asmjit::x86::rcx);
 
-  assembler->mov(asmjit::x86::rax, asmjit::imm_u(is_debugger_present));
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.is_debugger_present));
   assembler->call(asmjit::x86::rax);
 
   assembler->test(asmjit::x86::rax, asmjit::x86::rax);
   assembler->jz(label_nodebug);
 
-  assembler->mov(asmjit::x86::rax, asmjit::imm_u(debug_break));
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.debug_break));
   assembler->call(asmjit::x86::rax);
 
   assembler->bind(label_nodebug);
 
   assembler->mov(asmjit::x86::rcx, 0);
-  assembler->mov(asmjit::x86::rax, asmjit::imm_u(set_last_error));
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.set_last_error));
   assembler->call(asmjit::x86::rax);
 
-  for (std::size_t i = 0; addresses_beg != addresses_end;
-       ++addresses_beg, ++call_convs_beg, ++args_full_beg, ++i)
-  {
-    void* const address = *addresses_beg;
-    auto const& args = *args_full_beg;
-    std::size_t const num_args = args.size();
-
-    ArgVisitor64 arg_visitor{assembler, num_args};
-    std::for_each(
-      std::crbegin(args), std::crend(args), [&](CallArg const& arg) {
-        arg.Apply(std::ref(arg_visitor));
-      });
-
-    assembler->mov(asmjit::x86::rax,
-                   asmjit::imm_u(reinterpret_cast<DWORD_PTR>(address)));
-    assembler->call(asmjit::x86::rax);
-
-    DWORD_PTR const current_return_value_remote =
-      reinterpret_cast<DWORD_PTR>(return_values_remote) +
-      i * sizeof(detail::CallResultRemote);
+  asmjit::GpReg const int_regs[] = {
+    asmjit::x86::rcx, asmjit::x86::rdx, asmjit::x86::r8, asmjit::x86::r9};
+  asmjit::XmmReg const float_regs[] = {
+    asmjit::x86::xmm0, asmjit::x86::xmm1, asmjit::x86::xmm2, asmjit::x86::xmm3};
 
-    assembler->mov(
-      asmjit::x86::rcx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_i64)));
-    assembler->mov(asmjit::x86::qword_ptr(asmjit::x86::rcx), asmjit::x86::rax);
+  for (std::size_t i = 0; i < signature.GetNumCalls(); ++i)
+  {
+    std::size_t const num_args = signature.GetNumArgs(i);
+    for (std::size_t j = num_args; j-- > 0;)
+    {
+      std::int32_t const arg = ToDisp(layout.GetArgOffset(i, j));
+      if (j >= 4)
+      {
+        assembler->mov(asmjit::x86::rax,
+                       asmjit::x86::qword_ptr(asmjit::x86::rbx, arg));
+        assembler->mov(
+          asmjit::x86::qword_ptr(asmjit::x86::rsp, ToDisp(j * 8)),
+          asmjit::x86::rax);
+        continue;
+      }
+
+      switch (signature.GetArg(i, j))
+      {
+      case CallArgKind::kInt32:
+      case CallArgKind::kInt64:
+        assembler->mov(int_regs[j],
+                       asmjit::x86::qword_ptr(asmjit::x86::rbx, arg));
+        break;
+      case CallArgKind::kFloat32:
+        assembler->movss(float_regs[j],
+                         asmjit::x86::dword_ptr(asmjit::x86::rbx, arg));
+        break;
+      case CallArgKind::kFloat64:
+        assembler->movsd(float_regs[j],
+                         asmjit::x86::qword_ptr(asmjit::x86::rbx, arg));
+        break;
+      }
+    }
 
     assembler->mov(
-      asmjit::x86::rcx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_float)));
-    assembler->movss(asmjit::x86::dword_ptr(asmjit::x86::rcx),
-                     asmjit::x86::xmm0);
+      asmjit::x86::rax,
+      asmjit::x86::qword_ptr(asmjit::x86::rbx,
+                             ToDisp(layout.GetAddressOffset(i))));
+    assembler->call(asmjit::x86::rax);
 
+    std::int32_t const result = ToDisp(layout.GetResultOffset(i));
     assembler->mov(
-      asmjit::x86::rcx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, return_double)));
-    assembler->movsd(asmjit::x86::qword_ptr(asmjit::x86::rcx),
-                     asmjit::x86::xmm0);
-
-    assembler->mov(asmjit::x86::rax, asmjit::imm_u(get_last_error));
+      asmjit::x86::qword_ptr(
+        asmjit::x86::rbx,
+        result + ToDisp(offsetof(CallResultRemote, return_i64))),
+      asmjit::x86::rax);
+    assembler->movss(
+      asmjit::x86::dword_ptr(
+        asmjit::x86::rbx,
+        result + ToDisp(offsetof(CallResultRemote, return_float))),
+      asmjit::x86::xmm0);
+    assembler->movsd(
+      asmjit::x86::qword_ptr(
+        asmjit::x86::rbx,
+        result + ToDisp(offsetof(CallResultRemote, return_double))),
+      asmjit::x86::xmm0);
+
+    assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.get_last_error));
     assembler->call(asmjit::x86::rax);
 
     assembler->mov(
-      asmjit::x86::rcx,
-      asmjit::imm_u(current_return_value_remote +
-                    offsetof(detail::CallResultRemote, last_error)));
-    assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::rcx), asmjit::x86::eax);
+      asmjit::x86::dword_ptr(
+        asmjit::x86::rbx,
+        result + ToDisp(offsetof(CallResultRemote, last_error))),
+      asmjit::x86::eax);
   }
 
   assembler->add(asmjit::x86::rsp, asmjit::imm_u(stack_offset));
+  assembler->pop(asmjit::x86::rbx);
 
   assembler->ret();
 }
 
-template <typename AddressesForwardIterator,
-          typename ConvForwardIterator,
-          typename ArgsForwardIterator>
-inline Allocator GenerateCallCode(Process const& process,
-                                  AddressesForwardIterator addresses_beg,
-                                  AddressesForwardIterator addresses_end,
-                                  ConvForwardIterator call_convs_beg,
-                                  ArgsForwardIterator args_full_beg,
-                                  PVOID return_values_remote)
+// Alloc is called with the size of the code and returns where to put it in
+// the target.
+template <typename AllocFunc>
+inline PVOID GenerateCallStub(Process const& process,
+                              CallSignature const& signature,
+                              CallStubImports const& imports,
+                              AllocFunc const& alloc)
 {
-  HADESMEM_DETAIL_TRACE_A("GenerateCallCode called.");
-
-  Module const kernel32{process, L"kernel32.dll"};
-  auto const get_last_error = reinterpret_cast<DWORD_PTR>(
-    FindProcedure(process, kernel32, "GetLastError"));
-  auto const set_last_error = reinterpret_cast<DWORD_PTR>(
-    FindProcedure(process, kernel32, "SetLastError"));
-  auto const is_debugger_present = reinterpret_cast<DWORD_PTR>(
-    FindProcedure(process, kernel32, "IsDebuggerPresent"));
-  auto const debug_break =
-    reinterpret_cast<DWORD_PTR>(FindProcedure(process, kernel32, "DebugBreak"));
+  HADESMEM_DETAIL_TRACE_A("GenerateCallStub called.");
 
   asmjit::JitRuntime runtime;
   asmjit::X86Assembler assembler{&runtime};
 #if defined(HADESMEM_DETAIL_ARCH_X64)
-  GenerateCallCode64(
+  GenerateCallStub64(&assembler, signature, imports);
 #elif defined(HADESMEM_DETAIL_ARCH_X86)
-  GenerateCallCode32(
+  GenerateCallStub32(&assembler, signature, imports);
 #else
 #error "[HadesMem] Unsupported architecture."
 #endif
-    &assembler,
-    addresses_beg,
-    addresses_end,
-    call_convs_beg,
-    args_full_beg,
-    get_last_error,
-    set_last_error,
-    is_debugger_present,
-    debug_break,
-    return_values_remote);
 
   DWORD_PTR const stub_size = assembler.getCodeSize();
 
-  HADESMEM_DETAIL_TRACE_A("Allocating memory for remote stub.");
-
-  Allocator stub_mem_remote{process, stub_size};
-
-  HADESMEM_DETAIL_TRACE_A("Performing code relocation.");
+  PVOID const stub_remote = alloc(static_cast<SIZE_T>(stub_size));
 
   std::vector<BYTE> code_real(stub_size);
   assembler.relocCode(code_real.data(),
-                      reinterpret_cast<DWORD_PTR>(stub_mem_remote.GetBase()));
+                      reinterpret_cast<DWORD_PTR>(stub_remote));
+
+  WriteVector(process, stub_remote, code_real);
+
+  FlushInstructionCache(process, stub_remote, stub_size);
+
+  return stub_remote;
+}
+
+inline Allocator GenerateCallStub(Process const& process,
+                                  CallSignature const& signature,
+                                  CallStubImports const& imports)
+{
+  std::unique_ptr<Allocator> stub_mem_remote;
+  GenerateCallStub(process, signature, imports, [&](SIZE_T size) {
+    stub_mem_remote = std::make_unique<Allocator>(process, size);
+    return stub_mem_remote->GetBase();
+  });
+  return std::move(*stub_mem_remote);
+}
+
+// Stubs generated for a single process, shared by every Call/CallMulti on
+// that process. Holds its own handle to the process, so the process ID can't
+// be reused while the cache is alive.
+class CallStubProcessCache
+{
+public:
+  // Bounds the amount of code left in the target by callers that use lots of
+  // different signatures. Calls past the limit get an uncached stub.
+  static std::size_t const kMaxStubs = 256;
+
+  explicit CallStubProcessCache(Process const& process)
+    : process_{process},
+      imports_(GetCallStubImports(process_)),
+      code_heap_{process_, RemoteHeapFlags::kExecutable},
+      data_heap_{process_}
+  {
+  }
+
+  CallStubProcessCache(CallStubProcessCache const& other) = delete;
+
+  CallStubProcessCache& operator=(CallStubProcessCache const& other) = delete;
+
+  Process const& GetProcess() const noexcept
+  {
+    return process_;
+  }
+
+  CallStubImports const& GetImports() const noexcept
+  {
+    return imports_;
+  }
+
+  bool IsAlive() const noexcept
+  {
+    return ::WaitForSingleObject(process_.GetHandle(), 0) == WAIT_TIMEOUT;
+  }
+
+  // Returns nullptr if the signature is not cached and the cache is full.
+  PVOID GetStub(CallSignature const& signature)
+  {
+    std::lock_guard<std::mutex> const lock{mutex_};
+
+    if (stubs_.size() >= kMaxStubs && !stubs_.Find(signature))
+    {
+      return nullptr;
+    }
+
+    auto const generate = [&](CallSignature const& s) {
+      return GenerateCallStub(process_, s, imports_, [&](SIZE_T size) {
+        return code_heap_.Alloc(size);
+      });
+    };
+    return stubs_.GetOrCreate(signature, generate);
+  }
+
+  std::size_t GetNumStubs() const
+  {
+    std::lock_guard<std::mutex> const lock{mutex_};
+    return stubs_.size();
+  }
+
+  // Small blocks for call data, so repeated calls don't need a VirtualAllocEx
+  // each.
+  PVOID AllocData(SIZE_T size)
+  {
+    std::lock_guard<std::mutex> const lock{mutex_};
+    return data_heap_.Alloc(size);
+  }
+
+  void FreeData(PVOID address)
+  {
+    std::lock_guard<std::mutex> const lock{mutex_};
+    data_heap_.Free(address);
+  }
+
+private:
+  Process const process_;
+  CallStubImports const imports_;
+  mutable std::mutex mutex_;
+  RemoteHeap code_heap_;
+  RemoteHeap data_heap_;
+  CallStubCache<PVOID> stubs_;
+};
+
+class CallDataBlock
+{
+public:
+  explicit CallDataBlock(CallStubProcessCache& cache, SIZE_T size)
+    : cache_{&cache}, base_{cache.AllocData(size)}
+  {
+  }
 
-  HADESMEM_DETAIL_TRACE_A("Writing remote code stub.");
+  CallDataBlock(CallDataBlock const& other) = delete;
 
-  WriteVector(process, stub_mem_remote.GetBase(), code_real);
+  CallDataBlock& operator=(CallDataBlock const& other) = delete;
 
-  FlushInstructionCache(process, stub_mem_remote.GetBase(), stub_size);
+  ~CallDataBlock()
+  {
+    try
+    {
+      cache_->FreeData(base_);
+    }
+    catch (...)
+    {
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+  }
+
+  PVOID GetBase() const noexcept
+  {
+    return base_;
+  }
+
+private:
+  CallStubProcessCache* cache_;
+  PVOID base_;
+};
+
+struct CallStubRegistry
+{
+  std::mutex mutex;
+  std::map<DWORD, std::shared_ptr<CallStubProcessCache>> caches;
+};
 
-  return stub_mem_remote;
+inline CallStubRegistry& GetCallStubRegistry()
+{
+  static CallStubRegistry registry;
+  return registry;
+}
+
+inline std::shared_ptr<CallStubProcessCache>
+  GetCallStubProcessCache(Process const& process)
+{
+  CallStubRegistry& registry = GetCallStubRegistry();
+  std::lock_guard<std::mutex> const lock{registry.mutex};
+
+  auto const iter = registry.caches.find(process.GetId());
+  if (iter != std::end(registry.caches) && iter->second->IsAlive())
+  {
+    return iter->second;
+  }
+
+  // Drop the caches of processes that have exited while we're here, so we
+  // don't hold on to their handles forever. Their IDs can be reused as soon
+  // as the last handle is closed.
+  for (auto i = std::begin(registry.caches); i != std::end(registry.caches);)
+  {
+    i = i->second->IsAlive() ? std::next(i) : registry.caches.erase(i);
+  }
+
+  auto cache = std::make_shared<CallStubProcessCache>(process);
+  registry.caches[process.GetId()] = cache;
+  return cache;
 }
 }
 
+// Frees the call stubs cached for the process. Calls in progress keep the
+// stubs they are using alive until they return.
+inline void FlushCallStubCache(Process const& process)
+{
+  detail::CallStubRegistry& registry = detail::GetCallStubRegistry();
+  std::lock_guard<std::mutex> const lock{registry.mutex};
+  registry.caches.erase(process.GetId());
+}
+
 template <typename AddressesForwardIterator,
           typename ConvForwardIterator,
           typename ArgsForwardIterator,
@@ -910,42 +1030,57 @@ inline void CallMulti(Process const& process,
   auto const num_addresses =
     static_cast<NumAddressesUnsigned>(num_addresses_signed);
 
-  HADESMEM_DETAIL_TRACE_A("Allocating memory for return values.");
+  std::shared_ptr<detail::CallStubProcessCache> const cache =
+    detail::GetCallStubProcessCache(process);
+
+  detail::CallSignature const signature =
+    detail::MakeCallSignature(num_addresses, call_convs_beg, args_full_beg);
+  detail::CallDataLayout const layout{signature};
+
+  // The stub is reused across calls, so all that's left to allocate is a
+  // single (small, heap allocated) block for the addresses, arguments and
+  // results.
+  HADESMEM_DETAIL_TRACE_A("Packing call data.");
+
+  std::vector<BYTE> data(layout.GetSize());
+  detail::PackCallData(
+    layout, num_addresses, addresses_beg, args_full_beg, data.data());
 
-  Allocator const return_values_remote{
-    process, sizeof(detail::CallResultRemote) * num_addresses};
+  detail::CallDataBlock const data_remote{*cache, data.size()};
+  WriteVector(cache->GetProcess(), data_remote.GetBase(), data);
 
-  HADESMEM_DETAIL_TRACE_A("Allocating memory for code stub.");
+  HADESMEM_DETAIL_TRACE_A("Looking up code stub.");
 
-  Allocator const code_remote{
-    detail::GenerateCallCode(process,
-                             addresses_beg,
-                             addresses_end,
-                             call_convs_beg,
-                             args_full_beg,
-                             return_values_remote.GetBase())};
-  LPTHREAD_START_ROUTINE code_remote_pfn =
+  PVOID stub_remote = cache->GetStub(signature);
+  std::unique_ptr<Allocator> stub_uncached;
+  if (!stub_remote)
+  {
+    stub_uncached = std::make_unique<Allocator>(detail::GenerateCallStub(
+      cache->GetProcess(), signature, cache->GetImports()));
+    stub_remote = stub_uncached->GetBase();
+  }
+  LPTHREAD_START_ROUTINE stub_remote_pfn =
     reinterpret_cast<LPTHREAD_START_ROUTINE>(
-      reinterpret_cast<DWORD_PTR>(code_remote.GetBase()));
+      reinterpret_cast<DWORD_PTR>(stub_remote));
 
   HADESMEM_DETAIL_TRACE_A("Creating remote thread and waiting.");
 
-  detail::CreateRemoteThreadAndWait(process, code_remote_pfn);
+  // The stub is the thread's start routine, and its only parameter is the
+  // address of the call data block (the stub itself is shared, so everything
+  // which varies between calls has to come in through the block).
+  detail::CreateRemoteThreadAndWait(
+    process, stub_remote_pfn, INFINITE, data_remote.GetBase());
 
   HADESMEM_DETAIL_TRACE_A("Reading return values.");
 
-  std::vector<detail::CallResultRemote> const return_vals_remote =
-    ReadVector<detail::CallResultRemote>(
-      process, return_values_remote.GetBase(), num_addresses);
-
-  std::vector<CallResultRaw> return_vals;
-  return_vals.reserve(num_addresses);
-  std::transform(std::begin(return_vals_remote),
-                 std::end(return_vals_remote),
-                 results,
-                 [](detail::CallResultRemote const& r) {
-                   return static_cast<CallResultRaw>(r);
-                 });
+  data = ReadVector<BYTE>(process, data_remote.GetBase(), data.size());
+
+  for (std::size_t i = 0; i < num_addresses; ++i)
+  {
+    *results = static_cast<CallResultRaw>(
+      detail::UnpackCallResult(layout, i, data.data()));
+    ++results;
+  }
 }
 
 template <typename ArgsForwardIterator>
@@ -0,0 +1,170 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Runs writes on a single background thread, in the order they were queued,
+// so producers can get on with building the next buffer instead of waiting
+// on the disk. Each write says how many bytes it is holding on to, and
+// Queue blocks once too much is waiting, so a fast producer can't run the
+// process out of memory.
+//
+// A write which throws doesn't stop the ones after it. The first error is
+// rethrown by Flush.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+class AsyncWriter
+{
+public:
+  explicit AsyncWriter(std::size_t max_pending_bytes)
+    : max_pending_bytes_{max_pending_bytes}
+  {
+    thread_ = std::thread{[this]() { Main(); }};
+  }
+
+  AsyncWriter(AsyncWriter const& other) = delete;
+
+  AsyncWriter& operator=(AsyncWriter const& other) = delete;
+
+  // Anything still queued is written first. Errors are lost, so call Flush
+  // if you care about them.
+  ~AsyncWriter()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    queued_condition_.notify_all();
+
+    try
+    {
+      thread_.join();
+    }
+    catch (...)
+    {
+    }
+  }
+
+  // A single write bigger than the limit is still accepted, but only once
+  // everything before it is done.
+  void Queue(std::size_t num_bytes, std::function<void()> write)
+  {
+    HADESMEM_DETAIL_ASSERT(!!write);
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (pending_bytes_ && pending_bytes_ + num_bytes > max_pending_bytes_)
+      {
+        consumed_condition_.wait(lock);
+      }
+
+      writes_.emplace_back(num_bytes, std::move(write));
+      pending_bytes_ += num_bytes;
+    }
+    queued_condition_.notify_one();
+  }
+
+  // Waits for everything queued so far to be written.
+  void Flush()
+  {
+    std::exception_ptr error;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (pending_bytes_ || !writes_.empty() || is_writing_)
+      {
+        consumed_condition_.wait(lock);
+      }
+
+      std::swap(error, error_);
+    }
+
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+
+  std::size_t GetPendingBytes() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_bytes_;
+  }
+
+private:
+  void Main()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+      while (writes_.empty() && running_)
+      {
+        queued_condition_.wait(lock);
+      }
+
+      if (writes_.empty())
+      {
+        break;
+      }
+
+      auto write = std::move(writes_.front());
+      writes_.pop_front();
+      is_writing_ = true;
+
+      lock.unlock();
+
+      std::exception_ptr error;
+      try
+      {
+        write.second();
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+
+      // Free the buffer the write was holding on to before letting another
+      // one in.
+      write.second = nullptr;
+
+      lock.lock();
+
+      if (error && !error_)
+      {
+        error_ = error;
+      }
+      pending_bytes_ -= write.first;
+      is_writing_ = false;
+      consumed_condition_.notify_all();
+    }
+  }
+
+  std::size_t max_pending_bytes_;
+  std::size_t pending_bytes_{};
+  bool running_{true};
+  bool is_writing_{};
+  std::deque<std::pair<std::size_t, std::function<void()>>> writes_;
+  std::exception_ptr error_;
+  mutable std::mutex mutex_;
+  std::condition_variable queued_condition_;
+  std::condition_variable consumed_condition_;
+  std::thread thread_;
+};
+}
+}
@@ -0,0 +1,370 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+#if defined(_M_X64) || defined(__SSE2__) ||                                    \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HADESMEM_DETAIL_BASE_RELOCATIONS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Building blocks for RelocationTable (see pelib/relocation_table.hpp), and
+// for anything which has to apply relocations to an image it holds locally
+// (manual mapping, rebasing a dump, etc.). The whole relocation directory is
+// decoded from one buffer into a flat array of (type, offset) pairs, rather
+// than a Relocation object (and a read) per entry.
+//
+// Fixups are applied in runs. Entries which are of the same type and cover
+// consecutive pointers (vtables, jump tables, pointer arrays, etc. are laid
+// out that way, and it's the bulk of the entries in a typical image) are
+// applied as a single add over the run, which uses SSE2 where it's
+// available. Everything else is applied one at a time.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+// Same values as IMAGE_REL_BASED_*.
+enum : std::uint8_t
+{
+  kRelocationAbsolute = 0,
+  kRelocationHigh = 1,
+  kRelocationLow = 2,
+  kRelocationHighLow = 3,
+  kRelocationDir64 = 10
+};
+
+struct RelocationEntry
+{
+  std::uint8_t type;
+  std::uint16_t offset;
+};
+
+inline RelocationEntry DecodeRelocationEntry(std::uint16_t raw) noexcept
+{
+  return RelocationEntry{static_cast<std::uint8_t>(raw >> 12),
+                         static_cast<std::uint16_t>(raw & 0x0FFF)};
+}
+
+// Decodes count raw (little endian) WORD entries.
+inline void AppendRelocationEntries(std::uint8_t const* data,
+                                    std::size_t count,
+                                    std::vector<RelocationEntry>& entries)
+{
+  entries.reserve(entries.size() + count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::uint16_t raw;
+    std::memcpy(&raw, data + i * sizeof(raw), sizeof(raw));
+    entries.push_back(DecodeRelocationEntry(raw));
+  }
+}
+
+class RelocationSpan
+{
+public:
+  RelocationSpan() = default;
+
+  RelocationSpan(RelocationEntry const* data, std::size_t size) noexcept
+    : data_{data}, size_{size}
+  {
+  }
+
+  RelocationEntry const* begin() const noexcept
+  {
+    return data_;
+  }
+
+  RelocationEntry const* end() const noexcept
+  {
+    return data_ + size_;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  bool empty() const noexcept
+  {
+    return !size_;
+  }
+
+  RelocationEntry const& operator[](std::size_t i) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(i < size_);
+    return data_[i];
+  }
+
+private:
+  RelocationEntry const* data_{};
+  std::size_t size_{};
+};
+
+struct RelocationBlockInfo
+{
+  std::uint32_t virtual_address;
+  std::uint32_t size_of_block;
+  // Index of the block's first entry in the table's entry array.
+  std::size_t first;
+  std::size_t count;
+};
+
+class BaseRelocations
+{
+public:
+  BaseRelocations() = default;
+
+  // Blocks are walked with the same rules as RelocationBlockList. A block
+  // with a SizeOfBlock of zero is empty, and the walk stops at the first
+  // block whose entries would run past the end of the data (in which case
+  // the table is marked as truncated).
+  explicit BaseRelocations(std::uint8_t const* data, std::size_t size)
+  {
+    std::size_t const kHeaderSize = 8;
+    std::size_t offset = 0;
+    while (size - offset >= kHeaderSize)
+    {
+      RelocationBlockInfo block{};
+      std::memcpy(&block.virtual_address, data + offset, 4);
+      std::memcpy(&block.size_of_block, data + offset + 4, 4);
+
+      if (block.size_of_block && block.size_of_block < kHeaderSize)
+      {
+        truncated_ = true;
+        return;
+      }
+
+      block.first = entries_.size();
+      block.count = block.size_of_block
+                      ? (block.size_of_block - kHeaderSize) / 2
+                      : 0;
+      if (block.count > (size - offset - kHeaderSize) / 2)
+      {
+        truncated_ = true;
+        return;
+      }
+
+      AppendRelocationEntries(
+        data + offset + kHeaderSize, block.count, entries_);
+      blocks_.push_back(block);
+      offset += kHeaderSize + block.count * 2;
+    }
+
+    truncated_ = offset != size;
+  }
+
+  std::size_t GetNumBlocks() const noexcept
+  {
+    return blocks_.size();
+  }
+
+  RelocationBlockInfo const& GetBlock(std::size_t block) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(block < blocks_.size());
+    return blocks_[block];
+  }
+
+  RelocationSpan GetEntries(std::size_t block) const noexcept
+  {
+    auto const& info = GetBlock(block);
+    return RelocationSpan{entries_.data() + info.first, info.count};
+  }
+
+  std::size_t GetNumEntries() const noexcept
+  {
+    return entries_.size();
+  }
+
+  RelocationSpan GetAllEntries() const noexcept
+  {
+    return RelocationSpan{entries_.data(), entries_.size()};
+  }
+
+  // True if there was data left over which couldn't be decoded as a block
+  // (a bad SizeOfBlock, or a trailing partial block).
+  bool IsTruncated() const noexcept
+  {
+    return truncated_;
+  }
+
+private:
+  std::vector<RelocationBlockInfo> blocks_;
+  std::vector<RelocationEntry> entries_;
+  bool truncated_{};
+};
+
+inline void AddRelocationDelta32(std::uint8_t* p,
+                                 std::size_t count,
+                                 std::uint32_t delta) noexcept
+{
+  std::size_t i = 0;
+#if defined(HADESMEM_DETAIL_BASE_RELOCATIONS_SSE2)
+  __m128i const d = _mm_set1_epi32(static_cast<int>(delta));
+  for (; i + 4 <= count; i += 4)
+  {
+    auto const q = reinterpret_cast<__m128i*>(p + i * 4);
+    _mm_storeu_si128(q, _mm_add_epi32(_mm_loadu_si128(q), d));
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    std::uint32_t value;
+    std::memcpy(&value, p + i * 4, sizeof(value));
+    value += delta;
+    std::memcpy(p + i * 4, &value, sizeof(value));
+  }
+}
+
+inline void AddRelocationDelta64(std::uint8_t* p,
+                                 std::size_t count,
+                                 std::uint64_t delta) noexcept
+{
+  std::size_t i = 0;
+#if defined(HADESMEM_DETAIL_BASE_RELOCATIONS_SSE2)
+  // _mm_set1_epi64x isn't available on every x86 compiler.
+  auto const lo = static_cast<int>(static_cast<std::uint32_t>(delta));
+  auto const hi = static_cast<int>(static_cast<std::uint32_t>(delta >> 32));
+  __m128i const d = _mm_set_epi32(hi, lo, hi, lo);
+  for (; i + 2 <= count; i += 2)
+  {
+    auto const q = reinterpret_cast<__m128i*>(p + i * 8);
+    _mm_storeu_si128(q, _mm_add_epi64(_mm_loadu_si128(q), d));
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    std::uint64_t value;
+    std::memcpy(&value, p + i * 8, sizeof(value));
+    value += delta;
+    std::memcpy(p + i * 8, &value, sizeof(value));
+  }
+}
+
+struct RelocationApplyResult
+{
+  std::size_t num_applied;
+  // IMAGE_REL_BASED_ABSOLUTE (padding).
+  std::size_t num_skipped;
+  // Fixups which would read or write outside of the image. Not applied.
+  std::size_t num_out_of_bounds;
+  // Types which aren't handled (e.g. IMAGE_REL_BASED_HIGHADJ, or anything
+  // architecture specific). Not applied.
+  std::size_t num_unsupported;
+};
+
+// The image is in its mapped layout (i.e. indexed by RVA). The delta is the
+// new base minus the preferred base. HIGHLOW, HIGH and LOW use the low 32
+// bits of it, the same as the loader.
+inline RelocationApplyResult ApplyRelocations(std::uint8_t* image,
+                                              std::size_t image_size,
+                                              BaseRelocations const& relocs,
+                                              std::uint64_t delta) noexcept
+{
+  RelocationApplyResult result{};
+
+  auto const get_width = [](std::uint8_t type) -> std::size_t {
+    switch (type)
+    {
+    case kRelocationHighLow:
+      return 4;
+    case kRelocationDir64:
+      return 8;
+    case kRelocationHigh:
+    case kRelocationLow:
+      return 2;
+    default:
+      return 0;
+    }
+  };
+
+  auto const delta_32 = static_cast<std::uint32_t>(delta);
+  for (std::size_t b = 0; b < relocs.GetNumBlocks(); ++b)
+  {
+    std::uint64_t const page = relocs.GetBlock(b).virtual_address;
+    auto const entries = relocs.GetEntries(b);
+    std::size_t i = 0;
+    while (i < entries.size())
+    {
+      auto const type = entries[i].type;
+      if (type == kRelocationAbsolute)
+      {
+        ++result.num_skipped;
+        ++i;
+        continue;
+      }
+
+      std::size_t const width = get_width(type);
+      if (!width)
+      {
+        ++result.num_unsupported;
+        ++i;
+        continue;
+      }
+
+      std::size_t j = i + 1;
+      if (width >= 4)
+      {
+        while (j < entries.size() && entries[j].type == type &&
+               static_cast<std::size_t>(entries[j].offset) ==
+                 entries[j - 1].offset + width)
+        {
+          ++j;
+        }
+      }
+
+      std::size_t const count = j - i;
+      std::uint64_t const rva = page + entries[i].offset;
+      if (rva > image_size || image_size - rva < count * width)
+      {
+        // Apply whatever part of the run is still inside the image.
+        std::size_t const in_bounds =
+          rva < image_size
+            ? static_cast<std::size_t>((image_size - rva) / width)
+            : 0;
+        result.num_out_of_bounds += count - in_bounds;
+        j = i + in_bounds;
+        if (!in_bounds)
+        {
+          i += count;
+          continue;
+        }
+      }
+
+      auto const p = image + static_cast<std::size_t>(rva);
+      std::size_t const n = j - i;
+      if (type == kRelocationHighLow)
+      {
+        AddRelocationDelta32(p, n, delta_32);
+      }
+      else if (type == kRelocationDir64)
+      {
+        AddRelocationDelta64(p, n, delta);
+      }
+      else
+      {
+        std::uint16_t value;
+        std::memcpy(&value, p, sizeof(value));
+        value = static_cast<std::uint16_t>(
+          value + (type == kRelocationHigh ? delta_32 >> 16 : delta_32));
+        std::memcpy(p, &value, sizeof(value));
+      }
+      result.num_applied += n;
+      i += count;
+    }
+  }
+
+  return result;
+}
+}
+}
@@ -0,0 +1,280 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <locale>
+#include <ostream>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// A small benchmark runner in the style of Google Benchmark. Each benchmark
+// is a function which does a fixed amount of work (so many items, so many
+// bytes) per call. It's called in growing batches until a batch takes at
+// least the minimum time, and the throughput of that batch is what gets
+// reported.
+//
+// Results are written as JSON, in the same layout Google Benchmark uses, so
+// the same tools can be used to compare runs between versions.
+//
+// Nothing in here depends on the OS. Where to get CPU time from is up to the
+// caller (without it, CPU time is left out of the results).
+
+namespace hadesmem
+{
+namespace detail
+{
+struct BenchmarkResult
+{
+  std::string name;
+  std::uint64_t iterations;
+  // Per iteration.
+  double real_time_ns;
+  double cpu_time_ns;
+  bool has_cpu_time;
+  double items_per_second;
+  double bytes_per_second;
+};
+
+inline std::string EscapeJsonString(std::string const& s)
+{
+  std::string escaped;
+  escaped.reserve(s.size());
+  for (char const c : s)
+  {
+    switch (c)
+    {
+    case '"':
+      escaped += "\\\"";
+      break;
+    case '\\':
+      escaped += "\\\\";
+      break;
+    case '\n':
+      escaped += "\\n";
+      break;
+    case '\r':
+      escaped += "\\r";
+      break;
+    case '\t':
+      escaped += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+      {
+        char buf[7];
+        std::snprintf(
+          buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+        escaped += buf;
+      }
+      else
+      {
+        escaped += c;
+      }
+      break;
+    }
+  }
+  return escaped;
+}
+
+class BenchmarkRunner
+{
+public:
+  using ClockFunc = std::function<std::chrono::nanoseconds()>;
+
+  explicit BenchmarkRunner(std::chrono::nanoseconds min_time,
+                           ClockFunc cpu_clock = nullptr,
+                           ClockFunc real_clock = nullptr)
+    : min_time_{min_time},
+      cpu_clock_{std::move(cpu_clock)},
+      real_clock_{std::move(real_clock)}
+  {
+    HADESMEM_DETAIL_ASSERT(min_time_.count() > 0);
+
+    if (!real_clock_)
+    {
+      real_clock_ = []() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch());
+      };
+    }
+  }
+
+  // Benchmarks whose names don't match are skipped. Empty matches everything.
+  void SetFilter(std::string const& filter)
+  {
+    filter_ = filter.empty() ? std::regex{} : std::regex{filter};
+    has_filter_ = !filter.empty();
+  }
+
+  // If set, each result is also printed as a line of text when it's done.
+  void SetLog(std::ostream* log) noexcept
+  {
+    log_ = log;
+  }
+
+  bool IsEnabled(std::string const& name) const
+  {
+    return !has_filter_ || std::regex_search(name, filter_);
+  }
+
+  // Returns false if the benchmark was filtered out.
+  template <typename Func>
+  bool Run(std::string const& name,
+           std::uint64_t items,
+           std::uint64_t bytes,
+           Func const& func)
+  {
+    if (!IsEnabled(name))
+    {
+      return false;
+    }
+
+    // Same growth policy as Google Benchmark: aim a little past the minimum
+    // time, but never grow by more than 10x at once.
+    std::uint64_t const kMaxIterations = 1000000000ULL;
+    std::uint64_t iterations = 1;
+    for (;;)
+    {
+      auto const cpu_beg = cpu_clock_ ? cpu_clock_() : Nanoseconds{};
+      auto const real_beg = real_clock_();
+      for (std::uint64_t i = 0; i < iterations; ++i)
+      {
+        func();
+      }
+      auto const real_elapsed = real_clock_() - real_beg;
+      auto const cpu_elapsed =
+        cpu_clock_ ? cpu_clock_() - cpu_beg : Nanoseconds{};
+
+      if (real_elapsed >= min_time_ || iterations >= kMaxIterations)
+      {
+        Record(name, iterations, items, bytes, real_elapsed, cpu_elapsed);
+        return true;
+      }
+
+      double const multiplier =
+        real_elapsed.count() > 0
+          ? (std::min)(10.0,
+                       1.4 * static_cast<double>(min_time_.count()) /
+                         static_cast<double>(real_elapsed.count()))
+          : 10.0;
+      auto const next = static_cast<std::uint64_t>(
+        static_cast<double>(iterations) * multiplier);
+      iterations = (std::min)(kMaxIterations, (std::max)(next, iterations + 1));
+    }
+  }
+
+  std::vector<BenchmarkResult> const& GetResults() const noexcept
+  {
+    return results_;
+  }
+
+  // Context is free form (e.g. version, architecture, build type).
+  void WriteJson(
+    std::ostream& out,
+    std::vector<std::pair<std::string, std::string>> const& context) const
+  {
+    auto const old_locale = out.imbue(std::locale::classic());
+    auto const old_precision = out.precision(17);
+
+    out << "{\n  \"context\": {";
+    for (std::size_t i = 0; i < context.size(); ++i)
+    {
+      out << (i ? ",\n" : "\n") << "    \""
+          << EscapeJsonString(context[i].first) << "\": \""
+          << EscapeJsonString(context[i].second) << "\"";
+    }
+    out << "\n  },\n  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results_.size(); ++i)
+    {
+      auto const& r = results_[i];
+      out << (i ? ",\n" : "\n") << "    {\n"
+          << "      \"name\": \"" << EscapeJsonString(r.name) << "\",\n"
+          << "      \"iterations\": " << r.iterations << ",\n"
+          << "      \"real_time\": " << r.real_time_ns << ",\n";
+      if (r.has_cpu_time)
+      {
+        out << "      \"cpu_time\": " << r.cpu_time_ns << ",\n";
+      }
+      out << "      \"time_unit\": \"ns\",\n"
+          << "      \"items_per_second\": " << r.items_per_second << ",\n"
+          << "      \"bytes_per_second\": " << r.bytes_per_second << "\n"
+          << "    }";
+    }
+    out << "\n  ]\n}\n";
+
+    out.precision(old_precision);
+    out.imbue(old_locale);
+  }
+
+private:
+  using Nanoseconds = std::chrono::nanoseconds;
+
+  void Record(std::string const& name,
+              std::uint64_t iterations,
+              std::uint64_t items,
+              std::uint64_t bytes,
+              Nanoseconds real_elapsed,
+              Nanoseconds cpu_elapsed)
+  {
+    // A clock which didn't tick still has to give finite numbers.
+    auto const ns = (std::max)(real_elapsed.count(), Nanoseconds::rep{1});
+    double const seconds = static_cast<double>(ns) / 1e9;
+    double const n = static_cast<double>(iterations);
+
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.real_time_ns = static_cast<double>(real_elapsed.count()) / n;
+    result.cpu_time_ns = static_cast<double>(cpu_elapsed.count()) / n;
+    result.has_cpu_time = !!cpu_clock_;
+    result.items_per_second = static_cast<double>(items) * n / seconds;
+    result.bytes_per_second = static_cast<double>(bytes) * n / seconds;
+    results_.push_back(result);
+
+    if (log_)
+    {
+      auto const old_locale = log_->imbue(std::locale::classic());
+      auto const old_flags = log_->flags();
+      auto const old_precision = log_->precision();
+      *log_ << std::left << std::setw(48) << name << std::right << std::fixed
+            << std::setprecision(0) << std::setw(14) << result.real_time_ns
+            << " ns" << std::setw(12) << iterations;
+      if (items)
+      {
+        *log_ << std::setprecision(1) << std::setw(14)
+              << result.items_per_second << " items/s";
+      }
+      if (bytes)
+      {
+        *log_ << std::setprecision(1) << std::setw(10)
+              << result.bytes_per_second / (1024 * 1024) << " MB/s";
+      }
+      *log_ << '\n';
+      log_->precision(old_precision);
+      log_->flags(old_flags);
+      log_->imbue(old_locale);
+    }
+  }
+
+  Nanoseconds min_time_;
+  ClockFunc cpu_clock_;
+  ClockFunc real_clock_;
+  std::regex filter_;
+  bool has_filter_{};
+  std::ostream* log_{};
+  std::vector<BenchmarkResult> results_;
+};
+}
+}
@@ -0,0 +1,250 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+
+// Request/response ring used to talk to a remote call server. The ring lives
+// in memory shared by the client and the server (which in the normal case is
+// a thread running generated code in the target process), so everything in it
+// is addressed by offset and the layout is fixed.
+//
+// Each slot moves from free to pending (client), pending to done (server) and
+// done to free (client). Slots are posted and served in order, so the server
+// only ever has to look at a single slot to know whether there is work.
+// Waking the server and waiting for results are left to the caller.
+//
+// Nothing in here depends on the OS. The server side is implemented here as
+// well so the protocol can be exercised in-process with a local thread
+// standing in for the remote server.
+
+namespace hadesmem
+{
+namespace detail
+{
+HADESMEM_DETAIL_STATIC_ASSERT(ATOMIC_INT_LOCK_FREE == 2);
+HADESMEM_DETAIL_STATIC_ASSERT(sizeof(std::atomic<std::uint32_t>) ==
+                              sizeof(std::uint32_t));
+
+struct CallRingHeader
+{
+  std::uint32_t magic;
+  std::uint32_t num_slots;
+  std::uint32_t slot_size;
+  std::atomic<std::uint32_t> stop;
+  // Handles (as seen by the server) used to wake the server and to signal
+  // completion. Owned and filled in by the client.
+  std::uint64_t request_event;
+  std::uint64_t done_event;
+};
+
+struct CallRingSlotHeader
+{
+  std::atomic<std::uint32_t> state;
+  std::uint32_t padding;
+  // Address (as seen by the server) of the code to run. It is called with a
+  // pointer to the slot data.
+  std::uint64_t stub;
+};
+
+HADESMEM_DETAIL_STATIC_ASSERT(std::is_standard_layout<CallRingHeader>::value);
+HADESMEM_DETAIL_STATIC_ASSERT(
+  std::is_standard_layout<CallRingSlotHeader>::value);
+
+class CallRing
+{
+public:
+  enum : std::uint32_t
+  {
+    kFree,
+    kPending,
+    kDone
+  };
+
+  static std::uint32_t const kMagic = 0x474E4952; // 'RING'
+
+  // Slots are cache line aligned so the client filling in one slot doesn't
+  // contend with the server working on another.
+  static std::size_t const kSlotAlignment = 64;
+  static std::size_t const kHeaderSize = kSlotAlignment;
+  static std::size_t const kSlotHeaderSize = sizeof(CallRingSlotHeader);
+
+  HADESMEM_DETAIL_STATIC_ASSERT(sizeof(CallRingHeader) <= kHeaderSize);
+
+  static std::size_t GetSlotSize(std::size_t data_size) noexcept
+  {
+    std::size_t const size = kSlotHeaderSize + data_size;
+    return (size + kSlotAlignment - 1) & ~(kSlotAlignment - 1);
+  }
+
+  static std::size_t GetRequiredSize(std::size_t num_slots,
+                                     std::size_t data_size) noexcept
+  {
+    return kHeaderSize + num_slots * GetSlotSize(data_size);
+  }
+
+  static std::size_t GetSlotOffset(std::size_t slot,
+                                   std::size_t data_size) noexcept
+  {
+    return kHeaderSize + slot * GetSlotSize(data_size);
+  }
+
+  // Lays out an empty ring. The memory must be at least GetRequiredSize bytes
+  // and suitably aligned (e.g. page aligned).
+  static void Format(void* base, std::size_t num_slots, std::size_t data_size)
+  {
+    HADESMEM_DETAIL_ASSERT(base != nullptr);
+    HADESMEM_DETAIL_ASSERT(num_slots != 0);
+
+    std::memset(base, 0, GetRequiredSize(num_slots, data_size));
+
+    auto const header = static_cast<CallRingHeader*>(base);
+    header->magic = kMagic;
+    header->num_slots = static_cast<std::uint32_t>(num_slots);
+    header->slot_size = static_cast<std::uint32_t>(GetSlotSize(data_size));
+    header->stop.store(0, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < num_slots; ++i)
+    {
+      GetSlotHeader(base, i)->state.store(kFree, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  // Attaches to a ring laid out by Format. Each side of the ring (client or
+  // server) should use its own CallRing, as each keeps its own position.
+  explicit CallRing(void* base) noexcept
+    : header_{static_cast<CallRingHeader*>(base)}
+  {
+    HADESMEM_DETAIL_ASSERT(header_->magic == kMagic);
+  }
+
+  CallRingHeader& GetHeader() const noexcept
+  {
+    return *header_;
+  }
+
+  std::size_t GetNumSlots() const noexcept
+  {
+    return header_->num_slots;
+  }
+
+  std::size_t GetDataSize() const noexcept
+  {
+    return header_->slot_size - kSlotHeaderSize;
+  }
+
+  void* GetData(std::size_t slot) const noexcept
+  {
+    return reinterpret_cast<std::uint8_t*>(GetSlotHeader(slot)) +
+           kSlotHeaderSize;
+  }
+
+  // Client side.
+
+  // Returns false if the next slot is still in use (i.e. the ring is full
+  // and the oldest request has not been released yet).
+  bool TryAcquire(std::size_t* slot) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(slot != nullptr);
+
+    if (GetSlotHeader(head_)->state.load(std::memory_order_acquire) != kFree)
+    {
+      return false;
+    }
+
+    *slot = head_;
+    return true;
+  }
+
+  // The slot the next TryAcquire returns, or is waiting on if the ring is
+  // full.
+  std::size_t GetNextSlot() const noexcept
+  {
+    return head_;
+  }
+
+  // Hands the slot returned by TryAcquire to the server. The slot data must
+  // have been filled in already.
+  void Post(std::size_t slot, std::uint64_t stub) noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(slot == head_);
+
+    CallRingSlotHeader* const slot_header = GetSlotHeader(slot);
+    slot_header->stub = stub;
+    slot_header->state.store(kPending, std::memory_order_release);
+    head_ = (head_ + 1) % GetNumSlots();
+  }
+
+  bool IsDone(std::size_t slot) const noexcept
+  {
+    return GetSlotHeader(slot)->state.load(std::memory_order_acquire) ==
+           kDone;
+  }
+
+  // Returns the slot to the ring once the results have been read.
+  void Release(std::size_t slot) noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(IsDone(slot));
+    GetSlotHeader(slot)->state.store(kFree, std::memory_order_release);
+  }
+
+  void RequestStop() noexcept
+  {
+    header_->stop.store(1, std::memory_order_release);
+  }
+
+  // Server side.
+
+  bool IsStopRequested() const noexcept
+  {
+    return header_->stop.load(std::memory_order_acquire) != 0;
+  }
+
+  // Runs the next request, if there is one. Func is called with the stub
+  // address and a pointer to the slot data. This is what the generated server
+  // loop does for every request.
+  template <typename Func> bool TryServe(Func const& func)
+  {
+    CallRingSlotHeader* const slot_header = GetSlotHeader(tail_);
+    if (slot_header->state.load(std::memory_order_acquire) != kPending)
+    {
+      return false;
+    }
+
+    func(slot_header->stub, GetData(tail_));
+    slot_header->state.store(kDone, std::memory_order_release);
+    tail_ = (tail_ + 1) % GetNumSlots();
+    return true;
+  }
+
+private:
+  static CallRingSlotHeader* GetSlotHeader(void* base,
+                                           std::size_t slot) noexcept
+  {
+    auto const header = static_cast<CallRingHeader*>(base);
+    return reinterpret_cast<CallRingSlotHeader*>(
+      static_cast<std::uint8_t*>(base) + kHeaderSize +
+      slot * header->slot_size);
+  }
+
+  CallRingSlotHeader* GetSlotHeader(std::size_t slot) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(slot < GetNumSlots());
+    return GetSlotHeader(header_, slot);
+  }
+
+  CallRingHeader* header_;
+  std::size_t head_{};
+  std::size_t tail_{};
+};
+}
+}
@@ -0,0 +1,268 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+
+// Generated call stubs don't embed the target address or the argument values.
+// They read them from a data block passed in at runtime, so the code only
+// depends on the calling convention and the kind of each argument (the
+// 'signature'), and can be generated once and reused for every call with the
+// same signature.
+//
+// Nothing in here depends on the OS, so the cache and the data block layout
+// can be tested without a target process.
+
+namespace hadesmem
+{
+namespace detail
+{
+enum class CallArgKind : std::uint8_t
+{
+  kInt32,
+  kInt64,
+  kFloat32,
+  kFloat64
+};
+
+// One or more calls, each with a calling convention and a list of argument
+// kinds. The calling convention is stored as an integer so this doesn't need
+// to know about CallConv.
+class CallSignature
+{
+public:
+  void AddCall(std::uint32_t call_conv)
+  {
+    calls_.push_back(CallInfo{call_conv, args_.size(), 0});
+  }
+
+  void AddArg(CallArgKind kind)
+  {
+    HADESMEM_DETAIL_ASSERT(!calls_.empty());
+    args_.push_back(kind);
+    ++calls_.back().num_args;
+  }
+
+  std::size_t GetNumCalls() const noexcept
+  {
+    return calls_.size();
+  }
+
+  std::uint32_t GetCallConv(std::size_t call) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(call < calls_.size());
+    return calls_[call].call_conv;
+  }
+
+  std::size_t GetNumArgs(std::size_t call) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(call < calls_.size());
+    return calls_[call].num_args;
+  }
+
+  CallArgKind GetArg(std::size_t call, std::size_t arg) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(arg < GetNumArgs(call));
+    return args_[calls_[call].first_arg + arg];
+  }
+
+  std::size_t GetMaxNumArgs() const noexcept
+  {
+    std::size_t max_num_args = 0;
+    for (auto const& call : calls_)
+    {
+      max_num_args =
+        call.num_args > max_num_args ? call.num_args : max_num_args;
+    }
+    return max_num_args;
+  }
+
+  // FNV-1a.
+  std::size_t GetHash() const noexcept
+  {
+    std::uint64_t hash = 0xCBF29CE484222325ULL;
+    auto const mix = [&](std::uint64_t value) {
+      hash ^= value;
+      hash *= 0x100000001B3ULL;
+    };
+    for (auto const& call : calls_)
+    {
+      mix(call.call_conv);
+      mix(call.num_args);
+    }
+    for (auto const arg : args_)
+    {
+      mix(static_cast<std::uint64_t>(arg));
+    }
+    return static_cast<std::size_t>(hash);
+  }
+
+  friend bool operator==(CallSignature const& lhs,
+                         CallSignature const& rhs) noexcept
+  {
+    if (lhs.calls_.size() != rhs.calls_.size() || lhs.args_ != rhs.args_)
+    {
+      return false;
+    }
+
+    for (std::size_t i = 0; i < lhs.calls_.size(); ++i)
+    {
+      if (lhs.calls_[i].call_conv != rhs.calls_[i].call_conv ||
+          lhs.calls_[i].num_args != rhs.calls_[i].num_args)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  friend bool operator!=(CallSignature const& lhs,
+                         CallSignature const& rhs) noexcept
+  {
+    return !(lhs == rhs);
+  }
+
+private:
+  struct CallInfo
+  {
+    std::uint32_t call_conv;
+    std::size_t first_arg;
+    std::size_t num_args;
+  };
+
+  std::vector<CallInfo> calls_;
+  std::vector<CallArgKind> args_;
+};
+
+struct CallSignatureHash
+{
+  std::size_t operator()(CallSignature const& signature) const noexcept
+  {
+    return signature.GetHash();
+  }
+};
+
+// Layout of the data block read by a stub. For each call there is a record
+// containing the target address, then one 8 byte slot per argument (32-bit
+// values are zero extended, floats are stored in the low 4 bytes), then space
+// for the result, which the stub fills in.
+class CallDataLayout
+{
+public:
+  static std::size_t const kSlotSize = 8;
+  // Must be at least as large as CallResultRemote.
+  static std::size_t const kResultSize = 32;
+
+  explicit CallDataLayout(CallSignature const& signature)
+  {
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < signature.GetNumCalls(); ++i)
+    {
+      call_offsets_.push_back(offset);
+      offset += kSlotSize + signature.GetNumArgs(i) * kSlotSize;
+      result_offsets_.push_back(offset);
+      offset += kResultSize;
+    }
+    size_ = offset;
+  }
+
+  static std::size_t GetSize(std::size_t num_args) noexcept
+  {
+    return kSlotSize + num_args * kSlotSize + kResultSize;
+  }
+
+  std::size_t GetAddressOffset(std::size_t call) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(call < call_offsets_.size());
+    return call_offsets_[call];
+  }
+
+  std::size_t GetArgOffset(std::size_t call, std::size_t arg) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(call < call_offsets_.size());
+    return call_offsets_[call] + kSlotSize + arg * kSlotSize;
+  }
+
+  std::size_t GetResultOffset(std::size_t call) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(call < result_offsets_.size());
+    return result_offsets_[call];
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return size_;
+  }
+
+private:
+  std::vector<std::size_t> call_offsets_;
+  std::vector<std::size_t> result_offsets_;
+  std::size_t size_{};
+};
+
+inline void WriteCallDataSlot(void* data,
+                              std::size_t offset,
+                              void const* value,
+                              std::size_t size) noexcept
+{
+  HADESMEM_DETAIL_ASSERT(size <= CallDataLayout::kSlotSize);
+  auto const slot = static_cast<std::uint8_t*>(data) + offset;
+  std::memset(slot, 0, CallDataLayout::kSlotSize);
+  std::memcpy(slot, value, size);
+}
+
+// Maps signatures to stubs. T is whatever owns the generated code (e.g. an
+// Allocator in the target). Not thread-safe.
+template <typename T> class CallStubCache
+{
+public:
+  T const* Find(CallSignature const& signature) const
+  {
+    auto const iter = stubs_.find(signature);
+    return iter == stubs_.end() ? nullptr : &iter->second;
+  }
+
+  // Factory is called with the signature and returns a T. References to
+  // cached stubs remain valid until Clear is called.
+  template <typename Factory>
+  T const& GetOrCreate(CallSignature const& signature, Factory const& factory)
+  {
+    auto const iter = stubs_.find(signature);
+    if (iter != stubs_.end())
+    {
+      return iter->second;
+    }
+
+    return stubs_.emplace(signature, factory(signature)).first->second;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return stubs_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return stubs_.empty();
+  }
+
+  void Clear()
+  {
+    stubs_.clear();
+  }
+
+private:
+  std::unordered_map<CallSignature, T, CallSignatureHash> stubs_;
+};
+}
+}
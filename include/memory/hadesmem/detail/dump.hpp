@@ -3,20 +3,34 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <memory>
+#include <thread>
 #include <tuple>
 
 #include <windows.h>
 #include <psapi.h>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/async_writer.hpp>
+#include <hadesmem/detail/export_index.hpp>
 #include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/import_resolver.hpp>
+#include <hadesmem/detail/module_scan.hpp>
+#include <hadesmem/detail/pe_image_writer.hpp>
 #include <hadesmem/detail/peb.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/region_alloc_size.hpp>
 #include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/detail/thread_pool.hpp>
 #include <hadesmem/find_procedure.hpp>
 #include <hadesmem/pelib/dos_header.hpp>
 #include <hadesmem/pelib/export.hpp>
@@ -33,7 +47,7 @@
 #include <hadesmem/process.hpp>
 #include <hadesmem/process_helpers.hpp>
 #include <hadesmem/region.hpp>
-#include <hadesmem/region_list.hpp>
+#include <hadesmem/region_map.hpp>
 
 // TODO: Clean this up. It's a mess right now...
 
@@ -55,7 +69,8 @@ struct DumpFlags
     kUseOriginalImagePath = 1 << 1,
     kReconstructImports = 1 << 2,
     kAddNewSection = 1 << 3,
-    kInvalidFlagMaxValue = 1 << 4,
+    kScanStrippedHeaders = 1 << 4,
+    kInvalidFlagMaxValue = 1 << 5,
   };
 };
 
@@ -75,11 +90,10 @@ inline std::uint64_t RoundUp(std::uint64_t n, std::uint64_t m)
   return n + m - r;
 }
 
-inline void WriteDumpFile(Process const& process,
-                          std::wstring const& region_name,
-                          void const* buffer,
-                          std::size_t size,
-                          std::wstring const& dir_name = L"dumps")
+inline std::unique_ptr<std::fstream>
+  OpenDumpFile(Process const& process,
+               std::wstring const& region_name,
+               std::wstring const& dir_name)
 {
   HADESMEM_DETAIL_TRACE_A("Creating dump dir.");
 
@@ -105,14 +119,24 @@ inline void WriteDumpFile(Process const& process,
 
   HADESMEM_DETAIL_TRACE_A("Opening file.");
 
-  auto const dump_file =
-    OpenFile<char>(dump_path, std::ios::out | std::ios::binary);
+  auto dump_file = OpenFile<char>(dump_path, std::ios::out | std::ios::binary);
   if (!*dump_file)
   {
     HADESMEM_DETAIL_THROW_EXCEPTION(
       Error() << ErrorString("Unable to open dump file."));
   }
 
+  return dump_file;
+}
+
+inline void WriteDumpFile(Process const& process,
+                          std::wstring const& region_name,
+                          void const* buffer,
+                          std::size_t size,
+                          std::wstring const& dir_name = L"dumps")
+{
+  auto const dump_file = OpenDumpFile(process, region_name, dir_name);
+
   HADESMEM_DETAIL_TRACE_A("Writing file.");
 
   if (!dump_file->write(static_cast<char const*>(buffer), size))
@@ -122,6 +146,26 @@ inline void WriteDumpFile(Process const& process,
   }
 }
 
+// Streams the parts straight to the file, so they never have to be joined
+// into a single buffer.
+inline void WriteDumpFile(Process const& process,
+                          std::wstring const& region_name,
+                          PeImageWriter const& writer,
+                          std::wstring const& dir_name = L"dumps")
+{
+  auto const dump_file = OpenDumpFile(process, region_name, dir_name);
+
+  HADESMEM_DETAIL_TRACE_FORMAT_A("Writing file. Size: [%I64u].",
+                                 writer.GetFileSize());
+
+  writer.Write(*dump_file);
+  if (!*dump_file)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error() << ErrorString("Unable to write to dump file."));
+  }
+}
+
 inline std::wstring GetRegionPathOrDefault(Process const& process,
                                            void* p,
                                            void* imagebase,
@@ -364,7 +408,13 @@ struct ProcessLight
   ~ProcessLight() = default;
 
   std::vector<ModuleLight> modules_;
-  std::map<void*, std::vector<ExportLight>> export_map_;
+  // Exports for each VA in the index, sorted by module priority (lowest to
+  // highest). Indexed the same as export_index_.
+  ExportIndex export_index_;
+  std::vector<std::vector<ExportLight>> exports_;
+  // Memory a redirected import stub could be in. Only built when
+  // reconstructing imports.
+  AddressRangeSet redirected_import_ranges_;
 };
 
 struct PeDumper
@@ -380,6 +430,7 @@ public:
       flags_{flags},
       oep_{oep},
       m_{m},
+      import_resolvers_(MakeDefaultImportResolvers()),
       process_light_(MakeProcessLight())
   {
   }
@@ -401,6 +452,20 @@ public:
     process_light_ = MakeProcessLight();
   }
 
+  // Resolvers are tried in the order they were added, after the built in
+  // ones.
+  void AddImportResolver(std::unique_ptr<RedirectedImportResolver> resolver)
+  {
+    import_resolvers_.Add(std::move(resolver));
+  }
+
+  // Counters for the most recent module list build. Updated while it's
+  // running, so can be polled from another thread for progress.
+  ModuleScanStats const& GetModuleScanStats() const noexcept
+  {
+    return module_scan_stats_;
+  }
+
 private:
   ProcessLight BuildModuleList()
   {
@@ -418,54 +483,215 @@ private:
 
     HADESMEM_DETAIL_TRACE_FORMAT_A("ImageBase: [%p].", peb.ImageBaseAddress);
 
-    RegionList regions(*process_);
-    ProcessLight process_info;
-    for (auto const& region : regions)
+    module_scan_stats_.Reset();
+
+    RegionMap const regions{*process_};
+    std::vector<MEMORY_BASIC_INFORMATION> scan_regions;
+    for (auto const& mbi : regions)
     {
-      auto const region_beg = static_cast<std::uint8_t*>(region.GetBase());
-      auto const region_end = region_beg + region.GetSize();
+      auto const region_beg = static_cast<std::uint8_t*>(mbi.BaseAddress);
+      auto const region_end = region_beg + mbi.RegionSize;
       if (!region_beg || region_end < region_beg)
       {
         continue;
       }
 
-      if (!CanRead(*process_, region_beg) ||
-          IsBadProtect(*process_, region_beg))
+      if (!CanRead(mbi) || IsBadProtect(mbi))
       {
         continue;
       }
 
-      // TODO: Add a config flag to search for modules which are not aligned on
-      // a page boundary.
-      for (auto p = region_beg; p + page_size <= region_end; p += page_size)
+      scan_regions.push_back(mbi);
+      module_scan_stats_.bytes_total += mbi.RegionSize;
+    }
+    module_scan_stats_.regions_total = scan_regions.size();
+
+    auto const scan_beg = std::chrono::steady_clock::now();
+    auto const candidates = ScanForModuleCandidates(scan_regions, page_size);
+    module_scan_stats_.scan_us =
+      static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - scan_beg)
+          .count());
+
+    // Validation is done in order so the module list is the same no matter
+    // how the scan was split up.
+    auto const validate_beg = std::chrono::steady_clock::now();
+    ProcessLight process_info;
+    for (auto const& region_candidates : candidates)
+    {
+      for (auto const& candidate : region_candidates)
       {
-        HandleModuleCandidate(p, process_info, peb);
+        HandleModuleCandidate(reinterpret_cast<std::uint8_t*>(candidate.offset),
+                              candidate.type,
+                              regions,
+                              process_info,
+                              peb);
       }
     }
+    module_scan_stats_.validate_us =
+      static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - validate_beg)
+          .count());
+
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Module scan complete. Regions: [%I64u]. Bytes: [%I64u]. Failed "
+      "chunks: [%I64u]. Candidates: [%I64u]. Modules: [%Iu]. Scan: [%I64u "
+      "us]. Validate: [%I64u us].",
+      module_scan_stats_.regions_total.load(),
+      module_scan_stats_.bytes_done.load(),
+      module_scan_stats_.chunks_failed.load(),
+      module_scan_stats_.candidates.load(),
+      process_info.modules_.size(),
+      module_scan_stats_.scan_us.load(),
+      module_scan_stats_.validate_us.load());
 
     return process_info;
   }
 
+  // Reads each region in large chunks and checks the page starts locally,
+  // rather than doing a query, protect and read for every page. Regions are
+  // shared out between threads. Candidates are returned per region, in
+  // region order, with the offset being the address.
+  // TODO: Add a config flag to search for modules which are not aligned on
+  // a page boundary.
+  std::vector<std::vector<ModuleCandidate>> ScanForModuleCandidates(
+    std::vector<MEMORY_BASIC_INFORMATION> const& regions,
+    std::size_t page_size)
+  {
+    std::vector<std::vector<ModuleCandidate>> candidates(regions.size());
+    std::atomic<std::size_t> next_region{0};
+    auto const scan_regions = [&]() {
+      std::vector<std::uint8_t> buffer;
+      for (std::size_t i = next_region++; i < regions.size();
+           i = next_region++)
+      {
+        ScanRegionForModules(regions[i], page_size, buffer, candidates[i]);
+        ++module_scan_stats_.regions_done;
+      }
+    };
+
+    std::size_t const num_threads = (std::min)(
+      regions.size(),
+      static_cast<std::size_t>(
+        (std::max)(1U, std::thread::hardware_concurrency())));
+    std::vector<std::thread> threads;
+    try
+    {
+      for (std::size_t i = 1; i < num_threads; ++i)
+      {
+        threads.emplace_back(scan_regions);
+      }
+
+      scan_regions();
+    }
+    catch (...)
+    {
+      next_region = regions.size();
+      for (auto& thread : threads)
+      {
+        thread.join();
+      }
+      throw;
+    }
+
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+
+    return candidates;
+  }
+
+  void ScanRegionForModules(MEMORY_BASIC_INFORMATION const& mbi,
+                            std::size_t page_size,
+                            std::vector<std::uint8_t>& buffer,
+                            std::vector<ModuleCandidate>& candidates)
+  {
+    std::size_t const kChunkSize = 0x100000;
+
+    std::uint32_t const scan_flags =
+      !!(flags_ & DumpFlags::kScanStrippedHeaders)
+        ? ModuleScanFlags::kStrippedHeaders
+        : ModuleScanFlags::kNone;
+
+    auto const region_beg = static_cast<std::uint8_t*>(mbi.BaseAddress);
+    std::size_t const region_size = mbi.RegionSize - mbi.RegionSize % page_size;
+    std::size_t const chunk_size = kChunkSize - kChunkSize % page_size;
+    buffer.resize(chunk_size);
+    std::size_t const num_candidates = candidates.size();
+    for (std::size_t offset = 0; offset < region_size; offset += chunk_size)
+    {
+      std::size_t const len = (std::min)(chunk_size, region_size - offset);
+      auto const chunk_beg = region_beg + offset;
+      if (ReadChunk(chunk_beg, buffer.data(), len))
+      {
+        FindModuleCandidates(buffer.data(),
+                             len,
+                             page_size,
+                             reinterpret_cast<std::uintptr_t>(chunk_beg),
+                             scan_flags,
+                             candidates);
+      }
+      else
+      {
+        // Something changed underneath us (e.g. part of the region was
+        // freed or reprotected). Fall back to doing it a page at a time.
+        ++module_scan_stats_.chunks_failed;
+        for (std::size_t page = 0; page < len; page += page_size)
+        {
+          if (ReadChunk(chunk_beg + page, buffer.data(), page_size))
+          {
+            FindModuleCandidates(
+              buffer.data(),
+              page_size,
+              page_size,
+              reinterpret_cast<std::uintptr_t>(chunk_beg + page),
+              scan_flags,
+              candidates);
+          }
+        }
+      }
+
+      module_scan_stats_.bytes_done += len;
+    }
+
+    module_scan_stats_.candidates += candidates.size() - num_candidates;
+  }
+
+  bool ReadChunk(void* address, void* buffer, std::size_t len) const noexcept
+  {
+    SIZE_T bytes_read = 0;
+    return ::ReadProcessMemory(
+             process_->GetHandle(), address, buffer, len, &bytes_read) &&
+           bytes_read == len;
+  }
+
   // TODO: Support dumping and rebuilding modules which have had their headers
   // erased.
   void HandleModuleCandidate(std::uint8_t* p,
+                             ModuleCandidateType type,
+                             RegionMap const& regions,
                              ProcessLight& process_info,
                              winternl::PEB const& peb)
   {
-    auto const mz = Read<std::array<char, 2>>(*process_, p);
-    if (mz[0] != 'M' || mz[1] != 'Z')
+    if (type == ModuleCandidateType::kStrippedHeaders)
     {
-      return;
+      HADESMEM_DETAIL_TRACE_FORMAT_A(
+        "Found module candidate with erased DOS header. Base: [%p].", p);
+    }
+    else
+    {
+      HADESMEM_DETAIL_TRACE_FORMAT_A("Found module candidate. Base: [%p].", p);
     }
-
-    HADESMEM_DETAIL_TRACE_FORMAT_A("Found module candidate. Base: [%p].", p);
 
     // We potentially over-estimate module size here, but it's probably best
     // to over-estimate in the case where we have no headers, and in the
     // case where we do have headers it's not a big deal because we only use
     // this size to determine the maximum amount of data to read, not the
     // minimum.
-    auto const size = GetModuleRegionSize(*process_, p, true);
+    auto const size = GetModuleRegionSize(regions, p, true);
     if (size > static_cast<DWORD>(-1))
     {
       HADESMEM_DETAIL_TRACE_FORMAT_A(
@@ -497,7 +723,8 @@ private:
     }
   }
 
-  void BuildExportMap(ProcessLight& process_info)
+  void BuildExportMap(ProcessLight const& process_info,
+                      std::map<void*, std::vector<ExportLight>>& export_map)
   {
     if (!(flags_ & DumpFlags::kReconstructImports))
     {
@@ -650,7 +877,7 @@ private:
 
         HADESMEM_DETAIL_TRACE_A("Adding to export map.");
 
-        process_info.export_map_[va].emplace_back(ExportLight{
+        export_map[va].emplace_back(ExportLight{
           resolved_module, e.ByName(), e.GetName(), e.GetProcedureNumber()});
       }
     }
@@ -658,14 +885,15 @@ private:
     HADESMEM_DETAIL_TRACE_FORMAT_A("Num Modules: [%Iu].",
                                    process_info.modules_.size());
     HADESMEM_DETAIL_TRACE_FORMAT_A("Num Export VAs: [%Iu].",
-                                   process_info.export_map_.size());
+                                   export_map.size());
   }
 
-  void SortExportMapModules(ProcessLight& process_info)
+  void SortExportMapModules(
+    std::map<void*, std::vector<ExportLight>>& export_map)
   {
     HADESMEM_DETAIL_TRACE_A("Sorting export map modules by priority.");
 
-    for (auto& i : process_info.export_map_)
+    for (auto& i : export_map)
     {
       auto& modules = i.second;
       std::sort(std::begin(modules),
@@ -676,11 +904,40 @@ private:
     }
   }
 
+  // The memory scan does a lookup for every 4 bytes of the image, so the map
+  // is only used while building and is then flattened into an index.
+  void BuildExportIndex(ProcessLight& process_info,
+                        std::map<void*, std::vector<ExportLight>>& export_map)
+  {
+    HADESMEM_DETAIL_TRACE_A("Building export index.");
+
+    std::vector<std::uint64_t> vas;
+    vas.reserve(export_map.size());
+    process_info.exports_.reserve(export_map.size());
+    for (auto& i : export_map)
+    {
+      vas.push_back(reinterpret_cast<std::uintptr_t>(i.first));
+      process_info.exports_.emplace_back(std::move(i.second));
+    }
+
+    // Map keys are unique and in address order, so the index doesn't
+    // reorder anything.
+    process_info.export_index_ = ExportIndex{std::move(vas)};
+    HADESMEM_DETAIL_ASSERT(process_info.export_index_.size() ==
+                           process_info.exports_.size());
+  }
+
   ProcessLight MakeProcessLight()
   {
     auto process_info = BuildModuleList();
-    BuildExportMap(process_info);
-    SortExportMapModules(process_info);
+    std::map<void*, std::vector<ExportLight>> export_map;
+    BuildExportMap(process_info, export_map);
+    SortExportMapModules(export_map);
+    BuildExportIndex(process_info, export_map);
+    if (!!(flags_ & DumpFlags::kReconstructImports))
+    {
+      process_info.redirected_import_ranges_ = GetRedirectedImportRanges();
+    }
     return process_info;
   }
 
@@ -691,95 +948,131 @@ private:
     DWORD virtual_size_;
   };
 
+  // A rebuilt module, ready to be written out.
+  struct ModuleDump
+  {
+    // Headers and section data, allocated once at the planned size.
+    std::vector<std::uint8_t> raw_new_;
+    // Reconstructed import directories (if any). Anything in raw_new_ past
+    // where they start is dropped.
+    std::vector<char> import_dirs_;
+    DWORD import_dirs_offset_;
+    DWORD file_size_;
+  };
+
+  static PeImageWriter MakeDumpWriter(ModuleDump const& dump)
+  {
+    PeImageWriter writer;
+    writer.AddPart(0, dump.raw_new_.data(), dump.raw_new_.size());
+    if (dump.import_dirs_offset_)
+    {
+      writer.AddPart(dump.import_dirs_offset_,
+                     dump.import_dirs_.data(),
+                     dump.import_dirs_.size());
+    }
+    writer.SetFileSize(dump.file_size_);
+    return writer;
+  }
+
+  // TODO: Do some validation here based on memory layout?
+  // TODO: Ensure all the crazy scenarios like overlapping virtual sections,
+  // bogus header sizes and pointers, etc. all work.
+  // TODO: Validate section virtual sizes against the VA region sizes?
+  // TODO: Automatically align sections? (e.g. Bump section virtual size
+  // from 0x400 to 0x1000).
+  PeLayout PlanLayout(Process const& local_process,
+                      PeFile const& pe_file_headers,
+                      NtHeaders const& nt_headers,
+                      std::size_t image_size)
+  {
+    HADESMEM_DETAIL_TRACE_A("Planning file layout.");
+
+    std::vector<PeLayoutSectionIn> sections_in;
+    SectionList const sections(local_process, pe_file_headers);
+    for (auto const& section : sections)
+    {
+      sections_in.push_back(
+        PeLayoutSectionIn{section.GetVirtualAddress(),
+                          section.GetVirtualSize(),
+                          section.GetSizeOfRawData(),
+                          section.GetPointerToRawData()});
+    }
+
+    auto layout = PlanPeLayout(nt_headers.GetSizeOfHeaders(),
+                               nt_headers.GetFileAlignment(),
+                               nt_headers.GetSectionAlignment(),
+                               image_size,
+                               sections_in);
+
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Planned file size: [%I64X].",
+                                   layout.file_size);
+
+    return layout;
+  }
+
+  // raw_new must already be the planned size.
   std::vector<SectionData> CopySectionData(Process const& local_process,
                                            PeFile const& pe_file_headers,
                                            NtHeaders const& nt_headers,
+                                           PeLayout const& layout,
                                            std::vector<std::uint8_t>& raw_new,
                                            std::vector<std::uint8_t> const& raw)
   {
     HADESMEM_DETAIL_TRACE_A("Copying section data.");
 
+    HADESMEM_DETAIL_ASSERT(raw_new.size() == layout.file_size);
+
     std::vector<SectionData> section_datas;
 
     SectionList const sections(local_process, pe_file_headers);
+    std::size_t n = 0;
     for (auto const& section : sections)
     {
+      auto const& planned = layout.sections[n++];
+
       HADESMEM_DETAIL_TRACE_FORMAT_A(
         "VirtualAddress: [%08lX]. PointerToRawData: [%08lX].",
         section.GetVirtualAddress(),
         section.GetPointerToRawData());
 
-      // TODO: Do some validation here based on memory layout?
-      // TODO: Ensure all the crazy scenarios like overlapping virtual sections,
-      // bogus header sizes and pointers, etc. all work.
-      // TODO: When rounding up from raw to virtual, we should check for
-      // zero-fill at the end and then drop as much data as possible in order to
-      // reduce file size.
-      // TODO: Validate section virtual sizes against the VA region sizes?
-      // TODO: Automatically align sections? (e.g. Bump section virtual size
-      // from 0x400 to 0x1000).
-      // TODO: It's not always correct to use VirtualSize here. It's great for
-      // analysis reasons, but if you want runnable dumps some programs might
-      // rely on that virtual space to be zero'd out at runtime.
+      // The headers always get the full size, even if there's no data.
       auto const section_size = static_cast<DWORD>(RoundUp(
         (std::max)(section.GetVirtualSize(), section.GetSizeOfRawData()),
         nt_headers.GetSectionAlignment()));
-      auto const ptr_raw_data_new_tmp =
-        section.GetPointerToRawData() < raw_new.size()
-          ? static_cast<DWORD>(
-              RoundUp(raw_new.size(), nt_headers.GetFileAlignment()))
-          : section.GetPointerToRawData();
-      auto const ptr_raw_data_new = static_cast<DWORD>(
-        RoundUp(ptr_raw_data_new_tmp, nt_headers.GetFileAlignment()));
 
       HADESMEM_DETAIL_TRACE_FORMAT_A(
         "New PointerToRawData: [%08lX]. New SizeOfRawData: [%08lX].",
-        ptr_raw_data_new,
+        planned.pointer_to_raw_data,
         section_size);
 
-      if (ptr_raw_data_new > raw_new.size())
-      {
-        raw_new.resize(ptr_raw_data_new);
-      }
-
       section_datas.emplace_back(
-        SectionData{ptr_raw_data_new, section_size, section_size});
+        SectionData{planned.pointer_to_raw_data, section_size, section_size});
 
-      if (section.GetVirtualAddress() >= raw.size())
+      if (!planned.file_size)
       {
         HADESMEM_DETAIL_TRACE_A("WARNING! Not writing any data for current "
                                 "section due to out-of-bounds VA.");
         continue;
       }
 
-      auto const raw_data = raw.data() + section.GetVirtualAddress();
-      auto const raw_data_end =
-        (std::min)(raw_data + section_size, raw.data() + raw.size());
-      if (raw_data_end != raw_data + section_size)
+      if (planned.copy_size != planned.file_size)
       {
         HADESMEM_DETAIL_TRACE_A("WARNING! Truncating read for current section "
                                 "due to out-of-bounds VA.");
       }
 
-      auto const new_size = raw_new.size() + section_size;
-      raw_new.reserve(new_size);
-      std::copy(raw_data, raw_data_end, std::back_inserter(raw_new));
-      raw_new.resize(new_size);
-
-      auto raw_section_size = section_size;
-      for (auto p = raw_new.data() + raw_new.size() - sizeof(std::uint32_t);
-           (p >
-            raw_new.data() + ptr_raw_data_new + section.GetSizeOfRawData()) &&
-           *reinterpret_cast<std::uint32_t*>(p);
-           p -= sizeof(std::uint32_t))
-      {
-        raw_section_size -= sizeof(std::uint32_t);
-      }
-
-      raw_section_size = static_cast<DWORD>(
-        RoundUp(raw_section_size, nt_headers.GetFileAlignment()));
-
-      section_datas.back().raw_size_ = raw_section_size;
+      auto const section_data = raw_new.data() + planned.pointer_to_raw_data;
+      std::copy(raw.data() + section.GetVirtualAddress(),
+                raw.data() + section.GetVirtualAddress() + planned.copy_size,
+                section_data);
+
+      // TODO: It would be nice to also drop the zero fill from the file
+      // itself, not just from SizeOfRawData.
+      section_datas.back().raw_size_ = GetTrimmedRawSize(
+        section_data,
+        planned.file_size,
+        (std::min)(section.GetSizeOfRawData(), planned.file_size),
+        nt_headers.GetFileAlignment());
     }
 
     return section_datas;
@@ -855,16 +1148,69 @@ private:
     return nt_headers_new;
   }
 
+  // Ranges of memory which a redirected import stub could be in. Anything
+  // else can be rejected in the scan without trying the resolvers.
+  AddressRangeSet GetRedirectedImportRanges() const
+  {
+    AddressRangeSet ranges;
+    RegionMap const regions{*process_};
+    for (auto const& mbi : regions)
+    {
+      if (CanExecute(mbi))
+      {
+        auto const region_beg =
+          reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+        ranges.Add(region_beg, region_beg + mbi.RegionSize);
+      }
+    }
+    ranges.Finalize();
+    return ranges;
+  }
+
   std::map<DWORD, ExportLight const*>
     DoMemoryScan(std::vector<std::uint8_t>& raw_new,
-                 std::map<void*, std::vector<ExportLight>> const& export_map,
+                 ProcessLight const& process_info,
                  void* base,
                  std::size_t pe_size,
                  Process const& local_process,
-                 PeFile const& pe_file_new)
+                 PeFile const& pe_file_new,
+                 std::size_t scan_threads)
   {
     HADESMEM_DETAIL_TRACE_A("Performing memory scan.");
 
+    auto const& export_index = process_info.export_index_;
+    auto const& exports = process_info.exports_;
+
+    auto const read_va = [&](std::size_t offset) -> void* {
+      void* va = nullptr;
+      if (offset + sizeof(va) <= raw_new.size())
+      {
+        std::memcpy(&va, raw_new.data() + offset, sizeof(va));
+      }
+      return va;
+    };
+
+    // The scan itself only finds candidates (split across threads by image
+    // slice). Deciding which ones to fix up depends on the previous fixup, so
+    // that part is done in order afterwards.
+    // Without any resolvers there's no point looking for stubs.
+    AddressRangeSet const no_ranges;
+    auto const& redirected_ranges = import_resolvers_.empty()
+                                      ? no_ranges
+                                      : process_info.redirected_import_ranges_;
+    auto const hits =
+      ScanForExports(raw_new.data(),
+                     raw_new.size(),
+                     sizeof(void*),
+                     export_index,
+                     redirected_ranges,
+                     scan_threads);
+
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Num candidates: [%Iu].", hits.size());
+
+    auto const redirected = ResolveRedirectedImports(
+      raw_new, hits, process_info.redirected_import_ranges_);
+
     // TODO: Support other scanning algorithms.
     // TODO: Be smarter about deciding which imports are legitimate and which
     // are false positives.
@@ -873,20 +1219,39 @@ private:
     // TODO: Check section characteristics as an additional heuristic?
     std::map<DWORD, ExportLight const*> fixup_map;
     bool fixup_adjacent = false;
-    for (auto p = raw_new.data(); p < raw_new.data() + raw_new.size() - 3;
-         p += 4)
+    std::size_t next_offset = 0;
+    for (auto const& hit : hits)
     {
-      auto const offset =
-        static_cast<DWORD>(reinterpret_cast<std::uintptr_t>(p) -
-                           reinterpret_cast<std::uintptr_t>(raw_new.data()));
+      // Overlaps the previous fixup.
+      if (hit.offset < next_offset)
+      {
+        continue;
+      }
 
-      auto va = *reinterpret_cast<void**>(p);
-      auto i = export_map.find(va);
-      if (i == std::end(export_map))
+      // Anything we skipped over wasn't an import.
+      if (hit.offset != next_offset)
+      {
+        fixup_adjacent = false;
+      }
+      next_offset = hit.offset + 4;
+
+      auto const offset = static_cast<DWORD>(hit.offset);
+
+      auto va = read_va(hit.offset);
+      auto i = hit.index;
+      if (i == ExportIndex::kNotFound)
       {
         // TODO: Make sure this doesn't overlap with any previous fixups,
         // redirected or otherwise?
-        auto const resolved_va = ResolveRedirectedImport(va);
+        std::uint64_t const va_int = reinterpret_cast<std::uintptr_t>(va);
+        auto const redirected_iter =
+          std::lower_bound(std::begin(redirected),
+                           std::end(redirected),
+                           std::make_pair(va_int, std::uint64_t{}));
+        HADESMEM_DETAIL_ASSERT(redirected_iter != std::end(redirected) &&
+                               redirected_iter->first == va_int);
+        auto const resolved_va = reinterpret_cast<void*>(
+          static_cast<std::uintptr_t>(redirected_iter->second));
         if (!resolved_va)
         {
           fixup_adjacent = false;
@@ -898,8 +1263,8 @@ private:
           va,
           resolved_va);
 
-        i = export_map.find(resolved_va);
-        if (i == std::end(export_map))
+        i = export_index.Find(reinterpret_cast<std::uintptr_t>(resolved_va));
+        if (i == ExportIndex::kNotFound)
         {
           HADESMEM_DETAIL_TRACE_A("WARNING! Successfully resolved redirected "
                                   "import, but then failed to match it to an "
@@ -918,8 +1283,10 @@ private:
         continue;
       }
 
+      auto const& va_exports = exports[i];
+
       {
-        auto const e = i->second.back();
+        auto const e = va_exports.back();
         HADESMEM_DETAIL_TRACE_FORMAT_W(
           L"Found matching VA. Logging last entry only. Offset: [%08X]. VA: "
           L"[%p]. Module: [%s]. Name: [%hs]. Ordinal: [%lu]. ByName: [%d].",
@@ -942,9 +1309,9 @@ private:
       // TODO: Add a config flag to control this behavior.
       if (!(reinterpret_cast<std::uintptr_t>(va) % 0x1000) && !fixup_adjacent)
       {
-        auto const next_va = *reinterpret_cast<void**>(p + 8);
-        auto const next_e = export_map.find(next_va);
-        if (next_e == std::end(export_map))
+        auto const next_va = read_va(hit.offset + 8);
+        if (export_index.Find(reinterpret_cast<std::uintptr_t>(next_va)) ==
+            ExportIndex::kNotFound)
         {
           HADESMEM_DETAIL_TRACE_A("WARNING! Skipping page aligned VA.");
           continue;
@@ -955,7 +1322,7 @@ private:
 
       // Modules are sorted by priority. Lowest to highest.
       auto& fixup_export = fixup_map[rva];
-      fixup_export = &i->second.back();
+      fixup_export = &va_exports.back();
 
       // Try and match to use the same module as the previous adjacent fixup
       // if possible (there could be a different match because of forwarded
@@ -972,7 +1339,7 @@ private:
           : prev_fixup_iter->second->module_->pe_file_.GetBase();
       if (prev_module_base)
       {
-        for (auto& e : i->second)
+        for (auto& e : va_exports)
         {
           if (fixup_export != &e &&
               e.module_->pe_file_.GetBase() == prev_module_base)
@@ -990,7 +1357,7 @@ private:
       }
 
       fixup_adjacent = true;
-      p += sizeof(void*) - 4;
+      next_offset = hit.offset + sizeof(void*);
     }
 
     if (fixup_map.empty())
@@ -1003,17 +1370,13 @@ private:
 
   void CopyHeaders(std::vector<std::uint8_t>& raw_new,
                    NtHeaders const& nt_headers,
-                   std::size_t pe_size,
                    bool has_disk_headers,
                    std::vector<std::uint8_t> const& raw,
                    std::vector<char> const& pe_file_disk_data)
   {
     HADESMEM_DETAIL_TRACE_A("Copying headers.");
 
-    // TODO: Fix this hack properly. We reserve plenty of size in the buffer so
-    // when we open the PE file object later pointing to the buffer, if we add
-    // more data to the buffer it won't be reallocated.
-    raw_new.reserve(pe_size * 5);
+    HADESMEM_DETAIL_ASSERT(raw_new.size() >= nt_headers.GetSizeOfHeaders());
     auto const headers_buf_beg =
       has_disk_headers
         ? reinterpret_cast<std::uint8_t const*>(pe_file_disk_data.data())
@@ -1070,22 +1433,46 @@ private:
 
   void DumpSingleModule(void* base, ModuleLight const* m = nullptr)
   {
-    auto const& process_info = process_light_;
-    auto const& modules = process_info.modules_;
-    auto const& export_map = process_info.export_map_;
+    if (!m)
+    {
+      auto const& modules = process_light_.modules_;
+      auto const module_iter = std::find_if(
+        std::begin(modules), std::end(modules), [&](ModuleLight const& m) {
+          return m.pe_file_.GetBase() == base;
+        });
 
-    auto const module_iter = std::find_if(
-      std::begin(modules), std::end(modules), [&](ModuleLight const& m) {
-        return m.pe_file_.GetBase() == base;
-      });
+      if (module_iter == std::end(modules))
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error() << ErrorString("Failed to find target module."));
+      }
 
-    if (module_iter == std::end(modules))
-    {
-      HADESMEM_DETAIL_THROW_EXCEPTION(
-        Error() << ErrorString("Failed to find target module."));
+      m = &*module_iter;
     }
 
-    m = &*module_iter;
+    auto const dump = BuildModuleDump(
+      base, *m, (std::max)(1U, std::thread::hardware_concurrency()));
+    WriteDumpFile(
+      *process_, GetDumpFileName(base, *m), MakeDumpWriter(dump), L"pe_dumps");
+  }
+
+  // TODO: Write to a new sub-directory each time (e.g.
+  // pe_dumps\foo.exe\1234\1).
+  static std::wstring GetDumpFileName(void* base, ModuleLight const& m)
+  {
+    return PtrToHexString<wchar_t>(base) + L"_" + m.name_;
+  }
+
+  // Only reads from the target and the (already built) process info, so is
+  // safe to call for multiple modules at once. The import scan is split
+  // across scan_threads threads, which should be 1 when the caller is already
+  // running one module per thread.
+  ModuleDump BuildModuleDump(void* base,
+                             ModuleLight const& module,
+                             std::size_t scan_threads)
+  {
+    auto const& process_info = process_light_;
+    ModuleLight const* const m = &module;
 
     auto const pe_size = m->pe_file_.GetSize();
 
@@ -1121,22 +1508,29 @@ private:
     PeFile const& pe_file_headers = *pe_file_headers_ptr;
     NtHeaders nt_headers(local_process, pe_file_headers);
 
-    std::vector<std::uint8_t> raw_new(nt_headers.GetSizeOfHeaders());
-    CopyHeaders(
-      raw_new, nt_headers, pe_size, has_disk_headers, raw, pe_file_disk_data);
+    // Everything but the reconstructed imports has a known size, so lay it
+    // out first and allocate the buffer once. PeFile objects point into it,
+    // so it must not be reallocated after this.
+    auto const layout =
+      PlanLayout(local_process, pe_file_headers, nt_headers, raw.size());
+    const auto dword_max = (std::numeric_limits<DWORD>::max)();
+    HADESMEM_DETAIL_ASSERT(layout.file_size < dword_max);
+    ModuleDump dump{
+      std::vector<std::uint8_t>(static_cast<std::size_t>(layout.file_size)),
+      std::vector<char>(),
+      0,
+      static_cast<DWORD>(layout.file_size)};
+    auto& raw_new = dump.raw_new_;
 
-    auto const section_datas =
-      CopySectionData(local_process, pe_file_headers, nt_headers, raw_new, raw);
-    raw_new.reserve(raw_new.size() * 2);
+    CopyHeaders(raw_new, nt_headers, has_disk_headers, raw, pe_file_disk_data);
+
+    auto const section_datas = CopySectionData(
+      local_process, pe_file_headers, nt_headers, layout, raw_new, raw);
 
-    const auto dword_max = (std::numeric_limits<DWORD>::max)();
-    HADESMEM_DETAIL_ASSERT(raw_new.size() < dword_max);
-    HADESMEM_DETAIL_ASSERT(raw_new.capacity() < dword_max);
     PeFile const pe_file_new(local_process,
                              raw_new.data(),
                              PeFileType::kData,
                              static_cast<DWORD>(raw_new.size()));
-    auto const raw_new_capacity = raw_new.capacity();
 
     std::unique_ptr<PeFile> pe_file_none;
     auto nt_headers_new =
@@ -1165,15 +1559,19 @@ private:
 
       auto& last_section = sections_vec[sections_vec.size() - 1];
 
-      auto const old_size = last_section.GetSizeOfRawData();
       auto const old_section_end =
         can_add_new_section
           ? 0
           : static_cast<DWORD>(RoundUp(last_section.GetVirtualSize(),
                                        nt_headers_new.GetSectionAlignment()));
 
-      auto const fixup_map = DoMemoryScan(
-        raw_new, export_map, base, pe_size, local_process, pe_file_new);
+      auto const fixup_map = DoMemoryScan(raw_new,
+                                          process_info,
+                                          base,
+                                          pe_size,
+                                          local_process,
+                                          pe_file_new,
+                                          scan_threads);
 
       auto coalesced_fixup_map = CoalesceImportDescriptors(fixup_map);
 
@@ -1211,16 +1609,11 @@ private:
                             import_directories_buf,
                             descriptors_cur);
 
-      auto const new_size = UpdateLastSectionSize(
+      UpdateLastSectionSize(
         import_directories_buf, nt_headers_new, old_section_end, last_section);
 
-      WriteImportDirectories(raw_new,
-                             last_section,
-                             old_section_end,
-                             raw_new_capacity,
-                             new_size,
-                             old_size,
-                             import_directories_buf);
+      WriteImportDirectories(
+        dump, last_section, old_section_end, import_directories_buf);
 
       // TODO: Before we were fixing section sizes correctly above, the last
       // section data was truncated and we didn't appear to detect it properly
@@ -1236,55 +1629,35 @@ private:
       FixImports(local_process, pe_file, pe_file_new);
     }
 
-    // TODO: Write to a new sub-directory each time (e.g.
-    // pe_dumps\foo.exe\1234\1).
-    WriteDumpFile(*process_,
-                  PtrToHexString<wchar_t>(base) + L"_" + m->name_,
-                  raw_new.data(),
-                  raw_new.size(),
-                  L"pe_dumps");
+    return dump;
   }
 
-  void WriteImportDirectories(std::vector<std::uint8_t>& raw_new,
+  // The import directories aren't copied into raw_new, they're written
+  // after it as a separate part.
+  void WriteImportDirectories(ModuleDump& dump,
                               Section const& last_section,
                               DWORD old_section_end,
-                              std::size_t raw_new_capacity,
-                              DWORD new_size,
-                              DWORD old_size,
-                              std::vector<char> const& import_directories_buf)
+                              std::vector<char>& import_directories_buf)
   {
     HADESMEM_DETAIL_TRACE_A("Adding new import directories to file.");
 
     auto const prev_virt_end =
       last_section.GetPointerToRawData() + old_section_end;
-    HADESMEM_DETAIL_TRACE_FORMAT_A("Expanding last section to its previous "
-                                   "virtual size. New End: [0x%lX].",
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Truncating or expanding last section to "
+                                   "its previous virtual size. New End: "
+                                   "[0x%lX].",
                                    prev_virt_end);
-    raw_new.resize(prev_virt_end);
-
-    (void)raw_new_capacity;
-    HADESMEM_DETAIL_ASSERT(raw_new.capacity() == raw_new_capacity);
-
-    auto const new_end = raw_new.size() + (new_size - old_size);
-    HADESMEM_DETAIL_TRACE_FORMAT_A(
-      "Appending new data after old virtual end. New End: [0x%IX].", new_end);
-    raw_new.reserve(new_end);
-
-    HADESMEM_DETAIL_ASSERT(raw_new.capacity() == raw_new_capacity);
-
-    std::copy(std::begin(import_directories_buf),
-              std::end(import_directories_buf),
-              std::back_inserter(raw_new));
-
-    HADESMEM_DETAIL_ASSERT(raw_new.capacity() == raw_new_capacity);
 
     auto const new_raw_size =
       last_section.GetPointerToRawData() + last_section.GetSizeOfRawData();
     HADESMEM_DETAIL_TRACE_FORMAT_A(
       "Expanding to section aligned size. New End: [0x%lX].", new_raw_size);
-    raw_new.resize(new_raw_size);
+    HADESMEM_DETAIL_ASSERT(prev_virt_end + import_directories_buf.size() <=
+                           new_raw_size);
 
-    HADESMEM_DETAIL_ASSERT(raw_new.capacity() == raw_new_capacity);
+    dump.import_dirs_ = std::move(import_directories_buf);
+    dump.import_dirs_offset_ = prev_virt_end;
+    dump.file_size_ = new_raw_size;
   }
 
   std::map<DWORD, std::vector<ExportLight const*>> CoalesceImportDescriptors(
@@ -1799,89 +2172,163 @@ private:
   // TODO: Add optional OEP scan. Also make it optional whether to adjust the
   // OEP in the headers, or simply add the OEP as a new custom export.
   // TODO: Detect and resolve apphelp shims?
+  // Modules are independent once the process info is built, so they are
+  // dumped in parallel, biggest first so the longest one isn't left until
+  // last. Finished images are handed to a single writer thread so workers
+  // never wait on the disk. A module which fails doesn't stop the others;
+  // the first error (in module order) is rethrown once everything is done,
+  // or failing that the first error from the writer.
   inline void DumpAllModules()
   {
     auto const& modules = process_light_.modules_;
+    if (modules.empty())
+    {
+      return;
+    }
+
+    std::vector<ModuleLight const*> order;
     for (auto const& m : modules)
     {
-      DumpSingleModule(m.pe_file_.GetBase(), &m);
+      order.push_back(&m);
     }
-  }
+    std::stable_sort(std::begin(order),
+                     std::end(order),
+                     [](ModuleLight const* lhs, ModuleLight const* rhs) {
+                       return lhs->pe_file_.GetSize() > rhs->pe_file_.GetSize();
+                     });
+
+    std::size_t const kMaxPendingWriteBytes = 0x10000000;
+    AsyncWriter writer{kMaxPendingWriteBytes};
+    std::vector<std::exception_ptr> errors(modules.size());
 
-  // Overwatch redirects all entries in the IAT to a dynamically generated stub
-  // which performs some rudimentary pointer arithmetic to mask the API being
-  // called.
-  // 0:000> u 00007FF7170224F0
-  // Overwatch+0x1724f0:
-  // 00007ff7`170224f0 488d0d6de22f01  lea     rcx,[Overwatch+0x1470764
-  // (00007ff7`18320764)] ; "ntdll.dll"
-  // 00007ff7`170224f7 ff15cbecef00    call    qword ptr [Overwatch+0x10711c8
-  // (00007ff7`17f211c8)]
-  // 0:000> u poi(00007ff7`17f211c8)
-  // 00000223`c86f00fc 48b8151334b7fe7f0000 mov rax,offset
-  // kernel32!FindFirstVolumeW+0x195 (00007ffe`b7341315)
-  // 00000223`c86f0106 48057b390000    add     rax,397Bh
-  // 00000223`c86f010c ffe0            jmp     rax
-  // 0:000> ln 0x00007ffe`b7341315 + 0x3970
-  // (00007ffe`b7344c90)   kernel32!GetModuleHandleAStub
-  // NOTE: Doesn't work since the last patch, and I won't be updating it for
-  // legal reasons. Not going to remove it though because whilst it's not useful
-  // for its original purpose it still serves as an example of how to extend the
-  // import redirection resolution code.
-  // TODO: This should be a plugin/extension/whatever.
-  // TODO: Further perf improvements by using the buffer and memory region info
-  // we already have in the memory scanning function, rather than duplicating
-  // work here (and in other 'extensions').
-  void* ResolveRedirectedImportForOverwatch(void* va) const
-  {
-#if defined(HADESMEM_DETAIL_ARCH_X64)
-    try
     {
-      auto const stub = static_cast<std::uint8_t*>(va);
-      if (!CanExecute(*process_, stub))
+      std::size_t const num_threads = (std::min)(
+        modules.size(),
+        static_cast<std::size_t>(
+          (std::max)(1U, std::thread::hardware_concurrency())));
+      ThreadPool pool{num_threads, 1};
+      for (auto const m : order)
       {
-        return nullptr;
+        auto const index = static_cast<std::size_t>(m - modules.data());
+        auto const task = [this, m, index, &writer, &errors]() {
+          try
+          {
+            void* const base = m->pe_file_.GetBase();
+            // The pool already has a thread per core, so a parallel scan
+            // inside each task would only oversubscribe the machine.
+            auto const dump =
+              std::make_shared<ModuleDump>(BuildModuleDump(base, *m, 1));
+            auto const file_name = GetDumpFileName(base, *m);
+            auto const process = process_;
+            writer.Queue(dump->raw_new_.size() + dump->import_dirs_.size(),
+                         [process, dump, file_name]() {
+                           WriteDumpFile(*process,
+                                         file_name,
+                                         MakeDumpWriter(*dump),
+                                         L"pe_dumps");
+                         });
+          }
+          catch (...)
+          {
+            HADESMEM_DETAIL_TRACE_FORMAT_W(
+              L"WARNING! Failed to dump module. Name: [%s].",
+              m->name_.c_str());
+            errors[index] = std::current_exception();
+          }
+        };
+
+        do
+        {
+          pool.WaitForSlot();
+        } while (!pool.QueueTask(task));
       }
 
-      const auto stub_buf = ReadVector<std::uint8_t>(*process_, stub, 0x11);
+      // Tasks still running when the queue drains are waited on when the pool
+      // is destroyed.
+      pool.WaitForEmpty();
+    }
 
-      // mov rax, imm64
-      if (stub_buf[0] != 0x48 || stub_buf[1] != 0xB8)
-      {
-        return nullptr;
-      }
+    std::exception_ptr write_error;
+    try
+    {
+      writer.Flush();
+    }
+    catch (...)
+    {
+      HADESMEM_DETAIL_TRACE_A("WARNING! Failed to write module dumps.");
+      write_error = std::current_exception();
+    }
 
-      // add rax, imm32
-      if (stub_buf[0xA] != 0x48 || stub_buf[0xB] != 0x05)
+    for (auto const& error : errors)
+    {
+      if (error)
       {
-        return nullptr;
+        std::rethrow_exception(error);
       }
+    }
+
+    if (write_error)
+    {
+      std::rethrow_exception(write_error);
+    }
+  }
 
-      // jmp rax
-      if (stub_buf[0x10] != 0xFF || stub_buf[0x11] != 0xE0)
+  static ImportResolverChain MakeDefaultImportResolvers()
+  {
+    ImportResolverChain resolvers;
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+    resolvers.Add(std::make_unique<OverwatchImportResolver>());
+#endif // #if defined(HADESMEM_DETAIL_ARCH_X64)
+    return resolvers;
+  }
+
+  // Resolves every candidate which didn't match an export in one go, reading
+  // the stubs through a block cache instead of querying and reading each one
+  // separately. Returns (va, resolved va) sorted by va, with a resolved va of
+  // zero where nothing matched.
+  std::vector<std::pair<std::uint64_t, std::uint64_t>>
+    ResolveRedirectedImports(std::vector<std::uint8_t> const& raw_new,
+                             std::vector<ExportScanHit> const& hits,
+                             AddressRangeSet const& ranges) const
+  {
+    std::vector<std::uint64_t> vas;
+    for (auto const& hit : hits)
+    {
+      if (hit.index == ExportIndex::kNotFound)
       {
-        return nullptr;
+        vas.push_back(
+          ReadScanValue(raw_new.data() + hit.offset, sizeof(void*)));
       }
+    }
+    std::sort(std::begin(vas), std::end(vas));
+    vas.erase(std::unique(std::begin(vas), std::end(vas)), std::end(vas));
+
+    BlockReadCache cache{
+      ranges, [&](std::uint64_t address, void* buffer, std::size_t len) {
+        SIZE_T bytes_read = 0;
+        return ::ReadProcessMemory(
+                 process_->GetHandle(),
+                 reinterpret_cast<void const*>(
+                   static_cast<std::uintptr_t>(address)),
+                 buffer,
+                 len,
+                 &bytes_read) &&
+               bytes_read == len;
+      }};
+    auto const resolved = import_resolvers_.ResolveBatch(vas, cache);
 
-      auto const o = *reinterpret_cast<std::uint8_t* const*>(&stub_buf[2]);
-      auto const n = *reinterpret_cast<std::uint32_t const*>(&stub_buf[0xc]);
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Redirected import candidates: [%Iu]. Reads: [%Iu].",
+      vas.size(),
+      cache.GetNumReads());
 
-      return o + n;
-    }
-    catch (...)
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> redirected;
+    redirected.reserve(vas.size());
+    for (std::size_t i = 0; i < vas.size(); ++i)
     {
-      return nullptr;
+      redirected.emplace_back(vas[i], resolved[i]);
     }
-#else // #if defined(HADESMEM_DETAIL_ARCH_X64)
-    (void)va;
-    return nullptr;
-#endif
-  }
-
-  void* ResolveRedirectedImport(void* va) const
-  {
-    // Just hardcode one for now. Needs proper plugin support.
-    return ResolveRedirectedImportForOverwatch(va);
+    return redirected;
   }
 
   Process const* process_{};
@@ -1889,7 +2336,10 @@ private:
   std::uint32_t flags_{};
   DWORD oep_{};
   ModuleLight const* m_{};
+  ImportResolverChain import_resolvers_;
 
+  // Must come before process_light_, which is built in the constructor.
+  ModuleScanStats module_scan_stats_;
   ProcessLight process_light_;
 };
 
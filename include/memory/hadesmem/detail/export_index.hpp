@@ -0,0 +1,342 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Lookup structures for the import reconstruction memory scan in PeDumper.
+// The scan looks at every 4 byte step of an image, and almost none of the
+// values it finds are export addresses, so the fast path is rejecting a value
+// without touching the export table at all: first against the range covered
+// by the exports, then against a bitmap of the pages containing an export.
+// Only values which get past both are looked up (binary search over a flat
+// sorted array).
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+// Sorted, merged set of [beg, end) address ranges.
+class AddressRangeSet
+{
+public:
+  void Add(std::uint64_t beg, std::uint64_t end)
+  {
+    HADESMEM_DETAIL_ASSERT(beg <= end);
+
+    if (beg != end)
+    {
+      ranges_.emplace_back(beg, end);
+      is_sorted_ = false;
+    }
+  }
+
+  // Must be called after adding ranges and before querying.
+  void Finalize()
+  {
+    if (is_sorted_)
+    {
+      return;
+    }
+
+    std::sort(std::begin(ranges_), std::end(ranges_));
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> merged;
+    for (auto const& range : ranges_)
+    {
+      if (!merged.empty() && range.first <= merged.back().second)
+      {
+        merged.back().second = (std::max)(merged.back().second, range.second);
+      }
+      else
+      {
+        merged.push_back(range);
+      }
+    }
+    ranges_.swap(merged);
+    is_sorted_ = true;
+  }
+
+  bool Contains(std::uint64_t address) const noexcept
+  {
+    return FindRange(address) != nullptr;
+  }
+
+  // The range containing the address, or null.
+  std::pair<std::uint64_t, std::uint64_t> const*
+    FindRange(std::uint64_t address) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(is_sorted_);
+
+    if (ranges_.empty() || address < ranges_.front().first ||
+        address >= ranges_.back().second)
+    {
+      return nullptr;
+    }
+
+    auto const iter = std::upper_bound(
+      std::begin(ranges_),
+      std::end(ranges_),
+      address,
+      [](std::uint64_t a, std::pair<std::uint64_t, std::uint64_t> const& r) {
+        return a < r.first;
+      });
+    if (iter == std::begin(ranges_) || address >= std::prev(iter)->second)
+    {
+      return nullptr;
+    }
+
+    return &*std::prev(iter);
+  }
+
+  std::size_t size() const noexcept
+  {
+    return ranges_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return ranges_.empty();
+  }
+
+private:
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges_;
+  bool is_sorted_{true};
+};
+
+class ExportIndex
+{
+public:
+  static std::size_t const kNotFound = static_cast<std::size_t>(-1);
+  static std::size_t const kPageShift = 12;
+
+  ExportIndex() = default;
+
+  // Duplicates are removed. The index of a VA is its position in the sorted
+  // list of unique VAs, so callers can keep per-VA data in a parallel array.
+  explicit ExportIndex(std::vector<std::uint64_t> vas) : vas_(std::move(vas))
+  {
+    std::sort(std::begin(vas_), std::end(vas_));
+    vas_.erase(std::unique(std::begin(vas_), std::end(vas_)), std::end(vas_));
+    if (vas_.empty())
+    {
+      return;
+    }
+
+    min_va_ = vas_.front();
+    max_va_ = vas_.back();
+
+    // Roughly 16 bits per distinct page keeps false positives low without
+    // the bitmap getting big enough to fall out of cache.
+    std::size_t num_pages = 1;
+    for (std::size_t i = 1; i < vas_.size(); ++i)
+    {
+      num_pages += (vas_[i] >> kPageShift) != (vas_[i - 1] >> kPageShift);
+    }
+    std::size_t num_bits = 4096;
+    while (num_bits < num_pages * 16)
+    {
+      num_bits *= 2;
+    }
+    page_mask_ = num_bits - 1;
+    page_bits_.resize(num_bits / 64);
+    for (auto const va : vas_)
+    {
+      std::size_t const bit = HashPage(va);
+      page_bits_[bit / 64] |= 1ULL << (bit % 64);
+    }
+  }
+
+  std::size_t size() const noexcept
+  {
+    return vas_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return vas_.empty();
+  }
+
+  std::uint64_t GetVa(std::size_t index) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(index < vas_.size());
+    return vas_[index];
+  }
+
+  // False means definitely not an export. True means maybe.
+  bool MayContain(std::uint64_t va) const noexcept
+  {
+    if (va < min_va_ || va > max_va_ || vas_.empty())
+    {
+      return false;
+    }
+
+    std::size_t const bit = HashPage(va);
+    return !!(page_bits_[bit / 64] & (1ULL << (bit % 64)));
+  }
+
+  std::size_t Find(std::uint64_t va) const noexcept
+  {
+    if (!MayContain(va))
+    {
+      return kNotFound;
+    }
+
+    auto const iter = std::lower_bound(std::begin(vas_), std::end(vas_), va);
+    if (iter == std::end(vas_) || *iter != va)
+    {
+      return kNotFound;
+    }
+
+    return static_cast<std::size_t>(std::distance(std::begin(vas_), iter));
+  }
+
+private:
+  std::size_t HashPage(std::uint64_t va) const noexcept
+  {
+    std::uint64_t const page = va >> kPageShift;
+    return static_cast<std::size_t>((page * 0x9E3779B97F4A7C15ULL) >> 32) &
+           page_mask_;
+  }
+
+  std::vector<std::uint64_t> vas_;
+  std::vector<std::uint64_t> page_bits_;
+  std::size_t page_mask_{};
+  std::uint64_t min_va_{};
+  std::uint64_t max_va_{};
+};
+
+struct ExportScanHit
+{
+  std::size_t offset;
+  // ExportIndex::kNotFound if the value only matched the extra ranges.
+  std::size_t index;
+};
+
+inline std::uint64_t ReadScanValue(std::uint8_t const* p,
+                                   std::size_t ptr_size) noexcept
+{
+  if (ptr_size == sizeof(std::uint64_t))
+  {
+    std::uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// Scans [beg, end) of the buffer in 4 byte steps for pointer sized values
+// which are either exports or fall inside one of the extra ranges (e.g.
+// executable memory which might contain a redirection stub). Values which
+// would run off the end of the buffer are not considered.
+inline void ScanForExportsSlice(std::uint8_t const* data,
+                                std::size_t size,
+                                std::size_t ptr_size,
+                                std::size_t beg,
+                                std::size_t end,
+                                ExportIndex const& index,
+                                AddressRangeSet const& extra_ranges,
+                                std::vector<ExportScanHit>& hits)
+{
+  HADESMEM_DETAIL_ASSERT(ptr_size == 4 || ptr_size == 8);
+  HADESMEM_DETAIL_ASSERT(beg % 4 == 0);
+
+  if (size < ptr_size)
+  {
+    return;
+  }
+
+  end = (std::min)(end, size - ptr_size + 1);
+  for (std::size_t offset = beg; offset < end; offset += 4)
+  {
+    std::uint64_t const value = ReadScanValue(data + offset, ptr_size);
+    // Almost everything is rejected here.
+    bool const maybe_export = index.MayContain(value);
+    bool const maybe_extra = !extra_ranges.empty() &&
+                             extra_ranges.Contains(value);
+    if (!maybe_export && !maybe_extra)
+    {
+      continue;
+    }
+
+    std::size_t const i =
+      maybe_export ? index.Find(value) : ExportIndex::kNotFound;
+    if (i != ExportIndex::kNotFound || maybe_extra)
+    {
+      hits.push_back(ExportScanHit{offset, i});
+    }
+  }
+}
+
+// Splits the buffer into one slice per thread. Hits are returned in offset
+// order regardless of the number of threads.
+inline std::vector<ExportScanHit>
+  ScanForExports(std::uint8_t const* data,
+                 std::size_t size,
+                 std::size_t ptr_size,
+                 ExportIndex const& index,
+                 AddressRangeSet const& extra_ranges,
+                 std::size_t num_threads)
+{
+  // Not worth spinning up threads for small images.
+  std::size_t const kMinSliceSize = 0x40000;
+  num_threads = (std::max)(
+    std::size_t{1}, (std::min)(num_threads, size / kMinSliceSize));
+
+  std::size_t const slice_size = ((size / num_threads) + 3) & ~std::size_t{3};
+  auto const scan_slice = [&](std::size_t i, std::vector<ExportScanHit>& out) {
+    std::size_t const beg = i * slice_size;
+    std::size_t const end =
+      (i + 1 == num_threads) ? size : (std::min)(size, beg + slice_size);
+    ScanForExportsSlice(
+      data, size, ptr_size, beg, end, index, extra_ranges, out);
+  };
+
+  std::vector<std::vector<ExportScanHit>> slice_hits(num_threads);
+  std::vector<std::thread> threads;
+  try
+  {
+    for (std::size_t i = 1; i < num_threads; ++i)
+    {
+      threads.emplace_back([&, i]() { scan_slice(i, slice_hits[i]); });
+    }
+
+    scan_slice(0, slice_hits[0]);
+  }
+  catch (...)
+  {
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+    throw;
+  }
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  std::vector<ExportScanHit> hits;
+  for (auto& slice : slice_hits)
+  {
+    hits.insert(std::end(hits), std::begin(slice), std::end(slice));
+  }
+  return hits;
+}
+}
+}
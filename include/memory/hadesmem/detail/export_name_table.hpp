@@ -0,0 +1,302 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Name and ordinal lookup for an export directory, decoded from a local copy
+// of the part of the image which holds it. ExportList (and so FindProcedure)
+// walks every export with a read per field until it finds a match, which is
+// fine for a single lookup but not for resolving a whole import table. This
+// decodes the directory once, and looks names up the same way the loader
+// does (the hint first, then a binary search).
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct ExportTarget
+{
+  // Zero if forwarded.
+  std::uint32_t rva;
+  // E.g. "NTDLL.RtlAllocateHeap" or "NTDLL.#123". Empty if not forwarded.
+  std::string forwarder;
+};
+
+struct ExportForwarder
+{
+  std::string module;
+  std::string function;
+  bool by_ordinal;
+  std::uint16_t ordinal;
+};
+
+// Same split as Export (at the last '.'). The module name is returned as is,
+// so it may be missing its extension.
+inline bool ParseExportForwarder(std::string const& forwarder,
+                                 ExportForwarder* parsed)
+{
+  HADESMEM_DETAIL_ASSERT(parsed != nullptr);
+
+  auto const split_pos = forwarder.rfind('.');
+  if (split_pos == std::string::npos || !split_pos ||
+      split_pos + 1 == forwarder.size())
+  {
+    return false;
+  }
+
+  parsed->module = forwarder.substr(0, split_pos);
+  parsed->function = forwarder.substr(split_pos + 1);
+  parsed->by_ordinal = parsed->function[0] == '#';
+  parsed->ordinal = 0;
+  if (parsed->by_ordinal)
+  {
+    if (parsed->function.size() < 2 || parsed->function.size() > 6)
+    {
+      return false;
+    }
+
+    std::uint32_t ordinal = 0;
+    for (std::size_t i = 1; i < parsed->function.size(); ++i)
+    {
+      char const c = parsed->function[i];
+      if (c < '0' || c > '9')
+      {
+        return false;
+      }
+      ordinal = ordinal * 10 + static_cast<std::uint32_t>(c - '0');
+    }
+    if (ordinal > 0xFFFF)
+    {
+      return false;
+    }
+    parsed->ordinal = static_cast<std::uint16_t>(ordinal);
+  }
+
+  return true;
+}
+
+class ExportNameTable
+{
+public:
+  // Layout of IMAGE_EXPORT_DIRECTORY.
+  static std::size_t const kDirSize = 40;
+
+  ExportNameTable() = default;
+
+  // The data holds [base_rva, base_rva + size) of the image. Returns false
+  // (and leaves the table empty) if anything the directory refers to is
+  // outside of that. That's not necessarily an error, it may just mean a
+  // bigger range has to be read.
+  bool Parse(std::uint8_t const* data,
+             std::uint32_t base_rva,
+             std::size_t size,
+             std::uint32_t dir_rva,
+             std::uint32_t dir_size)
+  {
+    *this = ExportNameTable{};
+
+    auto const get = [&](std::uint64_t rva, std::uint64_t len) {
+      return rva >= base_rva && rva - base_rva <= size &&
+                 len <= size - (rva - base_rva)
+               ? data + (rva - base_rva)
+               : nullptr;
+    };
+    auto const get_u32 = [](std::uint8_t const* p) {
+      std::uint32_t value;
+      std::memcpy(&value, p, sizeof(value));
+      return value;
+    };
+    auto const get_string = [&](std::uint32_t rva, std::string* s) {
+      auto const beg = get(rva, 0);
+      if (!beg)
+      {
+        return false;
+      }
+      auto const end = data + size;
+      auto const terminator = std::find(beg, end, std::uint8_t{0});
+      if (terminator == end)
+      {
+        return false;
+      }
+      s->assign(reinterpret_cast<char const*>(beg),
+                reinterpret_cast<char const*>(terminator));
+      return true;
+    };
+
+    auto const dir = get(dir_rva, kDirSize);
+    if (!dir)
+    {
+      return false;
+    }
+
+    std::uint32_t const ordinal_base = get_u32(dir + 16);
+    std::uint32_t const num_functions = get_u32(dir + 20);
+    std::uint32_t const num_names = get_u32(dir + 24);
+    auto const functions =
+      get(get_u32(dir + 28), static_cast<std::uint64_t>(num_functions) * 4);
+    auto const names =
+      get(get_u32(dir + 32), static_cast<std::uint64_t>(num_names) * 4);
+    auto const name_ordinals =
+      get(get_u32(dir + 36), static_cast<std::uint64_t>(num_names) * 2);
+    if ((num_functions && !functions) ||
+        (num_names && (!names || !name_ordinals)))
+    {
+      return false;
+    }
+
+    ExportNameTable table;
+    table.ordinal_base_ = ordinal_base;
+    table.functions_.reserve(num_functions);
+    for (std::uint32_t i = 0; i < num_functions; ++i)
+    {
+      std::uint32_t const rva = get_u32(functions + i * 4);
+      table.functions_.push_back(rva);
+      if (rva >= dir_rva && rva - dir_rva < dir_size)
+      {
+        std::string forwarder;
+        if (!get_string(rva, &forwarder))
+        {
+          return false;
+        }
+        table.forwarders_.emplace_back(i, std::move(forwarder));
+      }
+    }
+
+    table.names_.reserve(num_names);
+    table.name_ordinals_.reserve(num_names);
+    for (std::uint32_t i = 0; i < num_names; ++i)
+    {
+      std::string name;
+      if (!get_string(get_u32(names + i * 4), &name))
+      {
+        return false;
+      }
+      std::uint16_t ordinal;
+      std::memcpy(&ordinal, name_ordinals + i * 2, sizeof(ordinal));
+      table.names_.push_back(std::move(name));
+      table.name_ordinals_.push_back(ordinal);
+    }
+
+    // The linker emits names in sorted order, but nothing checks that.
+    table.sorted_.resize(num_names);
+    for (std::uint32_t i = 0; i < num_names; ++i)
+    {
+      table.sorted_[i] = i;
+    }
+    std::stable_sort(std::begin(table.sorted_),
+                     std::end(table.sorted_),
+                     [&](std::uint32_t lhs, std::uint32_t rhs) {
+                       return table.names_[lhs] < table.names_[rhs];
+                     });
+
+    *this = std::move(table);
+    return true;
+  }
+
+  std::uint32_t GetOrdinalBase() const noexcept
+  {
+    return ordinal_base_;
+  }
+
+  std::size_t GetNumFunctions() const noexcept
+  {
+    return functions_.size();
+  }
+
+  std::size_t GetNumNames() const noexcept
+  {
+    return names_.size();
+  }
+
+  // The hint is the index into the name table the importer expects the name
+  // to be at. It's only ever used as a shortcut, so it can be anything.
+  bool FindByName(std::string const& name,
+                  std::uint16_t hint,
+                  ExportTarget* target) const
+  {
+    HADESMEM_DETAIL_ASSERT(target != nullptr);
+
+    if (hint < names_.size() && names_[hint] == name)
+    {
+      return GetTarget(name_ordinals_[hint], target);
+    }
+
+    auto const iter = std::lower_bound(
+      std::begin(sorted_),
+      std::end(sorted_),
+      name,
+      [&](std::uint32_t i, std::string const& n) { return names_[i] < n; });
+    if (iter == std::end(sorted_) || names_[*iter] != name)
+    {
+      return false;
+    }
+
+    return GetTarget(name_ordinals_[*iter], target);
+  }
+
+  // The ordinal is biased (i.e. the same as in an import by ordinal).
+  bool FindByOrdinal(std::uint16_t ordinal, ExportTarget* target) const
+  {
+    HADESMEM_DETAIL_ASSERT(target != nullptr);
+
+    if (ordinal < ordinal_base_)
+    {
+      return false;
+    }
+
+    return GetTarget(ordinal - ordinal_base_, target);
+  }
+
+private:
+  bool GetTarget(std::size_t index, ExportTarget* target) const
+  {
+    if (index >= functions_.size() || !functions_[index])
+    {
+      return false;
+    }
+
+    auto const iter = std::lower_bound(
+      std::begin(forwarders_),
+      std::end(forwarders_),
+      index,
+      [](std::pair<std::size_t, std::string> const& f, std::size_t i) {
+        return f.first < i;
+      });
+    if (iter != std::end(forwarders_) && iter->first == index)
+    {
+      target->rva = 0;
+      target->forwarder = iter->second;
+    }
+    else
+    {
+      target->rva = functions_[index];
+      target->forwarder.clear();
+    }
+
+    return true;
+  }
+
+  std::uint32_t ordinal_base_{};
+  std::vector<std::uint32_t> functions_;
+  // Sorted by function index.
+  std::vector<std::pair<std::size_t, std::string>> forwarders_;
+  std::vector<std::string> names_;
+  std::vector<std::uint16_t> name_ordinals_;
+  // Indices into names_, sorted by name.
+  std::vector<std::uint32_t> sorted_;
+};
+}
+}
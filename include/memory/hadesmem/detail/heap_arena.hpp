@@ -0,0 +1,183 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+
+// Bookkeeping for RemoteHeap. Blocks are carved out of chunks of address space
+// handed to us by the caller and sorted into power of two size classes. All
+// the metadata lives here, nothing is ever read from or written to the chunks
+// themselves, so this works the same whether the chunks are in another process
+// or are just made up numbers in a test.
+
+namespace hadesmem
+{
+namespace detail
+{
+class HeapArena
+{
+public:
+  struct Chunk
+  {
+    std::uintptr_t base;
+    std::size_t size;
+  };
+
+  static std::size_t const kMinBlockSize = 0x10;
+  static std::size_t const kMaxBlockSize = 0x1000;
+  static std::size_t const kNumSizeClasses = 9;
+
+  HADESMEM_DETAIL_STATIC_ASSERT((kMinBlockSize << (kNumSizeClasses - 1)) ==
+                                kMaxBlockSize);
+
+  static std::size_t GetSizeClass(std::size_t size) noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(size <= kMaxBlockSize);
+
+    std::size_t size_class = 0;
+    while ((kMinBlockSize << size_class) < size)
+    {
+      ++size_class;
+    }
+    return size_class;
+  }
+
+  static std::size_t GetClassSize(std::size_t size_class) noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(size_class < kNumSizeClasses);
+    return kMinBlockSize << size_class;
+  }
+
+  // Chunks must be at least kMaxBlockSize bytes and kMinBlockSize aligned
+  // (blocks are aligned to kMinBlockSize). New blocks are carved from chunks
+  // in the order they were added.
+  void AddChunk(std::uintptr_t base, std::size_t size)
+  {
+    HADESMEM_DETAIL_ASSERT(base != 0);
+    HADESMEM_DETAIL_ASSERT(size >= kMaxBlockSize);
+    HADESMEM_DETAIL_ASSERT(base % kMinBlockSize == 0);
+
+    chunks_.push_back(Chunk{base, size});
+  }
+
+  // Returns zero if there is no room left, in which case the caller should add
+  // a chunk and try again.
+  std::uintptr_t Allocate(std::size_t size)
+  {
+    HADESMEM_DETAIL_ASSERT(size != 0 && size <= kMaxBlockSize);
+
+    std::size_t const size_class = GetSizeClass(size);
+    std::vector<std::uintptr_t>& free_list = free_lists_[size_class];
+    std::uintptr_t address = 0;
+    if (!free_list.empty())
+    {
+      address = free_list.back();
+      free_list.pop_back();
+    }
+    else
+    {
+      address = Carve(GetClassSize(size_class));
+      if (!address)
+      {
+        return 0;
+      }
+    }
+
+    live_.emplace(address, static_cast<std::uint8_t>(size_class));
+    bytes_allocated_ += GetClassSize(size_class);
+    return address;
+  }
+
+  // Returns false if the address is not a live block (e.g. a double free).
+  bool Free(std::uintptr_t address)
+  {
+    auto const iter = live_.find(address);
+    if (iter == std::end(live_))
+    {
+      return false;
+    }
+
+    std::size_t const size_class = iter->second;
+    live_.erase(iter);
+    free_lists_[size_class].push_back(address);
+    bytes_allocated_ -= GetClassSize(size_class);
+    return true;
+  }
+
+  // Returns zero if the address is not a live block.
+  std::size_t GetBlockSize(std::uintptr_t address) const
+  {
+    auto const iter = live_.find(address);
+    return iter == std::end(live_) ? 0 : GetClassSize(iter->second);
+  }
+
+  // Frees every block but keeps the chunks for reuse.
+  void Reset() noexcept
+  {
+    live_.clear();
+    for (auto& free_list : free_lists_)
+    {
+      free_list.clear();
+    }
+    cur_chunk_ = 0;
+    cur_offset_ = 0;
+    bytes_allocated_ = 0;
+  }
+
+  // Forgets about everything, including the chunks.
+  void Clear() noexcept
+  {
+    Reset();
+    chunks_.clear();
+  }
+
+  std::vector<Chunk> const& GetChunks() const noexcept
+  {
+    return chunks_;
+  }
+
+  std::size_t GetNumBlocks() const noexcept
+  {
+    return live_.size();
+  }
+
+  std::size_t GetBytesAllocated() const noexcept
+  {
+    return bytes_allocated_;
+  }
+
+private:
+  std::uintptr_t Carve(std::size_t block_size) noexcept
+  {
+    // Whatever is left at the end of a chunk is wasted once we move on to the
+    // next one. At most kMaxBlockSize - kMinBlockSize bytes per chunk.
+    for (; cur_chunk_ < chunks_.size(); ++cur_chunk_, cur_offset_ = 0)
+    {
+      Chunk const& chunk = chunks_[cur_chunk_];
+      if (chunk.size - cur_offset_ >= block_size)
+      {
+        std::uintptr_t const address = chunk.base + cur_offset_;
+        cur_offset_ += block_size;
+        return address;
+      }
+    }
+
+    return 0;
+  }
+
+  std::vector<Chunk> chunks_;
+  std::size_t cur_chunk_{};
+  std::size_t cur_offset_{};
+  std::vector<std::uintptr_t> free_lists_[kNumSizeClasses];
+  std::unordered_map<std::uintptr_t, std::uint8_t> live_;
+  std::size_t bytes_allocated_{};
+};
+}
+}
@@ -0,0 +1,247 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Building blocks for ImportTable (see pelib/import_table.hpp). Thunk arrays
+// are decoded from bulk reads rather than one thunk at a time, and every name
+// the table refers to (module names and IMAGE_IMPORT_BY_NAME entries) is
+// looked up in a pool built from a single read of the region which holds
+// them. Strings are only decoded when they're asked for.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct ImportThunkData
+{
+  bool by_ordinal;
+  std::uint16_t ordinal;
+  // RVA of the IMAGE_IMPORT_BY_NAME (i.e. the hint, followed by the name).
+  std::uint32_t name_rva;
+};
+
+// Same decoding as IMAGE_SNAP_BY_ORDINAL and IMAGE_ORDINAL.
+inline ImportThunkData DecodeImportThunk(std::uint64_t raw,
+                                         bool is_64) noexcept
+{
+  std::uint64_t const ordinal_flag =
+    is_64 ? 0x8000000000000000ULL : 0x80000000ULL;
+  ImportThunkData data{};
+  data.by_ordinal = !!(raw & ordinal_flag);
+  data.ordinal = static_cast<std::uint16_t>(raw & 0xFFFF);
+  data.name_rva = data.by_ordinal ? 0 : static_cast<std::uint32_t>(raw);
+  return data;
+}
+
+inline std::uint64_t GetImportThunkValue(std::uint8_t const* p,
+                                         bool is_64) noexcept
+{
+  if (is_64)
+  {
+    std::uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// Appends thunks from the buffer until the null terminator. Returns true if
+// the terminator was found, false if more data is needed (a trailing partial
+// thunk is ignored).
+inline bool AppendImportThunks(std::uint8_t const* data,
+                               std::size_t size,
+                               bool is_64,
+                               std::vector<std::uint64_t>& thunks)
+{
+  std::size_t const thunk_size = is_64 ? 8 : 4;
+  for (std::size_t offset = 0; offset + thunk_size <= size;
+       offset += thunk_size)
+  {
+    std::uint64_t const value = GetImportThunkValue(data + offset, is_64);
+    if (!value)
+    {
+      return true;
+    }
+
+    thunks.push_back(value);
+  }
+
+  return false;
+}
+
+// ASCII only, which is all the loader compares module names with.
+inline bool IsEqualImportName(char const* lhs,
+                              std::size_t lhs_len,
+                              char const* rhs,
+                              std::size_t rhs_len,
+                              bool no_case) noexcept
+{
+  if (lhs_len != rhs_len)
+  {
+    return false;
+  }
+
+  auto const to_upper = [](char c) {
+    return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+  };
+  for (std::size_t i = 0; i < lhs_len; ++i)
+  {
+    if (lhs[i] != rhs[i] && (!no_case || to_upper(lhs[i]) != to_upper(rhs[i])))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// A range of RVAs which is laid out contiguously in the file (a section, or
+// the whole image once it's mapped), so it can be covered by one read.
+struct ImportNameSpan
+{
+  std::uint32_t beg;
+  std::uint32_t end;
+};
+
+// Room left after the last name, so it can be read as part of the same
+// region. Longer names fall back to being read on their own.
+std::uint32_t const kImportNameTail = 0x200;
+
+// Picks the span holding the most names, and returns the smallest range in
+// it which covers all of those names (plus the tail). Names outside of it
+// have to be read on their own. Empty if there are no names in any span.
+inline std::pair<std::uint32_t, std::uint32_t>
+  GetImportNameRegion(std::vector<std::uint32_t> const& rvas,
+                      std::vector<ImportNameSpan> const& spans)
+{
+  std::pair<std::uint32_t, std::uint32_t> region{};
+  std::size_t best_count = 0;
+  for (auto const& span : spans)
+  {
+    std::size_t count = 0;
+    std::uint32_t min_rva = span.end;
+    std::uint32_t max_rva = span.beg;
+    for (auto const rva : rvas)
+    {
+      if (rva >= span.beg && rva < span.end)
+      {
+        ++count;
+        min_rva = (std::min)(min_rva, rva);
+        max_rva = (std::max)(max_rva, rva);
+      }
+    }
+
+    if (count > best_count)
+    {
+      best_count = count;
+      std::uint64_t const end =
+        static_cast<std::uint64_t>(max_rva) + kImportNameTail;
+      region.first = min_rva;
+      region.second = static_cast<std::uint32_t>(
+        (std::min)(end, static_cast<std::uint64_t>(span.end)));
+    }
+  }
+
+  return region;
+}
+
+class ImportNamePool
+{
+public:
+  ImportNamePool() = default;
+
+  explicit ImportNamePool(std::uint32_t base_rva,
+                          std::vector<std::uint8_t> data)
+    : base_rva_{base_rva}, data_(std::move(data))
+  {
+  }
+
+  std::uint32_t GetBaseRva() const noexcept
+  {
+    return base_rva_;
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return data_.size();
+  }
+
+  bool Contains(std::uint32_t rva) const noexcept
+  {
+    return rva >= base_rva_ && rva - base_rva_ < data_.size();
+  }
+
+  // Null if the string isn't entirely inside the pool (including its
+  // terminator), in which case the caller has to read it some other way.
+  char const* GetString(std::uint32_t rva, std::size_t* len) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(len != nullptr);
+
+    if (!Contains(rva))
+    {
+      return nullptr;
+    }
+
+    auto const beg = data_.data() + (rva - base_rva_);
+    auto const end = data_.data() + data_.size();
+    auto const terminator = std::find(beg, end, std::uint8_t{0});
+    if (terminator == end)
+    {
+      return nullptr;
+    }
+
+    *len = static_cast<std::size_t>(terminator - beg);
+    return reinterpret_cast<char const*>(beg);
+  }
+
+  bool GetString(std::uint32_t rva, std::string* str) const
+  {
+    HADESMEM_DETAIL_ASSERT(str != nullptr);
+
+    std::size_t len = 0;
+    char const* const s = GetString(rva, &len);
+    if (!s)
+    {
+      return false;
+    }
+
+    str->assign(s, len);
+    return true;
+  }
+
+  bool GetHint(std::uint32_t rva, std::uint16_t* hint) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(hint != nullptr);
+
+    if (!Contains(rva) || data_.size() - (rva - base_rva_) < sizeof(*hint))
+    {
+      return false;
+    }
+
+    std::memcpy(hint, data_.data() + (rva - base_rva_), sizeof(*hint));
+    return true;
+  }
+
+private:
+  std::uint32_t base_rva_{};
+  std::vector<std::uint8_t> data_;
+};
+}
+}
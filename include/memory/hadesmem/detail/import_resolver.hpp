@@ -0,0 +1,383 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/export_index.hpp>
+
+// Resolution of redirected imports for PeDumper. Some protectors point IAT
+// entries at small generated stubs which compute the real API address, so the
+// value in the image never matches an export. Each resolver declares the stub
+// shapes it understands as byte patterns and decodes matching stubs from a
+// local copy of the bytes.
+//
+// Candidates are resolved as a batch, sorted by address, through a small
+// cache of blocks read from the target, so a few reads cover every stub in a
+// block rather than doing a query and read per candidate.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct StubPattern
+{
+  std::vector<std::uint8_t> data;
+  // 0xFF where the byte has to match, 0 for a wildcard.
+  std::vector<std::uint8_t> mask;
+};
+
+// Same format as FindPattern (e.g. "48 B8 ?? ?? FF E0"). Patterns come from
+// resolvers rather than users, so a bad one is a bug.
+inline StubPattern MakeStubPattern(char const* pattern)
+{
+  HADESMEM_DETAIL_ASSERT(pattern != nullptr);
+
+  auto const hex_value = [](char c) -> int {
+    if (c >= '0' && c <= '9')
+    {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+      return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+      return c - 'A' + 10;
+    }
+    return -1;
+  };
+
+  StubPattern stub_pattern;
+  for (char const* p = pattern; *p;)
+  {
+    if (*p == ' ')
+    {
+      ++p;
+      continue;
+    }
+
+    HADESMEM_DETAIL_ASSERT(p[1] != '\0');
+    if (p[0] == '?' && p[1] == '?')
+    {
+      stub_pattern.data.push_back(0);
+      stub_pattern.mask.push_back(0);
+    }
+    else
+    {
+      int const hi = hex_value(p[0]);
+      int const lo = hex_value(p[1]);
+      HADESMEM_DETAIL_ASSERT(hi >= 0 && lo >= 0);
+      stub_pattern.data.push_back(static_cast<std::uint8_t>(hi * 16 + lo));
+      stub_pattern.mask.push_back(0xFF);
+    }
+    p += 2;
+  }
+
+  HADESMEM_DETAIL_ASSERT(!stub_pattern.data.empty());
+  return stub_pattern;
+}
+
+inline bool MatchStubPattern(StubPattern const& pattern,
+                             std::uint8_t const* data,
+                             std::size_t size) noexcept
+{
+  if (size < pattern.data.size())
+  {
+    return false;
+  }
+
+  for (std::size_t i = 0; i < pattern.data.size(); ++i)
+  {
+    if ((data[i] & pattern.mask[i]) != pattern.data[i])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+class RedirectedImportResolver
+{
+public:
+  virtual ~RedirectedImportResolver()
+  {
+  }
+
+  virtual char const* GetName() const = 0;
+
+  // Resolve is only called for stubs which match one of these.
+  virtual std::vector<StubPattern> const& GetPatterns() const = 0;
+
+  // The stub is at least as big as the pattern it matched. Returns zero if
+  // it can't be resolved after all. Must be safe to call from multiple
+  // threads at once.
+  virtual std::uint64_t Resolve(std::uint64_t va,
+                                std::uint8_t const* stub,
+                                std::size_t size) const = 0;
+};
+
+// Overwatch redirects all entries in the IAT to a dynamically generated stub
+// which performs some rudimentary pointer arithmetic to mask the API being
+// called.
+// 0:000> u 00007FF7170224F0
+// Overwatch+0x1724f0:
+// 00007ff7`170224f0 488d0d6de22f01  lea     rcx,[Overwatch+0x1470764
+// (00007ff7`18320764)] ; "ntdll.dll"
+// 00007ff7`170224f7 ff15cbecef00    call    qword ptr [Overwatch+0x10711c8
+// (00007ff7`17f211c8)]
+// 0:000> u poi(00007ff7`17f211c8)
+// 00000223`c86f00fc 48b8151334b7fe7f0000 mov rax,offset
+// kernel32!FindFirstVolumeW+0x195 (00007ffe`b7341315)
+// 00000223`c86f0106 48057b390000    add     rax,397Bh
+// 00000223`c86f010c ffe0            jmp     rax
+// 0:000> ln 0x00007ffe`b7341315 + 0x3970
+// (00007ffe`b7344c90)   kernel32!GetModuleHandleAStub
+// NOTE: Doesn't work since the last patch, and I won't be updating it for
+// legal reasons. Not going to remove it though because whilst it's not useful
+// for its original purpose it still serves as an example of how to write a
+// resolver.
+class OverwatchImportResolver : public RedirectedImportResolver
+{
+public:
+  OverwatchImportResolver()
+    // mov rax, imm64; add rax, imm32; jmp rax
+    : patterns_{MakeStubPattern("48 B8 ?? ?? ?? ?? ?? ?? ?? ?? "
+                                "48 05 ?? ?? ?? ?? "
+                                "FF E0")}
+  {
+  }
+
+  virtual char const* GetName() const override
+  {
+    return "Overwatch";
+  }
+
+  virtual std::vector<StubPattern> const& GetPatterns() const override
+  {
+    return patterns_;
+  }
+
+  virtual std::uint64_t Resolve(std::uint64_t /*va*/,
+                                std::uint8_t const* stub,
+                                std::size_t size) const override
+  {
+    HADESMEM_DETAIL_ASSERT(size >= 0x12);
+    (void)size;
+
+    std::uint64_t o = 0;
+    std::memcpy(&o, stub + 0x2, sizeof(o));
+    // The immediate is sign extended.
+    std::int32_t n = 0;
+    std::memcpy(&n, stub + 0xC, sizeof(n));
+    return o + static_cast<std::uint64_t>(static_cast<std::int64_t>(n));
+  }
+
+private:
+  std::vector<StubPattern> patterns_;
+};
+
+// Reads the target in blocks, clamped to the given ranges so a block never
+// crosses into memory which might not be readable. Only a few blocks are
+// kept, which is enough when reads are done in address order.
+class BlockReadCache
+{
+public:
+  using ReadFunc = std::function<bool(std::uint64_t, void*, std::size_t)>;
+
+  BlockReadCache(AddressRangeSet const& ranges,
+                 ReadFunc read,
+                 std::size_t block_size = 0x10000)
+    : ranges_{&ranges}, read_{std::move(read)}, block_size_{block_size}
+  {
+    HADESMEM_DETAIL_ASSERT(!!read_);
+    HADESMEM_DETAIL_ASSERT(block_size && !(block_size & (block_size - 1)));
+  }
+
+  // Copies as much as is available (up to size) from address onwards, and
+  // returns the number of bytes copied. Stops at the end of a range or at
+  // a block which couldn't be read.
+  std::size_t Read(std::uint64_t address, void* buffer, std::size_t size)
+  {
+    auto out = static_cast<std::uint8_t*>(buffer);
+    std::size_t done = 0;
+    while (done < size)
+    {
+      Block const* const block = GetBlock(address + done);
+      if (!block)
+      {
+        break;
+      }
+
+      auto const block_offset =
+        static_cast<std::size_t>(address + done - block->beg);
+      std::size_t const len =
+        (std::min)(size - done, block->data.size() - block_offset);
+      std::memcpy(out + done, block->data.data() + block_offset, len);
+      done += len;
+    }
+
+    return done;
+  }
+
+  std::size_t GetNumReads() const noexcept
+  {
+    return num_reads_;
+  }
+
+private:
+  struct Block
+  {
+    std::uint64_t beg;
+    std::vector<std::uint8_t> data;
+    bool valid;
+  };
+
+  static std::size_t const kMaxBlocks = 4;
+
+  Block const* GetBlock(std::uint64_t address)
+  {
+    for (auto const& block : blocks_)
+    {
+      if (address >= block.beg && address - block.beg < block.data.size())
+      {
+        return block.valid ? &block : nullptr;
+      }
+    }
+
+    auto const range = ranges_->FindRange(address);
+    if (!range)
+    {
+      return nullptr;
+    }
+
+    std::uint64_t const aligned = address & ~(std::uint64_t{block_size_} - 1);
+    std::uint64_t const beg = (std::max)(aligned, range->first);
+    std::uint64_t const end = (std::min)(aligned + block_size_, range->second);
+
+    if (blocks_.size() == kMaxBlocks)
+    {
+      blocks_.erase(std::begin(blocks_));
+    }
+
+    blocks_.push_back(
+      Block{beg, std::vector<std::uint8_t>(static_cast<std::size_t>(end - beg)),
+            false});
+    Block& block = blocks_.back();
+    ++num_reads_;
+    block.valid = read_(beg, block.data.data(), block.data.size());
+    return block.valid ? &block : nullptr;
+  }
+
+  AddressRangeSet const* ranges_;
+  ReadFunc read_;
+  std::size_t block_size_;
+  std::vector<Block> blocks_;
+  std::size_t num_reads_{};
+};
+
+class ImportResolverChain
+{
+public:
+  void Add(std::unique_ptr<RedirectedImportResolver> resolver)
+  {
+    HADESMEM_DETAIL_ASSERT(resolver != nullptr);
+
+    for (auto const& pattern : resolver->GetPatterns())
+    {
+      max_stub_size_ = (std::max)(max_stub_size_, pattern.data.size());
+      if (pattern.mask[0])
+      {
+        first_bytes_[pattern.data[0]] = true;
+      }
+      else
+      {
+        std::fill(std::begin(first_bytes_), std::end(first_bytes_), true);
+      }
+    }
+
+    resolvers_.push_back(std::move(resolver));
+  }
+
+  bool empty() const noexcept
+  {
+    return resolvers_.empty();
+  }
+
+  std::size_t size() const noexcept
+  {
+    return resolvers_.size();
+  }
+
+  // Resolvers are tried in the order they were added, and the first one to
+  // resolve a stub wins. Returns zero if none of them can.
+  std::uint64_t Resolve(std::uint64_t va,
+                        std::uint8_t const* stub,
+                        std::size_t size) const
+  {
+    if (!size || !first_bytes_[stub[0]])
+    {
+      return 0;
+    }
+
+    for (auto const& resolver : resolvers_)
+    {
+      for (auto const& pattern : resolver->GetPatterns())
+      {
+        if (MatchStubPattern(pattern, stub, size))
+        {
+          if (std::uint64_t const resolved = resolver->Resolve(va, stub, size))
+          {
+            return resolved;
+          }
+        }
+      }
+    }
+
+    return 0;
+  }
+
+  // The VAs must be sorted, so the cache sees the reads in order. Results
+  // are in the same order as the VAs.
+  std::vector<std::uint64_t> ResolveBatch(std::vector<std::uint64_t> const& vas,
+                                          BlockReadCache& cache) const
+  {
+    HADESMEM_DETAIL_ASSERT(std::is_sorted(std::begin(vas), std::end(vas)));
+
+    std::vector<std::uint64_t> resolved(vas.size());
+    if (resolvers_.empty())
+    {
+      return resolved;
+    }
+
+    std::vector<std::uint8_t> stub(max_stub_size_);
+    for (std::size_t i = 0; i < vas.size(); ++i)
+    {
+      std::size_t const size = cache.Read(vas[i], stub.data(), stub.size());
+      resolved[i] = Resolve(vas[i], stub.data(), size);
+    }
+
+    return resolved;
+  }
+
+private:
+  std::vector<std::unique_ptr<RedirectedImportResolver>> resolvers_;
+  std::size_t max_stub_size_{};
+  bool first_bytes_[0x100]{};
+};
+}
+}
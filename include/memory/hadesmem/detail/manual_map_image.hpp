@@ -0,0 +1,592 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/base_relocations.hpp>
+#include <hadesmem/detail/import_name_pool.hpp>
+
+// The stages of ManualMap (see manual_map.hpp) which only need a local copy
+// of the file: parsing the headers, laying the image out the way the loader
+// would, relocating it, listing its imports and TLS callbacks, and planning
+// how it gets written to the target and protected. Everything else (the
+// parts which touch the target) is in manual_map.hpp.
+//
+// Functions which can fail because the file is malformed return an error
+// string, or null on success.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+// Same values as IMAGE_DIRECTORY_ENTRY_*.
+enum : std::size_t
+{
+  kManualMapDirExport = 0,
+  kManualMapDirImport = 1,
+  kManualMapDirException = 3,
+  kManualMapDirBaseReloc = 5,
+  kManualMapDirTls = 9,
+  kManualMapNumDataDirs = 16
+};
+
+// Same values as PAGE_*.
+enum : std::uint32_t
+{
+  kManualMapNoAccess = 0x01,
+  kManualMapReadOnly = 0x02,
+  kManualMapReadWrite = 0x04,
+  kManualMapExecute = 0x10,
+  kManualMapExecuteRead = 0x20,
+  kManualMapExecuteReadWrite = 0x40
+};
+
+std::uint32_t const kManualMapPageSize = 0x1000;
+
+struct ManualMapSection
+{
+  std::uint32_t virtual_address;
+  // VirtualSize, or SizeOfRawData if that's zero (same as the loader).
+  std::uint32_t virtual_size;
+  std::uint32_t size_of_raw_data;
+  std::uint32_t pointer_to_raw_data;
+  std::uint32_t characteristics;
+};
+
+struct ManualMapDataDir
+{
+  std::uint32_t rva;
+  std::uint32_t size;
+};
+
+struct ManualMapHeaders
+{
+  bool is_64;
+  std::uint16_t machine;
+  std::uint16_t characteristics;
+  std::uint64_t image_base;
+  std::uint32_t size_of_image;
+  std::uint32_t size_of_headers;
+  std::uint32_t entry_point;
+  // Offset of the image base field, so it can be updated after relocation.
+  std::size_t image_base_offset;
+  ManualMapDataDir data_dirs[kManualMapNumDataDirs];
+  std::vector<ManualMapSection> sections;
+};
+
+inline std::uint64_t ReadManualMapValue(std::uint8_t const* p,
+                                        std::size_t size) noexcept
+{
+  HADESMEM_DETAIL_ASSERT(size <= 8);
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    value |= static_cast<std::uint64_t>(p[i]) << (i * 8);
+  }
+  return value;
+}
+
+inline void WriteManualMapValue(std::uint8_t* p,
+                                std::uint64_t value,
+                                std::size_t size) noexcept
+{
+  HADESMEM_DETAIL_ASSERT(size <= 8);
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    p[i] = static_cast<std::uint8_t>(value >> (i * 8));
+  }
+}
+
+inline char const* ParseManualMapHeaders(std::uint8_t const* data,
+                                         std::size_t size,
+                                         ManualMapHeaders* headers)
+{
+  HADESMEM_DETAIL_ASSERT(headers != nullptr);
+
+  auto const get = [&](std::size_t offset, std::size_t len) {
+    return offset <= size && len <= size - offset
+             ? ReadManualMapValue(data + offset, len)
+             : 0;
+  };
+
+  if (size < 0x40 || get(0, 2) != 0x5A4D)
+  {
+    return "Invalid DOS header.";
+  }
+
+  std::size_t const nt_headers = static_cast<std::size_t>(get(0x3C, 4));
+  if (nt_headers > size || size - nt_headers < 24 ||
+      get(nt_headers, 4) != 0x00004550)
+  {
+    return "Invalid NT headers.";
+  }
+
+  ManualMapHeaders h{};
+  h.machine = static_cast<std::uint16_t>(get(nt_headers + 4, 2));
+  auto const num_sections = static_cast<std::size_t>(get(nt_headers + 6, 2));
+  auto const opt_size = static_cast<std::size_t>(get(nt_headers + 20, 2));
+  h.characteristics = static_cast<std::uint16_t>(get(nt_headers + 22, 2));
+
+  std::size_t const opt = nt_headers + 24;
+  auto const magic = get(opt, 2);
+  if (magic != 0x10B && magic != 0x20B)
+  {
+    return "Invalid optional header.";
+  }
+  h.is_64 = magic == 0x20B;
+  std::size_t const data_dirs = opt + (h.is_64 ? 112 : 96);
+  if (opt_size < data_dirs - opt || size - opt < opt_size)
+  {
+    return "Invalid optional header.";
+  }
+
+  h.entry_point = static_cast<std::uint32_t>(get(opt + 16, 4));
+  h.image_base_offset = h.is_64 ? opt + 24 : opt + 28;
+  h.image_base = get(h.image_base_offset, h.is_64 ? 8 : 4);
+  h.size_of_image = static_cast<std::uint32_t>(get(opt + 56, 4));
+  h.size_of_headers = static_cast<std::uint32_t>(get(opt + 60, 4));
+  if (!h.size_of_image || h.size_of_headers > h.size_of_image)
+  {
+    return "Invalid image size.";
+  }
+
+  std::size_t const num_data_dirs = (std::min)(
+    static_cast<std::size_t>(get(data_dirs - 4, 4)),
+    (std::min)(static_cast<std::size_t>(kManualMapNumDataDirs),
+               (opt_size - (data_dirs - opt)) / 8));
+  for (std::size_t i = 0; i < num_data_dirs; ++i)
+  {
+    h.data_dirs[i].rva = static_cast<std::uint32_t>(get(data_dirs + i * 8, 4));
+    h.data_dirs[i].size =
+      static_cast<std::uint32_t>(get(data_dirs + i * 8 + 4, 4));
+  }
+
+  std::size_t const section_table = opt + opt_size;
+  if (num_sections * 40 > size - section_table)
+  {
+    return "Invalid section table.";
+  }
+
+  for (std::size_t i = 0; i < num_sections; ++i)
+  {
+    std::size_t const s = section_table + i * 40;
+    ManualMapSection section{};
+    section.virtual_size = static_cast<std::uint32_t>(get(s + 8, 4));
+    section.virtual_address = static_cast<std::uint32_t>(get(s + 12, 4));
+    section.size_of_raw_data = static_cast<std::uint32_t>(get(s + 16, 4));
+    section.pointer_to_raw_data = static_cast<std::uint32_t>(get(s + 20, 4));
+    section.characteristics = static_cast<std::uint32_t>(get(s + 36, 4));
+    if (!section.virtual_size)
+    {
+      section.virtual_size = section.size_of_raw_data;
+    }
+
+    if (static_cast<std::uint64_t>(section.virtual_address) +
+          section.virtual_size >
+        h.size_of_image)
+    {
+      return "Section is outside of the image.";
+    }
+
+    // Raw data is clamped to the virtual size, so only that much of it has
+    // to actually be in the file.
+    std::uint32_t const raw_size =
+      (std::min)(section.size_of_raw_data, section.virtual_size);
+    if (raw_size && (section.pointer_to_raw_data > size ||
+                     raw_size > size - section.pointer_to_raw_data))
+    {
+      return "Section data is outside of the file.";
+    }
+
+    h.sections.push_back(section);
+  }
+
+  *headers = std::move(h);
+  return nullptr;
+}
+
+// Lays the file out the way the loader would. Anything not covered by the
+// headers or a section's raw data is zero.
+inline std::vector<std::uint8_t> MapManualMapImage(
+  std::uint8_t const* data, std::size_t size, ManualMapHeaders const& headers)
+{
+  std::vector<std::uint8_t> image(headers.size_of_image);
+
+  std::size_t const headers_size =
+    (std::min)(static_cast<std::size_t>(headers.size_of_headers), size);
+  std::copy(data, data + headers_size, image.data());
+
+  for (auto const& section : headers.sections)
+  {
+    std::uint32_t const raw_size =
+      (std::min)(section.size_of_raw_data, section.virtual_size);
+    if (raw_size)
+    {
+      std::memcpy(&image[section.virtual_address],
+                  data + section.pointer_to_raw_data,
+                  raw_size);
+    }
+  }
+
+  return image;
+}
+
+// Also updates the image base in the (mapped) headers, as the loader does.
+inline char const* RelocateManualMapImage(std::vector<std::uint8_t>& image,
+                                          ManualMapHeaders const& headers,
+                                          std::uint64_t new_base)
+{
+  std::uint64_t const delta = new_base - headers.image_base;
+  if (delta)
+  {
+    // IMAGE_FILE_RELOCS_STRIPPED
+    auto const& dir = headers.data_dirs[kManualMapDirBaseReloc];
+    if ((headers.characteristics & 0x0001) || !dir.rva || !dir.size)
+    {
+      return "Image has no relocations.";
+    }
+
+    if (static_cast<std::uint64_t>(dir.rva) + dir.size > image.size())
+    {
+      return "Relocation directory is outside of the image.";
+    }
+
+    // Decoded up front, so a fixup which lands in the directory can't change
+    // the fixups which follow it.
+    BaseRelocations const relocs{&image[dir.rva], dir.size};
+    if (relocs.IsTruncated())
+    {
+      return "Invalid relocation directory.";
+    }
+
+    auto const result =
+      ApplyRelocations(image.data(), image.size(), relocs, delta);
+    if (result.num_out_of_bounds)
+    {
+      return "Relocation is outside of the image.";
+    }
+    if (result.num_unsupported)
+    {
+      return "Unsupported relocation type.";
+    }
+  }
+
+  if (headers.image_base_offset + (headers.is_64 ? 8 : 4) <= image.size())
+  {
+    WriteManualMapValue(&image[headers.image_base_offset],
+                        new_base,
+                        headers.is_64 ? 8 : 4);
+  }
+
+  return nullptr;
+}
+
+struct ManualMapImport
+{
+  bool by_ordinal;
+  std::uint16_t ordinal;
+  std::uint16_t hint;
+  // Empty if by ordinal.
+  std::string name;
+  // Where the resolved address goes.
+  std::uint32_t iat_rva;
+};
+
+struct ManualMapImportModule
+{
+  std::string name;
+  std::vector<ManualMapImport> imports;
+};
+
+inline bool GetManualMapString(std::vector<std::uint8_t> const& image,
+                               std::uint32_t rva,
+                               std::string* s)
+{
+  if (rva >= image.size())
+  {
+    return false;
+  }
+
+  auto const beg = std::begin(image) + rva;
+  auto const terminator = std::find(beg, std::end(image), std::uint8_t{0});
+  if (terminator == std::end(image))
+  {
+    return false;
+  }
+
+  s->assign(beg, terminator);
+  return true;
+}
+
+// Descriptors are walked with the same rules as ImportDirList, and thunks
+// with the same rules as the loader (names come from the ILT if there is
+// one, otherwise from the IAT). Bound imports are ignored, everything is
+// resolved from scratch.
+inline char const*
+  GetManualMapImports(std::vector<std::uint8_t> const& image,
+                      ManualMapHeaders const& headers,
+                      std::vector<ManualMapImportModule>* modules)
+{
+  HADESMEM_DETAIL_ASSERT(modules != nullptr);
+
+  modules->clear();
+  auto const& dir = headers.data_dirs[kManualMapDirImport];
+  if (!dir.rva || !dir.size)
+  {
+    return nullptr;
+  }
+
+  std::size_t const kDescSize = 20;
+  std::size_t const thunk_size = headers.is_64 ? 8 : 4;
+  for (std::uint64_t desc = dir.rva;; desc += kDescSize)
+  {
+    if (desc + kDescSize > image.size())
+    {
+      return "Import directory is outside of the image.";
+    }
+
+    auto const p = &image[static_cast<std::size_t>(desc)];
+    auto const ilt = static_cast<std::uint32_t>(ReadManualMapValue(p, 4));
+    auto const name = static_cast<std::uint32_t>(ReadManualMapValue(p + 12, 4));
+    auto const iat = static_cast<std::uint32_t>(ReadManualMapValue(p + 16, 4));
+    if (!name || !iat)
+    {
+      return nullptr;
+    }
+
+    ManualMapImportModule module;
+    if (!GetManualMapString(image, name, &module.name))
+    {
+      return "Import module name is outside of the image.";
+    }
+
+    std::uint32_t const names = ilt ? ilt : iat;
+    if (names >= image.size() || iat >= image.size())
+    {
+      return "Import thunks are outside of the image.";
+    }
+
+    std::vector<std::uint64_t> thunks;
+    if (!AppendImportThunks(
+          &image[names], image.size() - names, headers.is_64, thunks))
+    {
+      return "Import thunks are not terminated.";
+    }
+    if (thunks.size() > (image.size() - iat) / thunk_size)
+    {
+      return "Import thunks are outside of the image.";
+    }
+
+    for (std::size_t i = 0; i < thunks.size(); ++i)
+    {
+      auto const data = DecodeImportThunk(thunks[i], headers.is_64);
+      ManualMapImport import{};
+      import.by_ordinal = data.by_ordinal;
+      import.ordinal = data.ordinal;
+      import.iat_rva = static_cast<std::uint32_t>(iat + i * thunk_size);
+      if (!data.by_ordinal)
+      {
+        if (static_cast<std::uint64_t>(data.name_rva) + 2 > image.size() ||
+            !GetManualMapString(image, data.name_rva + 2, &import.name))
+        {
+          return "Import name is outside of the image.";
+        }
+        import.hint = static_cast<std::uint16_t>(
+          ReadManualMapValue(&image[data.name_rva], 2));
+      }
+      module.imports.push_back(std::move(import));
+    }
+
+    modules->push_back(std::move(module));
+  }
+}
+
+inline void SetManualMapImport(std::vector<std::uint8_t>& image,
+                               ManualMapHeaders const& headers,
+                               ManualMapImport const& import,
+                               std::uint64_t va)
+{
+  std::size_t const thunk_size = headers.is_64 ? 8 : 4;
+  HADESMEM_DETAIL_ASSERT(import.iat_rva + thunk_size <= image.size());
+  WriteManualMapValue(&image[import.iat_rva], va, thunk_size);
+}
+
+// Must be called after the image has been relocated to its new base. Returns
+// the VAs of the callbacks in the target.
+inline char const*
+  GetManualMapTlsCallbacks(std::vector<std::uint8_t> const& image,
+                           ManualMapHeaders const& headers,
+                           std::uint64_t base,
+                           std::vector<std::uint64_t>* callbacks)
+{
+  HADESMEM_DETAIL_ASSERT(callbacks != nullptr);
+
+  callbacks->clear();
+  auto const& dir = headers.data_dirs[kManualMapDirTls];
+  if (!dir.rva)
+  {
+    return nullptr;
+  }
+
+  std::size_t const ptr_size = headers.is_64 ? 8 : 4;
+  if (static_cast<std::uint64_t>(dir.rva) + 4 * ptr_size > image.size())
+  {
+    return "TLS directory is outside of the image.";
+  }
+
+  // AddressOfCallBacks.
+  std::uint64_t const va =
+    ReadManualMapValue(&image[dir.rva + 3 * ptr_size], ptr_size);
+  if (!va)
+  {
+    return nullptr;
+  }
+
+  if (va < base)
+  {
+    return "TLS callbacks are outside of the image.";
+  }
+
+  for (std::uint64_t rva = va - base;; rva += ptr_size)
+  {
+    if (rva + ptr_size > image.size())
+    {
+      return "TLS callbacks are outside of the image.";
+    }
+
+    std::uint64_t const callback =
+      ReadManualMapValue(&image[static_cast<std::size_t>(rva)], ptr_size);
+    if (!callback)
+    {
+      return nullptr;
+    }
+    callbacks->push_back(callback);
+  }
+}
+
+// Same mapping from section characteristics as the loader.
+inline std::uint32_t GetManualMapProtect(std::uint32_t characteristics)
+{
+  bool const execute = !!(characteristics & 0x20000000);
+  bool const read = !!(characteristics & 0x40000000);
+  bool const write = !!(characteristics & 0x80000000);
+  if (execute)
+  {
+    return write ? kManualMapExecuteReadWrite
+                 : (read ? kManualMapExecuteRead : kManualMapExecute);
+  }
+  if (write)
+  {
+    return kManualMapReadWrite;
+  }
+  return read ? kManualMapReadOnly : kManualMapNoAccess;
+}
+
+struct ManualMapRegion
+{
+  std::uint32_t rva;
+  // Whole pages.
+  std::uint32_t size;
+  std::uint32_t protect;
+  // Bytes to write, from the start of the region. Trailing zeroes are left
+  // out, as fresh memory in the target is already zeroed.
+  std::uint32_t write_size;
+};
+
+// Runs of pages which share a protection. The headers are read only, pages
+// which aren't covered by anything are no access, and pages shared by more
+// than one section (only possible with a section alignment below the page
+// size) get the union of their access.
+inline std::vector<ManualMapRegion>
+  PlanManualMapCommit(std::vector<std::uint8_t> const& image,
+                      ManualMapHeaders const& headers)
+{
+  std::size_t const page_size = kManualMapPageSize;
+  std::size_t const num_pages = (image.size() + page_size - 1) / page_size;
+  std::vector<std::uint32_t> characteristics(num_pages);
+  std::vector<bool> covered(num_pages);
+
+  auto const cover = [&](std::uint64_t beg,
+                         std::uint64_t end,
+                         std::uint32_t c) {
+    for (auto page = beg / page_size; page * page_size < end; ++page)
+    {
+      characteristics[static_cast<std::size_t>(page)] |= c;
+      covered[static_cast<std::size_t>(page)] = true;
+    }
+  };
+  cover(0, (std::max)(headers.size_of_headers, 1U), 0x40000000);
+  for (auto const& section : headers.sections)
+  {
+    cover(section.virtual_address,
+          static_cast<std::uint64_t>(section.virtual_address) +
+            section.virtual_size,
+          section.characteristics);
+  }
+
+  std::vector<ManualMapRegion> regions;
+  for (std::size_t page = 0; page < num_pages; ++page)
+  {
+    std::uint32_t const protect =
+      covered[page] ? GetManualMapProtect(characteristics[page])
+                    : kManualMapNoAccess;
+    if (!regions.empty() && regions.back().protect == protect)
+    {
+      regions.back().size += static_cast<std::uint32_t>(page_size);
+    }
+    else
+    {
+      regions.push_back(
+        ManualMapRegion{static_cast<std::uint32_t>(page * page_size),
+                        static_cast<std::uint32_t>(page_size),
+                        protect,
+                        0});
+    }
+  }
+
+  for (auto& region : regions)
+  {
+    std::size_t const end =
+      (std::min)(image.size(), static_cast<std::size_t>(region.rva) +
+                                 region.size);
+    std::size_t last = end;
+    while (last > region.rva && !image[last - 1])
+    {
+      --last;
+    }
+    region.write_size = static_cast<std::uint32_t>(last - region.rva);
+  }
+
+  return regions;
+}
+
+// The image is committed with a single write from the start up to the last
+// non-zero byte, rather than a write per region. The gaps between the regions'
+// writes are zero, and writing them costs far less than another cross-process
+// call.
+inline std::uint32_t
+  GetManualMapWriteSize(std::vector<ManualMapRegion> const& regions) noexcept
+{
+  std::uint32_t end = 0;
+  for (auto const& region : regions)
+  {
+    if (region.write_size)
+    {
+      end = (std::max)(end, region.rva + region.write_size);
+    }
+  }
+  return end;
+}
+}
+}
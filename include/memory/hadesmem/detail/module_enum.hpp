@@ -0,0 +1,406 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+#include <tlhelp32.h>
+
+#include <hadesmem/detail/optional.hpp>
+#include <hadesmem/detail/peb.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/toolhelp.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/winapi.hpp>
+#include <hadesmem/detail/winternl.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+// Module enumeration straight from the loader's list in the PEB, falling back
+// to Toolhelp when the list can't be used. Doesn't need a snapshot object in
+// the kernel, or a thread in the target.
+//
+// Walking the list costs a read per entry (each entry is only reachable from
+// the one before it). A full enumeration then reads all the names at once,
+// coalescing buffers which are close together (the loader allocates them from
+// the process heap, so they usually are). A lookup stops at the first match,
+// and only reads the names of entries whose name length matches.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct ModuleData
+{
+  HMODULE handle{};
+  DWORD size{};
+  std::wstring name;
+  std::wstring path;
+};
+
+inline std::wstring ReadUnicodeString(Process const& process,
+                                      UNICODE_STRING const& str)
+{
+  if (!str.Length || !str.Buffer)
+  {
+    return {};
+  }
+
+  auto const buf = ReadVector<wchar_t>(
+    process, str.Buffer, str.Length / sizeof(wchar_t));
+  return std::wstring(buf.data(), buf.size());
+}
+
+enum class LoaderWalkResult
+{
+  // The list can't be used (e.g. the process is still initializing). The
+  // caller should fall back to Toolhelp.
+  kUnusable,
+  kDone,
+  kStopped
+};
+
+// Calls func with each entry (in load order) until it returns true. Throws if
+// reading the list fails (e.g. because it was modified while we were walking
+// it).
+template <typename Func>
+inline LoaderWalkResult WalkLoaderModules(Process const& process,
+                                          Func const& func)
+{
+  // The PEB we get for a WoW64 process from a native process only lists the
+  // native modules, and we can't walk a native PEB from a WoW64 process.
+  if (IsWoW64Process(::GetCurrentProcess()) !=
+      IsWoW64Process(process.GetHandle()))
+  {
+    return LoaderWalkResult::kUnusable;
+  }
+
+  winternl::PEB const peb = GetPeb(process);
+  if (!peb.Ldr)
+  {
+    return LoaderWalkResult::kUnusable;
+  }
+
+  auto const ldr = Read<winternl::PEB_LDR_DATA>(process, peb.Ldr);
+  if (!ldr.Initialized)
+  {
+    return LoaderWalkResult::kUnusable;
+  }
+
+  auto const head = reinterpret_cast<LIST_ENTRY*>(
+    reinterpret_cast<std::uint8_t*>(peb.Ldr) +
+    offsetof(winternl::PEB_LDR_DATA, InLoadOrderModuleList));
+
+  // Bound the walk in case the list is corrupt (or was modified under us in
+  // a way that created a cycle).
+  std::size_t const kMaxModules = 0x4000;
+
+  std::size_t num_entries = 0;
+  for (LIST_ENTRY* link = ldr.InLoadOrderModuleList.Flink; link != head;)
+  {
+    if (!link || num_entries++ >= kMaxModules)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid loader module list."});
+    }
+
+    // InLoadOrderLinks is the first member, so the link is the entry.
+    auto const entry = Read<winternl::LDR_DATA_TABLE_ENTRY>(process, link);
+    link = entry.InLoadOrderLinks.Flink;
+
+    if (entry.DllBase && func(entry))
+    {
+      return LoaderWalkResult::kStopped;
+    }
+  }
+
+  return LoaderWalkResult::kDone;
+}
+
+// The base name almost always points into the path buffer, in which case it
+// doesn't need a read of its own.
+inline bool IsBaseNameInPath(winternl::LDR_DATA_TABLE_ENTRY const& entry,
+                             std::size_t* offset) noexcept
+{
+  auto const full_beg =
+    reinterpret_cast<std::uintptr_t>(entry.FullDllName.Buffer);
+  auto const full_end = full_beg + entry.FullDllName.Length;
+  auto const base_beg =
+    reinterpret_cast<std::uintptr_t>(entry.BaseDllName.Buffer);
+  auto const base_end = base_beg + entry.BaseDllName.Length;
+  if (full_beg && base_beg >= full_beg && base_end <= full_end &&
+      (base_beg - full_beg) % sizeof(wchar_t) == 0)
+  {
+    *offset = (base_beg - full_beg) / sizeof(wchar_t);
+    return true;
+  }
+
+  return false;
+}
+
+inline ModuleData ReadModuleData(Process const& process,
+                                 winternl::LDR_DATA_TABLE_ENTRY const& entry)
+{
+  ModuleData data;
+  data.handle = static_cast<HMODULE>(entry.DllBase);
+  data.size = entry.SizeOfImage;
+  data.path = ReadUnicodeString(process, entry.FullDllName);
+
+  std::size_t base_offset = 0;
+  if (IsBaseNameInPath(entry, &base_offset))
+  {
+    data.name = data.path.substr(base_offset,
+                                 entry.BaseDllName.Length / sizeof(wchar_t));
+  }
+  else
+  {
+    data.name = ReadUnicodeString(process, entry.BaseDllName);
+  }
+
+  return data;
+}
+
+// Reads the strings for all the entries, with a single read for each group of
+// buffers which are close together. A group which can't be read in one go
+// (e.g. because the gap crosses a page which isn't readable) falls back to a
+// read per string.
+inline std::vector<ModuleData> ReadModuleDataBatch(
+  Process const& process,
+  std::vector<winternl::LDR_DATA_TABLE_ENTRY> const& entries)
+{
+  std::uintptr_t const kMaxGap = 0x400;
+  std::uintptr_t const kMaxSpan = 0x10000;
+
+  struct StringRef
+  {
+    UNICODE_STRING const* str;
+    std::wstring* out;
+    std::size_t span;
+  };
+
+  struct Span
+  {
+    std::uintptr_t beg;
+    std::uintptr_t end;
+    std::vector<std::uint8_t> data;
+  };
+
+  std::vector<ModuleData> modules(entries.size());
+  std::vector<StringRef> strings;
+  strings.reserve(entries.size() * 2);
+  for (std::size_t i = 0; i < entries.size(); ++i)
+  {
+    modules[i].handle = static_cast<HMODULE>(entries[i].DllBase);
+    modules[i].size = entries[i].SizeOfImage;
+    if (entries[i].FullDllName.Length && entries[i].FullDllName.Buffer)
+    {
+      strings.push_back(
+        StringRef{&entries[i].FullDllName, &modules[i].path, 0});
+    }
+    std::size_t base_offset = 0;
+    if (!IsBaseNameInPath(entries[i], &base_offset) &&
+        entries[i].BaseDllName.Length && entries[i].BaseDllName.Buffer)
+    {
+      strings.push_back(
+        StringRef{&entries[i].BaseDllName, &modules[i].name, 0});
+    }
+  }
+
+  auto const get_beg = [](StringRef const& s) {
+    return reinterpret_cast<std::uintptr_t>(s.str->Buffer);
+  };
+  std::sort(std::begin(strings),
+            std::end(strings),
+            [&](StringRef const& lhs, StringRef const& rhs) {
+              return get_beg(lhs) < get_beg(rhs);
+            });
+
+  std::vector<Span> spans;
+  for (auto& s : strings)
+  {
+    std::uintptr_t const beg = get_beg(s);
+    std::uintptr_t const end = beg + s.str->Length;
+    if (!spans.empty() && beg <= spans.back().end + kMaxGap &&
+        end - spans.back().beg <= kMaxSpan)
+    {
+      spans.back().end = (std::max)(spans.back().end, end);
+    }
+    else
+    {
+      spans.push_back(Span{beg, end, {}});
+    }
+    s.span = spans.size() - 1;
+  }
+
+  for (auto& span : spans)
+  {
+    try
+    {
+      span.data = ReadVector<std::uint8_t>(
+        process,
+        reinterpret_cast<void*>(span.beg),
+        static_cast<std::size_t>(span.end - span.beg));
+    }
+    catch (std::exception const& /*e*/)
+    {
+      HADESMEM_DETAIL_TRACE_A("Falling back to a read per module name.");
+    }
+  }
+
+  for (auto const& s : strings)
+  {
+    Span const& span = spans[s.span];
+    if (span.data.empty())
+    {
+      *s.out = ReadUnicodeString(process, *s.str);
+      continue;
+    }
+
+    std::size_t const len = s.str->Length / sizeof(wchar_t);
+    s.out->resize(len);
+    if (len)
+    {
+      std::memcpy(&(*s.out)[0],
+                  span.data.data() + (get_beg(s) - span.beg),
+                  len * sizeof(wchar_t));
+    }
+  }
+
+  for (std::size_t i = 0; i < entries.size(); ++i)
+  {
+    std::size_t base_offset = 0;
+    if (IsBaseNameInPath(entries[i], &base_offset))
+    {
+      modules[i].name = modules[i].path.substr(
+        base_offset, entries[i].BaseDllName.Length / sizeof(wchar_t));
+    }
+  }
+
+  return modules;
+}
+
+// Returns an empty optional if the loader list is not usable, in which case
+// the caller should fall back to Toolhelp.
+inline Optional<std::vector<ModuleData>>
+  GetModulesFromLoader(Process const& process)
+{
+  std::vector<winternl::LDR_DATA_TABLE_ENTRY> entries;
+  auto const result =
+    WalkLoaderModules(process, [&](winternl::LDR_DATA_TABLE_ENTRY const& e) {
+      entries.push_back(e);
+      return false;
+    });
+  if (result == LoaderWalkResult::kUnusable)
+  {
+    return {};
+  }
+
+  return Optional<std::vector<ModuleData>>{
+    ReadModuleDataBatch(process, entries)};
+}
+
+inline std::vector<ModuleData> GetModulesFromToolhelp(Process const& process)
+{
+  SmartSnapHandle const snap{CreateToolhelp32Snapshot(
+    TH32CS_SNAPMODULE | TH32CS_SNAPMODULE32, process.GetId())};
+
+  std::vector<ModuleData> modules;
+  Optional<MODULEENTRY32W> entry;
+  for (entry = Module32First(snap.GetHandle()); entry;
+       entry = Module32Next(snap.GetHandle()))
+  {
+    ModuleData data;
+    data.handle = reinterpret_cast<HMODULE>(entry->modBaseAddr);
+    data.size = entry->modBaseSize;
+    data.name = entry->szModule;
+    data.path = entry->szExePath;
+    modules.emplace_back(std::move(data));
+  }
+
+  return modules;
+}
+
+// Modules in load order.
+inline std::vector<ModuleData> GetModules(Process const& process)
+{
+  try
+  {
+    auto modules = GetModulesFromLoader(process);
+    if (modules)
+    {
+      return std::move(*modules);
+    }
+  }
+  catch (std::exception const& /*e*/)
+  {
+    HADESMEM_DETAIL_TRACE_A(
+      boost::current_exception_diagnostic_information().c_str());
+  }
+
+  HADESMEM_DETAIL_TRACE_A("Falling back to Toolhelp.");
+
+  return GetModulesFromToolhelp(process);
+}
+
+// First module in load order for which check returns true. Entries the filter
+// rejects are skipped without reading their names, and nothing past the match
+// is read.
+template <typename EntryFilter, typename DataCheck>
+inline Optional<ModuleData> FindModuleData(Process const& process,
+                                           EntryFilter const& filter,
+                                           DataCheck const& check)
+{
+  try
+  {
+    Optional<ModuleData> found;
+    auto const result =
+      WalkLoaderModules(process, [&](winternl::LDR_DATA_TABLE_ENTRY const& e) {
+        if (!filter(e))
+        {
+          return false;
+        }
+
+        ModuleData data = ReadModuleData(process, e);
+        if (!check(data))
+        {
+          return false;
+        }
+
+        found = std::move(data);
+        return true;
+      });
+    if (result != LoaderWalkResult::kUnusable)
+    {
+      return found;
+    }
+  }
+  catch (std::exception const& /*e*/)
+  {
+    HADESMEM_DETAIL_TRACE_A(
+      boost::current_exception_diagnostic_information().c_str());
+  }
+
+  HADESMEM_DETAIL_TRACE_A("Falling back to Toolhelp.");
+
+  for (auto& data : GetModulesFromToolhelp(process))
+  {
+    if (check(data))
+    {
+      return Optional<ModuleData>{std::move(data)};
+    }
+  }
+
+  return {};
+}
+}
+}
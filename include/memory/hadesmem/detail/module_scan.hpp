@@ -0,0 +1,122 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Module candidate discovery for PeDumper. Memory is read in large chunks and
+// the start of each page is checked in the local buffer, so the target is
+// only touched once per chunk rather than once per page. Candidates still
+// need their headers validated by the caller.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct ModuleScanFlags
+{
+  enum : std::uint32_t
+  {
+    kNone = 0,
+    // Also report pages where the DOS header has been erased but e_lfanew
+    // still points to a PE signature in the same page.
+    kStrippedHeaders = 1 << 0,
+    kInvalidFlagMaxValue = 1 << 1
+  };
+};
+
+enum class ModuleCandidateType
+{
+  kMz,
+  kStrippedHeaders
+};
+
+struct ModuleCandidate
+{
+  std::size_t offset;
+  ModuleCandidateType type;
+};
+
+// Progress counters, safe to read from another thread while a scan is
+// running.
+struct ModuleScanStats
+{
+  std::atomic<std::uint64_t> regions_total{};
+  std::atomic<std::uint64_t> regions_done{};
+  std::atomic<std::uint64_t> bytes_total{};
+  std::atomic<std::uint64_t> bytes_done{};
+  std::atomic<std::uint64_t> chunks_failed{};
+  std::atomic<std::uint64_t> candidates{};
+  std::atomic<std::uint64_t> scan_us{};
+  std::atomic<std::uint64_t> validate_us{};
+
+  void Reset() noexcept
+  {
+    regions_total = 0;
+    regions_done = 0;
+    bytes_total = 0;
+    bytes_done = 0;
+    chunks_failed = 0;
+    candidates = 0;
+    scan_us = 0;
+    validate_us = 0;
+  }
+};
+
+// Checks the start of each page in the buffer, which must begin on a page
+// boundary. Candidates are appended in offset order, with offsets relative
+// to base_offset.
+inline void FindModuleCandidates(std::uint8_t const* data,
+                                 std::size_t size,
+                                 std::size_t page_size,
+                                 std::size_t base_offset,
+                                 std::uint32_t flags,
+                                 std::vector<ModuleCandidate>& candidates)
+{
+  HADESMEM_DETAIL_ASSERT(page_size >= 0x40);
+  HADESMEM_DETAIL_ASSERT(flags < ModuleScanFlags::kInvalidFlagMaxValue);
+
+  std::size_t const kLfanewOffset = 0x3C;
+
+  for (std::size_t offset = 0; offset + page_size <= size;
+       offset += page_size)
+  {
+    std::uint8_t const* const page = data + offset;
+    if (page[0] == 'M' && page[1] == 'Z')
+    {
+      candidates.push_back(
+        ModuleCandidate{base_offset + offset, ModuleCandidateType::kMz});
+      continue;
+    }
+
+    if (!(flags & ModuleScanFlags::kStrippedHeaders))
+    {
+      continue;
+    }
+
+    std::uint32_t lfanew = 0;
+    std::memcpy(&lfanew, page + kLfanewOffset, sizeof(lfanew));
+    if (lfanew < kLfanewOffset + sizeof(lfanew) || lfanew % 4 ||
+        lfanew > page_size - 4)
+    {
+      continue;
+    }
+
+    if (std::memcmp(page + lfanew, "PE\0\0", 4) == 0)
+    {
+      candidates.push_back(ModuleCandidate{
+        base_offset + offset, ModuleCandidateType::kStrippedHeaders});
+    }
+  }
+}
+}
+}
@@ -3,7 +3,10 @@
 
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <type_traits>
@@ -38,12 +41,22 @@ struct PatchConstants
   static std::size_t const kCallSize64 = 6;
   static std::size_t const kPushRetSize64 = 14;
   static std::size_t const kPushRetSize32 = 6;
+  static std::size_t const kJmpAbsSize64 = 14;
+  static std::size_t const kCallAbsSize64 = 16;
+  static std::size_t const kMaxJumpSize = kPushRetSize64;
+  static std::size_t const kMaxCallSize = kCallAbsSize64;
+  static std::size_t const kCounterIncSize = 16;
 #elif defined(HADESMEM_DETAIL_ARCH_X86)
   static std::size_t const kJmpSize64 = kJmpSize32;
   static std::size_t const kCallSize64 = kCallSize32;
+  static std::size_t const kMaxJumpSize = kJmpSize32;
+  static std::size_t const kMaxCallSize = kCallSize32;
+  static std::size_t const kCounterIncSize = 7;
 #else
 #error "[HadesMem] Unsupported architecture."
 #endif
+  // Largest stub gate (including the jump to the stub) we will generate.
+  static std::size_t const kMaxStubGateSize = 0x100;
 };
 
 // Inspired by EasyHook.
@@ -145,100 +158,272 @@ inline bool IsNear(void* address, void* target) noexcept
 #endif
 }
 
-inline std::vector<std::uint8_t> GenJmp32(void* address, void* target)
+// Fixed capacity code buffer used to assemble code locally before committing
+// it to the target with a single write. The generators below never allocate,
+// so a whole detour (stub gate, trampoline, etc.) can be built on the stack.
+template <std::size_t N> class CodeBuffer
 {
-  std::vector<std::uint8_t> buf = {0xE9, 0xEB, 0xBE, 0xAD, 0xDE};
-  auto const dst_len = sizeof(std::uint32_t);
-  auto const op_len = 1;
-  auto const disp = reinterpret_cast<std::uintptr_t>(target) -
-                    reinterpret_cast<std::uintptr_t>(address) - dst_len -
-                    op_len;
-  *reinterpret_cast<std::uint32_t*>(&buf[op_len]) =
-    static_cast<std::uint32_t>(disp);
-  return buf;
+public:
+  explicit CodeBuffer(void* address) noexcept
+    : address_{static_cast<std::uint8_t*>(address)}
+  {
+    HADESMEM_DETAIL_ASSERT(address_ != nullptr);
+  }
+
+  // Remote address of the start of the buffer.
+  void* GetAddress() const noexcept
+  {
+    return address_;
+  }
+
+  // Remote address of the next byte to be emitted.
+  void* GetCursor() const noexcept
+  {
+    return address_ + size_;
+  }
+
+  std::uint8_t const* GetData() const noexcept
+  {
+    return buf_.data();
+  }
+
+  // Access to code which has already been emitted (e.g. to fill in a
+  // placeholder once its target is known).
+  std::uint8_t* At(std::size_t offset) noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(offset < size_);
+    return buf_.data() + offset;
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return size_;
+  }
+
+  std::uint8_t* Reserve(std::size_t len)
+  {
+    if (len > N - size_)
+    {
+      HADESMEM_DETAIL_ASSERT(false);
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Code buffer overflow."});
+    }
+
+    std::uint8_t* const cur = buf_.data() + size_;
+    size_ += len;
+    return cur;
+  }
+
+  void Emit(std::uint8_t const* data, std::size_t len)
+  {
+    std::memcpy(Reserve(len), data, len);
+  }
+
+  // Pads with INT3 until the remote cursor is aligned.
+  void Align(std::size_t alignment)
+  {
+    HADESMEM_DETAIL_ASSERT(alignment && !(alignment & (alignment - 1)));
+    auto const cursor = reinterpret_cast<std::uintptr_t>(GetCursor());
+    std::size_t const pad =
+      (alignment - (cursor & (alignment - 1))) & (alignment - 1);
+    std::memset(Reserve(pad), 0xCC, pad);
+  }
+
+private:
+  std::array<std::uint8_t, N> buf_;
+  std::size_t size_{};
+  std::uint8_t* address_;
+};
+
+inline void StoreU32(std::uint8_t* buf, std::uint32_t value) noexcept
+{
+  std::memcpy(buf, &value, sizeof(value));
 }
 
-inline std::vector<std::uint8_t> GenCall32(void* address, void* target)
+inline void StorePtr(std::uint8_t* buf, void const* value) noexcept
 {
-  std::vector<std::uint8_t> buf = {0xE8, 0xEB, 0xBE, 0xAD, 0xDE};
-  auto const dst_len = sizeof(std::uint32_t);
-  auto const op_len = 1;
-  auto const disp = reinterpret_cast<std::uintptr_t>(target) -
-                    reinterpret_cast<std::uintptr_t>(address) - dst_len -
-                    op_len;
-  *reinterpret_cast<std::uint32_t*>(&buf[op_len]) =
-    static_cast<std::uint32_t>(disp);
-  return buf;
+  std::memcpy(buf, &value, sizeof(value));
 }
 
-inline std::vector<std::uint8_t> GenJmpTramp64(void* address, void* target)
+inline std::uint32_t GenRel32(void* address, void* target, std::size_t len)
 {
-  std::vector<std::uint8_t> buf = {0xFF, 0x25, 0xEF, 0xBE, 0xAD, 0xDE};
-  auto const dst_len = sizeof(std::uint32_t);
-  auto const op_len = 2;
   auto const disp = reinterpret_cast<std::uintptr_t>(target) -
-                    reinterpret_cast<std::uintptr_t>(address) - dst_len -
-                    op_len;
-  *reinterpret_cast<std::uint32_t*>(&buf[op_len]) =
-    static_cast<std::uint32_t>(disp);
-  return buf;
+                    reinterpret_cast<std::uintptr_t>(address) - len;
+  return static_cast<std::uint32_t>(disp);
 }
 
-inline std::vector<std::uint8_t> GenCallTramp64(void* address, void* target)
+// The Gen* functions write a single instruction (sequence) for the given
+// remote address into buf, which must have room for the corresponding size in
+// PatchConstants.
+
+inline void GenJmp32(std::uint8_t* buf, void* address, void* target) noexcept
 {
-  std::vector<std::uint8_t> buf = {0xFF, 0x15, 0xEF, 0xBE, 0xAD, 0xDE};
-  auto const dst_len = sizeof(std::uint32_t);
-  auto const op_len = 2;
-  auto const disp = reinterpret_cast<std::uintptr_t>(target) -
-                    reinterpret_cast<std::uintptr_t>(address) - dst_len -
-                    op_len;
-  *reinterpret_cast<std::uint32_t*>(&buf[op_len]) =
-    static_cast<std::uint32_t>(disp);
-  return buf;
+  buf[0] = 0xE9;
+  StoreU32(buf + 1, GenRel32(address, target, PatchConstants::kJmpSize32));
 }
 
-inline std::vector<std::uint8_t> GenPush32Ret(void* target)
+inline void GenCall32(std::uint8_t* buf, void* address, void* target) noexcept
 {
-  // clang-format off
-  std::vector<std::uint8_t> buf =
+  buf[0] = 0xE8;
+  StoreU32(buf + 1, GenRel32(address, target, PatchConstants::kCallSize32));
+}
+
+// JMP QWORD PTR [RIP+Rel32]
+inline void
+  GenJmpTramp64(std::uint8_t* buf, void* address, void* target) noexcept
+{
+  buf[0] = 0xFF;
+  buf[1] = 0x25;
+  StoreU32(buf + 2, GenRel32(address, target, PatchConstants::kJmpSize64));
+}
+
+// CALL QWORD PTR [RIP+Rel32]
+inline void
+  GenCallTramp64(std::uint8_t* buf, void* address, void* target) noexcept
+{
+  buf[0] = 0xFF;
+  buf[1] = 0x15;
+  StoreU32(buf + 2, GenRel32(address, target, PatchConstants::kCallSize64));
+}
+
+inline void GenPush32Ret(std::uint8_t* buf, void* target) noexcept
+{
+  // PUSH 0xDEADBEEF
+  buf[0] = 0x68;
+  StoreU32(buf + 1,
+           static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(target) &
+                                      0xFFFFFFFF));
+  // RET
+  buf[5] = 0xC3;
+}
+
+inline void GenPush64Ret(std::uint8_t* buf, void* target) noexcept
+{
+  auto const target_uint = static_cast<std::uint64_t>(
+    reinterpret_cast<std::uintptr_t>(target));
+  // PUSH 0xDEADBEEF
+  buf[0] = 0x68;
+  StoreU32(buf + 1, static_cast<std::uint32_t>(target_uint & 0xFFFFFFFF));
+  // MOV DWORD PTR [RSP+0x4], 0xDEADBEEF
+  buf[5] = 0xC7;
+  buf[6] = 0x44;
+  buf[7] = 0x24;
+  buf[8] = 0x04;
+  StoreU32(buf + 9,
+           static_cast<std::uint32_t>((target_uint >> 32) & 0xFFFFFFFF));
+  // RET
+  buf[13] = 0xC3;
+}
+
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+inline void GenJmpAbs64(std::uint8_t* buf, void* target) noexcept
+{
+  // JMP QWORD PTR [RIP+0x0]
+  buf[0] = 0xFF;
+  buf[1] = 0x25;
+  StoreU32(buf + 2, 0);
+  // DQ target
+  StorePtr(buf + 6, target);
+}
+
+inline void GenCallAbs64(std::uint8_t* buf, void* target) noexcept
+{
+  // CALL QWORD PTR [RIP+0x2]
+  buf[0] = 0xFF;
+  buf[1] = 0x15;
+  StoreU32(buf + 2, 2);
+  // JMP +0x8
+  buf[6] = 0xEB;
+  buf[7] = 0x08;
+  // DQ target
+  StorePtr(buf + 8, target);
+}
+#endif
+
+// Emits a jump to target into a buffer which has no size constraints (unlike a
+// patch site), so far jumps can carry their own target inline instead of
+// needing a separate trampoline page.
+template <std::size_t N>
+inline void EmitJump(CodeBuffer<N>& code, void* target)
+{
+  void* const address = code.GetCursor();
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  if (!IsNear(address, target))
   {
-    // PUSH 0xDEADBEEF
-    0x68, 0xEF, 0xBE, 0xAD, 0xDE,
-    // RET
-    0xC3
-  };
-  // clang-format on
-  auto const op_len = 1;
-  auto const target_low = static_cast<std::uint32_t>(
-    reinterpret_cast<std::uintptr_t>(target) & 0xFFFFFFFF);
-  *reinterpret_cast<std::uint32_t*>(&buf[op_len]) = target_low;
-  return buf;
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Using absolute jump. Target = %p.",
+                                   target);
+    GenJmpAbs64(code.Reserve(PatchConstants::kJmpAbsSize64), target);
+    return;
+  }
+#endif
+  HADESMEM_DETAIL_TRACE_FORMAT_A("Using relative jump. Target = %p.", target);
+  GenJmp32(code.Reserve(PatchConstants::kJmpSize32), address, target);
 }
 
-inline std::vector<std::uint8_t> GenPush64Ret(void* target)
+template <std::size_t N>
+inline void EmitCall(CodeBuffer<N>& code, void* target)
 {
-  // clang-format off
-  std::vector<std::uint8_t> buf =
+  void* const address = code.GetCursor();
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  if (!IsNear(address, target))
   {
-    // PUSH 0xDEADBEEF
-    0x68, 0xEF, 0xBE, 0xAD, 0xDE,
-    // MOV DWORD PTR [RSP+0x4], 0xDEADBEEF
-    0xC7, 0x44, 0x24, 0x04, 0xEF, 0xBE, 0xAD, 0xDE,
-    // RET
-    0xC3
-  };
-  // clang-format on
-  auto const low_data_offs = 1;
-  auto const high_data_offs = 9;
-  auto const target_uint = reinterpret_cast<std::uint64_t>(target);
-  auto const target_high =
-    static_cast<std::uint32_t>((target_uint >> 32) & 0xFFFFFFFF);
-  auto const target_low = static_cast<std::uint32_t>(target_uint & 0xFFFFFFFF);
-  *reinterpret_cast<std::uint32_t*>(&buf[low_data_offs]) = target_low;
-  *reinterpret_cast<std::uint32_t*>(&buf[high_data_offs]) = target_high;
-  return buf;
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Using absolute call. Target = %p.",
+                                   target);
+    GenCallAbs64(code.Reserve(PatchConstants::kCallAbsSize64), target);
+    return;
+  }
+#endif
+  HADESMEM_DETAIL_TRACE_FORMAT_A("Using relative call. Target = %p.", target);
+  GenCall32(code.Reserve(PatchConstants::kCallSize32), address, target);
+}
+
+// Atomically increments the counter at the given address without clobbering
+// any registers (flags are clobbered, so only use this at a call boundary).
+// The counter is 64-bit on x64 and 32-bit on x86.
+template <std::size_t N>
+inline void EmitCounterInc(CodeBuffer<N>& code, void* counter)
+{
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  std::uint8_t* const buf = code.Reserve(PatchConstants::kCounterIncSize);
+  // PUSH RAX
+  buf[0] = 0x50;
+  // MOV RAX, 0xDEADBEEFDEADBEEF
+  buf[1] = 0x48;
+  buf[2] = 0xB8;
+  StorePtr(buf + 3, counter);
+  // LOCK INC QWORD PTR [RAX]
+  buf[11] = 0xF0;
+  buf[12] = 0x48;
+  buf[13] = 0xFF;
+  buf[14] = 0x00;
+  // POP RAX
+  buf[15] = 0x58;
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  std::uint8_t* const buf = code.Reserve(PatchConstants::kCounterIncSize);
+  // LOCK INC DWORD PTR [0xDEADBEEF]
+  buf[0] = 0xF0;
+  buf[1] = 0xFF;
+  buf[2] = 0x05;
+  StorePtr(buf + 3, counter);
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+}
+
+// Writes the code to its remote address and flushes the instruction cache.
+template <std::size_t N>
+inline void WriteCode(Process const& process, CodeBuffer<N> const& code)
+{
+  HADESMEM_DETAIL_ASSERT(code.GetSize() != 0);
+  Write(process,
+        code.GetAddress(),
+        code.GetData(),
+        code.GetData() + code.GetSize());
+  FlushInstructionCache(process, code.GetAddress(), code.GetSize());
 }
 
+// Writes a jump at a patch site, which (unlike EmitJump) has to be kept as
+// small as possible.
 inline std::size_t
   WriteJump(Process const& process,
             void* address,
@@ -252,14 +437,13 @@ inline std::size_t
     target,
     static_cast<std::uint32_t>(push_ret_fallback));
 
-  std::vector<std::uint8_t> jump_buf;
+  CodeBuffer<PatchConstants::kMaxJumpSize> code{address};
 
 #if defined(HADESMEM_DETAIL_ARCH_X64)
   if (IsNear(address, target))
   {
     HADESMEM_DETAIL_TRACE_A("Using relative jump.");
-    jump_buf = GenJmp32(address, target);
-    HADESMEM_DETAIL_ASSERT(jump_buf.size() == PatchConstants::kJmpSize32);
+    GenJmp32(code.Reserve(PatchConstants::kJmpSize32), address, target);
   }
   else
   {
@@ -288,8 +472,8 @@ inline std::size_t
 
       trampolines->emplace_back(std::move(trampoline));
 
-      jump_buf = GenJmpTramp64(address, tramp_addr);
-      HADESMEM_DETAIL_ASSERT(jump_buf.size() == PatchConstants::kJmpSize64);
+      GenJmpTramp64(
+        code.Reserve(PatchConstants::kJmpSize64), address, tramp_addr);
     }
     else
     {
@@ -308,16 +492,12 @@ inline std::size_t
       if (target_high)
       {
         HADESMEM_DETAIL_TRACE_A("Push/ret 'jump' is big.");
-        jump_buf = GenPush64Ret(target);
-        HADESMEM_DETAIL_ASSERT(jump_buf.size() ==
-                               PatchConstants::kPushRetSize64);
+        GenPush64Ret(code.Reserve(PatchConstants::kPushRetSize64), target);
       }
       else
       {
         HADESMEM_DETAIL_TRACE_A("Push/ret 'jump' is small.");
-        jump_buf = GenPush32Ret(target);
-        HADESMEM_DETAIL_ASSERT(jump_buf.size() ==
-                               PatchConstants::kPushRetSize32);
+        GenPush32Ret(code.Reserve(PatchConstants::kPushRetSize32), target);
       }
     }
   }
@@ -325,67 +505,29 @@ inline std::size_t
   (void)push_ret_fallback;
   (void)trampolines;
   HADESMEM_DETAIL_TRACE_A("Using relative jump.");
-  jump_buf = GenJmp32(address, target);
-  HADESMEM_DETAIL_ASSERT(jump_buf.size() == PatchConstants::kJmpSize32);
+  GenJmp32(code.Reserve(PatchConstants::kJmpSize32), address, target);
 #else
 #error "[HadesMem] Unsupported architecture."
 #endif
 
-  WriteVector(process, address, jump_buf);
+  Write(process, address, code.GetData(), code.GetData() + code.GetSize());
 
-  return jump_buf.size();
-}
-
-inline std::size_t
-  WriteCall(Process const& process,
-            void* address,
-            void* target,
-            std::vector<std::unique_ptr<Allocator>>& trampolines)
-{
-  HADESMEM_DETAIL_TRACE_FORMAT_A("Address = %p, Target = %p", address, target);
-
-  std::vector<std::uint8_t> call_buf;
-
-// TODO: Avoid using a trampoline where possible.
-#if defined(HADESMEM_DETAIL_ARCH_X64)
-  std::unique_ptr<Allocator> trampoline = AllocatePageNear(process, address);
-
-  PVOID tramp_addr = trampoline->GetBase();
-
-  HADESMEM_DETAIL_TRACE_FORMAT_A("Using trampoline call. Trampoline = %p.",
-                                 tramp_addr);
-
-  Write(process, tramp_addr, reinterpret_cast<std::uintptr_t>(target));
-
-  trampolines.emplace_back(std::move(trampoline));
-
-  call_buf = GenCallTramp64(address, tramp_addr);
-  HADESMEM_DETAIL_ASSERT(call_buf.size() == PatchConstants::kCallSize64);
-#elif defined(HADESMEM_DETAIL_ARCH_X86)
-  (void)trampolines;
-  HADESMEM_DETAIL_TRACE_A("Using relative call.");
-  call_buf = GenCall32(address, target);
-  HADESMEM_DETAIL_ASSERT(call_buf.size() == PatchConstants::kCallSize32);
-#else
-#error "[HadesMem] Unsupported architecture."
-#endif
-
-  WriteVector(process, address, call_buf);
-
-  return call_buf.size();
+  return code.GetSize();
 }
 
 // TODO: Add frame pointer so we can unwind the stack while debugging?
 // TODO: Ensure we're correcty saving all registers/state. Currently
 // we're only saving regular registers. What about eflags, fpu, sse, etc.
-inline std::vector<std::uint8_t> GenStubGate32(void* stub,
-                                               void* get_orig_user_ptr_ptr_fn,
-                                               void* get_ret_address_ptr_ptr_fn)
+template <std::size_t N>
+inline void EmitStubGate32(CodeBuffer<N>& code,
+                           void* stub,
+                           void* get_orig_user_ptr_ptr_fn,
+                           void* get_ret_address_ptr_ptr_fn)
 {
   HADESMEM_DETAIL_ASSERT(stub);
   HADESMEM_DETAIL_ASSERT(get_orig_user_ptr_ptr_fn);
   // clang-format off
-  std::vector<std::uint8_t> buf =
+  static std::uint8_t const kStubGate[] =
   {
     // Add NOPs so Steam overlay works. It follows our hook, and it does not 
     // recognize the opcode sequence otherwise.
@@ -428,22 +570,25 @@ inline std::vector<std::uint8_t> GenStubGate32(void* stub,
   std::size_t const kRetAddrPtrOfs = 11;
   std::size_t const kStubPtrOfs = 29;
   std::size_t const kUserPtrOfs = 40;
-  *reinterpret_cast<void**>(&buf[kRetAddrPtrOfs]) = get_ret_address_ptr_ptr_fn;
-  *reinterpret_cast<void**>(&buf[kStubPtrOfs]) = stub;
-  *reinterpret_cast<void**>(&buf[kUserPtrOfs]) = get_orig_user_ptr_ptr_fn;
-  return buf;
+  std::uint8_t* const buf = code.Reserve(sizeof(kStubGate));
+  std::memcpy(buf, kStubGate, sizeof(kStubGate));
+  StorePtr(buf + kRetAddrPtrOfs, get_ret_address_ptr_ptr_fn);
+  StorePtr(buf + kStubPtrOfs, stub);
+  StorePtr(buf + kUserPtrOfs, get_orig_user_ptr_ptr_fn);
 }
 
 // TODO: Ensure we're correcty saving all registers/state. Currently
 // we're only saving regular registers. What about eflags, fpu, sse, etc.
-inline std::vector<std::uint8_t> GenStubGate64(void* stub,
-                                               void* get_orig_user_ptr_ptr_fn,
-                                               void* get_ret_address_ptr_ptr_fn)
+template <std::size_t N>
+inline void EmitStubGate64(CodeBuffer<N>& code,
+                           void* stub,
+                           void* get_orig_user_ptr_ptr_fn,
+                           void* get_ret_address_ptr_ptr_fn)
 {
   HADESMEM_DETAIL_ASSERT(stub);
   HADESMEM_DETAIL_ASSERT(get_orig_user_ptr_ptr_fn);
   // clang-format off
-  std::vector<std::uint8_t> buf =
+  static std::uint8_t const kStubGate[] =
   {
     // PUSH RAX
     0x50,
@@ -538,36 +683,43 @@ inline std::vector<std::uint8_t> GenStubGate64(void* stub,
   std::size_t const kRetAddrPtrOfs = 30;
   std::size_t const kStubPtrOfs = 56;
   std::size_t const kUserPtrOfs = 75;
-  *reinterpret_cast<void**>(&buf[kRetAddrPtrOfs]) = get_ret_address_ptr_ptr_fn;
-  *reinterpret_cast<void**>(&buf[kStubPtrOfs]) = stub;
-  *reinterpret_cast<void**>(&buf[kUserPtrOfs]) = get_orig_user_ptr_ptr_fn;
-  return buf;
+  std::uint8_t* const buf = code.Reserve(sizeof(kStubGate));
+  std::memcpy(buf, kStubGate, sizeof(kStubGate));
+  StorePtr(buf + kRetAddrPtrOfs, get_ret_address_ptr_ptr_fn);
+  StorePtr(buf + kStubPtrOfs, stub);
+  StorePtr(buf + kUserPtrOfs, get_orig_user_ptr_ptr_fn);
 }
 
-template <typename TargetFuncT>
-inline void WriteStubGate(Process const& process,
-                          void* address,
-                          void* stub,
-                          void* get_orig_user_ptr_ptr_fn,
-                          void* get_ret_address_ptr_ptr_fn)
+template <typename TargetFuncT, std::size_t N>
+inline void EmitStubGate(CodeBuffer<N>& code,
+                         void* stub,
+                         void* get_orig_user_ptr_ptr_fn,
+                         void* get_ret_address_ptr_ptr_fn)
 {
   using StubT = typename PatchDetourStub<TargetFuncT>;
 #if defined(HADESMEM_DETAIL_ARCH_X64)
-  auto const stub_gate =
-    GenStubGate64(stub, get_orig_user_ptr_ptr_fn, get_ret_address_ptr_ptr_fn);
+  EmitStubGate64(
+    code, stub, get_orig_user_ptr_ptr_fn, get_ret_address_ptr_ptr_fn);
 #elif defined(HADESMEM_DETAIL_ARCH_X86)
-  auto const stub_gate =
-    GenStubGate32(stub, get_orig_user_ptr_ptr_fn, get_ret_address_ptr_ptr_fn);
+  EmitStubGate32(
+    code, stub, get_orig_user_ptr_ptr_fn, get_ret_address_ptr_ptr_fn);
 #else
 #error "[HadesMem] Unsupported architecture."
 #endif
-  WriteVector(process, address, stub_gate);
-  WriteJump(process,
-            static_cast<std::uint8_t*>(address) + stub_gate.size(),
-            &StubT::Stub,
-            true,
-            nullptr);
-  FlushInstructionCache(process, address, stub_gate.size());
+  EmitJump(code, &StubT::Stub);
+}
+
+template <typename TargetFuncT>
+inline void WriteStubGate(Process const& process,
+                          void* address,
+                          void* stub,
+                          void* get_orig_user_ptr_ptr_fn,
+                          void* get_ret_address_ptr_ptr_fn)
+{
+  CodeBuffer<PatchConstants::kMaxStubGateSize> code{address};
+  EmitStubGate<TargetFuncT>(
+    code, stub, get_orig_user_ptr_ptr_fn, get_ret_address_ptr_ptr_fn);
+  WriteCode(process, code);
 }
 }
 }
\ No newline at end of file
@@ -0,0 +1,153 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <udis86.h>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <windows.h>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/patch_code_gen.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// Relocates whole instructions from the start of target until at least
+// patch_size bytes are covered, followed by a jump back to the remaining
+// original code. Relative jumps/calls are rebuilt to point at their original
+// destination. Works for any process, as the target is only accessed through
+// Read. Returns the number of bytes of original code which were relocated.
+template <std::size_t N>
+inline std::size_t EmitTrampoline(Process const& process,
+                                  void* target,
+                                  std::size_t patch_size,
+                                  CodeBuffer<N>& code)
+{
+  std::size_t const kMaxInstructionLen = 15;
+  std::size_t const kTrampSize = kMaxInstructionLen * 3;
+
+  auto const buffer = Read<std::uint8_t, kTrampSize>(process, target);
+
+  // TODO: Port to use Capstone instead.
+  // TODO: Add a disassembler module to abstract away the actual disassembly
+  // library being used (so later it can be replaced with a custom one, or
+  // support multiple backends, etc). Also useful when writing other tools
+  // like a standalone debugger/disassembler, memory editor, etc.
+  ud_t ud_obj;
+  ud_init(&ud_obj);
+  ud_set_input_buffer(&ud_obj, buffer.data(), buffer.size());
+  ud_set_syntax(&ud_obj, UD_SYN_INTEL);
+  ud_set_pc(&ud_obj, reinterpret_cast<std::uint64_t>(target));
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  ud_set_mode(&ud_obj, 64);
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  ud_set_mode(&ud_obj, 32);
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+
+  // TODO: Detect backward jumps into the detour and fail/notify/etc.
+  std::uint32_t instr_size = 0;
+  do
+  {
+    std::uint32_t const len = ud_disassemble(&ud_obj);
+    if (len == 0)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Disassembly failed."});
+    }
+
+#if !defined(HADESMEM_NO_TRACE)
+    char const* const asm_str = ud_insn_asm(&ud_obj);
+    char const* const asm_bytes_str = ud_insn_hex(&ud_obj);
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "%s. [%s].",
+      (asm_str ? asm_str : "Invalid."),
+      (asm_bytes_str ? asm_bytes_str : "Invalid."));
+#endif
+
+    // TODO: Improve support for rebuilding relative instructions, especially
+    // on x64.
+    ud_operand_t const* const op = ud_insn_opr(&ud_obj, 0);
+    bool is_jimm = op && op->type == UD_OP_JIMM;
+    // Handle JMP QWORD PTR [RIP+Rel32]. Necessary for hook chain support.
+    bool is_jmem = op && op->type == UD_OP_MEM && op->base == UD_R_RIP &&
+                   op->index == UD_NONE && op->scale == 0 && op->size == 0x40;
+    if ((ud_obj.mnemonic == UD_Ijmp || ud_obj.mnemonic == UD_Icall) && op &&
+        (is_jimm || is_jmem))
+    {
+      std::uint16_t const size = is_jimm ? op->size : op->offset;
+      HADESMEM_DETAIL_TRACE_FORMAT_A("Operand/offset size is %hu.", size);
+      std::int64_t const insn_target = [&]() -> std::int64_t {
+        switch (size)
+        {
+        case sizeof(std::int8_t) * CHAR_BIT:
+          return op->lval.sbyte;
+        case sizeof(std::int16_t) * CHAR_BIT:
+          return op->lval.sword;
+        case sizeof(std::int32_t) * CHAR_BIT:
+          return op->lval.sdword;
+        case sizeof(std::int64_t) * CHAR_BIT:
+          return op->lval.sqword;
+        default:
+          HADESMEM_DETAIL_ASSERT(false);
+          HADESMEM_DETAIL_THROW_EXCEPTION(
+            Error{} << ErrorString{"Unknown instruction size."});
+        }
+      }();
+
+      auto const resolve_rel =
+        [](std::uint64_t base, std::int64_t rel, std::uint32_t insn_len) {
+          return reinterpret_cast<std::uint8_t*>(
+                   static_cast<std::uintptr_t>(base)) +
+                 rel + insn_len;
+        };
+
+      std::uint64_t const insn_base = ud_insn_off(&ud_obj);
+      std::uint32_t const insn_len = ud_insn_len(&ud_obj);
+
+      auto const resolved_target =
+        resolve_rel(insn_base, insn_target, insn_len);
+      void* const jump_target =
+        is_jimm ? resolved_target : Read<void*>(process, resolved_target);
+      HADESMEM_DETAIL_TRACE_FORMAT_A("Jump/call target = %p.", jump_target);
+      if (ud_obj.mnemonic == UD_Ijmp)
+      {
+        HADESMEM_DETAIL_TRACE_A("Writing resolved jump.");
+        EmitJump(code, jump_target);
+      }
+      else
+      {
+        HADESMEM_DETAIL_ASSERT(ud_obj.mnemonic == UD_Icall);
+        HADESMEM_DETAIL_TRACE_A("Writing resolved call.");
+        EmitCall(code, jump_target);
+      }
+    }
+    else
+    {
+      code.Emit(ud_insn_ptr(&ud_obj), len);
+    }
+
+    instr_size += len;
+  } while (instr_size < patch_size);
+
+  HADESMEM_DETAIL_TRACE_A("Writing jump back to original code.");
+
+  EmitJump(code, static_cast<std::uint8_t*>(target) + instr_size);
+
+  return instr_size;
+}
+}
+}
@@ -0,0 +1,403 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/bound_import_desc.hpp>
+#include <hadesmem/pelib/bound_import_desc_list.hpp>
+#include <hadesmem/pelib/bound_import_fwd_ref.hpp>
+#include <hadesmem/pelib/bound_import_fwd_ref_list.hpp>
+#include <hadesmem/pelib/dos_header.hpp>
+#include <hadesmem/pelib/export.hpp>
+#include <hadesmem/pelib/export_dir.hpp>
+#include <hadesmem/pelib/export_list.hpp>
+#include <hadesmem/pelib/import_dir.hpp>
+#include <hadesmem/pelib/import_dir_list.hpp>
+#include <hadesmem/pelib/import_thunk.hpp>
+#include <hadesmem/pelib/import_thunk_list.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/overlay.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/pelib/relocation.hpp>
+#include <hadesmem/pelib/relocation_block.hpp>
+#include <hadesmem/pelib/relocation_block_list.hpp>
+#include <hadesmem/pelib/relocation_list.hpp>
+#include <hadesmem/pelib/section.hpp>
+#include <hadesmem/pelib/section_list.hpp>
+#include <hadesmem/pelib/tls_dir.hpp>
+#include <hadesmem/process.hpp>
+
+// Runs every PeLib component over a file held in memory, for fuzzers (see
+// examples/pefuzz) and for replaying the regression corpus. PeLib is expected
+// to reject malformed input by throwing hadesmem::Error, so that's all which
+// is caught. Anything else (a crash, an assert, any other exception, running
+// out of budget) is a bug.
+//
+// Some structures are walked until a terminator, or until a count which comes
+// from the file, so a bad file can keep PeLib busy for a very long time. Every
+// item visited is counted against a budget, and once it's used up the
+// remaining components are skipped and the result says so.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct PeFuzzComponent
+{
+  enum : std::uint32_t
+  {
+    kNone = 0,
+    kDosHeader = 1 << 0,
+    kNtHeaders = 1 << 1,
+    kSections = 1 << 2,
+    kExports = 1 << 3,
+    kImports = 1 << 4,
+    kBoundImports = 1 << 5,
+    kRelocations = 1 << 6,
+    kTls = 1 << 7,
+    kOverlay = 1 << 8,
+    kAll = (1 << 9) - 1,
+    kInvalidFlagMaxValue = 1 << 9,
+  };
+};
+
+struct PeFuzzBudget
+{
+  std::size_t max_items;
+  std::chrono::milliseconds max_time;
+};
+
+// Generous enough for any sane file (the samples need a few dozen items).
+inline PeFuzzBudget GetDefaultPeFuzzBudget() noexcept
+{
+  return PeFuzzBudget{0x10000, std::chrono::milliseconds{1000}};
+}
+
+struct PeFuzzResult
+{
+  std::size_t num_items;
+  // Number of components which rejected the file.
+  std::size_t num_errors;
+  bool budget_exhausted;
+};
+
+class PeFuzzCounter
+{
+public:
+  struct Exhausted
+  {
+  };
+
+  explicit PeFuzzCounter(PeFuzzBudget const& budget)
+    : budget_(budget), deadline_{std::chrono::steady_clock::now() +
+                                 budget.max_time}
+  {
+  }
+
+  // Throws Exhausted once the budget is used up.
+  void Tick()
+  {
+    ++num_items_;
+    if (num_items_ > budget_.max_items ||
+        (!(num_items_ % 0x100) && std::chrono::steady_clock::now() > deadline_))
+    {
+      throw Exhausted{};
+    }
+  }
+
+  std::size_t GetNumItems() const noexcept
+  {
+    return num_items_;
+  }
+
+private:
+  PeFuzzBudget budget_;
+  std::chrono::steady_clock::time_point deadline_;
+  std::size_t num_items_{};
+};
+
+// For APIs which fill an output iterator, so the loop inside PeLib is bounded
+// too.
+struct PeFuzzSink
+{
+  using value_type = ULONGLONG;
+
+  void push_back(ULONGLONG const& /*value*/)
+  {
+    counter->Tick();
+  }
+
+  PeFuzzCounter* counter;
+};
+
+inline void FuzzPeDosHeader(Process const& process,
+                            PeFile const& pe_file,
+                            PeFuzzCounter& counter)
+{
+  DosHeader const dos_header{process, pe_file};
+  counter.Tick();
+  (void)dos_header.GetNewHeaderOffset();
+}
+
+inline void FuzzPeNtHeaders(Process const& process,
+                            PeFile const& pe_file,
+                            PeFuzzCounter& counter)
+{
+  NtHeaders const nt_headers{process, pe_file};
+  counter.Tick();
+  (void)nt_headers.GetSizeOfImage();
+  for (DWORD i = 0; i < nt_headers.GetNumberOfRvaAndSizesClamped(); ++i)
+  {
+    counter.Tick();
+    (void)nt_headers.GetDataDirectoryVirtualAddress(static_cast<PeDataDir>(i));
+    (void)nt_headers.GetDataDirectorySize(static_cast<PeDataDir>(i));
+  }
+}
+
+inline void FuzzPeSections(Process const& process,
+                           PeFile const& pe_file,
+                           PeFuzzCounter& counter)
+{
+  SectionList const sections{process, pe_file};
+  for (auto const& section : sections)
+  {
+    counter.Tick();
+    (void)section.GetName();
+    (void)section.GetVirtualAddress();
+    (void)section.GetSizeOfRawData();
+  }
+}
+
+inline void FuzzPeExports(Process const& process,
+                          PeFile const& pe_file,
+                          PeFuzzCounter& counter)
+{
+  ExportDir const export_dir{process, pe_file};
+  counter.Tick();
+  (void)export_dir.GetName();
+
+  ExportList const exports{process, pe_file};
+  for (auto const& e : exports)
+  {
+    counter.Tick();
+    if (e.ByName())
+    {
+      (void)e.GetName();
+    }
+    if (e.IsForwarded())
+    {
+      (void)e.GetForwarderModule();
+      if (e.IsForwardedByOrdinal())
+      {
+        (void)e.GetForwarderOrdinal();
+      }
+      else
+      {
+        (void)e.GetForwarderFunction();
+      }
+    }
+  }
+}
+
+inline void FuzzPeImportThunks(Process const& process,
+                               PeFile const& pe_file,
+                               DWORD first_thunk,
+                               PeFuzzCounter& counter)
+{
+  if (!first_thunk)
+  {
+    return;
+  }
+
+  ImportThunkList const thunks{process, pe_file, first_thunk};
+  for (auto const& thunk : thunks)
+  {
+    counter.Tick();
+    if (thunk.ByOrdinal())
+    {
+      (void)thunk.GetOrdinal();
+    }
+    else
+    {
+      (void)thunk.GetHint();
+      (void)thunk.GetName();
+    }
+  }
+}
+
+inline void FuzzPeImports(Process const& process,
+                          PeFile const& pe_file,
+                          PeFuzzCounter& counter)
+{
+  ImportDirList const import_dirs{process, pe_file};
+  for (auto const& import_dir : import_dirs)
+  {
+    counter.Tick();
+    (void)import_dir.GetName();
+    // Each thunk list is allowed to fail on its own.
+    try
+    {
+      FuzzPeImportThunks(
+        process, pe_file, import_dir.GetOriginalFirstThunk(), counter);
+    }
+    catch (Error const& /*e*/)
+    {
+    }
+    FuzzPeImportThunks(process, pe_file, import_dir.GetFirstThunk(), counter);
+  }
+}
+
+inline void FuzzPeBoundImports(Process const& process,
+                               PeFile const& pe_file,
+                               PeFuzzCounter& counter)
+{
+  BoundImportDescriptorList const descs{process, pe_file};
+  for (auto const& desc : descs)
+  {
+    counter.Tick();
+    (void)desc.GetModuleName();
+
+    BoundImportForwarderRefList const forwarder_refs{process, pe_file, desc};
+    for (auto const& forwarder_ref : forwarder_refs)
+    {
+      counter.Tick();
+      (void)forwarder_ref.GetModuleName();
+    }
+  }
+}
+
+inline void FuzzPeRelocations(Process const& process,
+                              PeFile const& pe_file,
+                              PeFuzzCounter& counter)
+{
+  RelocationBlockList const blocks{process, pe_file};
+  for (auto const& block : blocks)
+  {
+    counter.Tick();
+    RelocationList const relocs{process,
+                                pe_file,
+                                block.GetRelocationDataStart(),
+                                block.GetNumberOfRelocations()};
+    for (auto const& reloc : relocs)
+    {
+      counter.Tick();
+      (void)reloc.GetType();
+      (void)reloc.GetOffset();
+    }
+  }
+}
+
+inline void FuzzPeTls(Process const& process,
+                      PeFile const& pe_file,
+                      PeFuzzCounter& counter)
+{
+  TlsDir const tls_dir{process, pe_file};
+  counter.Tick();
+  if (tls_dir.GetAddressOfCallBacks())
+  {
+    PeFuzzSink sink{&counter};
+    tls_dir.GetCallbacks(std::back_inserter(sink));
+  }
+}
+
+inline void FuzzPeOverlay(Process const& process,
+                          PeFile const& pe_file,
+                          PeFuzzCounter& counter)
+{
+  Overlay const overlay{process, pe_file};
+  counter.Tick();
+  (void)overlay.GetOffset();
+  (void)overlay.GetSize();
+}
+
+using PeFuzzFunc = void (*)(Process const&, PeFile const&, PeFuzzCounter&);
+
+struct PeFuzzTarget
+{
+  std::uint32_t component;
+  char const* name;
+  PeFuzzFunc func;
+};
+
+// In the order they're run by FuzzPeBuffer.
+inline std::vector<PeFuzzTarget> const& GetPeFuzzTargets()
+{
+  static std::vector<PeFuzzTarget> const targets = {
+    {PeFuzzComponent::kDosHeader, "dos_header", &FuzzPeDosHeader},
+    {PeFuzzComponent::kNtHeaders, "nt_headers", &FuzzPeNtHeaders},
+    {PeFuzzComponent::kSections, "section_list", &FuzzPeSections},
+    {PeFuzzComponent::kExports, "export_list", &FuzzPeExports},
+    {PeFuzzComponent::kImports, "import_dir_list", &FuzzPeImports},
+    {PeFuzzComponent::kBoundImports, "bound_import_desc_list",
+     &FuzzPeBoundImports},
+    {PeFuzzComponent::kRelocations, "relocation_block_list",
+     &FuzzPeRelocations},
+    {PeFuzzComponent::kTls, "tls_dir", &FuzzPeTls},
+    {PeFuzzComponent::kOverlay, "overlay", &FuzzPeOverlay}};
+  return targets;
+}
+
+// The data is copied, because PeLib wants a writable buffer and fuzzers hand
+// over a const one.
+inline PeFuzzResult
+  FuzzPeBuffer(void const* data,
+               std::size_t size,
+               PeFuzzBudget const& budget,
+               std::uint32_t components = PeFuzzComponent::kAll)
+{
+  HADESMEM_DETAIL_ASSERT(
+    !(components & ~(PeFuzzComponent::kInvalidFlagMaxValue - 1UL)));
+
+  PeFuzzResult result{};
+  if (!size || size > (std::numeric_limits<DWORD>::max)())
+  {
+    return result;
+  }
+
+  std::vector<std::uint8_t> buf(static_cast<std::uint8_t const*>(data),
+                                static_cast<std::uint8_t const*>(data) + size);
+  Process const process{::GetCurrentProcessId()};
+  PeFile const pe_file{
+    process, buf.data(), PeFileType::kData, static_cast<DWORD>(size)};
+
+  PeFuzzCounter counter{budget};
+  for (auto const& target : GetPeFuzzTargets())
+  {
+    if (!(components & target.component))
+    {
+      continue;
+    }
+
+    try
+    {
+      target.func(process, pe_file, counter);
+    }
+    catch (Error const& /*e*/)
+    {
+      ++result.num_errors;
+    }
+    catch (PeFuzzCounter::Exhausted const& /*e*/)
+    {
+      result.budget_exhausted = true;
+      break;
+    }
+  }
+
+  result.num_items = counter.GetNumItems();
+  return result;
+}
+}
+}
@@ -0,0 +1,249 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// File layout planning and output for rebuilt PE images (PeDumper). The
+// layout of the headers and every section is worked out up front, so the
+// buffer holding them can be allocated once at its final size. Anything
+// which is only known later (e.g. reconstructed import directories) is added
+// as a separate part rather than being appended to that buffer, and the
+// parts are streamed out in file order with the gaps zero filled.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+inline std::uint64_t AlignUp(std::uint64_t n, std::uint64_t m) noexcept
+{
+  if (!m)
+  {
+    return n;
+  }
+
+  auto const r = n % m;
+  return r ? n + m - r : n;
+}
+
+struct PeLayoutSectionIn
+{
+  std::uint32_t virtual_address;
+  std::uint32_t virtual_size;
+  std::uint32_t size_of_raw_data;
+  std::uint32_t pointer_to_raw_data;
+};
+
+struct PeLayoutSection
+{
+  std::uint32_t pointer_to_raw_data;
+  // Bytes reserved in the file for the section (its virtual size rounded up
+  // to the section alignment). Zero if the section has no data in the image.
+  std::uint32_t file_size;
+  // Number of bytes to copy from the image, starting at the section's VA.
+  std::uint32_t copy_size;
+};
+
+struct PeLayout
+{
+  std::vector<PeLayoutSection> sections;
+  std::uint64_t file_size;
+};
+
+// Sections are laid out in header order. Each one keeps its original raw
+// pointer if that doesn't overlap what came before, and is otherwise moved
+// to the next file aligned offset. Each one gets room for all of its virtual
+// data, as that's what's useful for analysis.
+// TODO: It's not always correct to use VirtualSize here. It's great for
+// analysis reasons, but if you want runnable dumps some programs might
+// rely on that virtual space to be zero'd out at runtime.
+inline PeLayout PlanPeLayout(std::uint32_t size_of_headers,
+                             std::uint32_t file_alignment,
+                             std::uint32_t section_alignment,
+                             std::uint64_t image_size,
+                             std::vector<PeLayoutSectionIn> const& sections)
+{
+  PeLayout layout{{}, size_of_headers};
+  for (auto const& section : sections)
+  {
+    auto const section_size = static_cast<std::uint32_t>(
+      AlignUp((std::max)(section.virtual_size, section.size_of_raw_data),
+              section_alignment));
+    auto const ptr_raw_data_tmp = section.pointer_to_raw_data < layout.file_size
+                                    ? AlignUp(layout.file_size, file_alignment)
+                                    : section.pointer_to_raw_data;
+    auto const ptr_raw_data =
+      static_cast<std::uint32_t>(AlignUp(ptr_raw_data_tmp, file_alignment));
+
+    layout.file_size = (std::max)(layout.file_size,
+                                  static_cast<std::uint64_t>(ptr_raw_data));
+
+    PeLayoutSection planned{ptr_raw_data, 0, 0};
+    if (section.virtual_address < image_size)
+    {
+      planned.file_size = section_size;
+      planned.copy_size = static_cast<std::uint32_t>((std::min)(
+        static_cast<std::uint64_t>(section_size),
+        image_size - section.virtual_address));
+      layout.file_size += section_size;
+    }
+
+    layout.sections.push_back(planned);
+  }
+
+  return layout;
+}
+
+// Drops trailing zero dwords from the section data, but never below the
+// original raw size, then rounds up to the file alignment.
+inline std::uint32_t GetTrimmedRawSize(std::uint8_t const* data,
+                                       std::uint32_t size,
+                                       std::uint32_t min_size,
+                                       std::uint32_t file_alignment) noexcept
+{
+  size -= size % sizeof(std::uint32_t);
+  while (size > min_size && size >= sizeof(std::uint32_t))
+  {
+    std::uint32_t value;
+    std::memcpy(&value, data + size - sizeof(value), sizeof(value));
+    if (value)
+    {
+      break;
+    }
+
+    size -= sizeof(value);
+  }
+
+  return static_cast<std::uint32_t>(AlignUp(size, file_alignment));
+}
+
+class PeImageWriter
+{
+public:
+  // Parts must be added in offset order. A part which starts before the end
+  // of the previous one truncates it. A null data pointer means zero fill.
+  void AddPart(std::uint64_t offset, void const* data, std::size_t size)
+  {
+    HADESMEM_DETAIL_ASSERT(parts_.empty() || offset >= parts_.back().offset);
+
+    parts_.push_back(
+      Part{offset, static_cast<std::uint8_t const*>(data), size});
+  }
+
+  // Pads or truncates the output. Defaults to the end of the furthest part.
+  void SetFileSize(std::uint64_t size) noexcept
+  {
+    file_size_ = size;
+    is_file_size_set_ = true;
+  }
+
+  std::uint64_t GetFileSize() const noexcept
+  {
+    if (is_file_size_set_)
+    {
+      return file_size_;
+    }
+
+    std::uint64_t size = 0;
+    for (std::size_t i = 0; i < parts_.size(); ++i)
+    {
+      size = (std::max)(size, parts_[i].offset + GetPartSize(i));
+    }
+    return size;
+  }
+
+  // Calls write(data, size) with consecutive pieces of the file, from the
+  // start.
+  template <typename WriteFunc> void Stream(WriteFunc const& write) const
+  {
+    std::uint64_t const file_size = GetFileSize();
+    std::uint64_t pos = 0;
+    for (std::size_t i = 0; i < parts_.size() && pos < file_size; ++i)
+    {
+      Part const& part = parts_[i];
+      WriteZeros(write, (std::min)(part.offset, file_size) - pos);
+      pos = (std::min)(part.offset, file_size);
+
+      auto const size = static_cast<std::size_t>((std::min)(
+        static_cast<std::uint64_t>(GetPartSize(i)), file_size - pos));
+      if (part.data)
+      {
+        write(part.data, size);
+      }
+      else
+      {
+        WriteZeros(write, size);
+      }
+      pos += size;
+    }
+
+    WriteZeros(write, file_size - pos);
+  }
+
+  void Write(std::ostream& out) const
+  {
+    Stream([&](void const* data, std::size_t size) {
+      out.write(static_cast<char const*>(data),
+                static_cast<std::streamsize>(size));
+    });
+  }
+
+  // The buffer (e.g. a file mapping) must be at least GetFileSize() bytes.
+  void Write(std::uint8_t* buffer) const
+  {
+    Stream([&](void const* data, std::size_t size) {
+      std::memcpy(buffer, data, size);
+      buffer += size;
+    });
+  }
+
+private:
+  struct Part
+  {
+    std::uint64_t offset;
+    std::uint8_t const* data;
+    std::size_t size;
+  };
+
+  std::size_t GetPartSize(std::size_t i) const noexcept
+  {
+    Part const& part = parts_[i];
+    if (i + 1 == parts_.size())
+    {
+      return part.size;
+    }
+
+    return static_cast<std::size_t>(
+      (std::min)(static_cast<std::uint64_t>(part.size),
+                 parts_[i + 1].offset - part.offset));
+  }
+
+  template <typename WriteFunc>
+  static void WriteZeros(WriteFunc const& write, std::uint64_t size)
+  {
+    static std::uint8_t const zeros[0x1000] = {};
+    while (size)
+    {
+      auto const len = static_cast<std::size_t>(
+        (std::min)(size, std::uint64_t{sizeof(zeros)}));
+      write(zeros, len);
+      size -= len;
+    }
+  }
+
+  std::vector<Part> parts_;
+  std::uint64_t file_size_{};
+  bool is_file_size_set_{};
+};
+}
+}
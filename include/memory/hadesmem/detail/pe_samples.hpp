@@ -0,0 +1,828 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Synthetic PE files for exercising PeLib, in the spirit of the Corkami
+// samples. Every file is built from scratch with a single section, so the
+// corpus can be regenerated anywhere and never has to be checked in. Some
+// of them are well formed, and some deliberately break the structures PeLib
+// walks (bad header offsets, truncated data, lists without terminators,
+// counts which are far too big, etc.).
+//
+// MutatePeSample makes cheap deterministic variations of a sample, for seeding
+// fuzzers and for regression runs.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct PeSample
+{
+  std::string name;
+  std::vector<std::uint8_t> data;
+};
+
+// Little endian, whatever the host is.
+inline void PokePeSample(std::vector<std::uint8_t>& data,
+                         std::size_t offset,
+                         std::uint64_t value,
+                         std::size_t size)
+{
+  HADESMEM_DETAIL_ASSERT(offset + size <= data.size());
+
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    data[offset + i] = static_cast<std::uint8_t>(value >> (i * 8));
+  }
+}
+
+inline std::uint64_t PeekPeSample(std::vector<std::uint8_t> const& data,
+                                  std::size_t offset,
+                                  std::size_t size)
+{
+  HADESMEM_DETAIL_ASSERT(offset + size <= data.size());
+
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    value |= static_cast<std::uint64_t>(data[offset + i]) << (i * 8);
+  }
+  return value;
+}
+
+// Headers, then one RWX section which everything else is allocated from,
+// then any extra sections, then the overlay (if any). Extra sections only
+// hold filler, and are there to make the section table bigger.
+class PeSampleBuilder
+{
+public:
+  static std::size_t const kNtHeadersOffset = 0x40;
+  static std::size_t const kOptionalHeaderOffset = 0x58;
+  static std::uint32_t const kFileAlignment = 0x200;
+  static std::uint32_t const kSectionAlignment = 0x1000;
+  static std::uint32_t const kSectionRva = 0x1000;
+
+  enum : std::size_t
+  {
+    kDirExport = 0,
+    kDirImport = 1,
+    kDirBaseReloc = 5,
+    kDirTls = 9,
+    kDirBoundImport = 11,
+    kDirIat = 12,
+    kNumDataDirs = 16
+  };
+
+  explicit PeSampleBuilder(bool is_64, std::size_t num_extra_sections = 0)
+    : is_64_{is_64}, num_extra_sections_{num_extra_sections}
+  {
+    // The headers have to fit before the first section.
+    HADESMEM_DETAIL_ASSERT(GetHeadersSize() <= kSectionRva);
+  }
+
+  bool Is64() const noexcept
+  {
+    return is_64_;
+  }
+
+  std::size_t GetPtrSize() const noexcept
+  {
+    return is_64_ ? 8 : 4;
+  }
+
+  std::uint64_t GetImageBase() const noexcept
+  {
+    return is_64_ ? 0x140000000ULL : 0x400000ULL;
+  }
+
+  // Returns the RVA of size zeroed bytes in the section.
+  std::uint32_t Alloc(std::size_t size, std::size_t align = 4)
+  {
+    HADESMEM_DETAIL_ASSERT(align && !(align & (align - 1)));
+
+    section_.resize((section_.size() + align - 1) & ~(align - 1));
+    auto const rva = static_cast<std::uint32_t>(kSectionRva + section_.size());
+    section_.resize(section_.size() + size);
+    return rva;
+  }
+
+  std::uint32_t AddString(std::string const& s)
+  {
+    auto const rva = Alloc(s.size() + 1, 1);
+    PutString(rva, s);
+    return rva;
+  }
+
+  // Pads the section with filler up to the end of its last file aligned
+  // block, so whatever was allocated last runs right up to the end of the raw
+  // data.
+  void FillToEnd(std::uint8_t filler)
+  {
+    auto const size = (section_.size() + kFileAlignment - 1) &
+                      ~static_cast<std::size_t>(kFileAlignment - 1);
+    section_.resize(size, filler);
+  }
+
+  void Put(std::uint32_t rva, std::uint64_t value, std::size_t size)
+  {
+    HADESMEM_DETAIL_ASSERT(rva >= kSectionRva);
+    PokePeSample(section_, rva - kSectionRva, value, size);
+  }
+
+  // Doesn't write the terminator, so there must already be room for it.
+  void PutString(std::uint32_t rva, std::string const& s)
+  {
+    HADESMEM_DETAIL_ASSERT(rva >= kSectionRva &&
+                           rva - kSectionRva + s.size() < section_.size());
+    std::copy(std::begin(s), std::end(s), &section_[rva - kSectionRva]);
+  }
+
+  void PutPtr(std::uint32_t rva, std::uint64_t value)
+  {
+    Put(rva, value, GetPtrSize());
+  }
+
+  void SetDataDir(std::size_t index, std::uint32_t rva, std::uint32_t size)
+  {
+    HADESMEM_DETAIL_ASSERT(index < kNumDataDirs);
+    data_dirs_[index][0] = rva;
+    data_dirs_[index][1] = size;
+  }
+
+  void SetEntryPoint(std::uint32_t rva) noexcept
+  {
+    entry_point_ = rva;
+  }
+
+  void SetDll(bool is_dll) noexcept
+  {
+    is_dll_ = is_dll;
+  }
+
+  void SetOverlay(std::vector<std::uint8_t> const& overlay)
+  {
+    overlay_ = overlay;
+  }
+
+  std::size_t GetSizeOfOptionalHeader() const noexcept
+  {
+    return is_64_ ? 0xF0 : 0xE0;
+  }
+
+  std::size_t GetDataDirOffset(std::size_t index) const noexcept
+  {
+    return kOptionalHeaderOffset + (is_64_ ? 112 : 96) + index * 8;
+  }
+
+  std::size_t GetSectionHeaderOffset() const noexcept
+  {
+    return kOptionalHeaderOffset + GetSizeOfOptionalHeader();
+  }
+
+  std::size_t GetNumSections() const noexcept
+  {
+    return 1 + num_extra_sections_;
+  }
+
+  std::uint32_t GetHeadersSize() const noexcept
+  {
+    std::size_t const align = kFileAlignment;
+    auto const size = GetSectionHeaderOffset() + GetNumSections() * 40;
+    return static_cast<std::uint32_t>((size + align - 1) & ~(align - 1));
+  }
+
+  // Only for RVAs in the first section.
+  std::size_t RvaToOffset(std::uint32_t rva) const noexcept
+  {
+    return rva - kSectionRva + GetHeadersSize();
+  }
+
+  std::vector<std::uint8_t> Build() const
+  {
+    auto const align = [](std::size_t n, std::size_t m) {
+      return (n + m - 1) & ~(m - 1);
+    };
+
+    std::size_t const headers_size = GetHeadersSize();
+    std::size_t const virtual_size =
+      (std::max)(section_.size(), std::size_t{1});
+    std::size_t const raw_size = align(virtual_size, kFileAlignment);
+    std::size_t const extra_rva =
+      align(kSectionRva + virtual_size, kSectionAlignment);
+    std::size_t const extra_offset = headers_size + raw_size;
+    std::size_t const image_size =
+      extra_rva + num_extra_sections_ * kSectionAlignment;
+
+    std::vector<std::uint8_t> data(extra_offset +
+                                   num_extra_sections_ * kFileAlignment);
+    std::copy(std::begin(section_), std::end(section_), &data[headers_size]);
+    data.insert(std::end(data), std::begin(overlay_), std::end(overlay_));
+
+    // IMAGE_DOS_HEADER
+    PokePeSample(data, 0, 0x5A4D, 2);
+    PokePeSample(data, 0x3C, kNtHeadersOffset, 4);
+
+    // IMAGE_FILE_HEADER
+    PokePeSample(data, kNtHeadersOffset, 0x00004550, 4);
+    PokePeSample(data, kNtHeadersOffset + 4, is_64_ ? 0x8664 : 0x14C, 2);
+    PokePeSample(data, kNtHeadersOffset + 6, GetNumSections(), 2);
+    PokePeSample(data, kNtHeadersOffset + 20, GetSizeOfOptionalHeader(), 2);
+    std::uint16_t const characteristics =
+      static_cast<std::uint16_t>((is_64_ ? 0x0022 : 0x0102) |
+                                 (is_dll_ ? 0x2000 : 0));
+    PokePeSample(data, kNtHeadersOffset + 22, characteristics, 2);
+
+    // IMAGE_OPTIONAL_HEADER
+    auto const opt = kOptionalHeaderOffset;
+    PokePeSample(data, opt, is_64_ ? 0x20B : 0x10B, 2);
+    PokePeSample(data, opt + 16, entry_point_, 4);
+    PokePeSample(data, opt + 20, kSectionRva, 4);
+    if (is_64_)
+    {
+      PokePeSample(data, opt + 24, GetImageBase(), 8);
+    }
+    else
+    {
+      PokePeSample(data, opt + 28, GetImageBase(), 4);
+    }
+    PokePeSample(data, opt + 32, kSectionAlignment, 4);
+    PokePeSample(data, opt + 36, kFileAlignment, 4);
+    PokePeSample(data, opt + 40, 4, 2);
+    PokePeSample(data, opt + 48, 4, 2);
+    PokePeSample(data, opt + 56, image_size, 4);
+    PokePeSample(data, opt + 60, headers_size, 4);
+    PokePeSample(data, opt + 68, 3, 2);
+    PokePeSample(data, opt + (is_64_ ? 108 : 92), kNumDataDirs, 4);
+    for (std::size_t i = 0; i < kNumDataDirs; ++i)
+    {
+      PokePeSample(data, GetDataDirOffset(i), data_dirs_[i][0], 4);
+      PokePeSample(data, GetDataDirOffset(i) + 4, data_dirs_[i][1], 4);
+    }
+
+    // IMAGE_SECTION_HEADER
+    auto const add_section = [&](std::size_t index,
+                                 std::string const& name,
+                                 std::size_t rva,
+                                 std::size_t size,
+                                 std::size_t offset) {
+      auto const sec = GetSectionHeaderOffset() + index * 40;
+      std::copy(std::begin(name), std::end(name), &data[sec]);
+      PokePeSample(data, sec + 8, size, 4);
+      PokePeSample(data, sec + 12, rva, 4);
+      PokePeSample(data, sec + 16, align(size, kFileAlignment), 4);
+      PokePeSample(data, sec + 20, offset, 4);
+      PokePeSample(data, sec + 36, 0xE0000060, 4);
+    };
+
+    add_section(0, ".hades", kSectionRva, virtual_size, headers_size);
+    for (std::size_t i = 0; i < num_extra_sections_; ++i)
+    {
+      auto const rva = extra_rva + i * kSectionAlignment;
+      auto const offset = extra_offset + i * kFileAlignment;
+      add_section(1 + i, ".s" + std::to_string(i), rva, kFileAlignment, offset);
+      std::string const filler = "hadesmem extra section " + std::to_string(i);
+      std::copy(std::begin(filler), std::end(filler), &data[offset]);
+    }
+
+    return data;
+  }
+
+private:
+  bool is_64_;
+  std::size_t num_extra_sections_;
+  bool is_dll_{};
+  std::uint32_t entry_point_{};
+  std::uint32_t data_dirs_[kNumDataDirs][2] = {};
+  std::vector<std::uint8_t> section_;
+  std::vector<std::uint8_t> overlay_;
+};
+
+// A single ret, for exports, TLS callbacks and the entry point to point at.
+inline std::uint32_t AddPeSampleCode(PeSampleBuilder& builder)
+{
+  auto const rva = builder.Alloc(0x10, 0x10);
+  builder.Put(rva, 0xC3, 1);
+  return rva;
+}
+
+// Two named exports (one of them forwarded) and one exported by ordinal
+// only. Returns the RVA of the IMAGE_EXPORT_DIRECTORY.
+inline std::uint32_t AddPeSampleExports(PeSampleBuilder& builder)
+{
+  auto const code = AddPeSampleCode(builder);
+
+  auto const dir = builder.Alloc(40);
+  auto const functions = builder.Alloc(3 * 4);
+  auto const names = builder.Alloc(2 * 4);
+  auto const ordinals = builder.Alloc(2 * 2);
+  auto const module_name = builder.AddString("sample.dll");
+  auto const alpha = builder.AddString("alpha");
+  auto const beta = builder.AddString("beta");
+  // Forwarders are told apart by pointing inside the export directory.
+  auto const forwarder = builder.AddString("NTDLL.RtlGetVersion");
+  auto const dir_end = builder.Alloc(0, 4);
+
+  builder.Put(dir + 12, module_name, 4);
+  builder.Put(dir + 16, 5, 4);
+  builder.Put(dir + 20, 3, 4);
+  builder.Put(dir + 24, 2, 4);
+  builder.Put(dir + 28, functions, 4);
+  builder.Put(dir + 32, names, 4);
+  builder.Put(dir + 36, ordinals, 4);
+
+  builder.Put(functions, code, 4);
+  builder.Put(functions + 4, forwarder, 4);
+  builder.Put(functions + 8, code, 4);
+  builder.Put(names, alpha, 4);
+  builder.Put(names + 4, beta, 4);
+  builder.Put(ordinals, 0, 2);
+  builder.Put(ordinals + 2, 1, 2);
+
+  builder.SetDataDir(PeSampleBuilder::kDirExport, dir, dir_end - dir);
+  builder.SetDll(true);
+  return dir;
+}
+
+// IMAGE_IMPORT_BY_NAME
+inline std::uint32_t AddPeSampleHintName(PeSampleBuilder& builder,
+                                         std::uint16_t hint,
+                                         std::string const& name)
+{
+  auto const rva = builder.Alloc(2 + name.size() + 1, 2);
+  builder.Put(rva, hint, 2);
+  builder.PutString(rva + 2, name);
+  return rva;
+}
+
+// kernel32.dll (one import by name, one by ordinal) and user32.dll (one by
+// name). Without an ILT only the IAT describes the imports, as with some
+// older linkers. Returns the RVA of the first IMAGE_IMPORT_DESCRIPTOR.
+inline std::uint32_t AddPeSampleImports(PeSampleBuilder& builder, bool with_ilt)
+{
+  auto const ptr_size = builder.GetPtrSize();
+  std::uint64_t const ordinal_flag =
+    builder.Is64() ? 0x8000000000000000ULL : 0x80000000ULL;
+
+  auto const descs = builder.Alloc(3 * 20);
+  auto const kernel32 = builder.AddString("kernel32.dll");
+  auto const user32 = builder.AddString("user32.dll");
+  auto const get_tick_count =
+    AddPeSampleHintName(builder, 0x1F0, "GetTickCount");
+  auto const message_box = AddPeSampleHintName(builder, 0x21C, "MessageBoxA");
+
+  std::uint64_t const kernel32_thunks[] = {
+    get_tick_count, ordinal_flag | 0x10, 0};
+  std::uint64_t const user32_thunks[] = {message_box, 0};
+
+  auto const add_thunks = [&](std::uint64_t const* thunks, std::size_t count) {
+    auto const rva = builder.Alloc(count * ptr_size, ptr_size);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      builder.PutPtr(static_cast<std::uint32_t>(rva + i * ptr_size), thunks[i]);
+    }
+    return rva;
+  };
+
+  auto const iat_beg = builder.Alloc(0, ptr_size);
+  auto const kernel32_iat = add_thunks(kernel32_thunks, 3);
+  auto const user32_iat = add_thunks(user32_thunks, 2);
+  auto const iat_end = builder.Alloc(0, ptr_size);
+
+  builder.Put(descs + 12, kernel32, 4);
+  builder.Put(descs + 16, kernel32_iat, 4);
+  builder.Put(descs + 20 + 12, user32, 4);
+  builder.Put(descs + 20 + 16, user32_iat, 4);
+  if (with_ilt)
+  {
+    builder.Put(descs, add_thunks(kernel32_thunks, 3), 4);
+    builder.Put(descs + 20, add_thunks(user32_thunks, 2), 4);
+  }
+
+  builder.SetDataDir(PeSampleBuilder::kDirImport, descs, 3 * 20);
+  builder.SetDataDir(PeSampleBuilder::kDirIat, iat_beg, iat_end - iat_beg);
+  return descs;
+}
+
+// Two blocks, with an IMAGE_REL_BASED_ABSOLUTE entry to pad the first one.
+// Each relocated pointer points back into the section. Returns the RVA of the
+// first IMAGE_BASE_RELOCATION.
+inline std::uint32_t AddPeSampleRelocations(PeSampleBuilder& builder)
+{
+  auto const ptr_size = builder.GetPtrSize();
+  std::uint16_t const type = builder.Is64() ? 10 : 3;
+
+  auto const targets = builder.Alloc(3 * ptr_size, ptr_size);
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    builder.PutPtr(static_cast<std::uint32_t>(targets + i * ptr_size),
+                   builder.GetImageBase() + targets);
+  }
+
+  auto const page = targets & ~0xFFFU;
+  auto const offset = targets & 0xFFFU;
+  auto const blocks = builder.Alloc(8 + 4 * 2 + 8 + 2 * 2);
+  builder.Put(blocks, page, 4);
+  builder.Put(blocks + 4, 8 + 4 * 2, 4);
+  for (std::uint32_t i = 0; i < 3; ++i)
+  {
+    builder.Put(
+      blocks + 8 + i * 2, (type << 12) | (offset + i * ptr_size), 2);
+  }
+  auto const second = blocks + 8 + 4 * 2;
+  builder.Put(second, page, 4);
+  builder.Put(second + 4, 8 + 2 * 2, 4);
+  builder.Put(second + 8, (type << 12) | offset, 2);
+  builder.Put(second + 10, (type << 12) | offset, 2);
+
+  builder.SetDataDir(
+    PeSampleBuilder::kDirBaseReloc, blocks, 8 + 4 * 2 + 8 + 2 * 2);
+  return blocks;
+}
+
+// Two callbacks. Returns the RVA of the callback array.
+inline std::uint32_t AddPeSampleTls(PeSampleBuilder& builder)
+{
+  auto const ptr_size = builder.GetPtrSize();
+  auto const image_base = builder.GetImageBase();
+  auto const code = AddPeSampleCode(builder);
+
+  auto const tls_data = builder.Alloc(0x10);
+  auto const index = builder.Alloc(4);
+  auto const dir_size = builder.Is64() ? 40U : 24U;
+  auto const dir = builder.Alloc(dir_size, ptr_size);
+  auto const callbacks = builder.Alloc(3 * ptr_size, ptr_size);
+
+  builder.PutPtr(dir, image_base + tls_data);
+  builder.PutPtr(static_cast<std::uint32_t>(dir + ptr_size),
+                 image_base + tls_data + 0x10);
+  builder.PutPtr(static_cast<std::uint32_t>(dir + 2 * ptr_size),
+                 image_base + index);
+  builder.PutPtr(static_cast<std::uint32_t>(dir + 3 * ptr_size),
+                 image_base + callbacks);
+  builder.PutPtr(callbacks, image_base + code);
+  builder.PutPtr(static_cast<std::uint32_t>(callbacks + ptr_size),
+                 image_base + code);
+
+  builder.SetDataDir(PeSampleBuilder::kDirTls, dir, dir_size);
+  return callbacks;
+}
+
+// kernel32.dll with a forwarder ref to ntdll.dll, then user32.dll. Names are
+// offsets from the start of the directory. Returns the RVA of the first
+// IMAGE_BOUND_IMPORT_DESCRIPTOR.
+inline std::uint32_t AddPeSampleBoundImports(PeSampleBuilder& builder)
+{
+  auto const dir = builder.Alloc(4 * 8);
+  auto const kernel32 = builder.AddString("kernel32.dll");
+  auto const ntdll = builder.AddString("ntdll.dll");
+  auto const user32 = builder.AddString("user32.dll");
+  auto const dir_end = builder.Alloc(0, 4);
+
+  builder.Put(dir, 0x55000000, 4);
+  builder.Put(dir + 4, kernel32 - dir, 2);
+  builder.Put(dir + 6, 1, 2);
+  builder.Put(dir + 8, 0x55000001, 4);
+  builder.Put(dir + 12, ntdll - dir, 2);
+  builder.Put(dir + 16, 0x55000002, 4);
+  builder.Put(dir + 20, user32 - dir, 2);
+
+  builder.SetDataDir(PeSampleBuilder::kDirBoundImport, dir, dir_end - dir);
+  return dir;
+}
+
+inline std::vector<PeSample> GetPeSamples()
+{
+  std::vector<PeSample> samples;
+  auto const add = [&](std::string const& name,
+                       std::vector<std::uint8_t> data) {
+    samples.push_back(PeSample{name, std::move(data)});
+  };
+
+  for (bool const is_64 : {false, true})
+  {
+    std::string const suffix = is_64 ? "64" : "32";
+
+    {
+      PeSampleBuilder builder{is_64};
+      builder.SetEntryPoint(AddPeSampleCode(builder));
+      add("tiny" + suffix, builder.Build());
+    }
+
+    // Everything at once, plus an overlay.
+    {
+      PeSampleBuilder builder{is_64};
+      AddPeSampleExports(builder);
+      AddPeSampleImports(builder, true);
+      AddPeSampleRelocations(builder);
+      AddPeSampleTls(builder);
+      AddPeSampleBoundImports(builder);
+      builder.SetOverlay(
+        std::vector<std::uint8_t>{'o', 'v', 'e', 'r', 'l', 'a', 'y'});
+      add("all" + suffix, builder.Build());
+    }
+
+    {
+      PeSampleBuilder builder{is_64};
+      AddPeSampleImports(builder, false);
+      add("imports_no_ilt" + suffix, builder.Build());
+    }
+  }
+
+  // e_lfanew points way past the end of the file.
+  {
+    PeSampleBuilder builder{false};
+    auto data = builder.Build();
+    PokePeSample(data, 0x3C, 0x7FFFFFF0, 4);
+    add("lfanew_oob", data);
+  }
+
+  // Ends in the middle of the section table.
+  {
+    PeSampleBuilder builder{false};
+    auto data = builder.Build();
+    data.resize(builder.GetSectionHeaderOffset() + 0x10);
+    add("truncated_headers", data);
+  }
+
+  // Every directory is there, but the section data is cut short.
+  {
+    PeSampleBuilder builder{true};
+    AddPeSampleExports(builder);
+    AddPeSampleImports(builder, true);
+    AddPeSampleTls(builder);
+    auto data = builder.Build();
+    data.resize(PeSampleBuilder::kFileAlignment + 0x30);
+    add("truncated_section", data);
+  }
+
+  // The section table is claimed to go on well past the end of the file.
+  {
+    PeSampleBuilder builder{false};
+    auto data = builder.Build();
+    PokePeSample(data, PeSampleBuilder::kNtHeadersOffset + 6, 0xFFFF, 2);
+    add("max_sections", data);
+  }
+
+  {
+    PeSampleBuilder builder{false};
+    auto data = builder.Build();
+    PokePeSample(data, PeSampleBuilder::kOptionalHeaderOffset, 0, 2);
+    add("bad_optional_magic", data);
+  }
+
+  // Every data directory points outside the image.
+  {
+    PeSampleBuilder builder{true};
+    for (std::size_t i = 0; i < PeSampleBuilder::kNumDataDirs; ++i)
+    {
+      builder.SetDataDir(i, 0x7FFFF000, 0x1000);
+    }
+    add("dir_rva_oob", builder.Build());
+  }
+
+  {
+    PeSampleBuilder builder{false};
+    auto const dir = AddPeSampleExports(builder);
+    builder.Put(dir + 20, 0x7FFFFFFF, 4);
+    builder.Put(dir + 24, 0x7FFFFFFF, 4);
+    add("huge_export_counts", builder.Build());
+  }
+
+  // No terminating descriptor, and no terminating thunks. Every thunk points
+  // back at the thunk list as if it were a hint/name.
+  {
+    PeSampleBuilder builder{true};
+    auto const descs = builder.Alloc(20);
+    auto const thunks = builder.Alloc(0x10, 8);
+    builder.Put(descs, thunks, 4);
+    builder.Put(descs + 12, thunks, 4);
+    builder.Put(descs + 16, thunks, 4);
+    builder.PutPtr(thunks, thunks);
+    builder.PutPtr(thunks + 8, thunks);
+    builder.SetDataDir(PeSampleBuilder::kDirImport, descs, 20);
+    builder.FillToEnd(0x10);
+    add("looping_imports", builder.Build());
+  }
+
+  {
+    PeSampleBuilder builder{false};
+    auto const blocks = AddPeSampleRelocations(builder);
+    builder.Put(blocks + 4, 0, 4);
+    add("reloc_zero_block", builder.Build());
+  }
+
+  {
+    PeSampleBuilder builder{true};
+    auto const blocks = AddPeSampleRelocations(builder);
+    builder.Put(blocks + 4, 0xFFFFFFF0, 4);
+    add("reloc_block_oob", builder.Build());
+  }
+
+  // The callback array runs to the end of the section.
+  {
+    PeSampleBuilder builder{false};
+    auto const callbacks = AddPeSampleTls(builder);
+    builder.Put(callbacks + 8, 0x41414141, 4);
+    builder.FillToEnd(0x41);
+    add("tls_unterminated_callbacks", builder.Build());
+  }
+
+  {
+    PeSampleBuilder builder{true};
+    auto const dir = AddPeSampleBoundImports(builder);
+    builder.Put(dir + 4, 0xFFFF, 2);
+    builder.Put(dir + 6, 0xFFFF, 2);
+    add("bound_import_bad_counts", builder.Build());
+  }
+
+  return samples;
+}
+
+// num_exports exports, all by name (sorted, as the loader requires). Returns
+// the names.
+inline std::vector<std::string>
+  AddPeSampleManyExports(PeSampleBuilder& builder, std::uint32_t num_exports)
+{
+  auto const code = AddPeSampleCode(builder);
+
+  auto const dir = builder.Alloc(40);
+  auto const functions = builder.Alloc(num_exports * 4);
+  auto const names = builder.Alloc(num_exports * 4);
+  auto const ordinals = builder.Alloc(num_exports * 2);
+  auto const module_name = builder.AddString("many_exports.dll");
+
+  std::vector<std::string> export_names;
+  export_names.reserve(num_exports);
+  for (std::uint32_t i = 0; i < num_exports; ++i)
+  {
+    std::string name = std::to_string(i);
+    name = "Export" + std::string(8 - name.size(), '0') + name;
+    builder.Put(functions + i * 4, code, 4);
+    builder.Put(names + i * 4, builder.AddString(name), 4);
+    builder.Put(ordinals + i * 2, i, 2);
+    export_names.push_back(std::move(name));
+  }
+  auto const dir_end = builder.Alloc(0, 4);
+
+  builder.Put(dir + 12, module_name, 4);
+  builder.Put(dir + 16, 1, 4);
+  builder.Put(dir + 20, num_exports, 4);
+  builder.Put(dir + 24, num_exports, 4);
+  builder.Put(dir + 28, functions, 4);
+  builder.Put(dir + 32, names, 4);
+  builder.Put(dir + 36, ordinals, 4);
+
+  builder.SetDataDir(PeSampleBuilder::kDirExport, dir, dir_end - dir);
+  builder.SetDll(true);
+  return export_names;
+}
+
+// Files for benchmarking PeLib and PeDumper, covering the shapes which tend to
+// be slow: lots of data, lots of exports, and lots of sections. Only well
+// formed files, so every component does all of its work.
+inline std::vector<PeSample> GetPeBenchmarkCorpus()
+{
+  std::vector<PeSample> corpus;
+
+  // Every directory, but tiny.
+  {
+    PeSampleBuilder builder{true};
+    AddPeSampleExports(builder);
+    AddPeSampleImports(builder, true);
+    AddPeSampleRelocations(builder);
+    AddPeSampleTls(builder);
+    AddPeSampleBoundImports(builder);
+    corpus.push_back(PeSample{"small", builder.Build()});
+  }
+
+  // 32MB of noise with a string every 4KB, for the scanners.
+  {
+    PeSampleBuilder builder{true};
+    AddPeSampleImports(builder, true);
+    AddPeSampleRelocations(builder);
+    std::size_t const size = 32 * 1024 * 1024;
+    auto const data = builder.Alloc(size, 0x1000);
+    std::uint32_t state = 0x12345678;
+    for (std::size_t i = 0; i < size; i += 4)
+    {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      builder.Put(static_cast<std::uint32_t>(data + i), state, 4);
+    }
+    for (std::size_t i = 0; i < size; i += 0x1000)
+    {
+      std::string const str = "hadesmem string " + std::to_string(i);
+      builder.PutString(static_cast<std::uint32_t>(data + i), str);
+      builder.Put(static_cast<std::uint32_t>(data + i + str.size()), 0, 1);
+    }
+    corpus.push_back(PeSample{"huge", builder.Build()});
+  }
+
+  {
+    PeSampleBuilder builder{false};
+    AddPeSampleManyExports(builder, 0x4000);
+    corpus.push_back(PeSample{"many_exports", builder.Build()});
+  }
+
+  // As many as will fit in the headers (the loader's limit is 96).
+  {
+    PeSampleBuilder builder{false, 90};
+    AddPeSampleImports(builder, true);
+    corpus.push_back(PeSample{"many_sections", builder.Build()});
+  }
+
+  return corpus;
+}
+
+// Flips bits, pokes interesting values, and truncates, all chosen by the
+// seed. The same input and seed always give the same output.
+inline std::vector<std::uint8_t> MutatePeSample(std::vector<std::uint8_t> data,
+                                                std::uint32_t seed)
+{
+  if (data.empty())
+  {
+    return data;
+  }
+
+  // xorshift32, so the output doesn't depend on the standard library.
+  std::uint32_t state = seed ^ 0x9E3779B9U;
+  state = state ? state : 1;
+  auto const next = [&]() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  };
+
+  // Most of the interesting structure is in the headers.
+  auto const pick_offset = [&]() {
+    std::size_t const limit =
+      next() % 2 ? (std::min)(data.size(), std::size_t{0x400}) : data.size();
+    return static_cast<std::size_t>(next() % limit);
+  };
+
+  std::uint32_t const interesting[] = {
+    0, 1, 0x7F, 0x80, 0xFF, 0xFFFF, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF};
+
+  std::uint32_t const num_mutations = 1 + next() % 4;
+  for (std::uint32_t i = 0; i < num_mutations && !data.empty(); ++i)
+  {
+    switch (next() % 4)
+    {
+    case 0:
+      data[pick_offset()] ^= static_cast<std::uint8_t>(1 << (next() % 8));
+      break;
+
+    case 1:
+    {
+      auto const offset = pick_offset() & ~std::size_t{3};
+      auto const size = (std::min)(data.size() - offset, std::size_t{4});
+      auto const value = interesting[next() % (sizeof(interesting) /
+                                               sizeof(interesting[0]))];
+      PokePeSample(data, offset, value, size);
+      break;
+    }
+
+    case 2:
+      data.resize(1 + next() % data.size());
+      break;
+
+    default:
+      data[pick_offset()] = static_cast<std::uint8_t>(next());
+      break;
+    }
+  }
+
+  return data;
+}
+
+// Every sample, followed by num_mutations mutations of each one.
+inline std::vector<PeSample> GetPeRegressionCorpus(std::uint32_t num_mutations)
+{
+  auto const samples = GetPeSamples();
+  std::vector<PeSample> corpus = samples;
+  for (auto const& sample : samples)
+  {
+    for (std::uint32_t i = 0; i < num_mutations; ++i)
+    {
+      corpus.push_back(PeSample{sample.name + ".mut" + std::to_string(i),
+                                MutatePeSample(sample.data, i)});
+    }
+  }
+  return corpus;
+}
+}
+}
@@ -0,0 +1,296 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/rcu_ptr.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+
+// Read-mostly open addressing hash table with lock-free readers. Writers are
+// serialized, build a new table and publish it with a single pointer swap.
+// Old tables are only reclaimed once no reader is inside the table, so lookups
+// never take a lock, never allocate and never observe a partial update. This
+// makes it suitable for use from exception handlers (e.g. VEH hooks).
+
+namespace hadesmem
+{
+namespace detail
+{
+template <typename T> inline std::uint64_t RcuFlatMapKeyBits(T* key) noexcept
+{
+  return reinterpret_cast<std::uintptr_t>(key);
+}
+
+template <typename T>
+inline std::enable_if_t<std::is_integral<T>::value, std::uint64_t>
+  RcuFlatMapKeyBits(T key) noexcept
+{
+  return static_cast<std::uint64_t>(key);
+}
+
+template <typename KeyT, typename ValueT> class RcuFlatMap
+{
+public:
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_trivially_copyable<KeyT>::value);
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_copy_constructible<ValueT>::value);
+
+  RcuFlatMap() = default;
+
+  RcuFlatMap(RcuFlatMap const&) = delete;
+
+  RcuFlatMap& operator=(RcuFlatMap const&) = delete;
+
+  // Safe to call concurrently with writers and from exception handlers.
+  bool Find(KeyT key, ValueT* value) const noexcept
+  {
+    typename RcuPtr<Table>::ReadGuard const guard{table_};
+
+    Table const* const table = guard.Get();
+    if (!table)
+    {
+      return false;
+    }
+
+    Slot const* const slot = table->Find(key);
+    if (!slot)
+    {
+      return false;
+    }
+
+    if (value)
+    {
+      *value = slot->value;
+    }
+
+    return true;
+  }
+
+  // Invokes f with a reference to the value which stays valid (and unchanged)
+  // for the duration of the call. Use this instead of Find for values which
+  // are expensive (or allocate) to copy.
+  template <typename F> bool Visit(KeyT key, F&& f) const
+  {
+    typename RcuPtr<Table>::ReadGuard const guard{table_};
+
+    Table const* const table = guard.Get();
+    if (!table)
+    {
+      return false;
+    }
+
+    Slot const* const slot = table->Find(key);
+    if (!slot)
+    {
+      return false;
+    }
+
+    f(slot->value);
+
+    return true;
+  }
+
+  bool Contains(KeyT key) const noexcept
+  {
+    return Find(key, nullptr);
+  }
+
+  std::size_t Size() const noexcept
+  {
+    typename RcuPtr<Table>::ReadGuard const guard{table_};
+
+    Table const* const table = guard.Get();
+    return table ? table->size : 0;
+  }
+
+  // Returns false (and leaves the existing mapping untouched) if the key is
+  // already present.
+  bool Insert(KeyT key, ValueT const& value)
+  {
+    std::lock_guard<std::mutex> const lock{writer_mutex_};
+
+    Table const* const old_table = table_.GetUnsafe();
+    if (old_table && old_table->Find(key))
+    {
+      return false;
+    }
+
+    std::size_t const size = (old_table ? old_table->size : 0) + 1;
+    auto new_table = std::make_unique<Table>(size);
+    if (old_table)
+    {
+      new_table->CopyFrom(*old_table);
+    }
+    new_table->Add(key, value);
+
+    table_.Publish(std::move(new_table));
+
+    return true;
+  }
+
+  bool Erase(KeyT key)
+  {
+    std::lock_guard<std::mutex> const lock{writer_mutex_};
+
+    Table const* const old_table = table_.GetUnsafe();
+    if (!old_table || !old_table->Find(key))
+    {
+      return false;
+    }
+
+    std::unique_ptr<Table> new_table;
+    if (old_table->size > 1)
+    {
+      new_table = std::make_unique<Table>(old_table->size - 1);
+      new_table->CopyFrom(*old_table, std::vector<KeyT>{key});
+    }
+
+    table_.Publish(std::move(new_table));
+
+    return true;
+  }
+
+  // Applies a set of insertions/replacements and erasures as a single update,
+  // so readers see either none or all of them and the table is only rebuilt
+  // once.
+  void Update(std::vector<std::pair<KeyT, ValueT>> const& assign,
+              std::vector<KeyT> const& erase)
+  {
+    std::lock_guard<std::mutex> const lock{writer_mutex_};
+
+    Table const* const old_table = table_.GetUnsafe();
+
+    std::vector<KeyT> skip{erase};
+    for (auto const& entry : assign)
+    {
+      skip.push_back(entry.first);
+    }
+
+    std::size_t const size =
+      (old_table ? old_table->size : 0) + assign.size();
+    auto new_table = std::make_unique<Table>(size);
+    if (old_table)
+    {
+      new_table->CopyFrom(*old_table, std::move(skip));
+    }
+    for (auto const& entry : assign)
+    {
+      HADESMEM_DETAIL_ASSERT(!new_table->Find(entry.first));
+      new_table->Add(entry.first, entry.second);
+    }
+
+    if (!new_table->size)
+    {
+      new_table.reset();
+    }
+
+    table_.Publish(std::move(new_table));
+  }
+
+  // Frees any tables retired while readers were still active. Never blocks.
+  void Reclaim()
+  {
+    std::lock_guard<std::mutex> const lock{writer_mutex_};
+    table_.Reclaim();
+  }
+
+private:
+  struct Slot
+  {
+    KeyT key;
+    ValueT value;
+    bool used;
+  };
+
+  struct Table
+  {
+    explicit Table(std::size_t count)
+    {
+      // Keep the load factor at or below 50% so probe sequences stay short.
+      std::size_t capacity = 4;
+      while (capacity < count * 2)
+      {
+        capacity *= 2;
+      }
+
+      slots.resize(capacity);
+      mask = capacity - 1;
+    }
+
+    std::size_t Hash(KeyT key) const noexcept
+    {
+      // Fibonacci hashing. Spreads aligned addresses (which share their low
+      // bits) across the whole table.
+      std::uint64_t const bits =
+        RcuFlatMapKeyBits(key) * 0x9E3779B97F4A7C15ULL;
+      return static_cast<std::size_t>(bits >> 32) & mask;
+    }
+
+    Slot const* Find(KeyT key) const noexcept
+    {
+      for (std::size_t i = Hash(key);; i = (i + 1) & mask)
+      {
+        Slot const& slot = slots[i];
+        if (!slot.used)
+        {
+          return nullptr;
+        }
+
+        if (slot.key == key)
+        {
+          return &slot;
+        }
+      }
+    }
+
+    void Add(KeyT key, ValueT const& value)
+    {
+      std::size_t i = Hash(key);
+      while (slots[i].used)
+      {
+        i = (i + 1) & mask;
+      }
+
+      slots[i].key = key;
+      slots[i].value = value;
+      slots[i].used = true;
+      ++size;
+    }
+
+    // Skip is sorted once up front, so large batches don't cost a scan of
+    // it for every slot.
+    void CopyFrom(Table const& other,
+                  std::vector<KeyT> skip = std::vector<KeyT>())
+    {
+      std::less<KeyT> const less;
+      std::sort(std::begin(skip), std::end(skip), less);
+      for (auto const& slot : other.slots)
+      {
+        if (slot.used && !std::binary_search(
+                           std::begin(skip), std::end(skip), slot.key, less))
+        {
+          Add(slot.key, slot.value);
+        }
+      }
+    }
+
+    std::vector<Slot> slots;
+    std::size_t mask{};
+    std::size_t size{};
+  };
+
+  RcuPtr<Table> table_;
+  std::mutex writer_mutex_;
+};
+}
+}
@@ -0,0 +1,188 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Pointer to an immutable object which is replaced wholesale by writers.
+// Readers never take a lock or allocate, and writers never wait for readers.
+// Old objects are only reclaimed once no reader is active. Writers either
+// serialize among themselves and use Publish, or race each other with
+// CompareAndPublish (copy-on-write in a CAS loop), which never takes a lock.
+
+// TODO: Use per-CPU (or striped) reader counters if contention on the single
+// reader counter ever shows up in profiles.
+
+namespace hadesmem
+{
+namespace detail
+{
+template <typename T> class RcuPtr
+{
+public:
+  class ReadGuard
+  {
+  public:
+    explicit ReadGuard(RcuPtr const& ptr) noexcept : ptr_(ptr)
+    {
+      ptr_.readers_.fetch_add(1, std::memory_order_seq_cst);
+      value_ = ptr_.value_.load(std::memory_order_acquire);
+    }
+
+    ReadGuard(ReadGuard const&) = delete;
+
+    ReadGuard& operator=(ReadGuard const&) = delete;
+
+    ~ReadGuard()
+    {
+      ptr_.readers_.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Stays valid (and unchanged) until the guard is destroyed.
+    T const* Get() const noexcept
+    {
+      return value_;
+    }
+
+  private:
+    RcuPtr const& ptr_;
+    T const* value_{};
+  };
+
+  RcuPtr() = default;
+
+  RcuPtr(RcuPtr const&) = delete;
+
+  RcuPtr& operator=(RcuPtr const&) = delete;
+
+  ~RcuPtr()
+  {
+    HADESMEM_DETAIL_ASSERT(readers_.load() == 0);
+    delete value_.load();
+    FreeRetired(retired_.load());
+  }
+
+  // Writer side only.
+  T const* GetUnsafe() const noexcept
+  {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+  // Writer side only.
+  void Publish(std::unique_ptr<T> value)
+  {
+    // Make sure we can't fail after the swap.
+    auto retired = std::make_unique<Retired>();
+
+    T* const old_value =
+      value_.exchange(value.release(), std::memory_order_seq_cst);
+    Retire(old_value, std::move(retired));
+
+    Reclaim();
+  }
+
+  // Replaces the current object with value if (and only if) it is still
+  // expected, in which case ownership of value is taken. The caller must hold
+  // a ReadGuard which returned expected, so that expected can't be reclaimed
+  // (and its address reused) while the new object is built from it. Nothing
+  // is reclaimed here, because the caller is still a reader; call Reclaim
+  // once the guard is gone.
+  bool CompareAndPublish(T const* expected, std::unique_ptr<T>& value)
+  {
+    // Make sure we can't fail after the swap.
+    auto retired = std::make_unique<Retired>();
+
+    T* old_value = const_cast<T*>(expected);
+    if (!value_.compare_exchange_strong(
+          old_value, value.get(), std::memory_order_seq_cst))
+    {
+      return false;
+    }
+
+    value.release();
+    Retire(old_value, std::move(retired));
+
+    return true;
+  }
+
+  // Frees any objects retired while readers were still active. Never blocks,
+  // and is safe to call from any number of writers at once.
+  void Reclaim() noexcept
+  {
+    // Take the whole list first, then check for readers. Everything taken was
+    // unpublished before the check, and a reader which could still be using it
+    // must have incremented the counter before it was unpublished and will not
+    // decrement it until it is done, so a zero count means every object taken
+    // is unreachable. Objects retired by other writers after the list was taken
+    // are left alone until the next call. We never wait here, because the
+    // thread holding a reference might be suspended (e.g. by SuspendedProcess)
+    // and waiting would deadlock.
+    Retired* const head = retired_.exchange(nullptr, std::memory_order_seq_cst);
+    if (!head)
+    {
+      return;
+    }
+
+    if (readers_.load(std::memory_order_seq_cst) == 0)
+    {
+      FreeRetired(head);
+      return;
+    }
+
+    Retired* tail = head;
+    while (tail->next)
+    {
+      tail = tail->next;
+    }
+    Push(head, tail);
+  }
+
+private:
+  struct Retired
+  {
+    std::unique_ptr<T> value;
+    Retired* next{};
+  };
+
+  void Retire(T* value, std::unique_ptr<Retired> retired) noexcept
+  {
+    if (value)
+    {
+      retired->value.reset(value);
+      Retired* const node = retired.release();
+      Push(node, node);
+    }
+  }
+
+  // Treiber stack push. Nodes are only ever removed by taking the whole list,
+  // so there is no ABA problem.
+  void Push(Retired* head, Retired* tail) noexcept
+  {
+    tail->next = retired_.load(std::memory_order_relaxed);
+    while (!retired_.compare_exchange_weak(
+      tail->next, head, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  static void FreeRetired(Retired* head) noexcept
+  {
+    while (head)
+    {
+      std::unique_ptr<Retired> const cur{head};
+      head = head->next;
+    }
+  }
+
+  std::atomic<T*> value_{nullptr};
+  mutable std::atomic<std::size_t> readers_{0};
+  std::atomic<Retired*> retired_{nullptr};
+};
+}
+}
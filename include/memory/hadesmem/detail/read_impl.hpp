@@ -16,6 +16,7 @@
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/protect.hpp>
+#include <hadesmem/region_map.hpp>
 
 namespace hadesmem
 {
@@ -56,11 +57,15 @@ inline void ReadUnchecked(Process const& process,
   }
 }
 
-inline void ReadImpl(Process const& process,
+// QueryFunc is called with each address we need region information for, and
+// should return the same thing as detail::Query.
+template <typename QueryFunc>
+void ReadRegionsImpl(Process const& process,
                      void* address,
                      void* data,
                      std::size_t len,
-                     std::uint32_t flags = ReadFlags::kNone)
+                     std::uint32_t flags,
+                     QueryFunc const& query)
 {
   HADESMEM_DETAIL_ASSERT(len ? address != nullptr : true);
   HADESMEM_DETAIL_ASSERT(data != nullptr);
@@ -72,7 +77,7 @@ inline void ReadImpl(Process const& process,
 
   for (;;)
   {
-    MEMORY_BASIC_INFORMATION const mbi = detail::Query(process, address);
+    MEMORY_BASIC_INFORMATION const mbi = query(address);
 
     void* const address_end = static_cast<std::uint8_t*>(address) + len;
     void* const region_next =
@@ -124,6 +129,31 @@ inline void ReadImpl(Process const& process,
   }
 }
 
+inline void ReadImpl(Process const& process,
+                     void* address,
+                     void* data,
+                     std::size_t len,
+                     std::uint32_t flags = ReadFlags::kNone)
+{
+  ReadRegionsImpl(
+    process, address, data, len, flags, [&](void const* region_address) {
+      return detail::Query(process, region_address);
+    });
+}
+
+inline void ReadImpl(Process const& process,
+                     RegionMap const& regions,
+                     void* address,
+                     void* data,
+                     std::size_t len,
+                     std::uint32_t flags = ReadFlags::kNone)
+{
+  ReadRegionsImpl(
+    process, address, data, len, flags, [&](void const* region_address) {
+      return regions.QueryForAccess(region_address, ProtectGuardType::kRead);
+    });
+}
+
 template <typename T>
 T ReadUnsafeImpl(Process const& process,
                  void* address,
@@ -11,12 +11,12 @@
 
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/peb.hpp>
+#include <hadesmem/detail/query_region.hpp>
 #include <hadesmem/detail/winternl.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
-#include <hadesmem/region.hpp>
-#include <hadesmem/region_list.hpp>
+#include <hadesmem/region_map.hpp>
 
 // TODO: Test hadesmem under large page mode. Especially getting module bases
 // using VirtualQueryEx etc. Also see things like NtMapViewOfSection hook,
@@ -28,35 +28,35 @@ namespace hadesmem
 namespace detail
 {
 // TODO: Rename this file.
-inline SIZE_T GetModuleRegionSize(hadesmem::Process const& process,
+inline SIZE_T GetModuleRegionSize(RegionMap const& regions,
                                   void const* base,
                                   bool break_on_bad_protect = true)
 {
-  hadesmem::Region r{process, base};
+  MEMORY_BASIC_INFORMATION const mbi = regions.Query(base);
 
-  hadesmem::RegionList regions{process};
-  auto iter = std::find_if(
-    std::begin(regions), std::end(regions), [&](Region const& region) {
-      return region.GetAllocBase() == r.GetAllocBase();
-    });
+  auto iter = std::find_if(std::begin(regions),
+                           std::end(regions),
+                           [&](MEMORY_BASIC_INFORMATION const& region) {
+                             return region.AllocationBase == mbi.AllocationBase;
+                           });
   SIZE_T size{};
-  while (iter != std::end(regions) && iter->GetAllocBase() == r.GetAllocBase())
+  while (iter != std::end(regions) &&
+         iter->AllocationBase == mbi.AllocationBase)
   {
-    if (break_on_bad_protect &&
-        hadesmem::IsBadProtect(process, iter->GetBase()))
+    if (break_on_bad_protect && IsBadProtect(*iter))
     {
       break;
     }
 
-    SIZE_T const region_size = iter->GetSize();
+    SIZE_T const region_size = iter->RegionSize;
     size += region_size;
     HADESMEM_DETAIL_ASSERT(size >= region_size);
     ++iter;
   }
 
-  HADESMEM_DETAIL_ASSERT(base >= r.GetAllocBase());
+  HADESMEM_DETAIL_ASSERT(base >= mbi.AllocationBase);
   size -= reinterpret_cast<std::intptr_t>(base) -
-          reinterpret_cast<std::intptr_t>(r.GetAllocBase());
+          reinterpret_cast<std::intptr_t>(mbi.AllocationBase);
 
   if (!size)
   {
@@ -66,5 +66,13 @@ inline SIZE_T GetModuleRegionSize(hadesmem::Process const& process,
 
   return size;
 }
+
+inline SIZE_T GetModuleRegionSize(hadesmem::Process const& process,
+                                  void const* base,
+                                  bool break_on_bad_protect = true)
+{
+  return GetModuleRegionSize(
+    RegionMap{process}, base, break_on_bad_protect);
+}
 }
 }
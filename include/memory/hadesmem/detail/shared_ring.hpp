@@ -0,0 +1,346 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+
+// Bounded lock-free message ring living in memory shared between processes.
+// Everything is addressed by offset and the layout is fixed, so both sides
+// can map the memory at different addresses. Each slot carries a sequence
+// number (as in Vyukov's bounded queue), which is what lets multiple
+// producers claim slots with a single CAS and lets the consumer read
+// messages in place.
+//
+// There is always a single consumer. The mode picks between one producer
+// (no CAS on the write path) and multiple producers.
+//
+// The other side can write anything to the shared memory, so nothing it
+// controls is trusted. The geometry is copied out when the ring is opened and
+// checked against the size of the memory, and a ring whose geometry doesn't
+// fit (or a message which claims to be bigger than a slot) is marked as
+// corrupted instead of being used.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+HADESMEM_DETAIL_STATIC_ASSERT(ATOMIC_LLONG_LOCK_FREE == 2);
+HADESMEM_DETAIL_STATIC_ASSERT(sizeof(std::atomic<std::uint64_t>) ==
+                              sizeof(std::uint64_t));
+
+enum class SharedRingMode : std::uint32_t
+{
+  kSpsc,
+  kMpsc
+};
+
+struct SharedRingHeader
+{
+  std::uint32_t magic;
+  SharedRingMode mode;
+  std::uint32_t num_slots;
+  std::uint32_t slot_size;
+  std::uint32_t max_message_size;
+  std::uint32_t padding_1[11];
+  // Producer and consumer positions are kept on separate cache lines.
+  std::atomic<std::uint64_t> head;
+  std::uint64_t padding_2[7];
+  std::atomic<std::uint64_t> tail;
+  std::uint64_t padding_3[7];
+};
+
+struct SharedRingSlotHeader
+{
+  std::atomic<std::uint64_t> sequence;
+  std::uint32_t size;
+  std::uint32_t padding;
+};
+
+HADESMEM_DETAIL_STATIC_ASSERT(std::is_standard_layout<SharedRingHeader>::value);
+HADESMEM_DETAIL_STATIC_ASSERT(sizeof(SharedRingHeader) == 192);
+HADESMEM_DETAIL_STATIC_ASSERT(
+  std::is_standard_layout<SharedRingSlotHeader>::value);
+HADESMEM_DETAIL_STATIC_ASSERT(sizeof(SharedRingSlotHeader) == 16);
+
+class SharedRing
+{
+public:
+  static std::uint32_t const kMagic = 0x474E5253; // 'SRNG'
+  static std::size_t const kSlotAlignment = 64;
+  static std::size_t const kHeaderSize = sizeof(SharedRingHeader);
+  static std::size_t const kSlotHeaderSize = sizeof(SharedRingSlotHeader);
+
+  static std::size_t GetSlotSize(std::size_t max_message_size) noexcept
+  {
+    std::size_t const size = kSlotHeaderSize + max_message_size;
+    return (size + kSlotAlignment - 1) & ~(kSlotAlignment - 1);
+  }
+
+  static std::size_t GetRequiredSize(std::size_t num_slots,
+                                     std::size_t max_message_size) noexcept
+  {
+    return kHeaderSize + num_slots * GetSlotSize(max_message_size);
+  }
+
+  // Lays out an empty ring. The number of slots must be a power of two. The
+  // memory must be at least GetRequiredSize bytes and 8 byte aligned (cache
+  // line aligned to avoid false sharing).
+  static void Format(void* base,
+                     std::size_t num_slots,
+                     std::size_t max_message_size,
+                     SharedRingMode mode)
+  {
+    HADESMEM_DETAIL_ASSERT(base != nullptr);
+    HADESMEM_DETAIL_ASSERT(reinterpret_cast<std::uintptr_t>(base) % 8 == 0);
+    HADESMEM_DETAIL_ASSERT(num_slots != 0 &&
+                           (num_slots & (num_slots - 1)) == 0);
+
+    std::memset(base, 0, GetRequiredSize(num_slots, max_message_size));
+
+    auto const header = static_cast<SharedRingHeader*>(base);
+    header->mode = mode;
+    header->num_slots = static_cast<std::uint32_t>(num_slots);
+    header->slot_size =
+      static_cast<std::uint32_t>(GetSlotSize(max_message_size));
+    header->max_message_size = static_cast<std::uint32_t>(max_message_size);
+    header->head.store(0, std::memory_order_relaxed);
+    header->tail.store(0, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < num_slots; ++i)
+    {
+      GetSlotHeader(header, i)->sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // Published last, so anyone polling for the magic sees a complete ring.
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = kMagic;
+  }
+
+  static bool IsFormatted(void const* base) noexcept
+  {
+    return static_cast<SharedRingHeader const*>(base)->magic == kMagic;
+  }
+
+  // size is the number of bytes available at base. Check IsCorrupted
+  // afterwards, a ring which isn't formatted or doesn't fit is never used.
+  SharedRing(void* base, std::size_t size) noexcept
+    : header_{static_cast<SharedRingHeader*>(base)}
+  {
+    if (size < kHeaderSize || !IsFormatted(base))
+    {
+      corrupted_ = true;
+      return;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // Everything is read exactly once and only the copies are checked and
+    // used, so the other side can't change anything after the fact.
+    mode_ = header_->mode;
+    num_slots_ = header_->num_slots;
+    max_message_size_ = header_->max_message_size;
+    std::size_t const slot_size = header_->slot_size;
+    std::size_t const available = size - kHeaderSize;
+    corrupted_ =
+      (mode_ != SharedRingMode::kSpsc && mode_ != SharedRingMode::kMpsc) ||
+      num_slots_ == 0 || (num_slots_ & (num_slots_ - 1)) != 0 ||
+      max_message_size_ > available ||
+      slot_size != GetSlotSize(max_message_size_) ||
+      num_slots_ > available / slot_size;
+    slot_size_ = slot_size;
+  }
+
+  SharedRingMode GetMode() const noexcept
+  {
+    return mode_;
+  }
+
+  std::size_t GetNumSlots() const noexcept
+  {
+    return num_slots_;
+  }
+
+  std::size_t GetMaxMessageSize() const noexcept
+  {
+    return max_message_size_;
+  }
+
+  // Set once the other side has written something impossible. Nothing more
+  // is read from the ring after that.
+  bool IsCorrupted() const noexcept
+  {
+    return corrupted_;
+  }
+
+  // Only a snapshot, both ends may be moving.
+  std::size_t GetNumPending() const noexcept
+  {
+    if (corrupted_)
+    {
+      return 0;
+    }
+
+    std::uint64_t const tail = header_->tail.load(std::memory_order_acquire);
+    std::uint64_t const head = header_->head.load(std::memory_order_acquire);
+    return static_cast<std::size_t>(head - tail);
+  }
+
+  // Producer side.
+
+  // Claims a slot and calls func with a pointer to size bytes to fill in,
+  // directly in shared memory. Returns false if the ring is full.
+  template <typename Func> bool TryProduce(std::size_t size, Func const& func)
+  {
+    HADESMEM_DETAIL_ASSERT(size <= GetMaxMessageSize());
+
+    if (corrupted_)
+    {
+      return false;
+    }
+
+    std::uint64_t pos = header_->head.load(std::memory_order_relaxed);
+    SharedRingSlotHeader* slot_header = nullptr;
+    for (;;)
+    {
+      slot_header = GetSlotHeader(pos);
+      std::uint64_t const sequence =
+        slot_header->sequence.load(std::memory_order_acquire);
+      auto const diff = static_cast<std::int64_t>(sequence - pos);
+      if (diff < 0)
+      {
+        return false;
+      }
+
+      if (diff > 0)
+      {
+        // Another producer got here first.
+        pos = header_->head.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if (mode_ == SharedRingMode::kSpsc)
+      {
+        header_->head.store(pos + 1, std::memory_order_relaxed);
+        break;
+      }
+
+      if (header_->head.compare_exchange_weak(
+            pos, pos + 1, std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+
+    func(GetSlotData(slot_header));
+    slot_header->size = static_cast<std::uint32_t>(size);
+    slot_header->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryWrite(void const* data, std::size_t size)
+  {
+    return TryProduce(size,
+                      [&](void* slot_data) {
+                        if (size)
+                        {
+                          std::memcpy(slot_data, data, size);
+                        }
+                      });
+  }
+
+  // Consumer side.
+
+  // Calls func with a pointer to the oldest message and its size, directly in
+  // shared memory. The slot is handed back to the producers once func
+  // returns. Returns false if the ring is empty or corrupted.
+  template <typename Func> bool TryConsume(Func const& func)
+  {
+    if (corrupted_)
+    {
+      return false;
+    }
+
+    std::uint64_t const pos = header_->tail.load(std::memory_order_relaxed);
+    SharedRingSlotHeader* const slot_header = GetSlotHeader(pos);
+    std::uint64_t const sequence =
+      slot_header->sequence.load(std::memory_order_acquire);
+    if (sequence != pos + 1)
+    {
+      return false;
+    }
+
+    std::size_t const size = slot_header->size;
+    if (size > GetMaxMessageSize())
+    {
+      corrupted_ = true;
+      return false;
+    }
+
+    func(static_cast<void const*>(GetSlotData(slot_header)), size);
+
+    slot_header->sequence.store(pos + GetNumSlots(), std::memory_order_release);
+    header_->tail.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // The buffer must be at least GetMaxMessageSize bytes.
+  bool TryRead(void* data, std::size_t* size)
+  {
+    HADESMEM_DETAIL_ASSERT(size != nullptr);
+
+    return TryConsume([&](void const* slot_data, std::size_t slot_size) {
+      if (slot_size)
+      {
+        std::memcpy(data, slot_data, slot_size);
+      }
+      *size = slot_size;
+    });
+  }
+
+private:
+  static SharedRingSlotHeader* GetSlotHeader(SharedRingHeader* header,
+                                             std::size_t slot) noexcept
+  {
+    return GetSlotHeader(header, slot, header->slot_size);
+  }
+
+  static SharedRingSlotHeader* GetSlotHeader(SharedRingHeader* header,
+                                             std::size_t slot,
+                                             std::size_t slot_size) noexcept
+  {
+    return reinterpret_cast<SharedRingSlotHeader*>(
+      reinterpret_cast<std::uint8_t*>(header) + kHeaderSize +
+      slot * slot_size);
+  }
+
+  SharedRingSlotHeader* GetSlotHeader(std::uint64_t pos) const noexcept
+  {
+    return GetSlotHeader(header_,
+                         static_cast<std::size_t>(pos & (num_slots_ - 1)),
+                         slot_size_);
+  }
+
+  static void* GetSlotData(SharedRingSlotHeader* slot_header) noexcept
+  {
+    return reinterpret_cast<std::uint8_t*>(slot_header) + kSlotHeaderSize;
+  }
+
+  SharedRingHeader* header_;
+  SharedRingMode mode_{};
+  std::size_t num_slots_{};
+  std::size_t max_message_size_{};
+  std::size_t slot_size_{};
+  bool corrupted_{};
+};
+}
+}
@@ -0,0 +1,240 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <windows.h>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/winapi.hpp>
+#include <hadesmem/detail/winternl.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
+// Pagefile backed section mapped both into our process and into a target
+// process, so the two can share data without any further IPC (e.g. hit
+// counters which are incremented by remote code and polled locally).
+
+namespace hadesmem
+{
+namespace detail
+{
+inline void* MapViewOfSectionRemote(Process const& process,
+                                    HANDLE section,
+                                    std::size_t size,
+                                    ULONG protect)
+{
+  using NtMapViewOfSectionPtr =
+    NTSTATUS(NTAPI*)(HANDLE section_handle,
+                     HANDLE process_handle,
+                     PVOID* base_address,
+                     ULONG_PTR zero_bits,
+                     SIZE_T commit_size,
+                     PLARGE_INTEGER section_offset,
+                     PSIZE_T view_size,
+                     winternl::SECTION_INHERIT inherit_disposition,
+                     ULONG allocation_type,
+                     ULONG win32_protect);
+
+  auto const nt_map_view_of_section = reinterpret_cast<NtMapViewOfSectionPtr>(
+    GetNtdllProcAddress("NtMapViewOfSection"));
+
+  PVOID base = nullptr;
+  SIZE_T view_size = size;
+  NTSTATUS const status = nt_map_view_of_section(section,
+                                                 process.GetHandle(),
+                                                 &base,
+                                                 0,
+                                                 0,
+                                                 nullptr,
+                                                 &view_size,
+                                                 winternl::ViewUnmap,
+                                                 0,
+                                                 protect);
+  if (!NT_SUCCESS(status))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"NtMapViewOfSection failed."}
+                                    << ErrorCodeWinStatus{status});
+  }
+
+  return base;
+}
+
+inline void UnmapViewOfSectionRemote(Process const& process, void* base)
+{
+  using NtUnmapViewOfSectionPtr =
+    NTSTATUS(NTAPI*)(HANDLE process_handle, PVOID base_address);
+
+  auto const nt_unmap_view_of_section =
+    reinterpret_cast<NtUnmapViewOfSectionPtr>(
+      GetNtdllProcAddress("NtUnmapViewOfSection"));
+
+  NTSTATUS const status = nt_unmap_view_of_section(process.GetHandle(), base);
+  if (!NT_SUCCESS(status))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"NtUnmapViewOfSection failed."}
+              << ErrorCodeWinStatus{status});
+  }
+}
+
+class SharedSection
+{
+public:
+  explicit SharedSection(Process const& process,
+                         std::size_t size,
+                         ULONG remote_protect = PAGE_READWRITE)
+    : process_{&process}, size_{size}
+  {
+    HADESMEM_DETAIL_ASSERT(size_ != 0);
+
+    auto const size_64 = static_cast<std::uint64_t>(size_);
+    section_ = ::CreateFileMappingW(INVALID_HANDLE_VALUE,
+                                    nullptr,
+                                    PAGE_EXECUTE_READWRITE | SEC_COMMIT,
+                                    static_cast<DWORD>(size_64 >> 32),
+                                    static_cast<DWORD>(size_64 & 0xFFFFFFFF),
+                                    nullptr);
+    if (!section_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"CreateFileMappingW failed."}
+                << ErrorCodeWinLast{last_error});
+    }
+
+    local_view_ = ::MapViewOfFile(
+      section_.GetHandle(), FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size_);
+    if (!local_view_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"MapViewOfFile failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    if (process.GetId() == ::GetCurrentProcessId())
+    {
+      remote_view_ = local_view_.GetHandle();
+    }
+    else
+    {
+      remote_view_ = MapViewOfSectionRemote(
+        process, section_.GetHandle(), size_, remote_protect);
+    }
+  }
+
+  explicit SharedSection(Process const&& process,
+                         std::size_t size,
+                         ULONG remote_protect = PAGE_READWRITE) = delete;
+
+  SharedSection(SharedSection const& other) = delete;
+
+  SharedSection& operator=(SharedSection const& other) = delete;
+
+  SharedSection(SharedSection&& other) noexcept
+    : process_{other.process_},
+      section_{std::move(other.section_)},
+      local_view_{std::move(other.local_view_)},
+      remote_view_{other.remote_view_},
+      size_{other.size_}
+  {
+    other.process_ = nullptr;
+    other.remote_view_ = nullptr;
+    other.size_ = 0;
+  }
+
+  SharedSection& operator=(SharedSection&& other) noexcept
+  {
+    UnmapUnchecked();
+
+    process_ = other.process_;
+    other.process_ = nullptr;
+
+    section_ = std::move(other.section_);
+
+    local_view_ = std::move(other.local_view_);
+
+    remote_view_ = other.remote_view_;
+    other.remote_view_ = nullptr;
+
+    size_ = other.size_;
+    other.size_ = 0;
+
+    return *this;
+  }
+
+  ~SharedSection()
+  {
+    UnmapUnchecked();
+  }
+
+  void Unmap()
+  {
+    if (!process_)
+    {
+      return;
+    }
+
+    if (remote_view_ && remote_view_ != local_view_.GetHandle())
+    {
+      UnmapViewOfSectionRemote(*process_, remote_view_);
+    }
+
+    local_view_.Cleanup();
+    section_.Cleanup();
+
+    process_ = nullptr;
+    remote_view_ = nullptr;
+    size_ = 0;
+  }
+
+  void* GetLocalBase() const noexcept
+  {
+    return local_view_.GetHandle();
+  }
+
+  void* GetRemoteBase() const noexcept
+  {
+    return remote_view_;
+  }
+
+  std::size_t GetSize() const noexcept
+  {
+    return size_;
+  }
+
+private:
+  void UnmapUnchecked() noexcept
+  {
+    try
+    {
+      Unmap();
+    }
+    catch (...)
+    {
+      // WARNING: View in remote process is leaked if 'Unmap' fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+
+      process_ = nullptr;
+      remote_view_ = nullptr;
+      size_ = 0;
+    }
+  }
+
+  Process const* process_;
+  SmartHandle section_;
+  SmartMappedFileHandle local_view_;
+  void* remote_view_{};
+  std::size_t size_;
+};
+}
+}
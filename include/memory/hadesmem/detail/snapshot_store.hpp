@@ -0,0 +1,331 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Storage and diffing for ProcessSnapshot. A snapshot is a sorted list of
+// regions whose contents are packed back to back in a single buffer supplied
+// by the caller (so it can be heap memory or a view of a file). Every page is
+// hashed once the data is in, which is all a diff needs, so diffing two
+// snapshots never touches the data itself.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct SnapshotRegion
+{
+  std::uint64_t base;
+  std::uint64_t size;
+  std::uint32_t protect;
+  // False if the contents couldn't be captured (e.g. the region was freed
+  // while we were copying). Invalid regions are treated as absent.
+  bool valid;
+  std::size_t data_offset;
+  std::size_t first_page;
+};
+
+struct SnapshotDiffRange
+{
+  std::uint64_t base;
+  std::uint64_t size;
+};
+
+struct SnapshotDiff
+{
+  // Pages present in the new snapshot only.
+  std::vector<SnapshotDiffRange> added;
+  // Pages present in the old snapshot only.
+  std::vector<SnapshotDiffRange> removed;
+  // Pages present in both with different contents.
+  std::vector<SnapshotDiffRange> changed;
+};
+
+class SnapshotStore
+{
+public:
+  static std::size_t const kPageSize = 0x1000;
+
+  // Regions must be page aligned, a multiple of the page size, and added in
+  // ascending order without overlapping.
+  void AddRegion(std::uint64_t base, std::uint64_t size, std::uint32_t protect)
+  {
+    HADESMEM_DETAIL_ASSERT(data_ == nullptr);
+    HADESMEM_DETAIL_ASSERT(base % kPageSize == 0 && size % kPageSize == 0);
+    HADESMEM_DETAIL_ASSERT(size != 0);
+    HADESMEM_DETAIL_ASSERT(regions_.empty() ||
+                           regions_.back().base + regions_.back().size <=
+                             base);
+
+    regions_.push_back(SnapshotRegion{base,
+                                      size,
+                                      protect,
+                                      true,
+                                      data_size_,
+                                      num_pages_});
+    data_size_ += static_cast<std::size_t>(size);
+    num_pages_ += static_cast<std::size_t>(size / kPageSize);
+  }
+
+  // Total number of bytes of storage needed for the regions added so far.
+  std::size_t GetDataSize() const noexcept
+  {
+    return data_size_;
+  }
+
+  // Supplies the storage, which must be at least GetDataSize bytes and must
+  // outlive the store. No more regions can be added after this.
+  void Attach(std::uint8_t* data) noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(data != nullptr || data_size_ == 0);
+    data_ = data;
+  }
+
+  std::size_t GetNumRegions() const noexcept
+  {
+    return regions_.size();
+  }
+
+  SnapshotRegion const& GetRegion(std::size_t index) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(index < regions_.size());
+    return regions_[index];
+  }
+
+  std::uint8_t* GetRegionData(std::size_t index) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(data_ != nullptr);
+    return data_ + GetRegion(index).data_offset;
+  }
+
+  void SetRegionValid(std::size_t index, bool valid) noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(index < regions_.size());
+    regions_[index].valid = valid;
+  }
+
+  // Must be called once all the data is in, before diffing.
+  void HashPages()
+  {
+    HADESMEM_DETAIL_ASSERT(data_ != nullptr || data_size_ == 0);
+
+    page_hashes_.resize(num_pages_);
+    for (std::size_t i = 0; i < num_pages_; ++i)
+    {
+      page_hashes_[i] = HashPage(data_ + i * kPageSize);
+    }
+  }
+
+  // Returns the index of the valid region containing the address, or
+  // GetNumRegions() if there isn't one.
+  std::size_t FindRegion(std::uint64_t address) const noexcept
+  {
+    auto const iter = std::upper_bound(
+      std::begin(regions_),
+      std::end(regions_),
+      address,
+      [](std::uint64_t a, SnapshotRegion const& r) { return a < r.base; });
+    if (iter == std::begin(regions_))
+    {
+      return regions_.size();
+    }
+
+    auto const prev = std::prev(iter);
+    if (!prev->valid || address - prev->base >= prev->size)
+    {
+      return regions_.size();
+    }
+
+    return static_cast<std::size_t>(std::distance(std::begin(regions_), prev));
+  }
+
+  // Reads may span regions as long as there are no gaps. Returns false
+  // (without writing anything) if any part of the range wasn't captured.
+  bool Read(std::uint64_t address, void* out, std::size_t len) const
+  {
+    HADESMEM_DETAIL_ASSERT(data_ != nullptr || data_size_ == 0);
+
+    if (!IsCaptured(address, len))
+    {
+      return false;
+    }
+
+    auto out_cur = static_cast<std::uint8_t*>(out);
+    while (len)
+    {
+      std::size_t const index = FindRegion(address);
+      SnapshotRegion const& region = regions_[index];
+      std::uint64_t const offset = address - region.base;
+      std::size_t const chunk_len = static_cast<std::size_t>(
+        (std::min)(static_cast<std::uint64_t>(len), region.size - offset));
+      std::memcpy(out_cur,
+                  data_ + region.data_offset + static_cast<std::size_t>(offset),
+                  chunk_len);
+      out_cur += chunk_len;
+      address += chunk_len;
+      len -= chunk_len;
+    }
+
+    return true;
+  }
+
+  bool IsCaptured(std::uint64_t address, std::size_t len) const noexcept
+  {
+    while (len)
+    {
+      std::size_t const index = FindRegion(address);
+      if (index == regions_.size())
+      {
+        return false;
+      }
+
+      SnapshotRegion const& region = regions_[index];
+      std::uint64_t const remaining = region.base + region.size - address;
+      if (remaining >= len)
+      {
+        return true;
+      }
+      address += remaining;
+      len -= static_cast<std::size_t>(remaining);
+    }
+
+    return true;
+  }
+
+  // Both snapshots must have had their pages hashed.
+  static SnapshotDiff Diff(SnapshotStore const& old_store,
+                           SnapshotStore const& new_store)
+  {
+    HADESMEM_DETAIL_ASSERT(old_store.page_hashes_.size() ==
+                           old_store.num_pages_);
+    HADESMEM_DETAIL_ASSERT(new_store.page_hashes_.size() ==
+                           new_store.num_pages_);
+
+    SnapshotDiff diff;
+    PageCursor old_cur{old_store};
+    PageCursor new_cur{new_store};
+    while (!old_cur.IsEnd() || !new_cur.IsEnd())
+    {
+      if (new_cur.IsEnd() ||
+          (!old_cur.IsEnd() && old_cur.GetAddress() < new_cur.GetAddress()))
+      {
+        AddPage(&diff.removed, old_cur.GetAddress());
+        old_cur.Next();
+      }
+      else if (old_cur.IsEnd() || new_cur.GetAddress() < old_cur.GetAddress())
+      {
+        AddPage(&diff.added, new_cur.GetAddress());
+        new_cur.Next();
+      }
+      else
+      {
+        if (old_cur.GetHash() != new_cur.GetHash())
+        {
+          AddPage(&diff.changed, new_cur.GetAddress());
+        }
+        old_cur.Next();
+        new_cur.Next();
+      }
+    }
+
+    return diff;
+  }
+
+  // Not cryptographic, just good enough that a changed page is vanishingly
+  // unlikely to hash the same. Works on 8 bytes at a time to keep up with
+  // memcpy.
+  static std::uint64_t HashPage(std::uint8_t const* page) noexcept
+  {
+    std::uint64_t hash = 0xCBF29CE484222325ULL;
+    for (std::size_t i = 0; i < kPageSize; i += sizeof(std::uint64_t))
+    {
+      std::uint64_t word;
+      std::memcpy(&word, page + i, sizeof(word));
+      hash ^= word;
+      hash *= 0x100000001B3ULL;
+      hash ^= hash >> 29;
+    }
+    return hash;
+  }
+
+private:
+  // Walks the pages of valid regions in address order.
+  class PageCursor
+  {
+  public:
+    explicit PageCursor(SnapshotStore const& store) : store_{&store}
+    {
+      SkipInvalid();
+    }
+
+    bool IsEnd() const noexcept
+    {
+      return region_ == store_->regions_.size();
+    }
+
+    std::uint64_t GetAddress() const noexcept
+    {
+      return store_->regions_[region_].base + page_ * kPageSize;
+    }
+
+    std::uint64_t GetHash() const noexcept
+    {
+      return store_->page_hashes_[store_->regions_[region_].first_page + page_];
+    }
+
+    void Next() noexcept
+    {
+      if (++page_ == store_->regions_[region_].size / kPageSize)
+      {
+        ++region_;
+        page_ = 0;
+        SkipInvalid();
+      }
+    }
+
+  private:
+    void SkipInvalid() noexcept
+    {
+      while (!IsEnd() && !store_->regions_[region_].valid)
+      {
+        ++region_;
+      }
+    }
+
+    SnapshotStore const* store_;
+    std::size_t region_{};
+    std::size_t page_{};
+  };
+
+  static void AddPage(std::vector<SnapshotDiffRange>* ranges,
+                      std::uint64_t address)
+  {
+    if (!ranges->empty() &&
+        ranges->back().base + ranges->back().size == address)
+    {
+      ranges->back().size += kPageSize;
+      return;
+    }
+
+    ranges->push_back(SnapshotDiffRange{address, kPageSize});
+  }
+
+  std::vector<SnapshotRegion> regions_;
+  std::vector<std::uint64_t> page_hashes_;
+  std::uint8_t* data_{};
+  std::size_t data_size_{};
+  std::size_t num_pages_{};
+};
+}
+}
@@ -0,0 +1,151 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <windows.h>
+#include <tlhelp32.h>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/winapi.hpp>
+#include <hadesmem/detail/winternl.hpp>
+#include <hadesmem/error.hpp>
+
+// Thread enumeration scoped to a single process.
+//
+// Toolhelp's TH32CS_SNAPTHREAD snapshots every thread in the system into a
+// section, which we then walk one entry at a time with a call per thread.
+// Instead we do a single NtQuerySystemInformation call (into a buffer sized
+// from the previous call) and only keep the threads of the process we're
+// interested in, or, when we
+// have a handle to the process, walk its thread list directly with
+// NtGetNextThread (which never looks at any other process, and hands us a
+// handle to each thread as we go).
+
+namespace hadesmem
+{
+namespace detail
+{
+inline std::vector<THREADENTRY32> GetProcessThreadEntries(DWORD pid)
+{
+  using NtQuerySystemInformationPtr = NTSTATUS(
+    NTAPI*)(winternl::SYSTEM_INFORMATION_CLASS system_information_class,
+            PVOID system_information,
+            ULONG system_information_length,
+            PULONG return_length);
+
+  auto const nt_query_system_information =
+    reinterpret_cast<NtQuerySystemInformationPtr>(
+      GetNtdllProcAddress("NtQuerySystemInformation"));
+
+  // Remember how much space the last call needed, so we usually only need a
+  // single call. Threads can be created between calls, so leave some slack.
+  static std::atomic<ULONG> size_hint{0x40000};
+
+  std::vector<std::uint8_t> buffer;
+  NTSTATUS status = HADESMEM_DETAIL_STATUS_INFO_LENGTH_MISMATCH;
+  for (ULONG size = size_hint.load(std::memory_order_relaxed);
+       status == HADESMEM_DETAIL_STATUS_INFO_LENGTH_MISMATCH;)
+  {
+    buffer.resize(size);
+    ULONG return_length = 0;
+    status = nt_query_system_information(winternl::SystemProcessInformation,
+                                         buffer.data(),
+                                         size,
+                                         &return_length);
+    size = (std::max)(size * 2, return_length + return_length / 4);
+    if (NT_SUCCESS(status))
+    {
+      size_hint.store(return_length + return_length / 4,
+                      std::memory_order_relaxed);
+    }
+  }
+
+  if (!NT_SUCCESS(status))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"NtQuerySystemInformation failed."}
+              << ErrorCodeWinStatus{status});
+  }
+
+  std::vector<THREADENTRY32> entries;
+  for (std::uint8_t const* cur = buffer.data();;)
+  {
+    auto const process_info =
+      reinterpret_cast<winternl::SYSTEM_PROCESS_INFORMATION const*>(cur);
+    if (static_cast<DWORD>(reinterpret_cast<DWORD_PTR>(
+          process_info->UniqueProcessId)) == pid)
+    {
+      auto const threads =
+        reinterpret_cast<winternl::SYSTEM_THREAD_INFORMATION const*>(
+          process_info + 1);
+      entries.reserve(process_info->NumberOfThreads);
+      for (ULONG i = 0; i < process_info->NumberOfThreads; ++i)
+      {
+        // Same as what Toolhelp fills in.
+        THREADENTRY32 entry{};
+        entry.dwSize = static_cast<DWORD>(sizeof(entry));
+        entry.th32ThreadID = static_cast<DWORD>(
+          reinterpret_cast<DWORD_PTR>(threads[i].ClientId.UniqueThread));
+        entry.th32OwnerProcessID = pid;
+        entry.tpBasePri = threads[i].BasePriority;
+        entries.push_back(entry);
+      }
+      break;
+    }
+
+    if (!process_info->NextEntryOffset)
+    {
+      break;
+    }
+
+    cur += process_info->NextEntryOffset;
+  }
+
+  return entries;
+}
+
+// Returns an invalid handle once there are no more threads. Pass a null
+// thread handle to get the first thread. Threads are returned in creation
+// order, so continuing from the last thread returned will find any threads
+// created since.
+inline SmartHandle
+  GetNextThread(HANDLE process, HANDLE thread, ACCESS_MASK access)
+{
+  using NtGetNextThreadPtr = NTSTATUS(NTAPI*)(HANDLE process_handle,
+                                              HANDLE thread_handle,
+                                              ACCESS_MASK desired_access,
+                                              ULONG handle_attributes,
+                                              ULONG flags,
+                                              PHANDLE new_thread_handle);
+
+  auto const nt_get_next_thread = reinterpret_cast<NtGetNextThreadPtr>(
+    GetNtdllProcAddress("NtGetNextThread"));
+
+  HANDLE next = nullptr;
+  NTSTATUS const status =
+    nt_get_next_thread(process, thread, access, 0, 0, &next);
+  if (status == HADESMEM_DETAIL_STATUS_NO_MORE_ENTRIES)
+  {
+    return SmartHandle{};
+  }
+
+  if (!NT_SUCCESS(status))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"NtGetNextThread failed."}
+                                    << ErrorCodeWinStatus{status});
+  }
+
+  HADESMEM_DETAIL_ASSERT(next != nullptr);
+  return SmartHandle{next};
+}
+}
+}
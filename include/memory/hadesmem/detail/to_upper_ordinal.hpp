@@ -4,6 +4,7 @@
 #pragma once
 
 #include <cassert>
+#include <cstddef>
 #include <limits>
 #include <string>
 #include <vector>
@@ -17,6 +18,43 @@ namespace hadesmem
 {
 namespace detail
 {
+// Same mapping as the string overloads, but never allocates (or fails).
+inline wchar_t ToUpperOrdinal(wchar_t c) noexcept
+{
+  // CharUpper converts a single character in-place in the pointer value if the
+  // high-order word is zero.
+  auto const upper = ::CharUpperW(
+    reinterpret_cast<LPWSTR>(static_cast<ULONG_PTR>(static_cast<WORD>(c))));
+  return static_cast<wchar_t>(reinterpret_cast<ULONG_PTR>(upper) & 0xFFFF);
+}
+
+inline bool IsEqualOrdinalNoCase(wchar_t const* lhs,
+                                 std::size_t lhs_len,
+                                 wchar_t const* rhs,
+                                 std::size_t rhs_len) noexcept
+{
+  if (lhs_len != rhs_len)
+  {
+    return false;
+  }
+
+  for (std::size_t i = 0; i < lhs_len; ++i)
+  {
+    if (lhs[i] != rhs[i] && ToUpperOrdinal(lhs[i]) != ToUpperOrdinal(rhs[i]))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+inline bool IsEqualOrdinalNoCase(std::wstring const& lhs,
+                                 std::wstring const& rhs) noexcept
+{
+  return IsEqualOrdinalNoCase(lhs.data(), lhs.size(), rhs.data(), rhs.size());
+}
+
 inline std::wstring ToUpperOrdinal(std::wstring const& str)
 {
   if (str.empty())
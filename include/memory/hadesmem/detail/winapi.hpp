@@ -20,6 +20,29 @@ inline SYSTEM_INFO GetSystemInfo()
   return sys_info;
 }
 
+inline FARPROC GetNtdllProcAddress(char const* name)
+{
+  HMODULE const ntdll = ::GetModuleHandleW(L"ntdll");
+  if (!ntdll)
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"GetModuleHandleW failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+
+  FARPROC const proc = ::GetProcAddress(ntdll, name);
+  if (!proc)
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"GetProcAddress failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+
+  return proc;
+}
+
 inline bool IsWoW64Process(HANDLE handle)
 {
   BOOL is_wow64 = FALSE;
@@ -303,19 +303,19 @@ struct SYSTEM_PROCESS_INFORMATION
   PVOID InheritedFromUniqueProcessId;
   ULONG HandleCount;
   ULONG SessionId;
-  ULONG UniqueProcessKey;
-  ULONG PeakVirtualSize;
-  ULONG VirtualSize;
+  ULONG_PTR UniqueProcessKey;
+  SIZE_T PeakVirtualSize;
+  SIZE_T VirtualSize;
   ULONG PageFaultCount;
-  ULONG PeakWorkingSetSize;
-  ULONG WorkingSetSize;
-  ULONG QuotaPeakPagedPoolUsage;
-  ULONG QuotaPagedPoolUsage;
-  ULONG QuotaPeakNonPagedPoolUsage;
-  ULONG QuotaNonPagedPoolUsage;
-  ULONG PagefileUsage;
-  ULONG PeakPagefileUsage;
-  ULONG PrivatePageCount;
+  SIZE_T PeakWorkingSetSize;
+  SIZE_T WorkingSetSize;
+  SIZE_T QuotaPeakPagedPoolUsage;
+  SIZE_T QuotaPagedPoolUsage;
+  SIZE_T QuotaPeakNonPagedPoolUsage;
+  SIZE_T QuotaNonPagedPoolUsage;
+  SIZE_T PagefileUsage;
+  SIZE_T PeakPagefileUsage;
+  SIZE_T PrivatePageCount;
   LARGE_INTEGER ReadOperationCount;
   LARGE_INTEGER WriteOperationCount;
   LARGE_INTEGER OtherOperationCount;
@@ -704,6 +704,29 @@ typedef struct _RTL_USER_PROCESS_PARAMETERS
 
 typedef RTL_USER_PROCESS_PARAMETERS* PRTL_USER_PROCESS_PARAMETERS;
 
+// The SDK only exposes a handful of the loader fields.
+struct PEB_LDR_DATA
+{
+  ULONG Length;
+  BOOLEAN Initialized;
+  HANDLE SsHandle;
+  LIST_ENTRY InLoadOrderModuleList;
+  LIST_ENTRY InMemoryOrderModuleList;
+  LIST_ENTRY InInitializationOrderModuleList;
+};
+
+struct LDR_DATA_TABLE_ENTRY
+{
+  LIST_ENTRY InLoadOrderLinks;
+  LIST_ENTRY InMemoryOrderLinks;
+  LIST_ENTRY InInitializationOrderLinks;
+  PVOID DllBase;
+  PVOID EntryPoint;
+  ULONG SizeOfImage;
+  UNICODE_STRING FullDllName;
+  UNICODE_STRING BaseDllName;
+};
+
 struct PEB
 {
   UCHAR InheritedAddressSpace;
@@ -712,7 +735,7 @@ struct PEB
   UCHAR BitField;
   PVOID Mutant;
   PVOID ImageBaseAddress;
-  PPEB_LDR_DATA Ldr;
+  PEB_LDR_DATA* Ldr;
   PRTL_USER_PROCESS_PARAMETERS ProcessParameters;
   PVOID SubSystemData;
   PVOID ProcessHeap;
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 #include <windows.h>
 
@@ -14,6 +15,7 @@
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/protect.hpp>
+#include <hadesmem/region_map.hpp>
 
 namespace hadesmem
 {
@@ -40,10 +42,14 @@ inline void WriteUnchecked(Process const& process,
   }
 }
 
-inline void WriteImpl(Process const& process,
+// QueryFunc is called with each address we need region information for, and
+// should return the same thing as detail::Query.
+template <typename QueryFunc>
+void WriteRegionsImpl(Process const& process,
                       PVOID address,
                       LPCVOID data,
-                      std::size_t len)
+                      std::size_t len,
+                      QueryFunc const& query)
 {
   HADESMEM_DETAIL_ASSERT(address != nullptr);
   HADESMEM_DETAIL_ASSERT(data != nullptr);
@@ -51,9 +57,10 @@ inline void WriteImpl(Process const& process,
 
   for (;;)
   {
-    ProtectGuard protect_guard{process, address, ProtectGuardType::kWrite};
+    MEMORY_BASIC_INFORMATION const mbi = query(address);
+
+    ProtectGuard protect_guard{process, mbi, ProtectGuardType::kWrite};
 
-    MEMORY_BASIC_INFORMATION const mbi = detail::Query(process, address);
     void* const region_next =
       static_cast<std::uint8_t*>(mbi.BaseAddress) + mbi.RegionSize;
 
@@ -83,6 +90,29 @@ inline void WriteImpl(Process const& process,
   }
 }
 
+inline void WriteImpl(Process const& process,
+                      PVOID address,
+                      LPCVOID data,
+                      std::size_t len)
+{
+  WriteRegionsImpl(
+    process, address, data, len, [&](void const* region_address) {
+      return detail::Query(process, region_address);
+    });
+}
+
+inline void WriteImpl(Process const& process,
+                      RegionMap const& regions,
+                      PVOID address,
+                      LPCVOID data,
+                      std::size_t len)
+{
+  WriteRegionsImpl(
+    process, address, data, len, [&](void const* region_address) {
+      return regions.QueryForAccess(region_address, ProtectGuardType::kWrite);
+    });
+}
+
 template <typename T>
 void WriteImpl(Process const& process, PVOID address, T const& data)
 {
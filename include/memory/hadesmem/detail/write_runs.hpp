@@ -0,0 +1,161 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Accumulates writes for WriteBatch and turns them into the smallest set of
+// non-overlapping runs, sorted by address. Writes which touch or overlap are
+// merged into a single run. Where writes overlap the one added last wins, as
+// if they had been done one at a time in order.
+//
+// Nothing in here depends on the OS.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct WriteRun
+{
+  std::uint64_t address;
+  std::size_t size;
+  // Offset of the data in the buffer returned by GetData.
+  std::size_t offset;
+};
+
+class WriteRuns
+{
+public:
+  void Add(std::uint64_t address, void const* data, std::size_t len)
+  {
+    HADESMEM_DETAIL_ASSERT(data != nullptr || !len);
+
+    if (!len)
+    {
+      return;
+    }
+
+    std::size_t const offset = data_.size();
+    auto const data_beg = static_cast<std::uint8_t const*>(data);
+    data_.insert(std::end(data_), data_beg, data_beg + len);
+    runs_.push_back(WriteRun{address, len, offset});
+    is_coalesced_ = runs_.size() == 1 ||
+                    (is_coalesced_ && IsBefore(runs_[runs_.size() - 2],
+                                               runs_.back()));
+  }
+
+  // Cheap if nothing has been added since the last call.
+  void Coalesce()
+  {
+    if (is_coalesced_)
+    {
+      return;
+    }
+
+    // Sort on address, keeping the order they were added in as a tie break
+    // so we know which one wins.
+    std::vector<std::size_t> order(runs_.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+      order[i] = i;
+    }
+    std::stable_sort(std::begin(order),
+                     std::end(order),
+                     [&](std::size_t lhs, std::size_t rhs) {
+                       return runs_[lhs].address < runs_[rhs].address;
+                     });
+
+    std::vector<WriteRun> runs;
+    std::vector<std::uint8_t> data;
+    data.reserve(data_.size());
+    std::vector<std::size_t> group;
+    for (std::size_t i = 0; i < order.size();)
+    {
+      WriteRun merged{runs_[order[i]].address, 0, data.size()};
+      std::uint64_t merged_end = merged.address;
+      group.clear();
+      for (; i < order.size() && runs_[order[i]].address <= merged_end; ++i)
+      {
+        WriteRun const& run = runs_[order[i]];
+        merged_end = (std::max)(merged_end, run.address + run.size);
+        group.push_back(order[i]);
+      }
+
+      merged.size = static_cast<std::size_t>(merged_end - merged.address);
+      data.resize(data.size() + merged.size);
+
+      // Apply in the order they were added.
+      std::sort(std::begin(group), std::end(group));
+      for (auto const index : group)
+      {
+        WriteRun const& run = runs_[index];
+        std::memcpy(&data[merged.offset] +
+                      static_cast<std::size_t>(run.address - merged.address),
+                    &data_[run.offset],
+                    run.size);
+      }
+
+      runs.push_back(merged);
+    }
+
+    runs_.swap(runs);
+    data_.swap(data);
+    is_coalesced_ = true;
+  }
+
+  // Only sorted and non-overlapping after a call to Coalesce.
+  std::vector<WriteRun> const& GetRuns() const noexcept
+  {
+    return runs_;
+  }
+
+  std::uint8_t const* GetData(WriteRun const& run) const noexcept
+  {
+    return data_.data() + run.offset;
+  }
+
+  // Includes bytes which will be overwritten by later writes until the runs
+  // are coalesced.
+  std::size_t GetNumBytes() const noexcept
+  {
+    return data_.size();
+  }
+
+  bool IsCoalesced() const noexcept
+  {
+    return is_coalesced_;
+  }
+
+  bool empty() const noexcept
+  {
+    return runs_.empty();
+  }
+
+  void Clear() noexcept
+  {
+    runs_.clear();
+    data_.clear();
+    is_coalesced_ = true;
+  }
+
+private:
+  // True if rhs can follow lhs in a coalesced list without any merging.
+  static bool IsBefore(WriteRun const& lhs, WriteRun const& rhs) noexcept
+  {
+    return lhs.address + lhs.size < rhs.address;
+  }
+
+  std::vector<WriteRun> runs_;
+  std::vector<std::uint8_t> data_;
+  bool is_coalesced_{true};
+};
+}
+}
@@ -5,7 +5,10 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <iterator>
 #include <string>
 #include <utility>
@@ -24,10 +27,12 @@
 #include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/detail/static_assert.hpp>
 #include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/thread_pool.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/find_procedure.hpp>
 #include <hadesmem/module.hpp>
+#include <hadesmem/module_snapshot.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/write.hpp>
 
@@ -38,7 +43,7 @@
 
 // TODO: .NET injection (without DLL dependency if possible).
 
-// TODO: Add manual mapping support again.
+// Manual mapping is in manual_map.hpp.
 
 // TODO: IME injection. https://github.com/dwendt/UniversalInject
 
@@ -110,9 +115,36 @@ struct InjectFlags
   };
 };
 
-inline HMODULE InjectDll(Process const& process,
-                         std::wstring const& path,
-                         std::uint32_t flags)
+struct InjectDllResult
+{
+  // Null if LoadLibraryExW failed.
+  HMODULE module;
+  DWORD last_error;
+};
+
+// Time spent in each stage of an injection, accumulated across calls.
+struct InjectTimings
+{
+  std::chrono::microseconds open;
+  std::chrono::microseconds ldr_init;
+  std::chrono::microseconds resolve;
+  std::chrono::microseconds write;
+  std::chrono::microseconds load;
+};
+
+struct InjectDllsProcessResult
+{
+  DWORD pid;
+  // Empty if error is set.
+  std::vector<InjectDllResult> modules;
+  InjectTimings timings;
+  std::exception_ptr error;
+};
+
+namespace detail
+{
+inline std::wstring ResolveInjectPath(std::wstring const& path,
+                                      std::uint32_t flags)
 {
   HADESMEM_DETAIL_ASSERT(!(flags & ~(InjectFlags::kInvalidFlagMaxValue - 1UL)));
 
@@ -147,50 +179,243 @@ inline HMODULE InjectDll(Process const& process,
       Error() << ErrorString("Could not find module file."));
   }
 
-  HADESMEM_DETAIL_TRACE_A("Calling ForceLdrInitializeThunk.");
+  return path_real;
+}
 
-  detail::ForceLdrInitializeThunk(process.GetId());
+template <typename PathsForwardIterator>
+inline std::vector<std::wstring> ResolveInjectPaths(
+  PathsForwardIterator paths_beg,
+  PathsForwardIterator paths_end,
+  std::uint32_t flags)
+{
+  std::vector<std::wstring> paths_real;
+  std::transform(paths_beg,
+                 paths_end,
+                 std::back_inserter(paths_real),
+                 [&](std::wstring const& path)
+                 {
+                   return ResolveInjectPath(path, flags);
+                 });
+  return paths_real;
+}
+
+class InjectStageTimer
+{
+public:
+  InjectStageTimer() : start_{std::chrono::steady_clock::now()}
+  {
+  }
 
-  HADESMEM_DETAIL_TRACE_FORMAT_W(L"Module path is \"%s\".", path_real.c_str());
+  // Adds the time since the last lap to the stage.
+  void Lap(std::chrono::microseconds* stage)
+  {
+    auto const now = std::chrono::steady_clock::now();
+    *stage +=
+      std::chrono::duration_cast<std::chrono::microseconds>(now - start_);
+    start_ = now;
+  }
+
+private:
+  std::chrono::steady_clock::time_point start_;
+};
 
-  std::size_t const path_buf_size = (path_real.size() + 1) * sizeof(wchar_t);
+// All the paths are written to a single block and loaded by a single remote
+// call (one generated stub, cached across injections) which calls
+// LoadLibraryExW once per path. Callers which already have a snapshot of the
+// target's modules can pass it to save another walk of the loader list.
+inline std::vector<InjectDllResult>
+  InjectDllsImpl(Process const& process,
+                 std::vector<std::wstring> const& paths_real,
+                 std::uint32_t flags,
+                 InjectTimings* timings,
+                 ModuleSnapshot const* modules = nullptr)
+{
+  if (paths_real.empty())
+  {
+    return {};
+  }
 
-  HADESMEM_DETAIL_TRACE_A("Allocating memory for module path.");
+  InjectTimings timings_local{};
+  InjectTimings& timings_real = timings ? *timings : timings_local;
+  InjectStageTimer timer;
 
-  Allocator const lib_file_remote{process, path_buf_size};
+  HADESMEM_DETAIL_TRACE_A("Calling ForceLdrInitializeThunk.");
 
-  HADESMEM_DETAIL_TRACE_A("Writing memory for module path.");
+  detail::ForceLdrInitializeThunk(process.GetId());
 
-  WriteString(process, lib_file_remote.GetBase(), path_real);
+  timer.Lap(&timings_real.ldr_init);
 
   HADESMEM_DETAIL_TRACE_A("Finding LoadLibraryExW.");
 
-  Module const kernel32_mod{process, L"kernel32.dll"};
   auto const load_library =
-    FindProcedure(process, kernel32_mod, "LoadLibraryExW");
+    modules ? FindProcedure(process,
+                            GetSnapshotModule(*modules, L"kernel32.dll"),
+                            "LoadLibraryExW")
+            : FindProcedure(
+                process, Module{process, L"kernel32.dll"}, "LoadLibraryExW");
+
+  timer.Lap(&timings_real.resolve);
+
+  std::vector<wchar_t> paths_buf;
+  std::vector<std::size_t> path_offsets;
+  for (auto const& path : paths_real)
+  {
+    HADESMEM_DETAIL_TRACE_FORMAT_W(L"Module path is \"%s\".", path.c_str());
+
+    path_offsets.push_back(paths_buf.size() * sizeof(wchar_t));
+    paths_buf.insert(std::end(paths_buf), std::begin(path), std::end(path));
+    paths_buf.push_back(L'\0');
+  }
+
+  HADESMEM_DETAIL_TRACE_A("Allocating memory for module paths.");
+
+  Allocator const lib_files_remote{process, paths_buf.size() * sizeof(wchar_t)};
+
+  HADESMEM_DETAIL_TRACE_A("Writing memory for module paths.");
+
+  WriteVector(process, lib_files_remote.GetBase(), paths_buf);
+
+  timer.Lap(&timings_real.write);
 
   HADESMEM_DETAIL_TRACE_A("Calling LoadLibraryExW.");
 
-  auto const load_library_ret =
-    Call(process,
-         reinterpret_cast<decltype(&LoadLibraryExW)>(load_library),
-         CallConv::kStdCall,
-         static_cast<LPCWSTR>(lib_file_remote.GetBase()),
-         __nullptr, // Can't use nullptr here because /clr...
-         add_path ? LOAD_WITH_ALTERED_SEARCH_PATH : 0UL);
-  if (!load_library_ret.GetReturnValue())
+  bool const add_path = !!(flags & InjectFlags::kAddToSearchOrder);
+  MultiCall multi_call{process};
+  for (auto const offset : path_offsets)
+  {
+    multi_call.Add(reinterpret_cast<decltype(&LoadLibraryExW)>(load_library),
+                   CallConv::kStdCall,
+                   reinterpret_cast<LPCWSTR>(
+                     static_cast<std::uint8_t*>(lib_files_remote.GetBase()) +
+                     offset),
+                   __nullptr, // Can't use nullptr here because /clr...
+                   add_path ? LOAD_WITH_ALTERED_SEARCH_PATH : 0UL);
+  }
+  std::vector<CallResultRaw> load_library_rets;
+  multi_call.Call(std::back_inserter(load_library_rets));
+
+  timer.Lap(&timings_real.load);
+
+  std::vector<InjectDllResult> results;
+  results.reserve(load_library_rets.size());
+  for (auto const& ret : load_library_rets)
+  {
+    results.push_back(InjectDllResult{ret.GetReturnValue<HMODULE>(),
+                                      ret.GetLastError()});
+  }
+  return results;
+}
+}
+
+// Injects every module in a single round-trip. Failing to load a module does
+// not stop the others from being loaded, check the per-module results.
+template <typename PathsForwardIterator>
+inline std::vector<InjectDllResult>
+  InjectDlls(Process const& process,
+             PathsForwardIterator paths_beg,
+             PathsForwardIterator paths_end,
+             std::uint32_t flags,
+             InjectTimings* timings = nullptr)
+{
+  using PathsForwardIteratorValueType =
+    typename std::iterator_traits<PathsForwardIterator>::value_type;
+  HADESMEM_DETAIL_STATIC_ASSERT(
+    std::is_base_of<std::wstring, PathsForwardIteratorValueType>::value);
+
+  return detail::InjectDllsImpl(
+    process,
+    detail::ResolveInjectPaths(paths_beg, paths_end, flags),
+    flags,
+    timings);
+}
+
+inline HMODULE InjectDll(Process const& process,
+                         std::wstring const& path,
+                         std::uint32_t flags)
+{
+  std::wstring const paths[] = {path};
+  std::vector<InjectDllResult> const results =
+    InjectDlls(process, std::begin(paths), std::end(paths), flags);
+  HADESMEM_DETAIL_ASSERT(results.size() == 1);
+  if (!results.front().module)
   {
     HADESMEM_DETAIL_THROW_EXCEPTION(
       Error{} << ErrorString{"LoadLibraryExW failed."}
-              << ErrorCodeWinLast{load_library_ret.GetLastError()});
+              << ErrorCodeWinLast{results.front().last_error});
   }
 
-  return load_library_ret.GetReturnValue();
+  return results.front().module;
 }
 
-inline void FreeDll(Process const& process, HMODULE module)
+// Injects every module into every process, working on up to max_parallel
+// processes at once. Errors are reported per process rather than thrown,
+// except for invalid paths, which are checked up front.
+template <typename PidsForwardIterator, typename PathsForwardIterator>
+inline std::vector<InjectDllsProcessResult>
+  InjectDllsMulti(PidsForwardIterator pids_beg,
+                  PidsForwardIterator pids_end,
+                  PathsForwardIterator paths_beg,
+                  PathsForwardIterator paths_end,
+                  std::uint32_t flags,
+                  std::size_t max_parallel)
+{
+  HADESMEM_DETAIL_ASSERT(max_parallel != 0);
+
+  std::vector<std::wstring> const paths_real =
+    detail::ResolveInjectPaths(paths_beg, paths_end, flags);
+
+  std::vector<InjectDllsProcessResult> results;
+  for (; pids_beg != pids_end; ++pids_beg)
+  {
+    results.push_back(InjectDllsProcessResult{
+      *pids_beg, std::vector<InjectDllResult>{}, InjectTimings{}, nullptr});
+  }
+
+  if (results.empty())
+  {
+    return results;
+  }
+
+  {
+    detail::ThreadPool pool{(std::min)(max_parallel, results.size()), 1};
+    for (auto& result : results)
+    {
+      auto const task = [&result, &paths_real, flags]()
+      {
+        try
+        {
+          detail::InjectStageTimer timer;
+          Process const process{result.pid};
+          timer.Lap(&result.timings.open);
+          result.modules =
+            detail::InjectDllsImpl(process, paths_real, flags, &result.timings);
+        }
+        catch (...)
+        {
+          result.error = std::current_exception();
+        }
+      };
+
+      do
+      {
+        pool.WaitForSlot();
+      } while (!pool.QueueTask(task));
+    }
+
+    // Tasks still running when the queue drains are waited on when the pool
+    // is destroyed.
+    pool.WaitForEmpty();
+  }
+
+  return results;
+}
+
+namespace detail
+{
+inline void FreeDllImpl(Process const& process,
+                        Module const& kernel32_mod,
+                        HMODULE module)
 {
-  Module const kernel32_mod{process, L"kernel32.dll"};
   auto const free_library = FindProcedure(process, kernel32_mod, "FreeLibrary");
 
   auto const free_library_ret =
@@ -205,6 +430,22 @@ inline void FreeDll(Process const& process, HMODULE module)
               << ErrorCodeWinLast{free_library_ret.GetLastError()});
   }
 }
+}
+
+inline void FreeDll(Process const& process, HMODULE module)
+{
+  detail::FreeDllImpl(process, Module{process, L"kernel32.dll"}, module);
+}
+
+// For freeing lots of modules, so kernel32.dll is looked up in the snapshot
+// instead of walking the loader list each time.
+inline void FreeDll(Process const& process,
+                    ModuleSnapshot const& modules,
+                    HMODULE module)
+{
+  detail::FreeDllImpl(
+    process, detail::GetSnapshotModule(modules, L"kernel32.dll"), module);
+}
 
 // TODO: Support passing an arg to the export (e.g. a string).
 inline CallResult<DWORD_PTR> CallExport(Process const& process,
@@ -4,7 +4,6 @@
 #pragma once
 
 #include <atomic>
-#include <climits>
 #include <cstdint>
 #include <functional>
 #include <map>
@@ -14,10 +13,6 @@
 #include <utility>
 #include <vector>
 
-#include <hadesmem/detail/warning_disable_prefix.hpp>
-#include <udis86.h>
-#include <hadesmem/detail/warning_disable_suffix.hpp>
-
 #include <windows.h>
 
 #include <hadesmem/alloc.hpp>
@@ -25,6 +20,7 @@
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/patch_code_gen.hpp>
 #include <hadesmem/detail/patch_detour_stub.hpp>
+#include <hadesmem/detail/patch_trampoline.hpp>
 #include <hadesmem/detail/patcher_aux.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
 #include <hadesmem/detail/srw_lock.hpp>
@@ -53,9 +49,6 @@
 // TODO: Add new Symbol class (or something along those lines) for looking up
 // function addresses in system DLLs that we want to hook.
 
-// TODO: Avoid some allocations when generating a trampoline by scanning for
-// code caves which we can use to store the trampoline.
-
 // TODO: Add proper tests for this (and other patchers). Especially important
 // for edge cases trying to be handled (thread suspension, thread redirection,
 // instruction resolution, no free trampoline blocks near a target address,
@@ -125,7 +118,8 @@ public:
       applied_{other.applied_},
       target_{other.target_},
       detour_{std::move(other.detour_)},
-      trampoline_{std::move(other.trampoline_)},
+      trampoline_{other.trampoline_},
+      trampoline_size_{other.trampoline_size_},
       stub_gate_{std::move(other.stub_gate_)},
       orig_(std::move(other.orig_)),
       trampolines_(std::move(other.trampolines_)),
@@ -136,6 +130,8 @@ public:
     other.process_ = nullptr;
     other.applied_ = false;
     other.target_ = nullptr;
+    other.trampoline_ = nullptr;
+    other.trampoline_size_ = 0;
     other.stub_ = nullptr;
   }
 
@@ -153,7 +149,11 @@ public:
 
     detour_ = std::move(other.detour_);
 
-    trampoline_ = std::move(other.trampoline_);
+    trampoline_ = other.trampoline_;
+    other.trampoline_ = nullptr;
+
+    trampoline_size_ = other.trampoline_size_;
+    other.trampoline_size_ = 0;
 
     stub_gate_ = std::move(other.stub_gate_);
 
@@ -195,6 +195,7 @@ public:
     // become zero, but we haven't actually called the trampoline yet, so we end
     // up jumping to the memory we just free'd!
     trampoline_ = nullptr;
+    trampoline_size_ = 0;
     trampolines_.clear();
     stub_gate_ = nullptr;
 
@@ -205,13 +206,22 @@ public:
     // threads are suspended already (e.g. creation-time injection).
     // Need to fix the potential deadlock problem, as well as the perf
     // problem, before re-enabling this.
-    // SuspendedProcess const suspended_process{process_.GetId()};
+    // SuspendedProcess const suspended_process{process_};
+
+    stub_gate_ = detail::AllocatePageNear(process_, target_);
+
+    // The stub gate and the trampoline share the page we allocated near the
+    // target. Both are assembled locally, then committed with a single write
+    // and a single flush. The buffer leaves plenty of room for relocated
+    // instructions being rebuilt as absolute jumps/calls.
+    std::size_t const kCodeSize = 0x400;
+    detail::CodeBuffer<kCodeSize> code{stub_gate_->GetBase()};
 
-    std::uint32_t const kMaxInstructionLen = 15;
-    std::uint32_t const kTrampSize = kMaxInstructionLen * 3;
+    detail::EmitStubGate<TargetFuncT>(
+      code, &*stub_, &GetOriginalArbitraryUserPtrPtr, &GetReturnAddressPtrPtr);
 
-    trampoline_ = std::make_unique<Allocator>(process_, kTrampSize);
-    auto tramp_cur = static_cast<std::uint8_t*>(trampoline_->GetBase());
+    code.Align(16);
+    trampoline_ = code.GetCursor();
 
     auto const detour_raw = detour_.target<DetourFuncRawT>();
     (void)detour_raw;
@@ -220,138 +230,18 @@ public:
       this,
       target_,
       detour_raw,
-      trampoline_->GetBase());
-
-    auto const buffer = ReadVector<std::uint8_t>(process_, target_, kTrampSize);
-
-    // TODO: Port to use Capstone instead.
-    // TODO: Add a disassembler module to abstract away the actual disassembly
-    // library being used (so later it can be replaced with a custom one, or
-    // support multiple backends, etc). Also useful when writing other tools
-    // like a standalone debugger/disassembler, memory editor, etc.
-    ud_t ud_obj;
-    ud_init(&ud_obj);
-    ud_set_input_buffer(&ud_obj, buffer.data(), buffer.size());
-    ud_set_syntax(&ud_obj, UD_SYN_INTEL);
-    ud_set_pc(&ud_obj, reinterpret_cast<std::uint64_t>(target_));
-#if defined(HADESMEM_DETAIL_ARCH_X64)
-    ud_set_mode(&ud_obj, 64);
-#elif defined(HADESMEM_DETAIL_ARCH_X86)
-    ud_set_mode(&ud_obj, 32);
-#else
-#error "[HadesMem] Unsupported architecture."
-#endif
-
-    stub_gate_ = detail::AllocatePageNear(process_, target_);
+      trampoline_);
 
     std::size_t const patch_size = GetPatchSize();
 
-    // TODO: Detect backward jumps into the detour and fail/notify/etc.
-    std::uint32_t instr_size = 0;
-    do
-    {
-      std::uint32_t const len = ud_disassemble(&ud_obj);
-      if (len == 0)
-      {
-        HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                        << ErrorString{"Disassembly failed."});
-      }
-
-#if !defined(HADESMEM_NO_TRACE)
-      char const* const asm_str = ud_insn_asm(&ud_obj);
-      char const* const asm_bytes_str = ud_insn_hex(&ud_obj);
-      HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "%s. [%s].",
-        (asm_str ? asm_str : "Invalid."),
-        (asm_bytes_str ? asm_bytes_str : "Invalid."));
-#endif
-
-      // TODO: Improve support for rebuilding relative instructions, especially
-      // on x64.
-      ud_operand_t const* const op = ud_insn_opr(&ud_obj, 0);
-      bool is_jimm = op && op->type == UD_OP_JIMM;
-      // Handle JMP QWORD PTR [RIP+Rel32]. Necessary for hook chain support.
-      bool is_jmem = op && op->type == UD_OP_MEM && op->base == UD_R_RIP &&
-                     op->index == UD_NONE && op->scale == 0 && op->size == 0x40;
-      if ((ud_obj.mnemonic == UD_Ijmp || ud_obj.mnemonic == UD_Icall) && op &&
-          (is_jimm || is_jmem))
-      {
-        std::uint16_t const size = is_jimm ? op->size : op->offset;
-        HADESMEM_DETAIL_TRACE_FORMAT_A("Operand/offset size is %hu.", size);
-        std::int64_t const insn_target = [&]() -> std::int64_t {
-          switch (size)
-          {
-          case sizeof(std::int8_t) * CHAR_BIT:
-            return op->lval.sbyte;
-          case sizeof(std::int16_t) * CHAR_BIT:
-            return op->lval.sword;
-          case sizeof(std::int32_t) * CHAR_BIT:
-            return op->lval.sdword;
-          case sizeof(std::int64_t) * CHAR_BIT:
-            return op->lval.sqword;
-          default:
-            HADESMEM_DETAIL_ASSERT(false);
-            HADESMEM_DETAIL_THROW_EXCEPTION(
-              Error{} << ErrorString{"Unknown instruction size."});
-          }
-        }();
-
-        auto const resolve_rel =
-          [](std::uint64_t base, std::int64_t target, std::uint32_t insn_len) {
-            return reinterpret_cast<std::uint8_t*>(
-                     static_cast<std::uintptr_t>(base)) +
-                   target + insn_len;
-          };
-
-        std::uint64_t const insn_base = ud_insn_off(&ud_obj);
-        std::uint32_t const insn_len = ud_insn_len(&ud_obj);
-
-        auto const resolved_target =
-          resolve_rel(insn_base, insn_target, insn_len);
-        void* const jump_target =
-          is_jimm ? resolved_target : Read<void*>(process_, resolved_target);
-        HADESMEM_DETAIL_TRACE_FORMAT_A("Jump/call target = %p.", jump_target);
-        if (ud_obj.mnemonic == UD_Ijmp)
-        {
-          HADESMEM_DETAIL_TRACE_A("Writing resolved jump.");
-          tramp_cur += detail::WriteJump(
-            process_, tramp_cur, jump_target, true, &trampolines_);
-        }
-        else
-        {
-          HADESMEM_DETAIL_ASSERT(ud_obj.mnemonic == UD_Icall);
-          HADESMEM_DETAIL_TRACE_A("Writing resolved call.");
-          tramp_cur +=
-            detail::WriteCall(process_, tramp_cur, jump_target, trampolines_);
-        }
-      }
-      else
-      {
-        std::uint8_t const* const raw = ud_insn_ptr(&ud_obj);
-        Write(process_, tramp_cur, raw, raw + len);
-        tramp_cur += len;
-      }
-
-      instr_size += len;
-    } while (instr_size < patch_size);
-
-    HADESMEM_DETAIL_TRACE_A("Writing jump back to original code.");
-
-    tramp_cur +=
-      detail::WriteJump(process_,
-                        tramp_cur,
-                        reinterpret_cast<std::uint8_t*>(target_) + instr_size,
-                        true,
-                        &trampolines_);
-
-    FlushInstructionCache(
-      process_, trampoline_->GetBase(), trampoline_->GetSize());
-
-    detail::WriteStubGate<TargetFuncT>(process_,
-                                       stub_gate_->GetBase(),
-                                       &*stub_,
-                                       &GetOriginalArbitraryUserPtrPtr,
-                                       &GetReturnAddressPtrPtr);
+    std::size_t const instr_size =
+      detail::EmitTrampoline(process_, target_, patch_size, code);
+
+    trampoline_size_ = static_cast<std::size_t>(
+      static_cast<std::uint8_t*>(code.GetCursor()) -
+      static_cast<std::uint8_t*>(trampoline_));
+
+    detail::WriteCode(process_, code);
 
     orig_ = ReadVector<std::uint8_t>(process_, target_, patch_size);
 
@@ -371,11 +261,11 @@ public:
       return;
     }
 
-    SuspendedProcess const suspended_process{process_.GetId()};
+    SuspendedProcess const suspended_process{process_};
 
     detail::VerifyPatchThreads(process_.GetId(), target_, orig_.size());
     detail::VerifyPatchThreads(
-      process_.GetId(), trampoline_->GetBase(), trampoline_->GetSize());
+      process_.GetId(), trampoline_, trampoline_size_);
 
     RemovePatch();
 
@@ -403,7 +293,8 @@ public:
       target_ = nullptr;
       detour_ = nullptr;
 
-      trampoline_.reset();
+      trampoline_ = nullptr;
+      trampoline_size_ = 0;
       orig_.clear();
       trampolines_.clear();
     }
@@ -423,7 +314,7 @@ public:
 
   virtual void* GetTrampoline() const noexcept override
   {
-    return trampoline_->GetBase();
+    return trampoline_;
   }
 
   virtual std::atomic<std::uint32_t>& GetRefCount() override
@@ -495,7 +386,9 @@ protected:
   bool detached_{false};
   void* target_{};
   DetourFuncT detour_{};
-  std::unique_ptr<Allocator> trampoline_{};
+  // Trampoline lives in the stub gate page, after the stub gate itself.
+  void* trampoline_{};
+  std::size_t trampoline_size_{};
   std::unique_ptr<Allocator> stub_gate_{};
   std::vector<BYTE> orig_{};
   std::vector<std::unique_ptr<Allocator>> trampolines_{};
@@ -0,0 +1,361 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/rcu_ptr.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/type_traits.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/local/patch_detour.hpp>
+#include <hadesmem/local/patch_detour_base.hpp>
+#include <hadesmem/process.hpp>
+
+// Multi-subscriber detour. A single PatchDetour is applied to the target and
+// dispatches to an ordered list of pre and post callbacks, rather than having
+// every subscriber stack its own detour (and its own trampoline and stub hop)
+// on top of the previous one.
+//
+// Pre callbacks are run in ascending priority order (ties are broken by
+// registration order) and may short-circuit the original function (and any
+// remaining pre callbacks) by setting *handled and filling in *retval. Post
+// callbacks are run in descending priority order, so a subscriber's post
+// callback runs 'outside' the post callbacks of subscribers with a larger
+// priority, as if they were stacked detours. Post callbacks are run whether or
+// not the call was handled.
+//
+// Nothing takes a lock. Dispatch reads the current callback lists, and
+// registration and unregistration copy them and publish the copy with a CAS
+// (retrying if another thread got in first), so it's safe to (un)register from
+// within a callback or from any number of threads at once. A callback may
+// still be invoked by a call which was already in flight when it was
+// unregistered.
+
+// TODO: Support member function targets.
+
+// TODO: Allow callbacks to call the original themselves (i.e. 'around' style
+// callbacks).
+
+namespace hadesmem
+{
+namespace detail
+{
+template <typename R> class PatchDetourChainResult
+{
+public:
+  R* Get() noexcept
+  {
+    return &value_;
+  }
+
+  template <typename F> void Invoke(F const& f)
+  {
+    value_ = f();
+  }
+
+  R Release()
+  {
+    return std::move(value_);
+  }
+
+private:
+  R value_{};
+};
+
+template <> class PatchDetourChainResult<void>
+{
+public:
+  void* Get() noexcept
+  {
+    return nullptr;
+  }
+
+  template <typename F> void Invoke(F const& f)
+  {
+    f();
+  }
+
+  void Release() noexcept
+  {
+  }
+};
+
+template <typename TargetFuncT, typename R, typename ArgsT>
+class PatchDetourChainImpl;
+
+template <typename TargetFuncT, typename R, typename... Args>
+class PatchDetourChainImpl<TargetFuncT, R, std::tuple<Args...>>
+{
+public:
+  using TargetFuncRawT =
+    std::add_pointer_t<std::remove_pointer_t<TargetFuncT>>;
+  using ResultPtrT = std::add_pointer_t<R>;
+  using PreCallbackT =
+    std::function<void(Args..., bool* handled, ResultPtrT retval)>;
+  using PostCallbackT = std::function<void(Args..., ResultPtrT retval)>;
+
+  HADESMEM_DETAIL_STATIC_ASSERT(
+    !std::is_member_function_pointer<TargetFuncT>::value);
+  HADESMEM_DETAIL_STATIC_ASSERT(IsFunction<TargetFuncRawT>::value);
+
+  explicit PatchDetourChainImpl(Process const& process, TargetFuncRawT target)
+    : state_{std::make_unique<State>()}
+  {
+    State* const state = state_.get();
+    detour_ = std::make_unique<PatchDetour<TargetFuncT>>(
+      process, target, [state](PatchDetourBase* detour, Args... args) -> R {
+        return state->Dispatch(detour, args...);
+      });
+  }
+
+  explicit PatchDetourChainImpl(Process const&& process,
+                                TargetFuncRawT target) = delete;
+
+  PatchDetourChainImpl(PatchDetourChainImpl const& other) = delete;
+
+  PatchDetourChainImpl& operator=(PatchDetourChainImpl const& other) = delete;
+
+  PatchDetourChainImpl(PatchDetourChainImpl&& other) = default;
+
+  PatchDetourChainImpl& operator=(PatchDetourChainImpl&& other)
+  {
+    // Unhook before the callbacks go away.
+    detour_ = std::move(other.detour_);
+    state_ = std::move(other.state_);
+
+    return *this;
+  }
+
+  ~PatchDetourChainImpl()
+  {
+    // Unhook before the callbacks go away.
+    detour_ = nullptr;
+  }
+
+  void Apply()
+  {
+    detour_->Apply();
+  }
+
+  void Remove()
+  {
+    detour_->Remove();
+  }
+
+  void RemoveUnchecked() noexcept
+  {
+    detour_->RemoveUnchecked();
+  }
+
+  bool IsApplied() const noexcept
+  {
+    return detour_->IsApplied();
+  }
+
+  // Calls the original function, bypassing all callbacks.
+  R CallOriginal(Args... args) const
+  {
+    return detour_->template GetTrampolineT<TargetFuncRawT>()(args...);
+  }
+
+  PatchDetourBase& GetDetour() noexcept
+  {
+    return *detour_;
+  }
+
+  PatchDetourBase const& GetDetour() const noexcept
+  {
+    return *detour_;
+  }
+
+  std::size_t RegisterPre(PreCallbackT const& callback,
+                          std::int32_t priority = 0)
+  {
+    return state_->Register(&Subscribers::pre, callback, priority);
+  }
+
+  std::size_t RegisterPost(PostCallbackT const& callback,
+                           std::int32_t priority = 0)
+  {
+    return state_->Register(&Subscribers::post, callback, priority);
+  }
+
+  // Returns false if there is no callback with the given ID (e.g. it was
+  // already unregistered).
+  bool Unregister(std::size_t id)
+  {
+    return state_->Unregister(id);
+  }
+
+private:
+  template <typename CallbackT> struct Subscriber
+  {
+    std::size_t id;
+    std::int32_t priority;
+    CallbackT callback;
+  };
+
+  struct Subscribers
+  {
+    std::vector<Subscriber<PreCallbackT>> pre;
+    std::vector<Subscriber<PostCallbackT>> post;
+  };
+
+  struct State
+  {
+    template <typename CallbackT>
+    std::size_t Register(std::vector<Subscriber<CallbackT>> Subscribers::*list,
+                         CallbackT const& callback,
+                         std::int32_t priority)
+    {
+      HADESMEM_DETAIL_ASSERT(callback);
+
+      std::size_t const id = next_id.fetch_add(1, std::memory_order_relaxed);
+      Update([&](Subscribers& new_subscribers) {
+        auto& callbacks = new_subscribers.*list;
+        auto const iter = std::upper_bound(
+          std::begin(callbacks),
+          std::end(callbacks),
+          priority,
+          [](std::int32_t p, Subscriber<CallbackT> const& s) {
+            return p < s.priority;
+          });
+        callbacks.insert(iter, Subscriber<CallbackT>{id, priority, callback});
+        return true;
+      });
+
+      return id;
+    }
+
+    bool Unregister(std::size_t id)
+    {
+      return Update([id](Subscribers& new_subscribers) {
+        auto const has_id = [id](auto const& s) { return s.id == id; };
+        auto& pre = new_subscribers.pre;
+        auto& post = new_subscribers.post;
+        std::size_t const old_size = pre.size() + post.size();
+        pre.erase(std::remove_if(std::begin(pre), std::end(pre), has_id),
+                  std::end(pre));
+        post.erase(std::remove_if(std::begin(post), std::end(post), has_id),
+                   std::end(post));
+        return pre.size() + post.size() != old_size;
+      });
+    }
+
+    // Copy-on-write in a CAS loop. The read guard keeps the object being
+    // copied alive (so its address can't be reused under us) until the copy
+    // has been published or lost the race. Returns false without publishing
+    // anything if modify does.
+    template <typename ModifyFn> bool Update(ModifyFn const& modify)
+    {
+      for (;;)
+      {
+        {
+          typename RcuPtr<Subscribers>::ReadGuard const guard{subscribers};
+          Subscribers const* const cur = guard.Get();
+          auto new_subscribers = cur ? std::make_unique<Subscribers>(*cur)
+                                     : std::make_unique<Subscribers>();
+          if (!modify(*new_subscribers))
+          {
+            return false;
+          }
+
+          if (subscribers.CompareAndPublish(cur, new_subscribers))
+          {
+            break;
+          }
+        }
+      }
+
+      subscribers.Reclaim();
+
+      return true;
+    }
+
+    R Dispatch(PatchDetourBase* detour, Args... args)
+    {
+      PatchDetourChainResult<R> result;
+      bool handled = false;
+
+      // Don't hold the read guard across the call to the original, which may
+      // block indefinitely and would otherwise delay reclamation.
+      {
+        typename RcuPtr<Subscribers>::ReadGuard const guard{subscribers};
+        if (Subscribers const* const cur = guard.Get())
+        {
+          for (auto const& s : cur->pre)
+          {
+            RunCallback(s.callback, args..., &handled, result.Get());
+            if (handled)
+            {
+              break;
+            }
+          }
+        }
+      }
+
+      if (!handled)
+      {
+        auto const original = detour->GetTrampolineT<TargetFuncRawT>();
+        result.Invoke([&]() { return original(args...); });
+      }
+
+      {
+        typename RcuPtr<Subscribers>::ReadGuard const guard{subscribers};
+        if (Subscribers const* const cur = guard.Get())
+        {
+          for (auto s = cur->post.rbegin(); s != cur->post.rend(); ++s)
+          {
+            RunCallback(s->callback, args..., result.Get());
+          }
+        }
+      }
+
+      return result.Release();
+    }
+
+    template <typename CallbackT, typename... CallbackArgs>
+    static void RunCallback(CallbackT const& callback,
+                            CallbackArgs&&... args) noexcept
+    {
+      try
+      {
+        callback(std::forward<CallbackArgs>(args)...);
+      }
+      catch (...)
+      {
+        HADESMEM_DETAIL_TRACE_A(
+          boost::current_exception_diagnostic_information().c_str());
+        HADESMEM_DETAIL_ASSERT(false);
+      }
+    }
+
+    RcuPtr<Subscribers> subscribers;
+    std::atomic<std::size_t> next_id{};
+  };
+
+  std::unique_ptr<State> state_;
+  std::unique_ptr<PatchDetour<TargetFuncT>> detour_;
+};
+}
+
+template <typename TargetFuncT>
+using PatchDetourChain =
+  detail::PatchDetourChainImpl<TargetFuncT,
+                               detail::FuncResultT<TargetFuncT>,
+                               detail::FuncArgsT<TargetFuncT>>;
+}
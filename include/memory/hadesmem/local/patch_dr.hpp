@@ -7,7 +7,6 @@
 #include <climits>
 #include <cstdint>
 #include <functional>
-#include <map>
 #include <memory>
 #include <sstream>
 #include <type_traits>
@@ -26,7 +25,6 @@
 #include <hadesmem/detail/patch_detour_stub.hpp>
 #include <hadesmem/detail/patcher_aux.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
-#include <hadesmem/detail/srw_lock.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
@@ -104,16 +102,16 @@ protected:
 
   virtual void WritePatch() override
   {
-    hadesmem::detail::AcquireSRWLock const lock(
-      &GetSrwLock(), hadesmem::detail::SRWLockType::Exclusive);
-
     auto& veh_hooks = GetVehHooks();
 
-    HADESMEM_DETAIL_ASSERT(veh_hooks.find(target_) == std::end(veh_hooks));
-    veh_hooks[target_] = this;
+    if (!veh_hooks.Insert(target_, MakeVehHook()))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Target already has a VEH hook."});
+    }
 
     auto const veh_cleanup_hook = [&]() {
-      auto const veh_hooks_removed = veh_hooks.erase(target_);
+      auto const veh_hooks_removed = veh_hooks.Erase(target_);
       (void)veh_hooks_removed;
       HADESMEM_DETAIL_ASSERT(veh_hooks_removed);
     };
@@ -124,7 +122,7 @@ protected:
 
     auto& dr_hooks = GetDrHooks();
     auto const thread_id = ::GetCurrentThreadId();
-    HADESMEM_DETAIL_ASSERT(dr_hooks.find(thread_id) == std::end(dr_hooks));
+    HADESMEM_DETAIL_ASSERT(!dr_hooks.Contains(thread_id));
 
     Thread const thread(thread_id);
     auto context = GetThreadContext(thread, CONTEXT_DEBUG_REGISTERS);
@@ -152,10 +150,14 @@ protected:
         Error{} << ErrorString{"No free debug registers."});
     }
 
-    dr_hooks[::GetCurrentThreadId()] = dr_index;
+    if (!dr_hooks.Insert(thread_id, dr_index))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Thread already has a DR hook."});
+    }
 
     auto const dr_cleanup_hook = [&]() {
-      auto const dr_hooks_removed = dr_hooks.erase(::GetCurrentThreadId());
+      auto const dr_hooks_removed = dr_hooks.Erase(thread_id);
       (void)dr_hooks_removed;
       HADESMEM_DETAIL_ASSERT(dr_hooks_removed);
     };
@@ -183,16 +185,14 @@ protected:
 
   virtual void RemovePatch() override
   {
-    hadesmem::detail::AcquireSRWLock const lock(
-      &GetSrwLock(), hadesmem::detail::SRWLockType::Exclusive);
-
     HADESMEM_DETAIL_TRACE_A("Unsetting DR hook.");
 
     auto& dr_hooks = GetDrHooks();
     auto const thread_id = ::GetCurrentThreadId();
-    auto const iter = dr_hooks.find(thread_id);
-    HADESMEM_DETAIL_ASSERT(iter != std::end(dr_hooks));
-    auto const dr_index = iter->second;
+    std::uintptr_t dr_index = 0;
+    auto const dr_hook_found = dr_hooks.Find(thread_id, &dr_index);
+    (void)dr_hook_found;
+    HADESMEM_DETAIL_ASSERT(dr_hook_found);
 
     Thread const thread(thread_id);
     auto context = GetThreadContext(thread, CONTEXT_DEBUG_REGISTERS);
@@ -204,12 +204,12 @@ protected:
 
     SetThreadContext(thread, context);
 
-    auto const dr_hooks_removed = dr_hooks.erase(thread_id);
+    auto const dr_hooks_removed = dr_hooks.Erase(thread_id);
     (void)dr_hooks_removed;
     HADESMEM_DETAIL_ASSERT(dr_hooks_removed);
 
     auto& veh_hooks = GetVehHooks();
-    auto const veh_hooks_removed = veh_hooks.erase(target_);
+    auto const veh_hooks_removed = veh_hooks.Erase(target_);
     (void)veh_hooks_removed;
     HADESMEM_DETAIL_ASSERT(veh_hooks_removed);
   }
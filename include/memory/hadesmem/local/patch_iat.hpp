@@ -21,10 +21,7 @@
 #include <hadesmem/module.hpp>
 #include <hadesmem/module_list.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
-#include <hadesmem/pelib/import_dir.hpp>
-#include <hadesmem/pelib/import_dir_list.hpp>
-#include <hadesmem/pelib/import_thunk.hpp>
-#include <hadesmem/pelib/import_thunk_list.hpp>
+#include <hadesmem/pelib/import_table.hpp>
 #include <hadesmem/pelib/export.hpp>
 #include <hadesmem/pelib/export_list.hpp>
 #include <hadesmem/process.hpp>
@@ -218,51 +215,31 @@ private:
 
   void HookModuleImports(PeFile const& pe_file)
   {
-    hadesmem::ImportDirList const import_dirs{process_, pe_file};
-    for (auto const& id : import_dirs)
+    // TODO: Handle forwarded exports here also? i.e. Hook both things that
+    // import via the forwarder and also hook the real implementation.
+
+    // Names come from the ILT, so (as before) modules without one are skipped.
+    hadesmem::ImportTable const imports{process_, pe_file};
+    auto const entry =
+      imports.FindImport(detail::WideCharToMultiByte(module_), function_);
+    if (entry.module == hadesmem::ImportTable::kNotFound)
     {
-      // TODO: Handle forwarded exports here also? i.e. Hook both things that
-      // import via the forwarder and also hook the real implementation.
-
-      auto const imp_mod_name =
-        detail::ToUpperOrdinal(detail::MultiByteToWideChar(id.GetName()));
-      if (imp_mod_name != module_)
-      {
-        continue;
-      }
-
-      HookModuleImportDir(pe_file, id);
+      return;
     }
-  }
 
-  void HookModuleImportDir(PeFile const& pe_file, hadesmem::ImportDir const& id)
-  {
-    hadesmem::ImportThunkList import_thunks{
-      process_, pe_file, id.GetFirstThunk()};
-    hadesmem::ImportThunkList orig_import_thunks{
-      process_, pe_file, id.GetOriginalFirstThunk()};
-    for (auto it = std::begin(import_thunks),
-              oit = std::begin(orig_import_thunks);
-         it != std::end(import_thunks) && oit != std::end(orig_import_thunks);
-         ++it, ++oit)
-    {
-      if (function_ != oit->GetName())
-      {
-        continue;
-      }
+    auto const func_ptr = reinterpret_cast<TargetFuncRawT*>(
+      imports.GetFunctionPtr(entry.module, entry.thunk));
 
-      HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "Got import thunk at [%p] with value [%p].",
-        it->GetFunctionPtr(),
-        reinterpret_cast<void const*>(it->GetFunction()));
-
-      auto& iat_hook = iat_hooks_[pe_file.GetBase()];
-      HADESMEM_DETAIL_ASSERT(!iat_hook);
-      auto const func_ptr =
-        reinterpret_cast<TargetFuncRawT*>(it->GetFunctionPtr());
-      iat_hook = std::make_unique<PatchFuncPtr<TargetFuncT, ContextT>>(
-        process_, func_ptr, detour_, context_);
-    }
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Got import thunk at [%p] with value [%p].",
+      func_ptr,
+      reinterpret_cast<void const*>(
+        imports.GetFunction(entry.module, entry.thunk)));
+
+    auto& iat_hook = iat_hooks_[pe_file.GetBase()];
+    HADESMEM_DETAIL_ASSERT(!iat_hook);
+    iat_hook = std::make_unique<PatchFuncPtr<TargetFuncT, ContextT>>(
+      process_, func_ptr, detour_, context_);
   }
 
   Process process_;
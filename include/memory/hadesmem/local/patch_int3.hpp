@@ -7,7 +7,6 @@
 #include <climits>
 #include <cstdint>
 #include <functional>
-#include <map>
 #include <memory>
 #include <sstream>
 #include <type_traits>
@@ -26,7 +25,6 @@
 #include <hadesmem/detail/patch_detour_stub.hpp>
 #include <hadesmem/detail/patcher_aux.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
-#include <hadesmem/detail/srw_lock.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
@@ -88,15 +86,13 @@ protected:
   {
     auto& veh_hooks = GetVehHooks();
 
+    if (!veh_hooks.Insert(target_, MakeVehHook()))
     {
-      hadesmem::detail::AcquireSRWLock const lock(
-        &GetSrwLock(), hadesmem::detail::SRWLockType::Exclusive);
-
-      HADESMEM_DETAIL_ASSERT(veh_hooks.find(target_) == std::end(veh_hooks));
-      veh_hooks[target_] = this;
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Target already has a VEH hook."});
     }
 
-    auto const cleanup_hook = [&]() { veh_hooks.erase(target_); };
+    auto const cleanup_hook = [&]() { veh_hooks.Erase(target_); };
     auto scope_cleanup_hook = hadesmem::detail::MakeScopeWarden(cleanup_hook);
 
     HADESMEM_DETAIL_TRACE_A("Writing breakpoint.");
@@ -113,13 +109,7 @@ protected:
 
     WriteVector(process_, target_, orig_);
 
-    {
-      hadesmem::detail::AcquireSRWLock const lock(
-        &GetSrwLock(), hadesmem::detail::SRWLockType::Exclusive);
-
-      auto& veh_hooks = GetVehHooks();
-      veh_hooks.erase(target_);
-    }
+    GetVehHooks().Erase(target_);
   }
 
   virtual bool CanHookChainImpl() const noexcept override
@@ -0,0 +1,801 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/rcu_flat_map.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
+// Page protection based hooks. Rather than modifying code or consuming a debug
+// register per target, the pages containing the targets are made inaccessible
+// (PAGE_NOACCESS or PAGE_GUARD) and the resulting faults are dispatched to the
+// hooks registered on that page. Every access to a hooked page costs an
+// exception (plus a single-step to re-arm the page), so this is best suited to
+// watching large numbers of rarely accessed targets.
+
+// TODO: Support remote processes (would require a debugger rather than VEH).
+
+// TODO: Add an option to report data accesses after they complete (i.e. from
+// the single-step handler) so write hooks can observe the new value.
+
+// TODO: Handle targets on pages which are already PAGE_GUARD or PAGE_NOACCESS
+// (e.g. stack guard pages).
+
+namespace hadesmem
+{
+struct PageAccess
+{
+  enum : std::uint32_t
+  {
+    kNone = 0,
+    kRead = 1 << 0,
+    kWrite = 1 << 1,
+    kExecute = 1 << 2,
+    kAll = kRead | kWrite | kExecute,
+    kInvalidFlagMaxValue = 1 << 3
+  };
+};
+
+enum class PageHookMode
+{
+  // Pages stay inaccessible until the hook is removed. Catches every access.
+  kNoAccess,
+  // Uses PAGE_GUARD, which preserves the original protection (so e.g. accesses
+  // which would fault anyway still fault normally), but is one-shot and must be
+  // re-armed after every hit.
+  kGuard
+};
+
+struct PageHookEvent
+{
+  // May be modified by the callback. If the instruction pointer is changed for
+  // an execute hook the faulting instruction is skipped.
+  PCONTEXT context;
+  // The address which was accessed.
+  void* address;
+  // Base of the watched range which matched.
+  void* target;
+  std::uint32_t access;
+};
+
+namespace detail
+{
+inline std::uintptr_t GetInstructionPointer(CONTEXT const& context) noexcept
+{
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  return static_cast<std::uintptr_t>(context.Rip);
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  return static_cast<std::uintptr_t>(context.Eip);
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+}
+
+// Serializes protection changes for a single page between the fault handler,
+// the single-step handler and hook registration. Lives for the lifetime of the
+// process once created, because a thread may still be single-stepping over the
+// page after the last hook on it has been removed.
+struct PageHookState
+{
+  std::uintptr_t base{};
+  DWORD orig_protect{};
+  DWORD armed_protect{};
+  PageHookMode mode{};
+  bool hooked{};
+  // Number of threads currently single-stepping with the page disarmed. Only
+  // the last thread to finish re-arms the page, so threads don't race to
+  // re-protect a page another thread is still executing on.
+  std::uint32_t stepping{};
+  std::atomic_flag lock = ATOMIC_FLAG_INIT;
+};
+
+class PageHookStateLock
+{
+public:
+  explicit PageHookStateLock(PageHookState& state) noexcept : state_(state)
+  {
+    while (state_.lock.test_and_set(std::memory_order_acquire))
+    {
+      ::YieldProcessor();
+    }
+  }
+
+  PageHookStateLock(PageHookStateLock const&) = delete;
+
+  PageHookStateLock& operator=(PageHookStateLock const&) = delete;
+
+  ~PageHookStateLock()
+  {
+    state_.lock.clear(std::memory_order_release);
+  }
+
+private:
+  PageHookState& state_;
+};
+
+struct PageHookRecord
+{
+  std::uintptr_t beg;
+  std::uintptr_t end;
+  std::uint32_t access;
+  std::uintptr_t owner;
+  std::shared_ptr<std::function<void(PageHookEvent&)>> callback;
+};
+
+struct PageHookList
+{
+  PageHookState* state;
+  std::vector<PageHookRecord> hooks;
+};
+
+class PageHookRegistry
+{
+public:
+  static PageHookRegistry& Get()
+  {
+    static PageHookRegistry registry;
+    return registry;
+  }
+
+  std::uintptr_t GetPageSize() const noexcept
+  {
+    return page_size_;
+  }
+
+  std::uintptr_t GetPageBase(std::uintptr_t address) const noexcept
+  {
+    return address & ~(page_size_ - 1);
+  }
+
+  // Registers all the hooks in one table update, then arms every newly hooked
+  // page with one VirtualProtect call per run of contiguous pages. Returns the
+  // list of pages touched so the owner can unregister them later.
+  std::vector<std::uintptr_t> Register(std::vector<PageHookRecord> const& hooks,
+                                       PageHookMode mode)
+  {
+    std::lock_guard<std::mutex> const lock{mutex_};
+
+    std::map<std::uintptr_t, PageHookList> lists;
+    std::vector<PageHookState*> new_pages;
+    // What the already hooked pages looked like, for rolling back.
+    std::vector<std::pair<std::uintptr_t, PageHookList>> previous;
+    for (auto const& hook : hooks)
+    {
+      for (std::uintptr_t page = GetPageBase(hook.beg); page < hook.end;
+           page += page_size_)
+      {
+        auto iter = lists.find(page);
+        if (iter == std::end(lists))
+        {
+          PageHookList list{};
+          if (!pages_.Visit(
+                page, [&](PageHookList const& cur) { list = cur; }))
+          {
+            // A thread may still be stepping over the page after it was
+            // last unhooked. That's fine, ProtectRuns leaves such pages alone
+            // and the last thread to finish arms it instead (see Rearm).
+            list.state = GetState(page);
+            {
+              PageHookStateLock const state_lock{*list.state};
+              list.state->mode = mode;
+            }
+            new_pages.push_back(list.state);
+          }
+          else
+          {
+            if (list.state->mode != mode)
+            {
+              HADESMEM_DETAIL_THROW_EXCEPTION(
+                Error{}
+                << ErrorString{"Page already hooked with another mode."});
+            }
+            previous.emplace_back(page, list);
+          }
+
+          iter = lists.emplace(page, std::move(list)).first;
+        }
+
+        iter->second.hooks.push_back(hook);
+      }
+    }
+
+    QueryOriginalProtect(new_pages);
+
+    for (auto const state : new_pages)
+    {
+      PageHookStateLock const state_lock{*state};
+      state->armed_protect =
+        state->mode == PageHookMode::kGuard
+          ? (state->orig_protect | PAGE_GUARD)
+          : static_cast<DWORD>(PAGE_NOACCESS);
+    }
+
+    // The hooks have to be published before the pages are armed, otherwise a
+    // fault could come in for a page the handler doesn't know about yet.
+    std::vector<std::pair<std::uintptr_t, PageHookList>> assign{
+      std::begin(lists), std::end(lists)};
+    pages_.Update(assign, {});
+
+    try
+    {
+      for (auto const state : new_pages)
+      {
+        PageHookStateLock const state_lock{*state};
+        state->hooked = true;
+      }
+
+      ProtectRuns(new_pages, true);
+    }
+    catch (...)
+    {
+      Rollback(new_pages, previous);
+      throw;
+    }
+
+    std::vector<std::uintptr_t> touched;
+    touched.reserve(lists.size());
+    for (auto const& list : lists)
+    {
+      touched.push_back(list.first);
+    }
+    return touched;
+  }
+
+  void Unregister(std::uintptr_t owner, std::vector<std::uintptr_t> const& pages)
+  {
+    std::lock_guard<std::mutex> const lock{mutex_};
+
+    std::vector<std::pair<std::uintptr_t, PageHookList>> assign;
+    std::vector<std::uintptr_t> erase;
+    std::vector<PageHookState*> unhooked;
+    for (auto const page : pages)
+    {
+      PageHookList list{};
+      if (!pages_.Visit(page, [&](PageHookList const& cur) { list = cur; }))
+      {
+        continue;
+      }
+
+      list.hooks.erase(
+        std::remove_if(std::begin(list.hooks),
+                       std::end(list.hooks),
+                       [&](PageHookRecord const& r) { return r.owner == owner; }),
+        std::end(list.hooks));
+      if (list.hooks.empty())
+      {
+        erase.push_back(page);
+        unhooked.push_back(list.state);
+      }
+      else
+      {
+        assign.emplace_back(page, std::move(list));
+      }
+    }
+
+    for (auto const state : unhooked)
+    {
+      PageHookStateLock const state_lock{*state};
+      state->hooked = false;
+    }
+
+    // Pages are restored before the hooks are unpublished, so every fault
+    // caused by our protection still finds its page. Pages with threads still
+    // stepping over them are restored by the last thread to finish instead
+    // (see HandleSingleStep).
+    ProtectRuns(unhooked, false);
+
+    pages_.Update(assign, erase);
+  }
+
+private:
+  // Pages disarmed for the instruction the current thread is stepping over.
+  // An instruction can touch any number of hooked pages (e.g. rep movs), so
+  // this has to be able to grow.
+  using PendingRearm = std::vector<PageHookState*>;
+
+  // Undoes a failed Register. Best effort, the original error is what gets
+  // reported.
+  void Rollback(
+    std::vector<PageHookState*> const& new_pages,
+    std::vector<std::pair<std::uintptr_t, PageHookList>> const& previous)
+  {
+    for (auto const state : new_pages)
+    {
+      PageHookStateLock const state_lock{*state};
+      state->hooked = false;
+    }
+
+    try
+    {
+      ProtectRuns(new_pages, false);
+    }
+    catch (...)
+    {
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+
+    std::vector<std::uintptr_t> erase;
+    erase.reserve(new_pages.size());
+    for (auto const state : new_pages)
+    {
+      erase.push_back(state->base);
+    }
+    pages_.Update(previous, erase);
+  }
+
+  PageHookRegistry()
+  {
+    SYSTEM_INFO system_info{};
+    ::GetSystemInfo(&system_info);
+    page_size_ = system_info.dwPageSize;
+
+    handler_ = ::AddVectoredExceptionHandler(1, &VectoredHandler);
+    if (!handler_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"AddVectoredExceptionHandler failed."}
+                << ErrorCodeWinLast{last_error});
+    }
+  }
+
+  PageHookState* GetState(std::uintptr_t page)
+  {
+    auto& state = states_[page];
+    if (!state)
+    {
+      state = std::make_unique<PageHookState>();
+      state->base = page;
+    }
+    return state.get();
+  }
+
+  void QueryOriginalProtect(std::vector<PageHookState*>& states)
+  {
+    std::sort(std::begin(states),
+              std::end(states),
+              [](PageHookState const* lhs, PageHookState const* rhs) {
+                return lhs->base < rhs->base;
+              });
+
+    // One query covers every page in the returned region, so contiguous pages
+    // don't need a query each.
+    std::uintptr_t region_end = 0;
+    DWORD region_protect = 0;
+    for (auto const state : states)
+    {
+      if (state->base >= region_end)
+      {
+        MEMORY_BASIC_INFORMATION mbi{};
+        if (!::VirtualQuery(
+              reinterpret_cast<void const*>(state->base), &mbi, sizeof(mbi)))
+        {
+          DWORD const last_error = ::GetLastError();
+          HADESMEM_DETAIL_THROW_EXCEPTION(
+            Error{} << ErrorString{"VirtualQuery failed."}
+                    << ErrorCodeWinLast{last_error});
+        }
+
+        if (mbi.State != MEM_COMMIT || (mbi.Protect & PAGE_GUARD) ||
+            (mbi.Protect & PAGE_NOACCESS))
+        {
+          HADESMEM_DETAIL_THROW_EXCEPTION(
+            Error{} << ErrorString{"Unsupported page state or protection."});
+        }
+
+        region_end = reinterpret_cast<std::uintptr_t>(mbi.BaseAddress) +
+                     mbi.RegionSize;
+        region_protect = mbi.Protect;
+      }
+
+      state->orig_protect = region_protect;
+    }
+  }
+
+  // Batches protection changes by merging runs of adjacent pages which want
+  // the same protection into a single VirtualProtect call.
+  void ProtectRuns(std::vector<PageHookState*> states, bool arm)
+  {
+    states.erase(std::remove_if(std::begin(states),
+                                std::end(states),
+                                [](PageHookState* s) { return !!s->stepping; }),
+                 std::end(states));
+    std::sort(std::begin(states),
+              std::end(states),
+              [](PageHookState const* lhs, PageHookState const* rhs) {
+                return lhs->base < rhs->base;
+              });
+
+    auto const get_protect = [&](PageHookState const* s) {
+      return arm ? s->armed_protect : s->orig_protect;
+    };
+
+    for (auto beg = std::begin(states); beg != std::end(states);)
+    {
+      auto end = beg + 1;
+      while (end != std::end(states) &&
+             (*end)->base == (*(end - 1))->base + page_size_ &&
+             get_protect(*end) == get_protect(*beg))
+      {
+        ++end;
+      }
+
+      std::vector<std::unique_ptr<PageHookStateLock>> locks;
+      for (auto iter = beg; iter != end; ++iter)
+      {
+        locks.emplace_back(std::make_unique<PageHookStateLock>(**iter));
+      }
+
+      // Recheck now that we hold the locks, a fault may have come in between.
+      bool const busy = std::any_of(
+        beg, end, [](PageHookState* s) { return !!s->stepping; });
+      if (busy)
+      {
+        for (auto iter = beg; iter != end; ++iter)
+        {
+          if (!(*iter)->stepping)
+          {
+            ProtectPage(**iter, get_protect(*iter));
+          }
+        }
+      }
+      else
+      {
+        DWORD old_protect = 0;
+        if (!::VirtualProtect(reinterpret_cast<void*>((*beg)->base),
+                              static_cast<SIZE_T>((end - beg) * page_size_),
+                              get_protect(*beg),
+                              &old_protect))
+        {
+          DWORD const last_error = ::GetLastError();
+          HADESMEM_DETAIL_THROW_EXCEPTION(
+            Error{} << ErrorString{"VirtualProtect failed."}
+                    << ErrorCodeWinLast{last_error});
+        }
+      }
+
+      beg = end;
+    }
+  }
+
+  static bool ProtectPage(PageHookState const& state, DWORD protect) noexcept
+  {
+    DWORD old_protect = 0;
+    return !!::VirtualProtect(reinterpret_cast<void*>(state.base),
+                              Get().page_size_,
+                              protect,
+                              &old_protect);
+  }
+
+  static PendingRearm& GetPendingRearm() noexcept
+  {
+    thread_local static PendingRearm pending;
+    return pending;
+  }
+
+  static void Rearm(PageHookState& state) noexcept
+  {
+    PageHookStateLock const lock{state};
+    HADESMEM_DETAIL_ASSERT(state.stepping);
+    if (--state.stepping == 0)
+    {
+      ProtectPage(state, state.hooked ? state.armed_protect : state.orig_protect);
+    }
+  }
+
+  static LONG CALLBACK VectoredHandler(PEXCEPTION_POINTERS exception_pointers)
+  {
+    switch (exception_pointers->ExceptionRecord->ExceptionCode)
+    {
+    case STATUS_GUARD_PAGE_VIOLATION:
+    case EXCEPTION_ACCESS_VIOLATION:
+      return HandleFault(exception_pointers);
+
+    case EXCEPTION_SINGLE_STEP:
+      return HandleSingleStep(exception_pointers);
+
+    default:
+      return EXCEPTION_CONTINUE_SEARCH;
+    }
+  }
+
+  static LONG HandleFault(PEXCEPTION_POINTERS exception_pointers)
+  {
+    auto const record = exception_pointers->ExceptionRecord;
+    auto const context = exception_pointers->ContextRecord;
+    if (record->NumberParameters < 2)
+    {
+      return EXCEPTION_CONTINUE_SEARCH;
+    }
+
+    auto& registry = Get();
+    std::uintptr_t const address = record->ExceptionInformation[1];
+    std::uintptr_t const page = registry.GetPageBase(address);
+    std::uintptr_t const ip = GetInstructionPointer(*context);
+
+    auto& pending = GetPendingRearm();
+    for (auto iter = std::begin(pending); iter != std::end(pending); ++iter)
+    {
+      if ((*iter)->base == page)
+      {
+        // We've already disarmed this page for the current instruction, so
+        // this is a genuine fault (e.g. a write to a read-only page). Put
+        // things back the way they were and let it propagate.
+        for (auto const state : pending)
+        {
+          Rearm(*state);
+        }
+        pending.clear();
+        context->EFlags &= ~static_cast<DWORD>(0x100);
+        return EXCEPTION_CONTINUE_SEARCH;
+      }
+    }
+
+    std::uint32_t const access =
+      (record->ExceptionInformation[0] == 8 || address == ip)
+        ? PageAccess::kExecute
+        : (record->ExceptionInformation[0] == 1 ? PageAccess::kWrite
+                                                : PageAccess::kRead);
+
+    PageHookState* state = nullptr;
+    bool const found =
+      registry.pages_.Visit(page, [&](PageHookList const& list) {
+        state = list.state;
+        for (auto const& hook : list.hooks)
+        {
+          if (address >= hook.beg && address < hook.end &&
+              (hook.access & access))
+          {
+            PageHookEvent event{context,
+                                reinterpret_cast<void*>(address),
+                                reinterpret_cast<void*>(hook.beg),
+                                access};
+            (*hook.callback)(event);
+          }
+        }
+      });
+    if (!found)
+    {
+      return EXCEPTION_CONTINUE_SEARCH;
+    }
+
+    HADESMEM_DETAIL_ASSERT(state);
+
+    if (access == PageAccess::kExecute && GetInstructionPointer(*context) != ip)
+    {
+      // Redirected away from the faulting instruction, so there's nothing to
+      // step over. Guard pages still need re-arming though, because the OS
+      // clears PAGE_GUARD when it raises the exception.
+      if (state->mode == PageHookMode::kGuard)
+      {
+        PageHookStateLock const lock{*state};
+        if (!state->stepping)
+        {
+          ProtectPage(*state, state->armed_protect);
+        }
+      }
+      return EXCEPTION_CONTINUE_EXECUTION;
+    }
+
+    try
+    {
+      pending.push_back(state);
+    }
+    catch (...)
+    {
+      // Out of memory, so the page can't be tracked for re-arming. Losing the
+      // hook on it is better than passing on a fault we caused.
+      HADESMEM_DETAIL_ASSERT(false);
+      PageHookStateLock const lock{*state};
+      if (!state->stepping)
+      {
+        ProtectPage(*state, state->orig_protect);
+      }
+      return EXCEPTION_CONTINUE_EXECUTION;
+    }
+
+    {
+      PageHookStateLock const lock{*state};
+      ++state->stepping;
+      if (state->mode == PageHookMode::kNoAccess)
+      {
+        ProtectPage(*state, state->orig_protect);
+      }
+    }
+
+    // Set trap flag so we can re-arm the page after the instruction executes.
+    context->EFlags |= 0x100;
+
+    return EXCEPTION_CONTINUE_EXECUTION;
+  }
+
+  static LONG HandleSingleStep(PEXCEPTION_POINTERS exception_pointers)
+  {
+    auto& pending = GetPendingRearm();
+    if (pending.empty())
+    {
+      return EXCEPTION_CONTINUE_SEARCH;
+    }
+
+    for (auto const state : pending)
+    {
+      Rearm(*state);
+    }
+    // Keeps its capacity, so the common case never allocates.
+    pending.clear();
+
+    // If a hardware breakpoint fired on the same instruction let its owner see
+    // the exception too.
+    if (exception_pointers->ContextRecord->Dr6 & 0xF)
+    {
+      return EXCEPTION_CONTINUE_SEARCH;
+    }
+
+    return EXCEPTION_CONTINUE_EXECUTION;
+  }
+
+  std::uintptr_t page_size_{};
+  std::mutex mutex_;
+  std::map<std::uintptr_t, std::unique_ptr<PageHookState>> states_;
+  RcuFlatMap<std::uintptr_t, PageHookList> pages_;
+  SmartRemoveVectoredExceptionHandler handler_;
+};
+}
+
+class PatchPage
+{
+public:
+  using CallbackT = std::function<void(PageHookEvent& event)>;
+
+  explicit PatchPage(Process const& process,
+                     PageHookMode mode = PageHookMode::kNoAccess)
+    : mode_{mode}, owner_{GetNextOwner()}
+  {
+    if (process.GetId() != ::GetCurrentProcessId())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"PatchPage only supported on local process."});
+    }
+
+    detail::PageHookRegistry::Get();
+  }
+
+  explicit PatchPage(Process const&& process,
+                     PageHookMode mode = PageHookMode::kNoAccess) = delete;
+
+  PatchPage(PatchPage const& other) = delete;
+
+  PatchPage& operator=(PatchPage const& other) = delete;
+
+  PatchPage(PatchPage&& other)
+    : mode_{other.mode_},
+      owner_{other.owner_},
+      staged_(std::move(other.staged_)),
+      pages_(std::move(other.pages_))
+  {
+    other.owner_ = 0;
+  }
+
+  PatchPage& operator=(PatchPage&& other)
+  {
+    RemoveUnchecked();
+
+    mode_ = other.mode_;
+    owner_ = other.owner_;
+    other.owner_ = 0;
+    staged_ = std::move(other.staged_);
+    pages_ = std::move(other.pages_);
+
+    return *this;
+  }
+
+  ~PatchPage()
+  {
+    RemoveUnchecked();
+  }
+
+  // Hooks are staged and only take effect on the next call to Apply, so
+  // adding many hooks on the same pages costs one protection change per run of
+  // pages rather than one per hook.
+  void Add(void* address,
+           std::size_t size,
+           std::uint32_t access,
+           CallbackT const& callback)
+  {
+    HADESMEM_DETAIL_ASSERT(address);
+    HADESMEM_DETAIL_ASSERT(size);
+    HADESMEM_DETAIL_ASSERT(access && access < PageAccess::kInvalidFlagMaxValue);
+    HADESMEM_DETAIL_ASSERT(callback);
+
+    auto const beg = reinterpret_cast<std::uintptr_t>(address);
+    staged_.push_back(detail::PageHookRecord{
+      beg,
+      beg + size,
+      access,
+      owner_,
+      std::make_shared<std::function<void(PageHookEvent&)>>(callback)});
+  }
+
+  void Apply()
+  {
+    if (staged_.empty())
+    {
+      return;
+    }
+
+    auto const touched =
+      detail::PageHookRegistry::Get().Register(staged_, mode_);
+    staged_.clear();
+
+    pages_.insert(std::end(pages_), std::begin(touched), std::end(touched));
+    std::sort(std::begin(pages_), std::end(pages_));
+    pages_.erase(std::unique(std::begin(pages_), std::end(pages_)),
+                 std::end(pages_));
+  }
+
+  void Remove()
+  {
+    if (pages_.empty())
+    {
+      return;
+    }
+
+    detail::PageHookRegistry::Get().Unregister(owner_, pages_);
+    pages_.clear();
+  }
+
+  void RemoveUnchecked() noexcept
+  {
+    try
+    {
+      Remove();
+    }
+    catch (...)
+    {
+      // WARNING: Hooks may not be removed if Remove fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+
+      pages_.clear();
+    }
+  }
+
+  bool IsApplied() const noexcept
+  {
+    return !pages_.empty();
+  }
+
+private:
+  static std::uintptr_t GetNextOwner() noexcept
+  {
+    static std::atomic<std::uintptr_t> next_owner{1};
+    return next_owner++;
+  }
+
+  PageHookMode mode_;
+  std::uintptr_t owner_;
+  std::vector<detail::PageHookRecord> staged_;
+  std::vector<std::uintptr_t> pages_;
+};
+}
@@ -7,7 +7,6 @@
 #include <climits>
 #include <cstdint>
 #include <functional>
-#include <map>
 #include <memory>
 #include <sstream>
 #include <type_traits>
@@ -25,8 +24,8 @@
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/patch_detour_stub.hpp>
 #include <hadesmem/detail/patcher_aux.hpp>
+#include <hadesmem/detail/rcu_flat_map.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
-#include <hadesmem/detail/srw_lock.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
@@ -43,13 +42,18 @@
 
 // TODO: Add context support.
 
-// TODO: Add page breakpoint hooks (PAGE_GUARD, PAGE_NOACCESS, etc.).
+// Page breakpoint hooks (PAGE_GUARD, PAGE_NOACCESS) live in PatchPage.
 
 namespace hadesmem
 {
 template <typename TargetFuncT> class PatchVeh : public PatchDetour<TargetFuncT>
 {
 public:
+  struct VehHook
+  {
+    void* resume;
+  };
+
   explicit PatchVeh(Process const& process,
                     TargetFuncT target,
                     DetourFuncT const& detour)
@@ -79,7 +83,6 @@ public:
   static void InitializeStatics()
   {
     GetInitialized();
-    GetSrwLock();
     GetVehHooks();
     GetDrHooks();
   }
@@ -144,52 +147,33 @@ protected:
 
   static LONG CALLBACK HandleBreakpoint(PEXCEPTION_POINTERS exception_pointers)
   {
-    hadesmem::detail::AcquireSRWLock const lock(
-      &GetSrwLock(), hadesmem::detail::SRWLockType::Shared);
-
-    auto& veh_hooks = GetVehHooks();
-    auto const iter =
-      veh_hooks.find(exception_pointers->ExceptionRecord->ExceptionAddress);
-    if (iter == std::end(veh_hooks))
+    VehHook hook;
+    if (!GetVehHooks().Find(
+          exception_pointers->ExceptionRecord->ExceptionAddress, &hook))
     {
       return EXCEPTION_CONTINUE_SEARCH;
     }
 
-    PatchVeh* patch = iter->second;
-#if defined(HADESMEM_DETAIL_ARCH_X64)
-    exception_pointers->ContextRecord->Rip =
-      reinterpret_cast<std::uintptr_t>(patch->stub_gate_->GetBase());
-#elif defined(HADESMEM_DETAIL_ARCH_X86)
-    exception_pointers->ContextRecord->Eip =
-      reinterpret_cast<std::uintptr_t>(patch->stub_gate_->GetBase());
-#else
-#error "[HadesMem] Unsupported architecture."
-#endif
+    SetResumeAddress(exception_pointers->ContextRecord, hook.resume);
 
     return EXCEPTION_CONTINUE_EXECUTION;
   }
 
   static LONG CALLBACK HandleSingleStep(PEXCEPTION_POINTERS exception_pointers)
   {
-    hadesmem::detail::AcquireSRWLock const lock(
-      &GetSrwLock(), hadesmem::detail::SRWLockType::Shared);
-
-    auto& veh_hooks = GetVehHooks();
-    auto const iter =
-      veh_hooks.find(exception_pointers->ExceptionRecord->ExceptionAddress);
-    if (iter == std::end(veh_hooks))
+    VehHook hook;
+    if (!GetVehHooks().Find(
+          exception_pointers->ExceptionRecord->ExceptionAddress, &hook))
     {
       return EXCEPTION_CONTINUE_SEARCH;
     }
 
-    auto& dr_hooks = GetDrHooks();
-    auto const dr_hook_iter = dr_hooks.find(::GetCurrentThreadId());
-    if (dr_hook_iter == std::end(dr_hooks))
+    std::uintptr_t dr_index = 0;
+    if (!GetDrHooks().Find(::GetCurrentThreadId(), &dr_index))
     {
       return EXCEPTION_CONTINUE_SEARCH;
     }
 
-    std::uintptr_t const dr_index = dr_hook_iter->second;
     if (!(exception_pointers->ContextRecord->Dr6 & (1ULL << dr_index)))
     {
       return EXCEPTION_CONTINUE_SEARCH;
@@ -200,18 +184,30 @@ protected:
     // Set resume flag
     exception_pointers->ContextRecord->EFlags |= (1ULL << 16);
 
-    PatchVeh* patch = iter->second;
+    SetResumeAddress(exception_pointers->ContextRecord, hook.resume);
+
+    return EXCEPTION_CONTINUE_EXECUTION;
+  }
+
+  static void SetResumeAddress(PCONTEXT context, void* resume) noexcept
+  {
 #if defined(HADESMEM_DETAIL_ARCH_X64)
-    exception_pointers->ContextRecord->Rip =
-      reinterpret_cast<std::uintptr_t>(patch->stub_gate_->GetBase());
+    context->Rip = reinterpret_cast<std::uintptr_t>(resume);
 #elif defined(HADESMEM_DETAIL_ARCH_X86)
-    exception_pointers->ContextRecord->Eip =
-      reinterpret_cast<std::uintptr_t>(patch->stub_gate_->GetBase());
+    context->Eip = reinterpret_cast<std::uintptr_t>(resume);
 #else
 #error "[HadesMem] Unsupported architecture."
 #endif
+  }
 
-    return EXCEPTION_CONTINUE_EXECUTION;
+  // Everything the exception handler needs is computed when the hook is
+  // registered, so the handler itself never locks, allocates, or dereferences
+  // the (movable) patch object.
+  VehHook MakeVehHook() const
+  {
+    VehHook hook{};
+    hook.resume = stub_gate_->GetBase();
+    return hook;
   }
 
   static bool& GetInitialized()
@@ -220,22 +216,16 @@ protected:
     return initialized;
   }
 
-  static std::map<void*, PatchVeh*>& GetVehHooks()
+  static detail::RcuFlatMap<void*, VehHook>& GetVehHooks()
   {
-    static std::map<void*, PatchVeh*> veh_hooks;
+    static detail::RcuFlatMap<void*, VehHook> veh_hooks;
     return veh_hooks;
   }
 
-  static std::map<DWORD, std::uintptr_t>& GetDrHooks()
+  static detail::RcuFlatMap<DWORD, std::uintptr_t>& GetDrHooks()
   {
-    static std::map<DWORD, std::uintptr_t> dr_hooks;
+    static detail::RcuFlatMap<DWORD, std::uintptr_t> dr_hooks;
     return dr_hooks;
   }
-
-  static SRWLOCK& GetSrwLock()
-  {
-    static SRWLOCK srw_lock = SRWLOCK_INIT;
-    return srw_lock;
-  }
 };
 }
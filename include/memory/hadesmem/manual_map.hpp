@@ -0,0 +1,750 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/call.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/export_name_table.hpp>
+#include <hadesmem/detail/force_initialize.hpp>
+#include <hadesmem/detail/manual_map_image.hpp>
+#include <hadesmem/detail/scope_warden.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/write_impl.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/find_procedure.hpp>
+#include <hadesmem/injector.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_snapshot.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/process_helpers.hpp>
+#include <hadesmem/read.hpp>
+
+// Loads a DLL into a process without going through the loader. Everything
+// which only needs the file (layout, relocation, import and TLS parsing) is
+// done locally, see detail/manual_map_image.hpp. The target is only touched
+// to allocate the image, to look up exports, to load missing dependencies
+// (all at once, with a single LoadLibraryExW stub), to write the finished
+// image (a single write, then a protection change per run of pages which
+// share a protection), and to run its initialization (a single stub which
+// calls the TLS callbacks and then the entry point).
+//
+// Limitations (same as the old implementation):
+// * The module isn't linked into the loader's lists, so it isn't visible to
+//   GetModuleHandle, ModuleList, etc.
+// * Static TLS (__declspec(thread)) isn't set up. Only the callbacks are run.
+// * On x86 the image isn't registered for SafeSEH, so an exception handler
+//   in the module will be rejected if the process enforces it.
+// * Delay loaded imports are left to the module's own helper, which loads
+//   them with the real loader.
+
+// TODO: Support unmapping (DLL_PROCESS_DETACH, RtlDeleteFunctionTable). Only
+// a failed initialization is undone for now.
+
+// TODO: Static TLS support.
+
+namespace hadesmem
+{
+// TODO: Type safety.
+struct ManualMapFlags
+{
+  enum : std::uint32_t
+  {
+    kNone = 0,
+    kPathResolution = 1 << 0,
+    kSkipEntryPoint = 1 << 1,
+    kInvalidFlagMaxValue = 1 << 2
+  };
+};
+
+namespace detail
+{
+inline std::string ToLowerManualMapName(std::string name)
+{
+  std::transform(std::begin(name),
+                 std::end(name),
+                 std::begin(name),
+                 [](char c) {
+                   return static_cast<char>(
+                     std::tolower(static_cast<unsigned char>(c)));
+                 });
+  return name;
+}
+
+// Export lookups for modules in the target. Each module's export directory
+// is read and indexed once (see ExportNameTable), so resolving an import
+// table costs a read per module rather than several reads per import.
+class RemoteExportCache
+{
+public:
+  explicit RemoteExportCache(Process const& process)
+    : process_{&process}, snapshot_{ForceLdrInitialize(process)}
+  {
+    for (auto const& module : snapshot_)
+    {
+      auto const name =
+        ToLowerManualMapName(detail::WideCharToMultiByte(module.GetName()));
+      modules_.emplace(name, RemoteModule{module.GetHandle(), false, {}});
+    }
+  }
+
+  explicit RemoteExportCache(Process const&& process) = delete;
+
+  // Anything which isn't already loaded is loaded with LoadLibraryExW, all
+  // in a single remote call.
+  void LoadModules(std::vector<std::string> const& names)
+  {
+    std::vector<std::string> missing;
+    for (auto const& name : names)
+    {
+      auto const name_lower = ToLowerManualMapName(name);
+      if (modules_.find(name_lower) == std::end(modules_) &&
+          std::find(std::begin(missing), std::end(missing), name_lower) ==
+            std::end(missing))
+      {
+        missing.push_back(name_lower);
+      }
+    }
+
+    if (missing.empty())
+    {
+      return;
+    }
+
+    std::vector<std::wstring> paths;
+    for (auto const& name : missing)
+    {
+      paths.push_back(detail::MultiByteToWideChar(name));
+    }
+
+    auto const results = detail::InjectDllsImpl(
+      *process_, paths, InjectFlags::kNone, nullptr, &snapshot_);
+    HADESMEM_DETAIL_ASSERT(results.size() == missing.size());
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+      if (!results[i].module)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Failed to load dependency."}
+                  << ErrorStringOther{missing[i]}
+                  << ErrorCodeWinLast{results[i].last_error});
+      }
+
+      // API sets resolve to a host with a different name, so this is keyed
+      // by the name that was asked for.
+      modules_.emplace(missing[i],
+                       RemoteModule{results[i].module, false, {}});
+    }
+  }
+
+  // Forwarders are followed (loading their modules if needed).
+  std::uint64_t Resolve(std::string const& module_name,
+                        ManualMapImport const& import)
+  {
+    return ResolveImpl(module_name,
+                       import.by_ordinal,
+                       import.ordinal,
+                       import.name,
+                       import.hint,
+                       0);
+  }
+
+  // The modules which were loaded when the cache was created. Anything loaded
+  // by LoadModules since then is not in here, but the system DLLs the mapper
+  // needs (kernel32.dll, ntdll.dll) always are.
+  ModuleSnapshot const& GetSnapshot() const noexcept
+  {
+    return snapshot_;
+  }
+
+private:
+  struct RemoteModule
+  {
+    HMODULE handle;
+    bool indexed;
+    ExportNameTable exports;
+  };
+
+  // Same limit as Export.
+  static std::size_t const kMaxForwarderDepth = 16;
+
+  // The loader has to have run before the module list means anything.
+  static Process const& ForceLdrInitialize(Process const& process)
+  {
+    detail::ForceLdrInitializeThunk(process.GetId());
+    return process;
+  }
+
+  RemoteModule& GetModule(std::string const& name)
+  {
+    auto const iter = modules_.find(ToLowerManualMapName(name));
+    if (iter == std::end(modules_))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Module is not loaded."}
+                                      << ErrorStringOther{name});
+    }
+
+    RemoteModule& module = iter->second;
+    if (!module.indexed)
+    {
+      Index(module);
+      module.indexed = true;
+    }
+
+    return module;
+  }
+
+  void Index(RemoteModule& module)
+  {
+    Module const remote{*process_, module.handle};
+    PeFile const pe_file{
+      *process_, remote.GetHandle(), PeFileType::kImage, remote.GetSize()};
+    NtHeaders const nt_headers{*process_, pe_file};
+    DWORD const dir_rva =
+      nt_headers.GetDataDirectoryVirtualAddress(PeDataDir::Export);
+    DWORD const dir_size =
+      nt_headers.GetDataDirectorySize(PeDataDir::Export);
+    if (!dir_rva || !dir_size)
+    {
+      return;
+    }
+
+    auto const base = reinterpret_cast<std::uint8_t*>(module.handle);
+
+    // The linker puts the tables and names inside the directory range, so
+    // that's usually all that's needed.
+    auto const dir_data =
+      ReadVector<std::uint8_t>(*process_, base + dir_rva, dir_size);
+    if (module.exports.Parse(
+          dir_data.data(), dir_rva, dir_data.size(), dir_rva, dir_size))
+    {
+      return;
+    }
+
+    auto const image_data =
+      ReadVector<std::uint8_t>(*process_, base, remote.GetSize());
+    if (!module.exports.Parse(
+          image_data.data(), 0, image_data.size(), dir_rva, dir_size))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid export directory."});
+    }
+  }
+
+  std::uint64_t ResolveImpl(std::string const& module_name,
+                            bool by_ordinal,
+                            std::uint16_t ordinal,
+                            std::string const& name,
+                            std::uint16_t hint,
+                            std::size_t depth)
+  {
+    RemoteModule const& module = GetModule(module_name);
+
+    ExportTarget target;
+    bool const found = by_ordinal
+                         ? module.exports.FindByOrdinal(ordinal, &target)
+                         : module.exports.FindByName(name, hint, &target);
+    if (!found)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Could not find import."}
+                << ErrorStringOther{module_name + "!" +
+                                    (by_ordinal ? "#" + std::to_string(ordinal)
+                                                : name)});
+    }
+
+    if (target.forwarder.empty())
+    {
+      return reinterpret_cast<std::uintptr_t>(module.handle) + target.rva;
+    }
+
+    ExportForwarder forwarder;
+    if (depth >= kMaxForwarderDepth ||
+        !ParseExportForwarder(target.forwarder, &forwarder))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid forwarder."}
+                << ErrorStringOther{target.forwarder});
+    }
+
+    if (forwarder.module.find('.') == std::string::npos)
+    {
+      forwarder.module += ".dll";
+    }
+    LoadModules(std::vector<std::string>{forwarder.module});
+
+    return ResolveImpl(forwarder.module,
+                       forwarder.by_ordinal,
+                       forwarder.ordinal,
+                       forwarder.function,
+                       0,
+                       depth + 1);
+  }
+
+  Process const* process_;
+  ModuleSnapshot snapshot_;
+  std::map<std::string, RemoteModule> modules_;
+};
+
+inline void FreeManualMapImage(Process const& process, void* base) noexcept
+{
+  BOOL const freed = ::VirtualFreeEx(process.GetHandle(), base, 0, MEM_RELEASE);
+  (void)freed;
+  HADESMEM_DETAIL_ASSERT(freed != FALSE);
+}
+
+// Tries the preferred base first, so the image may not need relocating.
+inline void* AllocManualMapImage(Process const& process,
+                                 ManualMapHeaders const& headers)
+{
+  void* base = ::VirtualAllocEx(process.GetHandle(),
+                                reinterpret_cast<void*>(
+                                  static_cast<std::uintptr_t>(
+                                    headers.image_base)),
+                                headers.size_of_image,
+                                MEM_RESERVE | MEM_COMMIT,
+                                PAGE_READWRITE);
+  if (!base)
+  {
+    base = ::VirtualAllocEx(process.GetHandle(),
+                            nullptr,
+                            headers.size_of_image,
+                            MEM_RESERVE | MEM_COMMIT,
+                            PAGE_READWRITE);
+  }
+
+  if (!base)
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"VirtualAllocEx failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+
+  return base;
+}
+
+// The whole allocation is still read/write, so the image goes in with a
+// single write. Fresh memory is already zeroed, so the write stops at the last
+// non-zero byte.
+inline void CommitManualMapImage(Process const& process,
+                                 void* base,
+                                 std::vector<std::uint8_t> const& image,
+                                 std::vector<ManualMapRegion> const& regions)
+{
+  auto const base_raw = static_cast<std::uint8_t*>(base);
+
+  std::uint32_t const write_size = GetManualMapWriteSize(regions);
+  HADESMEM_DETAIL_ASSERT(write_size <= image.size());
+  if (write_size)
+  {
+    detail::WriteUnchecked(process, base_raw, image.data(), write_size);
+  }
+
+  for (auto const& region : regions)
+  {
+    DWORD old_protect = 0;
+    if (!::VirtualProtectEx(process.GetHandle(),
+                            base_raw + region.rva,
+                            region.size,
+                            region.protect,
+                            &old_protect))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"VirtualProtectEx failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+  }
+
+  if (!::FlushInstructionCache(process.GetHandle(), base, image.size()))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"FlushInstructionCache failed."}
+              << ErrorCodeWinLast{last_error});
+  }
+}
+
+// Undoes a failed initialization the way the loader does when DllMain fails
+// (TLS callbacks and the entry point get DLL_PROCESS_DETACH), then removes
+// the exception table, all in a single remote call.
+inline void UninitializeManualMapImage(
+  Process const& process,
+  ModuleSnapshot const& modules,
+  void* base,
+  ManualMapHeaders const& headers,
+  std::vector<std::uint64_t> const& tls_callbacks,
+  bool call_entry_point,
+  bool delete_function_table)
+{
+  auto const base_raw = static_cast<std::uint8_t*>(base);
+  MultiCall multi_call{process};
+
+  for (auto const callback : tls_callbacks)
+  {
+    multi_call.Add(
+      reinterpret_cast<PIMAGE_TLS_CALLBACK>(
+        static_cast<std::uintptr_t>(callback)),
+      CallConv::kStdCall,
+      base,
+      static_cast<DWORD>(DLL_PROCESS_DETACH),
+      __nullptr); // Can't use nullptr here because /clr...
+  }
+
+  if (call_entry_point)
+  {
+    using DllMainFn = BOOL(WINAPI*)(HINSTANCE, DWORD, LPVOID);
+    multi_call.Add(
+      reinterpret_cast<DllMainFn>(base_raw + headers.entry_point),
+      CallConv::kStdCall,
+      static_cast<HINSTANCE>(base),
+      static_cast<DWORD>(DLL_PROCESS_DETACH),
+      __nullptr); // Can't use nullptr here because /clr...
+  }
+
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  if (delete_function_table)
+  {
+    Module const& ntdll_mod = GetSnapshotModule(modules, L"ntdll.dll");
+    auto const delete_function_table_fn =
+      FindProcedure(process, ntdll_mod, "RtlDeleteFunctionTable");
+    multi_call.Add(reinterpret_cast<decltype(&RtlDeleteFunctionTable)>(
+                     delete_function_table_fn),
+                   CallConv::kStdCall,
+                   reinterpret_cast<PRUNTIME_FUNCTION>(
+                     base_raw + headers.data_dirs[kManualMapDirException].rva));
+  }
+#else
+  (void)modules;
+  (void)delete_function_table;
+#endif
+
+  std::vector<CallResultRaw> rets;
+  multi_call.Call(std::back_inserter(rets));
+}
+
+// The exception table (x64 only), the TLS callbacks, and then the entry
+// point, all in a single remote call. Once that has run the image is in use
+// and *in_use is set. If the initialization then turns out to have failed it
+// is undone (see UninitializeManualMapImage) and *in_use is cleared again, so
+// the caller knows whether the image can be freed.
+inline void InitializeManualMapImage(Process const& process,
+                                     ModuleSnapshot const& modules,
+                                     void* base,
+                                     std::vector<std::uint8_t> const& image,
+                                     ManualMapHeaders const& headers,
+                                     std::uint32_t flags,
+                                     bool* in_use)
+{
+  HADESMEM_DETAIL_ASSERT(in_use != nullptr);
+
+  auto const base_raw = static_cast<std::uint8_t*>(base);
+  MultiCall multi_call{process};
+  std::size_t num_calls = 0;
+
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  bool const add_function_table =
+    headers.data_dirs[kManualMapDirException].rva &&
+    headers.data_dirs[kManualMapDirException].size;
+  if (add_function_table)
+  {
+    Module const& ntdll_mod = GetSnapshotModule(modules, L"ntdll.dll");
+    auto const add_function_table_fn =
+      FindProcedure(process, ntdll_mod, "RtlAddFunctionTable");
+    multi_call.Add(
+      reinterpret_cast<decltype(&RtlAddFunctionTable)>(add_function_table_fn),
+      CallConv::kStdCall,
+      reinterpret_cast<PRUNTIME_FUNCTION>(
+        base_raw + headers.data_dirs[kManualMapDirException].rva),
+      static_cast<DWORD>(headers.data_dirs[kManualMapDirException].size /
+                         sizeof(RUNTIME_FUNCTION)),
+      reinterpret_cast<DWORD64>(base));
+    ++num_calls;
+  }
+#endif
+
+  std::vector<std::uint64_t> tls_callbacks;
+  if (auto const error = GetManualMapTlsCallbacks(
+        image, headers, reinterpret_cast<std::uintptr_t>(base), &tls_callbacks))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{error});
+  }
+
+  for (auto const callback : tls_callbacks)
+  {
+    multi_call.Add(
+      reinterpret_cast<PIMAGE_TLS_CALLBACK>(
+        static_cast<std::uintptr_t>(callback)),
+      CallConv::kStdCall,
+      base,
+      static_cast<DWORD>(DLL_PROCESS_ATTACH),
+      __nullptr); // Can't use nullptr here because /clr...
+    ++num_calls;
+  }
+
+  bool const call_entry_point =
+    headers.entry_point && !(flags & ManualMapFlags::kSkipEntryPoint);
+  if (call_entry_point)
+  {
+    using DllMainFn = BOOL(WINAPI*)(HINSTANCE, DWORD, LPVOID);
+    multi_call.Add(
+      reinterpret_cast<DllMainFn>(base_raw + headers.entry_point),
+      CallConv::kStdCall,
+      static_cast<HINSTANCE>(base),
+      static_cast<DWORD>(DLL_PROCESS_ATTACH),
+      __nullptr); // Can't use nullptr here because /clr...
+    ++num_calls;
+  }
+
+  if (!num_calls)
+  {
+    return;
+  }
+
+  HADESMEM_DETAIL_TRACE_FORMAT_A("Running %u initialization calls.",
+                                 static_cast<unsigned>(num_calls));
+
+  std::vector<CallResultRaw> rets;
+  *in_use = true;
+  multi_call.Call(std::back_inserter(rets));
+  HADESMEM_DETAIL_ASSERT(rets.size() == num_calls);
+
+  bool function_table_added = false;
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  function_table_added =
+    add_function_table && !!rets.front().GetReturnValue<BOOLEAN>();
+  bool const function_table_failed =
+    add_function_table && !function_table_added;
+#else
+  bool const function_table_failed = false;
+#endif
+  bool const entry_point_failed =
+    call_entry_point && !rets.back().GetReturnValue<BOOL>();
+  if (!function_table_failed && !entry_point_failed)
+  {
+    return;
+  }
+
+  // Everything in the batch has run even if something before it failed, so
+  // all of it has to be undone before the image can go away. If that fails
+  // too the image is left mapped, because code in it may still be live
+  // (e.g. threads it started).
+  try
+  {
+    UninitializeManualMapImage(process,
+                               modules,
+                               base,
+                               headers,
+                               tls_callbacks,
+                               call_entry_point,
+                               function_table_added);
+    *in_use = false;
+  }
+  catch (...)
+  {
+    HADESMEM_DETAIL_TRACE_A(
+      boost::current_exception_diagnostic_information().c_str());
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Failed to undo initialization, leaving image at %p mapped.", base);
+  }
+
+  if (function_table_failed)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"RtlAddFunctionTable failed."});
+  }
+
+  HADESMEM_DETAIL_THROW_EXCEPTION(
+    Error{} << ErrorString{"DllMain failed."}
+            << ErrorCodeWinLast{rets.back().GetLastError()});
+}
+}
+
+// Keeps the export index for the target between mappings, so mapping several
+// modules into the same process only reads each dependency's exports once.
+class ManualMapper
+{
+public:
+  explicit ManualMapper(Process const& process)
+    : process_{&process}, exports_{process}
+  {
+  }
+
+  explicit ManualMapper(Process const&& process) = delete;
+
+  HMODULE Map(std::wstring const& path, std::uint32_t flags)
+  {
+    HADESMEM_DETAIL_ASSERT(
+      !(flags & ~(ManualMapFlags::kInvalidFlagMaxValue - 1UL)));
+
+    std::wstring const path_real = detail::ResolveInjectPath(
+      path,
+      (flags & ManualMapFlags::kPathResolution) ? InjectFlags::kPathResolution
+                                                : InjectFlags::kNone);
+
+    HADESMEM_DETAIL_TRACE_FORMAT_W(L"Mapping \"%s\".", path_real.c_str());
+
+    detail::SmartFileHandle const file{::CreateFileW(path_real.c_str(),
+                                                     GENERIC_READ,
+                                                     FILE_SHARE_READ,
+                                                     nullptr,
+                                                     OPEN_EXISTING,
+                                                     0,
+                                                     nullptr)};
+    if (!file.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"CreateFileW failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    LARGE_INTEGER file_size{};
+    if (!::GetFileSizeEx(file.GetHandle(), &file_size))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"GetFileSizeEx failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    detail::SmartHandle const file_mapping{::CreateFileMappingW(
+      file.GetHandle(), nullptr, PAGE_READONLY, 0, 0, nullptr)};
+    if (!file_mapping.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"CreateFileMappingW failed."}
+                << ErrorCodeWinLast{last_error});
+    }
+
+    detail::SmartMappedFileHandle const file_view{
+      ::MapViewOfFile(file_mapping.GetHandle(), FILE_MAP_READ, 0, 0, 0)};
+    if (!file_view.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"MapViewOfFile failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    auto const data = static_cast<std::uint8_t const*>(file_view.GetHandle());
+    auto const size = static_cast<std::size_t>(file_size.QuadPart);
+
+    detail::ManualMapHeaders headers;
+    if (auto const error = detail::ParseManualMapHeaders(data, size, &headers))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{error});
+    }
+
+    bool const is_64 = sizeof(void*) == 8;
+    if (headers.is_64 != is_64 ||
+        IsWoW64(*process_) != detail::IsWoW64Process(::GetCurrentProcess()))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Architecture mismatch."});
+    }
+
+    // IMAGE_FILE_DLL
+    if (!(headers.characteristics & 0x2000))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Image is not a DLL."});
+    }
+
+    std::vector<std::uint8_t> image =
+      detail::MapManualMapImage(data, size, headers);
+
+    std::vector<detail::ManualMapImportModule> imports;
+    if (auto const error =
+          detail::GetManualMapImports(image, headers, &imports))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{error});
+    }
+
+    HADESMEM_DETAIL_TRACE_A("Loading dependencies.");
+
+    std::vector<std::string> import_names;
+    for (auto const& module : imports)
+    {
+      import_names.push_back(module.name);
+    }
+    exports_.LoadModules(import_names);
+
+    HADESMEM_DETAIL_TRACE_A("Resolving imports.");
+
+    for (auto const& module : imports)
+    {
+      for (auto const& import : module.imports)
+      {
+        detail::SetManualMapImport(
+          image, headers, import, exports_.Resolve(module.name, import));
+      }
+    }
+
+    void* const base = detail::AllocManualMapImage(*process_, headers);
+    bool in_use = false;
+    auto const free_image = [&]() {
+      if (!in_use)
+      {
+        detail::FreeManualMapImage(*process_, base);
+      }
+    };
+    auto ensure_free_image = detail::MakeScopeWarden(free_image);
+
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Image base is %p.", base);
+
+    if (auto const error = detail::RelocateManualMapImage(
+          image, headers, reinterpret_cast<std::uintptr_t>(base)))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{error});
+    }
+
+    auto const regions = detail::PlanManualMapCommit(image, headers);
+
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Writing %u regions.",
+                                   static_cast<unsigned>(regions.size()));
+
+    detail::CommitManualMapImage(*process_, base, image, regions);
+
+    detail::InitializeManualMapImage(
+      *process_, exports_.GetSnapshot(), base, image, headers, flags, &in_use);
+
+    ensure_free_image.Dismiss();
+
+    return static_cast<HMODULE>(base);
+  }
+
+private:
+  Process const* process_;
+  detail::RemoteExportCache exports_;
+};
+
+inline HMODULE ManualMapDll(Process const& process,
+                            std::wstring const& path,
+                            std::uint32_t flags)
+{
+  ManualMapper mapper{process};
+  return mapper.Map(path, flags);
+}
+}
@@ -4,19 +4,18 @@
 #pragma once
 
 #include <cstring>
-#include <functional>
 #include <ostream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <windows.h>
-#include <tlhelp32.h>
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/filesystem.hpp>
-#include <hadesmem/detail/smart_handle.hpp>
-#include <hadesmem/detail/toolhelp.hpp>
+#include <hadesmem/detail/module_enum.hpp>
+#include <hadesmem/detail/optional.hpp>
 #include <hadesmem/detail/to_upper_ordinal.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
@@ -59,65 +58,81 @@ public:
 
 private:
   template <typename ModuleT> friend class ModuleIterator;
-
-  using EntryCallback = std::function<bool(MODULEENTRY32W const&)>;
-
-  explicit Module(Process const& process, MODULEENTRY32W const& entry)
-    : process_(&process), handle_(nullptr), size_(0), name_(), path_()
+  friend class ModuleSnapshot;
+
+  explicit Module(Process const& process, detail::ModuleData&& data)
+    : process_(&process),
+      handle_(data.handle),
+      size_(data.size),
+      name_(std::move(data.name)),
+      path_(std::move(data.path))
   {
-    Initialize(entry);
   }
 
+  // Lookups stop at the first match, and don't read the names of modules
+  // which can't match. Code doing lots of lookups should use ModuleSnapshot.
   void Initialize(HMODULE handle)
   {
-    auto const handle_check = [&](MODULEENTRY32W const& entry) -> bool {
-      return (reinterpret_cast<HMODULE>(entry.modBaseAddr) == handle ||
-              !handle);
+    auto const handle_filter = [&](
+      detail::winternl::LDR_DATA_TABLE_ENTRY const& entry) -> bool {
+      return (entry.DllBase == handle || !handle);
+    };
+    auto const handle_check = [&](detail::ModuleData const& data) -> bool {
+      return (data.handle == handle || !handle);
     };
 
-    InitializeIf(handle_check);
+    InitializeIf(
+      detail::FindModuleData(*process_, handle_filter, handle_check));
   }
 
   void Initialize(std::wstring const& path)
   {
     bool const is_path = (path.find_first_of(L"\\/") != std::wstring::npos);
 
-    std::wstring const path_upper = detail::ToUpperOrdinal(path);
-
-    auto const path_check = [&](MODULEENTRY32W const& entry) -> bool {
-      return is_path ? (detail::ArePathsEquivalent(path, entry.szExePath))
-                     : (path_upper == detail::ToUpperOrdinal(entry.szModule));
+    // Try a cheap case-insensitive comparison first, then fall back to
+    // checking the file identity (which handles short names, links, etc.).
+    auto const name_filter = [&](
+      detail::winternl::LDR_DATA_TABLE_ENTRY const& entry) -> bool {
+      auto const& str = is_path ? entry.FullDllName : entry.BaseDllName;
+      return str.Length == path.size() * sizeof(wchar_t);
+    };
+    auto const name_check = [&](detail::ModuleData const& data) -> bool {
+      return detail::IsEqualOrdinalNoCase(is_path ? data.path : data.name,
+                                          path);
     };
 
-    InitializeIf(path_check);
-  }
-
-  void Initialize(MODULEENTRY32W const& entry)
-  {
-    handle_ = reinterpret_cast<HMODULE>(entry.modBaseAddr);
-    size_ = entry.modBaseSize;
-    name_ = entry.szModule;
-    path_ = entry.szExePath;
-  }
-
-  void InitializeIf(EntryCallback const& check_func)
-  {
-    detail::SmartSnapHandle const snap{detail::CreateToolhelp32Snapshot(
-      TH32CS_SNAPMODULE | TH32CS_SNAPMODULE32, process_->GetId())};
+    auto found = detail::FindModuleData(*process_, name_filter, name_check);
+    if (found || !is_path)
+    {
+      InitializeIf(std::move(found));
+      return;
+    }
 
-    hadesmem::detail::Optional<MODULEENTRY32W> entry;
-    for (entry = detail::Module32First(snap.GetHandle()); entry;
-         entry = detail::Module32Next(snap.GetHandle()))
+    std::vector<detail::ModuleData> modules = detail::GetModules(*process_);
+    for (auto& data : modules)
     {
-      if (check_func(*entry))
+      if (detail::ArePathsEquivalent(path, data.path))
       {
-        Initialize(*entry);
+        InitializeIf(detail::Optional<detail::ModuleData>{std::move(data)});
         return;
       }
     }
 
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                    << ErrorString{"Could not find module."});
+    InitializeIf({});
+  }
+
+  void InitializeIf(detail::Optional<detail::ModuleData>&& data)
+  {
+    if (!data)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Could not find module."});
+    }
+
+    handle_ = data->handle;
+    size_ = data->size;
+    name_ = std::move(data->name);
+    path_ = std::move(data->path);
   }
 
   Process const* process_;
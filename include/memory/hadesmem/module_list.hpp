@@ -3,18 +3,18 @@
 
 #pragma once
 
+#include <cstddef>
 #include <iterator>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include <windows.h>
-#include <tlhelp32.h>
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/module_enum.hpp>
 #include <hadesmem/detail/optional.hpp>
-#include <hadesmem/detail/smart_handle.hpp>
-#include <hadesmem/detail/toolhelp.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
 #include <hadesmem/process.hpp>
@@ -45,12 +45,11 @@ public:
 
     impl_->process_ = &process;
 
-    // CreateToolhelp32Snapshot can fail with ERROR_PARTIAL_COPY for 'zombie'
-    // processes.
+    // Both the loader list and Toolhelp can fail for 'zombie' processes
+    // (e.g. CreateToolhelp32Snapshot fails with ERROR_PARTIAL_COPY).
     try
     {
-      impl_->snap_ = detail::CreateToolhelp32Snapshot(
-        TH32CS_SNAPMODULE | TH32CS_SNAPMODULE32, impl_->process_->GetId());
+      impl_->modules_ = detail::GetModules(*impl_->process_);
     }
     catch (std::exception const&)
     {
@@ -58,15 +57,7 @@ public:
       return;
     }
 
-    hadesmem::detail::Optional<MODULEENTRY32> const entry =
-      detail::Module32First(impl_->snap_.GetHandle());
-    if (!entry)
-    {
-      impl_.reset();
-      return;
-    }
-
-    impl_->module_ = Module{*impl_->process_, *entry};
+    Advance();
   }
 
   explicit ModuleIterator(Process&& process) = delete;
@@ -87,15 +78,7 @@ public:
   {
     HADESMEM_DETAIL_ASSERT(impl_.get());
 
-    hadesmem::detail::Optional<MODULEENTRY32> const entry =
-      detail::Module32Next(impl_->snap_.GetHandle());
-    if (!entry)
-    {
-      impl_.reset();
-      return *this;
-    }
-
-    impl_->module_ = Module{*impl_->process_, *entry};
+    Advance();
 
     return *this;
   }
@@ -118,10 +101,23 @@ public:
   }
 
 private:
+  void Advance()
+  {
+    if (impl_->next_ == impl_->modules_.size())
+    {
+      impl_.reset();
+      return;
+    }
+
+    impl_->module_ =
+      Module{*impl_->process_, std::move(impl_->modules_[impl_->next_++])};
+  }
+
   struct Impl
   {
     Process const* process_{nullptr};
-    detail::SmartSnapHandle snap_{};
+    std::vector<detail::ModuleData> modules_;
+    std::size_t next_{};
     hadesmem::detail::Optional<Module> module_{};
   };
 
@@ -0,0 +1,335 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/module_enum.hpp>
+#include <hadesmem/detail/to_upper_ordinal.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/process.hpp>
+
+// Point in time list of modules with case-insensitive hash indexes over the
+// base names and full paths, for code which needs to look up lots of modules
+// by name (e.g. resolving imports). Lookups are O(1) and never allocate.
+// Unlike Module, a path lookup only matches the path the loader has on record
+// (ignoring case and the type of separator), not any equivalent path.
+
+namespace hadesmem
+{
+namespace detail
+{
+inline wchar_t FoldModuleNameChar(wchar_t c) noexcept
+{
+  return c == L'/' ? L'\\' : ToUpperOrdinal(c);
+}
+
+inline std::size_t HashModuleName(wchar_t const* str, std::size_t len) noexcept
+{
+  // FNV-1a.
+  std::uint32_t hash = 2166136261U;
+  for (std::size_t i = 0; i < len; ++i)
+  {
+    hash ^= static_cast<std::uint16_t>(FoldModuleNameChar(str[i]));
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+inline bool IsEqualModuleName(wchar_t const* lhs,
+                              std::size_t lhs_len,
+                              wchar_t const* rhs,
+                              std::size_t rhs_len) noexcept
+{
+  if (lhs_len != rhs_len)
+  {
+    return false;
+  }
+
+  for (std::size_t i = 0; i < lhs_len; ++i)
+  {
+    if (FoldModuleNameChar(lhs[i]) != FoldModuleNameChar(rhs[i]))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Open addressing (linear probing) index from a folded string to a position in
+// a list which owns the strings.
+class ModuleNameIndex
+{
+public:
+  static std::size_t const kInvalidIndex = static_cast<std::size_t>(-1);
+
+  template <typename GetKeyFn>
+  void Build(std::size_t count, GetKeyFn const& get_key)
+  {
+    std::size_t capacity = 16;
+    while (capacity < count * 2)
+    {
+      capacity *= 2;
+    }
+
+    slots_.assign(capacity, Slot{0, kInvalidIndex});
+    mask_ = capacity - 1;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      std::wstring const& key = get_key(i);
+      std::size_t const hash = HashModuleName(key.c_str(), key.size());
+      // The same module can be on record more than once (e.g. when a process
+      // has loaded two copies of a DLL from different paths, they share a base
+      // name). The first one in load order wins, as with the linear search.
+      if (Find(key.c_str(), key.size(), hash, get_key) == kInvalidIndex)
+      {
+        Insert(hash, i);
+      }
+    }
+  }
+
+  template <typename GetKeyFn>
+  std::size_t Find(wchar_t const* key,
+                   std::size_t len,
+                   GetKeyFn const& get_key) const noexcept
+  {
+    return Find(key, len, HashModuleName(key, len), get_key);
+  }
+
+private:
+  struct Slot
+  {
+    std::size_t hash;
+    std::size_t index;
+  };
+
+  template <typename GetKeyFn>
+  std::size_t Find(wchar_t const* key,
+                   std::size_t len,
+                   std::size_t hash,
+                   GetKeyFn const& get_key) const noexcept
+  {
+    if (slots_.empty())
+    {
+      return kInvalidIndex;
+    }
+
+    for (std::size_t i = hash & mask_;; i = (i + 1) & mask_)
+    {
+      Slot const& slot = slots_[i];
+      if (slot.index == kInvalidIndex)
+      {
+        return kInvalidIndex;
+      }
+
+      if (slot.hash == hash)
+      {
+        std::wstring const& cur = get_key(slot.index);
+        if (IsEqualModuleName(cur.c_str(), cur.size(), key, len))
+        {
+          return slot.index;
+        }
+      }
+    }
+  }
+
+  void Insert(std::size_t hash, std::size_t index)
+  {
+    std::size_t i = hash & mask_;
+    while (slots_[i].index != kInvalidIndex)
+    {
+      i = (i + 1) & mask_;
+    }
+    slots_[i] = Slot{hash, index};
+  }
+
+  std::vector<Slot> slots_;
+  std::size_t mask_{};
+};
+}
+
+class ModuleSnapshot
+{
+public:
+  using value_type = Module;
+  using iterator = std::vector<Module>::const_iterator;
+  using const_iterator = std::vector<Module>::const_iterator;
+
+  explicit ModuleSnapshot(Process const& process)
+  {
+    std::vector<detail::ModuleData> modules = detail::GetModules(process);
+    modules_.reserve(modules.size());
+    for (auto& data : modules)
+    {
+      modules_.emplace_back(Module{process, std::move(data)});
+    }
+
+    by_handle_.reserve(modules_.size());
+    for (std::size_t i = 0; i < modules_.size(); ++i)
+    {
+      by_handle_.push_back(i);
+    }
+    std::sort(std::begin(by_handle_),
+              std::end(by_handle_),
+              [this](std::size_t lhs, std::size_t rhs) {
+                return modules_[lhs].GetHandle() < modules_[rhs].GetHandle();
+              });
+
+    names_.Build(modules_.size(), GetNameFn{this});
+    paths_.Build(modules_.size(), GetPathFn{this});
+  }
+
+  explicit ModuleSnapshot(Process const&& process) = delete;
+
+  // Base name (e.g. L"kernel32.dll") or full path (anything containing a
+  // separator). Returns nullptr if the module is not in the snapshot.
+  Module const* Find(wchar_t const* name, std::size_t len) const noexcept
+  {
+    bool const is_path = std::find_if(name, name + len, [](wchar_t c) {
+                           return c == L'\\' || c == L'/';
+                         }) != name + len;
+    std::size_t const index =
+      is_path ? paths_.Find(name, len, GetPathFn{this})
+              : names_.Find(name, len, GetNameFn{this});
+    return index == detail::ModuleNameIndex::kInvalidIndex ? nullptr
+                                                            : &modules_[index];
+  }
+
+  Module const* Find(wchar_t const* name) const noexcept
+  {
+    return Find(name, std::wcslen(name));
+  }
+
+  Module const* Find(std::wstring const& name) const noexcept
+  {
+    return Find(name.c_str(), name.size());
+  }
+
+  Module const* Find(HMODULE handle) const noexcept
+  {
+    auto const iter = std::lower_bound(
+      std::begin(by_handle_),
+      std::end(by_handle_),
+      handle,
+      [this](std::size_t lhs, HMODULE rhs) {
+        return modules_[lhs].GetHandle() < rhs;
+      });
+    return (iter != std::end(by_handle_) &&
+            modules_[*iter].GetHandle() == handle)
+             ? &modules_[*iter]
+             : nullptr;
+  }
+
+  // Module whose image contains the given address, if any.
+  Module const* FindByAddress(void const* address) const noexcept
+  {
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+    auto const iter = std::upper_bound(
+      std::begin(by_handle_),
+      std::end(by_handle_),
+      address_num,
+      [this](std::uintptr_t lhs, std::size_t rhs) {
+        auto const base = modules_[rhs].GetHandle();
+        return lhs < reinterpret_cast<std::uintptr_t>(base);
+      });
+    if (iter == std::begin(by_handle_))
+    {
+      return nullptr;
+    }
+
+    Module const& module = modules_[*std::prev(iter)];
+    auto const base = reinterpret_cast<std::uintptr_t>(module.GetHandle());
+    return address_num - base < module.GetSize() ? &module : nullptr;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return modules_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return modules_.empty();
+  }
+
+  const_iterator begin() const noexcept
+  {
+    return modules_.begin();
+  }
+
+  const_iterator cbegin() const noexcept
+  {
+    return modules_.cbegin();
+  }
+
+  const_iterator end() const noexcept
+  {
+    return modules_.end();
+  }
+
+  const_iterator cend() const noexcept
+  {
+    return modules_.cend();
+  }
+
+private:
+  // The modules own the keys, so the indexes only need to store positions.
+  // Module::GetName/GetPath return by value, so go via the members directly.
+  struct GetNameFn
+  {
+    std::wstring const& operator()(std::size_t i) const noexcept
+    {
+      return snapshot->modules_[i].name_;
+    }
+
+    ModuleSnapshot const* snapshot;
+  };
+
+  struct GetPathFn
+  {
+    std::wstring const& operator()(std::size_t i) const noexcept
+    {
+      return snapshot->modules_[i].path_;
+    }
+
+    ModuleSnapshot const* snapshot;
+  };
+
+  std::vector<Module> modules_;
+  std::vector<std::size_t> by_handle_;
+  detail::ModuleNameIndex names_;
+  detail::ModuleNameIndex paths_;
+};
+
+namespace detail
+{
+// For lookups the caller can't do without (e.g. kernel32.dll when building a
+// call stub), with the same error as constructing a Module.
+inline Module const& GetSnapshotModule(ModuleSnapshot const& modules,
+                                       wchar_t const* name)
+{
+  Module const* const module = modules.Find(name);
+  if (!module)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Could not find module."});
+  }
+  return *module;
+}
+}
+}
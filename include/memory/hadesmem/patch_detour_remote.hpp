@@ -0,0 +1,478 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/patch_code_gen.hpp>
+#include <hadesmem/detail/patch_trampoline.hpp>
+#include <hadesmem/detail/patcher_aux.hpp>
+#include <hadesmem/detail/shared_section.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/flush.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+#include <hadesmem/thread_helpers.hpp>
+#include <hadesmem/write.hpp>
+
+// Detour for any process (including our own) which doesn't require any of our
+// code to be running in the target. The detour is either an address which is
+// already valid in the target (e.g. an export of a previously injected module)
+// or position independent code which is generated once its final address and
+// the address of the trampoline are known.
+
+// TODO: Support detour code larger than the page we allocate near the target.
+
+namespace hadesmem
+{
+// Hit counters living in a section shared with the target, so remote detours
+// can count calls and the counts can be polled locally without any IPC. One
+// page is shared by all the detours which use it. Counters are handed back by
+// the detours when they are destroyed, so they can be reused.
+class RemoteCounters
+{
+public:
+  explicit RemoteCounters(Process const& process, std::size_t size = 0x1000)
+    : section_{process, size}
+  {
+  }
+
+  explicit RemoteCounters(Process const&& process,
+                          std::size_t size = 0x1000) = delete;
+
+  std::size_t Allocate()
+  {
+    if (!free_.empty())
+    {
+      std::size_t const index = free_.back();
+      free_.pop_back();
+      return index;
+    }
+
+    if (next_ >= GetCapacity())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"No free remote counters."});
+    }
+
+    return next_++;
+  }
+
+  void Release(std::size_t index)
+  {
+    HADESMEM_DETAIL_ASSERT(index < next_);
+    free_.push_back(index);
+  }
+
+  std::size_t GetCapacity() const noexcept
+  {
+    return section_.GetSize() / sizeof(std::uint64_t);
+  }
+
+  void* GetRemoteAddress(std::size_t index) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(index < next_);
+    return static_cast<std::uint64_t*>(section_.GetRemoteBase()) + index;
+  }
+
+  // Counters are 64-bit on x64 and 32-bit (wrapping) on x86.
+  std::uint64_t Read(std::size_t index) const noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(index < next_);
+    auto const counters =
+      static_cast<std::uint64_t volatile*>(section_.GetLocalBase());
+    return counters[index];
+  }
+
+  void Reset(std::size_t index) noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(index < next_);
+    auto const counters =
+      static_cast<std::uint64_t volatile*>(section_.GetLocalBase());
+    counters[index] = 0;
+  }
+
+private:
+  detail::SharedSection section_;
+  std::size_t next_{};
+  std::vector<std::size_t> free_;
+};
+
+class PatchDetourRemote
+{
+public:
+  // Generates position independent detour code, given the address it will be
+  // written to and the address of the trampoline (used to call the original).
+  using DetourGenT =
+    std::function<std::vector<std::uint8_t>(void* address, void* trampoline)>;
+
+  explicit PatchDetourRemote(Process const& process,
+                             void* target,
+                             void* detour,
+                             RemoteCounters* counters = nullptr)
+    : process_{process}, target_{target}, detour_{detour}, counters_{counters}
+  {
+    HADESMEM_DETAIL_ASSERT(target_ != nullptr);
+    HADESMEM_DETAIL_ASSERT(detour_ != nullptr);
+
+    Initialize();
+  }
+
+  explicit PatchDetourRemote(Process const& process,
+                             void* target,
+                             DetourGenT const& detour_gen,
+                             RemoteCounters* counters = nullptr)
+    : process_{process},
+      target_{target},
+      detour_gen_{detour_gen},
+      counters_{counters}
+  {
+    HADESMEM_DETAIL_ASSERT(target_ != nullptr);
+    HADESMEM_DETAIL_ASSERT(detour_gen_);
+
+    Initialize();
+  }
+
+  explicit PatchDetourRemote(Process const&& process,
+                             void* target,
+                             void* detour,
+                             RemoteCounters* counters = nullptr) = delete;
+
+  explicit PatchDetourRemote(Process const&& process,
+                             void* target,
+                             DetourGenT const& detour_gen,
+                             RemoteCounters* counters = nullptr) = delete;
+
+  PatchDetourRemote(PatchDetourRemote const& other) = delete;
+
+  PatchDetourRemote& operator=(PatchDetourRemote const& other) = delete;
+
+  PatchDetourRemote(PatchDetourRemote&& other)
+    : process_{std::move(other.process_)},
+      applied_{other.applied_},
+      detached_{other.detached_},
+      target_{other.target_},
+      detour_{other.detour_},
+      detour_gen_{std::move(other.detour_gen_)},
+      counters_{other.counters_},
+      counter_index_{other.counter_index_},
+      page_{std::move(other.page_)},
+      trampoline_{other.trampoline_},
+      trampoline_size_{other.trampoline_size_},
+      orig_(std::move(other.orig_)),
+      trampolines_(std::move(other.trampolines_))
+  {
+    other.applied_ = false;
+    other.target_ = nullptr;
+    other.counters_ = nullptr;
+    other.trampoline_ = nullptr;
+    other.trampoline_size_ = 0;
+  }
+
+  PatchDetourRemote& operator=(PatchDetourRemote&& other)
+  {
+    RemoveUnchecked();
+
+    ReleaseCounter();
+
+    process_ = std::move(other.process_);
+
+    applied_ = other.applied_;
+    other.applied_ = false;
+
+    detached_ = other.detached_;
+
+    target_ = other.target_;
+    other.target_ = nullptr;
+
+    detour_ = other.detour_;
+
+    detour_gen_ = std::move(other.detour_gen_);
+
+    counters_ = other.counters_;
+    other.counters_ = nullptr;
+
+    counter_index_ = other.counter_index_;
+
+    page_ = std::move(other.page_);
+
+    trampoline_ = other.trampoline_;
+    other.trampoline_ = nullptr;
+
+    trampoline_size_ = other.trampoline_size_;
+    other.trampoline_size_ = 0;
+
+    orig_ = std::move(other.orig_);
+
+    trampolines_ = std::move(other.trampolines_);
+
+    return *this;
+  }
+
+  ~PatchDetourRemote()
+  {
+    RemoveUnchecked();
+
+    ReleaseCounter();
+  }
+
+  void Apply()
+  {
+    if (applied_)
+    {
+      return;
+    }
+
+    if (detached_)
+    {
+      HADESMEM_DETAIL_ASSERT(false);
+      return;
+    }
+
+    // Free the previous code here rather than in Remove. See PatchDetour.
+    trampoline_ = nullptr;
+    trampoline_size_ = 0;
+    trampolines_.clear();
+    page_ = nullptr;
+
+    page_ = detail::AllocatePageNear(process_, target_);
+
+    // Stub (counter and jump to the detour), trampoline and generated detour
+    // code all share the page near the target, and are committed with a
+    // single write.
+    std::size_t const kCodeSize = 0x1000;
+    HADESMEM_DETAIL_ASSERT(page_->GetSize() >= kCodeSize);
+    detail::CodeBuffer<kCodeSize> code{page_->GetBase()};
+
+    if (counters_)
+    {
+      detail::EmitCounterInc(code,
+                             counters_->GetRemoteAddress(counter_index_));
+    }
+
+    // We don't know where generated detour code will end up until the
+    // trampoline has been built, so jump over the trampoline to it.
+    std::size_t const detour_jump_ofs = code.GetSize();
+    std::size_t const kMaxDetourJumpSize =
+      detail::PatchConstants::kMaxJumpSize;
+    if (!detour_gen_)
+    {
+      detail::EmitJump(code, detour_);
+    }
+    else
+    {
+      std::memset(
+        code.Reserve(kMaxDetourJumpSize), 0xCC, kMaxDetourJumpSize);
+    }
+
+    code.Align(16);
+    trampoline_ = code.GetCursor();
+
+    std::size_t const patch_size = GetPatchSize();
+
+    std::size_t const instr_size =
+      detail::EmitTrampoline(process_, target_, patch_size, code);
+
+    trampoline_size_ = static_cast<std::size_t>(
+      static_cast<std::uint8_t*>(code.GetCursor()) -
+      static_cast<std::uint8_t*>(trampoline_));
+
+    if (detour_gen_)
+    {
+      code.Align(16);
+      void* const detour_code = code.GetCursor();
+      auto const detour_buf = detour_gen_(detour_code, trampoline_);
+      if (detour_buf.empty())
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Detour code generator returned no code."});
+      }
+      code.Emit(detour_buf.data(), detour_buf.size());
+
+      // Patch the placeholder jump now that we know where it's going. The
+      // detour code is within the same page, so this is always a rel32 jump.
+      void* const detour_jump =
+        static_cast<std::uint8_t*>(code.GetAddress()) + detour_jump_ofs;
+      HADESMEM_DETAIL_ASSERT(detail::IsNear(detour_jump, detour_code));
+      detail::GenJmp32(code.At(detour_jump_ofs), detour_jump, detour_code);
+
+      detour_ = detour_code;
+    }
+
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Target = %p, Detour = %p, Stub = %p, Trampoline = %p.",
+      target_,
+      detour_,
+      page_->GetBase(),
+      trampoline_);
+
+    detail::WriteCode(process_, code);
+
+    SuspendedProcess const suspended_process{process_};
+
+    orig_ = ReadVector<std::uint8_t>(process_, target_, patch_size);
+
+    detail::VerifyPatchThreads(process_.GetId(), target_, orig_.size());
+
+    detail::WriteJump(
+      process_, target_, page_->GetBase(), false, &trampolines_);
+
+    FlushInstructionCache(process_, target_, instr_size);
+
+    applied_ = true;
+  }
+
+  void Remove()
+  {
+    if (!applied_)
+    {
+      return;
+    }
+
+    SuspendedProcess const suspended_process{process_};
+
+    detail::VerifyPatchThreads(process_.GetId(), target_, orig_.size());
+    detail::VerifyPatchThreads(process_.GetId(), trampoline_, trampoline_size_);
+
+    WriteVector(process_, target_, orig_);
+
+    FlushInstructionCache(process_, target_, orig_.size());
+
+    // Don't free the trampoline here. Do it in Apply/destructor. See
+    // PatchDetour for the rationale.
+
+    applied_ = false;
+  }
+
+  void RemoveUnchecked() noexcept
+  {
+    try
+    {
+      Remove();
+    }
+    catch (...)
+    {
+      // WARNING: Patch may not be removed if Remove fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+
+      applied_ = false;
+
+      target_ = nullptr;
+
+      trampoline_ = nullptr;
+      trampoline_size_ = 0;
+      orig_.clear();
+      trampolines_.clear();
+    }
+  }
+
+  void Detach() noexcept
+  {
+    applied_ = false;
+
+    detached_ = true;
+  }
+
+  bool IsApplied() const noexcept
+  {
+    return applied_;
+  }
+
+  void* GetTarget() const noexcept
+  {
+    return target_;
+  }
+
+  // Only valid for generated detours once the patch has been applied.
+  void* GetDetour() const noexcept
+  {
+    return detour_;
+  }
+
+  void* GetTrampoline() const noexcept
+  {
+    return trampoline_;
+  }
+
+  std::uint64_t GetHitCount() const noexcept
+  {
+    return counters_ ? counters_->Read(counter_index_) : 0;
+  }
+
+  void ResetHitCount() noexcept
+  {
+    if (counters_)
+    {
+      counters_->Reset(counter_index_);
+    }
+  }
+
+private:
+  void Initialize()
+  {
+    if (counters_)
+    {
+      counter_index_ = counters_->Allocate();
+      counters_->Reset(counter_index_);
+    }
+  }
+
+  void ReleaseCounter() noexcept
+  {
+    // A detached patch is left in place, so its stub may still be bumping the
+    // counter.
+    if (counters_ && !detached_)
+    {
+      try
+      {
+        counters_->Release(counter_index_);
+      }
+      catch (...)
+      {
+        // WARNING: Counter is leaked if Release fails.
+        HADESMEM_DETAIL_TRACE_A(
+          boost::current_exception_diagnostic_information().c_str());
+        HADESMEM_DETAIL_ASSERT(false);
+      }
+    }
+
+    counters_ = nullptr;
+  }
+
+  std::size_t GetPatchSize() const
+  {
+    bool const stub_near = detail::IsNear(target_, page_->GetBase());
+    HADESMEM_DETAIL_TRACE_A(stub_near ? "Stub near." : "Stub far.");
+    return stub_near ? detail::PatchConstants::kJmpSize32
+                     : detail::PatchConstants::kJmpSize64;
+  }
+
+  Process process_;
+  bool applied_{false};
+  bool detached_{false};
+  void* target_{};
+  void* detour_{};
+  DetourGenT detour_gen_;
+  RemoteCounters* counters_{};
+  std::size_t counter_index_{};
+  std::unique_ptr<Allocator> page_{};
+  void* trampoline_{};
+  std::size_t trampoline_size_{};
+  std::vector<std::uint8_t> orig_{};
+  std::vector<std::unique_ptr<Allocator>> trampolines_{};
+};
+}
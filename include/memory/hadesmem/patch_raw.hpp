@@ -92,7 +92,7 @@ public:
       return;
     }
 
-    SuspendedProcess const suspended_process{process_.GetId()};
+    SuspendedProcess const suspended_process{process_};
 
     detail::VerifyPatchThreads(process_.GetId(), target_, data_.size());
 
@@ -112,7 +112,7 @@ public:
       return;
     }
 
-    SuspendedProcess const suspended_process{process_.GetId()};
+    SuspendedProcess const suspended_process{process_};
 
     detail::VerifyPatchThreads(process_.GetId(), target_, data_.size());
 
@@ -5,10 +5,13 @@
 
 #include <hadesmem/local/patch_detour.hpp>
 #include <hadesmem/local/patch_detour_base.hpp>
+#include <hadesmem/local/patch_detour_chain.hpp>
 #include <hadesmem/local/patch_dr.hpp>
 #include <hadesmem/local/patch_func_ptr.hpp>
 #include <hadesmem/local/patch_iat.hpp>
 #include <hadesmem/local/patch_int3.hpp>
+#include <hadesmem/local/patch_page.hpp>
 #include <hadesmem/local/patch_veh.hpp>
 #include <hadesmem/local/patch_vmt.hpp>
+#include <hadesmem/patch_detour_remote.hpp>
 #include <hadesmem/patch_raw.hpp>
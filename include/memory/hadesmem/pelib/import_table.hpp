@@ -0,0 +1,578 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/import_name_pool.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/import_dir.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/pelib/section.hpp>
+#include <hadesmem/pelib/section_list.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+// Random access view of the import directory. ImportDirList and
+// ImportThunkList do a read (and usually an RvaToVa) per descriptor and per
+// thunk, and a string read per name, which is a lot of round trips when all
+// that's wanted is a count or a single import. This reads the descriptor
+// array and each ILT/IAT in bulk up front, and every name from one read of
+// the region which holds them (see detail/import_name_pool.hpp). Names are
+// only decoded when asked for.
+//
+// Descriptors are walked with the same rules as ImportDirList (stop at the
+// first entry without a Name or FirstThunk, or at the end of the data), and
+// thunks with the same rules as the loader (names come from the ILT if
+// there's a valid one, otherwise from the IAT). The table is a snapshot, so
+// anything written after it's built (e.g. by binding) isn't seen.
+
+namespace hadesmem
+{
+struct ImportTableEntry
+{
+  std::size_t module;
+  std::size_t thunk;
+};
+
+class ImportTable
+{
+public:
+  static std::size_t const kNotFound = static_cast<std::size_t>(-1);
+
+  explicit ImportTable(Process const& process, PeFile const& pe_file)
+    : process_{&process}, pe_file_{&pe_file}
+  {
+    ReadDescriptors();
+
+    std::vector<std::uint32_t> name_rvas;
+    for (auto& m : modules_)
+    {
+      ReadThunks(m);
+
+      name_rvas.push_back(m.desc.Name);
+      if (m.has_names)
+      {
+        for (auto const thunk : m.ilt)
+        {
+          auto const data = detail::DecodeImportThunk(thunk, pe_file.Is64());
+          if (!data.by_ordinal)
+          {
+            name_rvas.push_back(data.name_rva);
+          }
+        }
+      }
+    }
+
+    ReadNamePool(name_rvas);
+  }
+
+  explicit ImportTable(Process const&& process, PeFile const& pe_file) = delete;
+
+  explicit ImportTable(Process const& process, PeFile&& pe_file) = delete;
+
+  explicit ImportTable(Process const&& process, PeFile&& pe_file) = delete;
+
+  std::size_t GetNumModules() const noexcept
+  {
+    return modules_.size();
+  }
+
+  DWORD GetOriginalFirstThunk(std::size_t module) const
+  {
+    return GetModule(module).desc.OriginalFirstThunk;
+  }
+
+  DWORD GetTimeDateStamp(std::size_t module) const
+  {
+    return GetModule(module).desc.TimeDateStamp;
+  }
+
+  DWORD GetForwarderChain(std::size_t module) const
+  {
+    return GetModule(module).desc.ForwarderChain;
+  }
+
+  DWORD GetNameRaw(std::size_t module) const
+  {
+    return GetModule(module).desc.Name;
+  }
+
+  DWORD GetFirstThunk(std::size_t module) const
+  {
+    return GetModule(module).desc.FirstThunk;
+  }
+
+  std::string GetModuleName(std::size_t module) const
+  {
+    return ReadName(GetModule(module).desc.Name);
+  }
+
+  // The number of entries in the ILT (or the IAT, if there's no valid ILT).
+  std::size_t GetNumThunks(std::size_t module) const
+  {
+    return GetModule(module).ilt.size();
+  }
+
+  // False if names can't be recovered (a mapped image without an ILT, where
+  // the IAT has already been overwritten by the loader).
+  bool HasNames(std::size_t module) const
+  {
+    return GetModule(module).has_names;
+  }
+
+  ULONGLONG GetOrdinalRaw(std::size_t module, std::size_t thunk) const
+  {
+    auto const& m = GetModule(module);
+    HADESMEM_DETAIL_ASSERT(thunk < m.ilt.size());
+    return m.ilt[thunk];
+  }
+
+  bool ByOrdinal(std::size_t module, std::size_t thunk) const
+  {
+    return Decode(module, thunk).by_ordinal;
+  }
+
+  WORD GetOrdinal(std::size_t module, std::size_t thunk) const
+  {
+    return Decode(module, thunk).ordinal;
+  }
+
+  WORD GetHint(std::size_t module, std::size_t thunk) const
+  {
+    auto const name_rva = GetNameRva(module, thunk);
+    std::uint16_t hint = 0;
+    if (pool_.GetHint(name_rva, &hint))
+    {
+      return hint;
+    }
+
+    auto const name_import =
+      static_cast<std::uint8_t*>(RvaToVa(*process_, *pe_file_, name_rva));
+    if (!name_import)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid import name and hint."});
+    }
+    return Read<WORD>(*process_,
+                      name_import + offsetof(IMAGE_IMPORT_BY_NAME, Hint));
+  }
+
+  std::string GetName(std::size_t module, std::size_t thunk) const
+  {
+    return ReadName(static_cast<DWORD>(GetNameRva(module, thunk) +
+                                       offsetof(IMAGE_IMPORT_BY_NAME, Name)));
+  }
+
+  // The IAT entry. Only as many are read as there are entries in the ILT.
+  ULONGLONG GetFunction(std::size_t module, std::size_t thunk) const
+  {
+    auto const& m = GetModule(module);
+    if (thunk >= m.iat.size())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Invalid IAT entry."});
+    }
+    return m.iat[thunk];
+  }
+
+  // Address of the IAT entry, for patching.
+  ULONGLONG* GetFunctionPtr(std::size_t module, std::size_t thunk) const
+  {
+    auto const& m = GetModule(module);
+    if (thunk >= m.iat.size())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Invalid IAT entry."});
+    }
+    return reinterpret_cast<ULONGLONG*>(m.iat_va + thunk * GetThunkSize());
+  }
+
+  // Case insensitive, like the loader. kNotFound if there's no such module.
+  std::size_t FindModule(std::string const& module) const
+  {
+    for (std::size_t i = 0; i < modules_.size(); ++i)
+    {
+      if (IsNameEqual(modules_[i].desc.Name, module, true))
+      {
+        return i;
+      }
+    }
+
+    return kNotFound;
+  }
+
+  // Names are compared in place, so nothing is decoded for the imports which
+  // don't match. The module is kNotFound if there's no such import.
+  ImportTableEntry FindImport(std::string const& module,
+                              std::string const& name) const
+  {
+    for (std::size_t i = 0; i < modules_.size(); ++i)
+    {
+      auto const& m = modules_[i];
+      if (!m.has_names || !IsNameEqual(m.desc.Name, module, true))
+      {
+        continue;
+      }
+
+      for (std::size_t j = 0; j < m.ilt.size(); ++j)
+      {
+        auto const data = detail::DecodeImportThunk(m.ilt[j], pe_file_->Is64());
+        if (data.by_ordinal)
+        {
+          continue;
+        }
+
+        auto const name_rva = static_cast<DWORD>(
+          data.name_rva + offsetof(IMAGE_IMPORT_BY_NAME, Name));
+        if (IsNameEqual(name_rva, name, false))
+        {
+          return ImportTableEntry{i, j};
+        }
+      }
+    }
+
+    return ImportTableEntry{kNotFound, kNotFound};
+  }
+
+  ImportTableEntry FindImport(std::string const& module, WORD ordinal) const
+  {
+    for (std::size_t i = 0; i < modules_.size(); ++i)
+    {
+      auto const& m = modules_[i];
+      if (!m.has_names || !IsNameEqual(m.desc.Name, module, true))
+      {
+        continue;
+      }
+
+      for (std::size_t j = 0; j < m.ilt.size(); ++j)
+      {
+        auto const data = detail::DecodeImportThunk(m.ilt[j], pe_file_->Is64());
+        if (data.by_ordinal && data.ordinal == ordinal)
+        {
+          return ImportTableEntry{i, j};
+        }
+      }
+    }
+
+    return ImportTableEntry{kNotFound, kNotFound};
+  }
+
+private:
+  struct ModuleData
+  {
+    IMAGE_IMPORT_DESCRIPTOR desc;
+    std::uint8_t* iat_va;
+    // Where the names come from (a copy of the IAT if there's no valid ILT).
+    std::vector<ULONGLONG> ilt;
+    std::vector<ULONGLONG> iat;
+    bool has_names;
+  };
+
+  std::size_t GetThunkSize() const noexcept
+  {
+    return pe_file_->Is64() ? sizeof(IMAGE_THUNK_DATA64)
+                            : sizeof(IMAGE_THUNK_DATA32);
+  }
+
+  ModuleData const& GetModule(std::size_t module) const
+  {
+    HADESMEM_DETAIL_ASSERT(module < modules_.size());
+    return modules_[module];
+  }
+
+  detail::ImportThunkData Decode(std::size_t module, std::size_t thunk) const
+  {
+    return detail::DecodeImportThunk(GetOrdinalRaw(module, thunk),
+                                     pe_file_->Is64());
+  }
+
+  std::uint32_t GetNameRva(std::size_t module, std::size_t thunk) const
+  {
+    if (!HasNames(module))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Import names are unavailable."});
+    }
+
+    auto const data = Decode(module, thunk);
+    if (data.by_ordinal)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Import is by ordinal."});
+    }
+    return data.name_rva;
+  }
+
+  // Bytes which can be read starting at the address without leaving the file
+  // (or image).
+  std::size_t GetAvailable(void const* address) const noexcept
+  {
+    auto const base = static_cast<std::uint8_t const*>(pe_file_->GetBase());
+    auto const p = static_cast<std::uint8_t const*>(address);
+    if (p < base || p >= base + pe_file_->GetSize())
+    {
+      return 0;
+    }
+    return static_cast<std::size_t>(base + pe_file_->GetSize() - p);
+  }
+
+  void ReadDescriptors()
+  {
+    std::uint8_t* base = nullptr;
+    try
+    {
+      // Handles finding the directory (including the overlapped descriptor
+      // trick), so the walk starts in the same place as ImportDirList.
+      ImportDir const first{*process_, *pe_file_, nullptr};
+      base = static_cast<std::uint8_t*>(first.GetBase());
+    }
+    catch (std::exception const& /*e*/)
+    {
+      return;
+    }
+
+    std::size_t const kChunkSize = 0x40;
+    for (;;)
+    {
+      std::size_t const count =
+        (std::min)(kChunkSize,
+                   GetAvailable(base) / sizeof(IMAGE_IMPORT_DESCRIPTOR));
+      if (!count)
+      {
+        return;
+      }
+
+      std::vector<IMAGE_IMPORT_DESCRIPTOR> descs;
+      try
+      {
+        descs = ReadVector<IMAGE_IMPORT_DESCRIPTOR>(*process_, base, count);
+      }
+      catch (std::exception const& /*e*/)
+      {
+        return;
+      }
+
+      for (auto const& desc : descs)
+      {
+        if (!desc.Name || !desc.FirstThunk)
+        {
+          return;
+        }
+
+        ModuleData m{};
+        m.desc = desc;
+        modules_.push_back(m);
+      }
+
+      base += count * sizeof(IMAGE_IMPORT_DESCRIPTOR);
+    }
+  }
+
+  // Reads up to the terminator or the end of the data, whichever is first.
+  // At most max_count thunks if it's not zero (and then no terminator is
+  // needed).
+  std::vector<ULONGLONG> ReadThunkArray(std::uint8_t* va,
+                                        std::size_t max_count) const
+  {
+    // Enough for most modules to be done in a single read.
+    std::size_t const kChunkSize = 0x400;
+    std::vector<std::uint64_t> thunks;
+    std::size_t const thunk_size = GetThunkSize();
+    for (;;)
+    {
+      std::size_t count =
+        (std::min)(kChunkSize, GetAvailable(va) / thunk_size);
+      if (max_count)
+      {
+        count = (std::min)(count, max_count - thunks.size());
+      }
+      if (!count)
+      {
+        break;
+      }
+
+      std::vector<std::uint8_t> buf;
+      try
+      {
+        buf = ReadVector<std::uint8_t>(*process_, va, count * thunk_size);
+      }
+      catch (std::exception const& /*e*/)
+      {
+        break;
+      }
+
+      if (max_count)
+      {
+        // Taken as is, including any nulls.
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          thunks.push_back(detail::GetImportThunkValue(&buf[i * thunk_size],
+                                                       pe_file_->Is64()));
+        }
+      }
+      else if (detail::AppendImportThunks(
+                 buf.data(), buf.size(), pe_file_->Is64(), thunks))
+      {
+        break;
+      }
+
+      va += count * thunk_size;
+    }
+
+    return std::vector<ULONGLONG>(std::begin(thunks), std::end(thunks));
+  }
+
+  std::uint8_t* ThunkRvaToVa(DWORD rva) const
+  {
+    try
+    {
+      return static_cast<std::uint8_t*>(RvaToVa(*process_, *pe_file_, rva));
+    }
+    catch (std::exception const& /*e*/)
+    {
+      return nullptr;
+    }
+  }
+
+  void ReadThunks(ModuleData& m) const
+  {
+    DWORD const ilt = m.desc.OriginalFirstThunk;
+    DWORD const iat = m.desc.FirstThunk;
+    m.iat_va = ThunkRvaToVa(iat);
+
+    // Windows falls back to the IAT if the ILT is missing or invalid.
+    if (ilt && ilt != iat)
+    {
+      if (auto const ilt_va = ThunkRvaToVa(ilt))
+      {
+        m.ilt = ReadThunkArray(ilt_va, 0);
+        m.has_names = !m.ilt.empty();
+      }
+    }
+
+    if (!m.has_names)
+    {
+      m.ilt = m.iat_va ? ReadThunkArray(m.iat_va, 0) : std::vector<ULONGLONG>{};
+      m.iat = m.ilt;
+      // Once an image is mapped the IAT holds addresses instead.
+      m.has_names = pe_file_->GetType() == PeFileType::kData;
+      return;
+    }
+
+    if (m.iat_va)
+    {
+      m.iat = ReadThunkArray(m.iat_va, m.ilt.size());
+    }
+  }
+
+  std::vector<detail::ImportNameSpan> GetNameSpans() const
+  {
+    std::vector<detail::ImportNameSpan> spans;
+    if (pe_file_->GetType() == PeFileType::kImage)
+    {
+      spans.push_back(detail::ImportNameSpan{0, pe_file_->GetSize()});
+      return spans;
+    }
+
+    try
+    {
+      SectionList const sections{*process_, *pe_file_};
+      for (auto const& s : sections)
+      {
+        DWORD const virtual_size =
+          s.GetVirtualSize() ? s.GetVirtualSize() : s.GetSizeOfRawData();
+        DWORD const size = (std::min)(virtual_size, s.GetSizeOfRawData());
+        spans.push_back(detail::ImportNameSpan{
+          s.GetVirtualAddress(), s.GetVirtualAddress() + size});
+      }
+    }
+    catch (std::exception const& /*e*/)
+    {
+    }
+
+    return spans;
+  }
+
+  void ReadNamePool(std::vector<std::uint32_t> const& rvas)
+  {
+    auto const region = detail::GetImportNameRegion(rvas, GetNameSpans());
+    if (region.first == region.second)
+    {
+      return;
+    }
+
+    // Anything which goes wrong here just means every name is read on its
+    // own instead.
+    try
+    {
+      auto const va = RvaToVa(*process_, *pe_file_, region.first);
+      std::size_t const size = (std::min)(
+        static_cast<std::size_t>(region.second - region.first),
+        GetAvailable(va));
+      if (va && size)
+      {
+        pool_ = detail::ImportNamePool{
+          region.first, ReadVector<std::uint8_t>(*process_, va, size)};
+      }
+    }
+    catch (std::exception const& /*e*/)
+    {
+    }
+  }
+
+  std::string ReadName(DWORD rva) const
+  {
+    std::string name;
+    if (pool_.GetString(rva, &name))
+    {
+      return name;
+    }
+
+    auto const va = RvaToVa(*process_, *pe_file_, rva);
+    if (!va)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Invalid import name."});
+    }
+    return detail::CheckedReadString<char>(*process_, *pe_file_, va);
+  }
+
+  // A name which can't be read doesn't match anything.
+  bool IsNameEqual(DWORD rva, std::string const& name, bool no_case) const
+  {
+    std::size_t len = 0;
+    if (char const* const s = pool_.GetString(rva, &len))
+    {
+      return detail::IsEqualImportName(
+        s, len, name.data(), name.size(), no_case);
+    }
+
+    try
+    {
+      auto const other = ReadName(rva);
+      return detail::IsEqualImportName(
+        other.data(), other.size(), name.data(), name.size(), no_case);
+    }
+    catch (std::exception const& /*e*/)
+    {
+      return false;
+    }
+  }
+
+  Process const* process_;
+  PeFile const* pe_file_;
+  std::vector<ModuleData> modules_;
+  detail::ImportNamePool pool_;
+};
+}
@@ -0,0 +1,128 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/base_relocations.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+// Random access view of the relocation directory. RelocationBlockList and
+// RelocationList do a read per block and per entry, which is fine for
+// display but far too slow for anything which actually applies the
+// relocations. This reads the whole directory in one go and decodes it into
+// a flat array of (type, offset) pairs (see detail/base_relocations.hpp).
+//
+// Blocks are walked with the same rules as RelocationBlockList. The table is
+// a snapshot, so anything written after it's built isn't seen.
+
+namespace hadesmem
+{
+class RelocationTable
+{
+public:
+  explicit RelocationTable(Process const& process, PeFile const& pe_file)
+  {
+    NtHeaders const nt_headers{process, pe_file};
+    DWORD const data_dir_va =
+      nt_headers.GetDataDirectoryVirtualAddress(PeDataDir::BaseReloc);
+    DWORD const size = nt_headers.GetDataDirectorySize(PeDataDir::BaseReloc);
+    if (!data_dir_va || !size)
+    {
+      return;
+    }
+
+    auto const base =
+      static_cast<std::uint8_t*>(RvaToVa(process, pe_file, data_dir_va));
+    if (!base)
+    {
+      return;
+    }
+
+    // Only what's actually in the file (or image) is read. Anything past
+    // that shows up as a truncated table.
+    auto const file_beg = static_cast<std::uint8_t*>(pe_file.GetBase());
+    auto const file_end = file_beg + pe_file.GetSize();
+    if (base < file_beg || base >= file_end)
+    {
+      return;
+    }
+    std::size_t const available = static_cast<std::size_t>(file_end - base);
+
+    std::vector<std::uint8_t> const data = ReadVector<std::uint8_t>(
+      process, base, (std::min)(static_cast<std::size_t>(size), available));
+    relocs_ = detail::BaseRelocations{data.data(), data.size()};
+    truncated_ = relocs_.IsTruncated() || size > available;
+  }
+
+  explicit RelocationTable(Process const&& process,
+                           PeFile const& pe_file) = delete;
+
+  explicit RelocationTable(Process const& process, PeFile&& pe_file) = delete;
+
+  explicit RelocationTable(Process const&& process,
+                           PeFile&& pe_file) = delete;
+
+  std::size_t GetNumBlocks() const noexcept
+  {
+    return relocs_.GetNumBlocks();
+  }
+
+  DWORD GetVirtualAddress(std::size_t block) const noexcept
+  {
+    return relocs_.GetBlock(block).virtual_address;
+  }
+
+  DWORD GetSizeOfBlock(std::size_t block) const noexcept
+  {
+    return relocs_.GetBlock(block).size_of_block;
+  }
+
+  detail::RelocationSpan GetEntries(std::size_t block) const noexcept
+  {
+    return relocs_.GetEntries(block);
+  }
+
+  std::size_t GetNumEntries() const noexcept
+  {
+    return relocs_.GetNumEntries();
+  }
+
+  detail::RelocationSpan GetAllEntries() const noexcept
+  {
+    return relocs_.GetAllEntries();
+  }
+
+  bool IsTruncated() const noexcept
+  {
+    return truncated_;
+  }
+
+  // Applies every fixup to a local copy of the image (in its mapped layout).
+  detail::RelocationApplyResult ApplyRelocations(std::uint8_t* image,
+                                                 std::size_t image_size,
+                                                 std::uint64_t delta) const
+    noexcept
+  {
+    HADESMEM_DETAIL_ASSERT(image != nullptr || !image_size);
+    return detail::ApplyRelocations(image, image_size, relocs_, delta);
+  }
+
+private:
+  detail::BaseRelocations relocs_;
+  bool truncated_{};
+};
+}
@@ -0,0 +1,492 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/snapshot_store.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/detail/type_traits.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
+// Copy of every committed readable region of a process, taken in one pass so
+// that scanners, dumpers etc. get a consistent view no matter how many reads
+// they do (and don't pay for a ReadProcessMemory call on each one). Reads are
+// served from the copy using the same Read/ReadVector/ReadString interface as
+// for a live process.
+//
+// By default the target keeps running while it's being copied, so regions
+// copied later may be 'newer' than those copied earlier. kClone captures a
+// copy-on-write clone of the address space with PssCaptureSnapshot (Windows
+// 8.1+) and copies from that instead, so the snapshot is a true point in
+// time view and the target is only paused for as long as the clone takes.
+//
+// kSpillToFile keeps the contents in a temporary file mapping instead of on
+// the heap, so large snapshots are backed by the file system rather than the
+// page file.
+//
+// Two snapshots can be diffed at page granularity. Each page is hashed once
+// when the snapshot is taken, so diffing is cheap and doesn't touch the
+// contents.
+
+// TODO: Support process reflection (RtlCreateProcessReflection) for
+// kClone on Windows 7 and 8.
+
+// TODO: Copy regions in parallel.
+
+// TODO: Support a subset of the address space (e.g. a RegionFilter).
+
+namespace hadesmem
+{
+struct ProcessSnapshotFlags
+{
+  enum : std::uint32_t
+  {
+    kNone = 0,
+    kClone = 1 << 0,
+    kSpillToFile = 1 << 1,
+    kInvalidFlagMaxValue = 1 << 2
+  };
+};
+
+using ProcessSnapshotDiff = detail::SnapshotDiff;
+
+namespace detail
+{
+// Defined here rather than pulling in processsnapshot.h, which isn't
+// available when targetting older versions of Windows.
+DWORD const kPssCaptureVaClone = 0x00000001;
+int const kPssQueryVaCloneInformation = 1;
+
+using PssCaptureSnapshotFn = DWORD(WINAPI*)(HANDLE process_handle,
+                                            DWORD capture_flags,
+                                            DWORD thread_context_flags,
+                                            HANDLE* snapshot_handle);
+using PssQuerySnapshotFn = DWORD(WINAPI*)(HANDLE snapshot_handle,
+                                          int information_class,
+                                          void* buffer,
+                                          DWORD buffer_length);
+using PssFreeSnapshotFn = DWORD(WINAPI*)(HANDLE process_handle,
+                                         HANDLE snapshot_handle);
+
+class PssVaClone
+{
+public:
+  explicit PssVaClone(HANDLE process_handle)
+  {
+    HMODULE const kernel32 = ::GetModuleHandleW(L"kernel32.dll");
+    if (!kernel32)
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"GetModuleHandleW failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    auto const pss_capture_snapshot = reinterpret_cast<PssCaptureSnapshotFn>(
+      ::GetProcAddress(kernel32, "PssCaptureSnapshot"));
+    auto const pss_query_snapshot = reinterpret_cast<PssQuerySnapshotFn>(
+      ::GetProcAddress(kernel32, "PssQuerySnapshot"));
+    pss_free_snapshot_ = reinterpret_cast<PssFreeSnapshotFn>(
+      ::GetProcAddress(kernel32, "PssFreeSnapshot"));
+    if (!pss_capture_snapshot || !pss_query_snapshot || !pss_free_snapshot_)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Process cloning is not supported on this "
+                               "version of Windows."});
+    }
+
+    DWORD const capture_ret =
+      pss_capture_snapshot(process_handle, kPssCaptureVaClone, 0, &snapshot_);
+    if (capture_ret != ERROR_SUCCESS)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"PssCaptureSnapshot failed."}
+                << ErrorCodeWinRet{capture_ret});
+    }
+
+    DWORD const query_ret = pss_query_snapshot(
+      snapshot_, kPssQueryVaCloneInformation, &clone_, sizeof(clone_));
+    if (query_ret != ERROR_SUCCESS)
+    {
+      Cleanup();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"PssQuerySnapshot failed."}
+                << ErrorCodeWinRet{query_ret});
+    }
+  }
+
+  PssVaClone(PssVaClone const& other) = delete;
+
+  PssVaClone& operator=(PssVaClone const& other) = delete;
+
+  ~PssVaClone()
+  {
+    Cleanup();
+  }
+
+  // Owned by the snapshot, and only valid as long as this object is.
+  HANDLE GetHandle() const noexcept
+  {
+    return clone_;
+  }
+
+private:
+  void Cleanup() noexcept
+  {
+    if (snapshot_)
+    {
+      // Also terminates the clone process.
+      DWORD const free_ret =
+        pss_free_snapshot_(::GetCurrentProcess(), snapshot_);
+      (void)free_ret;
+      HADESMEM_DETAIL_ASSERT(free_ret == ERROR_SUCCESS);
+      snapshot_ = nullptr;
+    }
+  }
+
+  PssFreeSnapshotFn pss_free_snapshot_{};
+  HANDLE snapshot_{};
+  HANDLE clone_{};
+};
+}
+
+class ProcessSnapshot
+{
+public:
+  explicit ProcessSnapshot(Process const& process,
+                           std::uint32_t flags = ProcessSnapshotFlags::kNone)
+    : pid_{process.GetId()}, flags_{flags}
+  {
+    HADESMEM_DETAIL_ASSERT(flags < ProcessSnapshotFlags::kInvalidFlagMaxValue);
+
+    if (!!(flags & ProcessSnapshotFlags::kClone))
+    {
+      detail::PssVaClone const clone{process.GetHandle()};
+      Capture(clone.GetHandle());
+    }
+    else
+    {
+      Capture(process.GetHandle());
+    }
+  }
+
+  explicit ProcessSnapshot(
+    Process const&& process,
+    std::uint32_t flags = ProcessSnapshotFlags::kNone) = delete;
+
+  ProcessSnapshot(ProcessSnapshot const& other) = delete;
+
+  ProcessSnapshot& operator=(ProcessSnapshot const& other) = delete;
+
+  ProcessSnapshot(ProcessSnapshot&& other) noexcept
+    : pid_{other.pid_},
+      flags_{other.flags_},
+      store_(std::move(other.store_)),
+      heap_data_(std::move(other.heap_data_)),
+      file_{std::move(other.file_)},
+      mapping_{std::move(other.mapping_)},
+      view_{std::move(other.view_)}
+  {
+    other.pid_ = 0;
+  }
+
+  ProcessSnapshot& operator=(ProcessSnapshot&& other) noexcept
+  {
+    pid_ = other.pid_;
+    other.pid_ = 0;
+    flags_ = other.flags_;
+    store_ = std::move(other.store_);
+    heap_data_ = std::move(other.heap_data_);
+    file_ = std::move(other.file_);
+    mapping_ = std::move(other.mapping_);
+    view_ = std::move(other.view_);
+    return *this;
+  }
+
+  DWORD GetProcessId() const noexcept
+  {
+    return pid_;
+  }
+
+  std::uint32_t GetFlags() const noexcept
+  {
+    return flags_;
+  }
+
+  std::size_t GetNumRegions() const noexcept
+  {
+    return store_->GetNumRegions();
+  }
+
+  // Regions which couldn't be copied (e.g. because they were freed during
+  // the capture) are still listed, but marked as invalid.
+  detail::SnapshotRegion const& GetRegion(std::size_t index) const noexcept
+  {
+    return store_->GetRegion(index);
+  }
+
+  std::size_t GetDataSize() const noexcept
+  {
+    return store_->GetDataSize();
+  }
+
+  bool IsCaptured(LPCVOID address, std::size_t len) const noexcept
+  {
+    return store_->IsCaptured(ToAddress(address), len);
+  }
+
+  void Read(LPCVOID address, void* data, std::size_t len) const
+  {
+    HADESMEM_DETAIL_ASSERT(data != nullptr || !len);
+
+    if (!store_->Read(ToAddress(address), data, len))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Address not in snapshot."});
+    }
+  }
+
+  // Pages which were added, removed, or changed since the previous
+  // snapshot. Both snapshots should be of the same process.
+  ProcessSnapshotDiff Diff(ProcessSnapshot const& previous) const
+  {
+    HADESMEM_DETAIL_ASSERT(pid_ == previous.pid_);
+
+    return detail::SnapshotStore::Diff(*previous.store_, *store_);
+  }
+
+private:
+  static std::uint64_t ToAddress(LPCVOID address) noexcept
+  {
+    return reinterpret_cast<std::uintptr_t>(address);
+  }
+
+  void Capture(HANDLE source)
+  {
+    store_ = std::make_unique<detail::SnapshotStore>();
+
+    for (auto const& mbi : QueryRegions(source))
+    {
+      store_->AddRegion(reinterpret_cast<std::uintptr_t>(mbi.BaseAddress),
+                        mbi.RegionSize,
+                        mbi.Protect);
+    }
+
+    store_->Attach(AllocateStorage(store_->GetDataSize()));
+
+    for (std::size_t i = 0; i < store_->GetNumRegions(); ++i)
+    {
+      auto const& region = store_->GetRegion(i);
+      auto const address =
+        reinterpret_cast<LPCVOID>(static_cast<std::uintptr_t>(region.base));
+      auto const size = static_cast<std::size_t>(region.size);
+      SIZE_T bytes_read = 0;
+      if (!::ReadProcessMemory(
+            source, address, store_->GetRegionData(i), size, &bytes_read) ||
+          bytes_read != size)
+      {
+        store_->SetRegionValid(i, false);
+      }
+    }
+
+    store_->HashPages();
+  }
+
+  static std::vector<MEMORY_BASIC_INFORMATION> QueryRegions(HANDLE source)
+  {
+    std::vector<MEMORY_BASIC_INFORMATION> regions;
+
+    auto address = static_cast<std::uint8_t const*>(nullptr);
+    MEMORY_BASIC_INFORMATION mbi{};
+    while (::VirtualQueryEx(source, address, &mbi, sizeof(mbi)) ==
+           sizeof(mbi))
+    {
+      if (detail::CanRead(mbi) && !detail::IsGuard(mbi))
+      {
+        regions.push_back(mbi);
+      }
+
+      auto const next =
+        static_cast<std::uint8_t const*>(mbi.BaseAddress) + mbi.RegionSize;
+      if (next <= address)
+      {
+        break;
+      }
+      address = next;
+    }
+
+    // The sweep normally ends with ERROR_INVALID_PARAMETER once we're past
+    // the end of the address space, but we should always find something.
+    if (regions.empty())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"VirtualQueryEx failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    return regions;
+  }
+
+  std::uint8_t* AllocateStorage(std::size_t size)
+  {
+    if (!size)
+    {
+      return nullptr;
+    }
+
+    if (!(flags_ & ProcessSnapshotFlags::kSpillToFile))
+    {
+      heap_data_ = std::make_unique<std::uint8_t[]>(size);
+      return heap_data_.get();
+    }
+
+    std::vector<wchar_t> temp_dir(MAX_PATH + 1);
+    if (!::GetTempPathW(static_cast<DWORD>(temp_dir.size()), temp_dir.data()))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"GetTempPathW failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    std::vector<wchar_t> temp_path(MAX_PATH + 1);
+    if (!::GetTempFileNameW(temp_dir.data(), L"hms", 0, temp_path.data()))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"GetTempFileNameW failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    // The file goes away as soon as the snapshot does.
+    file_ = detail::SmartFileHandle{
+      ::CreateFileW(temp_path.data(),
+                    GENERIC_READ | GENERIC_WRITE,
+                    0,
+                    nullptr,
+                    CREATE_ALWAYS,
+                    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                    nullptr)};
+    if (!file_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"CreateFileW failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    auto const size_64 = static_cast<std::uint64_t>(size);
+    mapping_ = detail::SmartHandle{
+      ::CreateFileMappingW(file_.GetHandle(),
+                           nullptr,
+                           PAGE_READWRITE,
+                           static_cast<DWORD>(size_64 >> 32),
+                           static_cast<DWORD>(size_64 & 0xFFFFFFFF),
+                           nullptr)};
+    if (!mapping_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"CreateFileMappingW failed."}
+                << ErrorCodeWinLast{last_error});
+    }
+
+    view_ = detail::SmartMappedFileHandle{::MapViewOfFile(
+      mapping_.GetHandle(), FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size)};
+    if (!view_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"MapViewOfFile failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    return static_cast<std::uint8_t*>(view_.GetHandle());
+  }
+
+  DWORD pid_{};
+  std::uint32_t flags_{};
+  // Heap allocated so the storage pointer it holds survives a move.
+  std::unique_ptr<detail::SnapshotStore> store_;
+  std::unique_ptr<std::uint8_t[]> heap_data_;
+  detail::SmartFileHandle file_;
+  detail::SmartHandle mapping_;
+  detail::SmartMappedFileHandle view_;
+};
+
+template <typename T>
+inline T Read(ProcessSnapshot const& snapshot, PVOID address)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_default_constructible<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+
+  T data;
+  snapshot.Read(address, std::addressof(data), sizeof(data));
+  return data;
+}
+
+template <typename T, typename Alloc = std::allocator<T>>
+inline std::vector<T, Alloc> ReadVector(ProcessSnapshot const& snapshot,
+                                        PVOID address,
+                                        std::size_t count)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_default_constructible<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(count ? address != nullptr : true);
+
+  if (!count)
+  {
+    return {};
+  }
+
+  std::vector<T, Alloc> data(count);
+  snapshot.Read(address, data.data(), sizeof(T) * count);
+  return data;
+}
+
+template <typename T,
+          typename Traits = std::char_traits<T>,
+          typename Alloc = std::allocator<T>>
+std::basic_string<T, Traits, Alloc> ReadString(ProcessSnapshot const& snapshot,
+                                               PVOID address)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsCharType<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+
+  // Reads are just a memcpy, so there's nothing to be gained by reading in
+  // chunks like we do for a live process.
+  std::basic_string<T, Traits, Alloc> data;
+  for (auto cur = static_cast<T const*>(address);; ++cur)
+  {
+    T c;
+    snapshot.Read(cur, &c, sizeof(c));
+    if (c == T())
+    {
+      break;
+    }
+    data.push_back(c);
+  }
+
+  return data;
+}
+}
@@ -22,6 +22,7 @@
 #include <hadesmem/detail/type_traits.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/protect.hpp>
+#include <hadesmem/region_map.hpp>
 
 namespace hadesmem
 {
@@ -41,6 +42,20 @@ template <typename T> inline T Read(Process const& process, PVOID address)
   return detail::ReadImpl<T>(process, address);
 }
 
+template <typename T>
+inline T Read(Process const& process, RegionMap const& regions, PVOID address)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_default_constructible<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+
+  T data;
+  detail::ReadImpl(
+    process, regions, address, std::addressof(data), sizeof(data));
+  return data;
+}
+
 template <typename T> inline T ReadUnsafe(Process const& process, PVOID address)
 {
   HADESMEM_DETAIL_ASSERT(address != nullptr);
@@ -83,12 +98,15 @@ inline void
   std::copy(std::begin(data), std::end(data), out);
 }
 
-template <typename T, typename OutputIterator>
-void ReadStringEx(Process const& process,
-                  PVOID address,
-                  OutputIterator data,
-                  std::size_t chunk_len,
-                  void* upper_bound)
+namespace detail
+{
+template <typename T, typename OutputIterator, typename QueryFunc>
+void ReadStringRegionsImpl(Process const& process,
+                           PVOID address,
+                           OutputIterator data,
+                           std::size_t chunk_len,
+                           void* upper_bound,
+                           QueryFunc const& query)
 {
   HADESMEM_DETAIL_STATIC_ASSERT(detail::IsCharType<T>::value);
   HADESMEM_DETAIL_STATIC_ASSERT(std::is_base_of<
@@ -99,10 +117,11 @@ void ReadStringEx(Process const& process,
 
   for (;;)
   {
+    MEMORY_BASIC_INFORMATION const mbi = query(address);
+
     detail::ProtectGuard protect_guard{
-      process, address, detail::ProtectGuardType::kRead};
+      process, mbi, detail::ProtectGuardType::kRead};
 
-    MEMORY_BASIC_INFORMATION const mbi = detail::Query(process, address);
     PVOID const region_next_real =
       static_cast<PBYTE>(mbi.BaseAddress) + mbi.RegionSize;
     void* const region_next = upper_bound
@@ -143,6 +162,45 @@ void ReadStringEx(Process const& process,
     }
   }
 }
+}
+
+template <typename T, typename OutputIterator>
+void ReadStringEx(Process const& process,
+                  PVOID address,
+                  OutputIterator data,
+                  std::size_t chunk_len,
+                  void* upper_bound)
+{
+  detail::ReadStringRegionsImpl<T>(
+    process,
+    address,
+    data,
+    chunk_len,
+    upper_bound,
+    [&](void const* region_address) {
+      return detail::Query(process, region_address);
+    });
+}
+
+template <typename T, typename OutputIterator>
+void ReadStringEx(Process const& process,
+                  RegionMap const& regions,
+                  PVOID address,
+                  OutputIterator data,
+                  std::size_t chunk_len,
+                  void* upper_bound)
+{
+  detail::ReadStringRegionsImpl<T>(
+    process,
+    address,
+    data,
+    chunk_len,
+    upper_bound,
+    [&](void const* region_address) {
+      return regions.QueryForAccess(region_address,
+                                    detail::ProtectGuardType::kRead);
+    });
+}
 
 template <typename T,
           typename Traits = std::char_traits<T>,
@@ -156,6 +214,23 @@ std::basic_string<T, Traits, Alloc>
   return data;
 }
 
+template <typename T,
+          typename Traits = std::char_traits<T>,
+          typename Alloc = std::allocator<T>>
+std::basic_string<T, Traits, Alloc> ReadString(Process const& process,
+                                               RegionMap const& regions,
+                                               PVOID address)
+{
+  std::basic_string<T, Traits, Alloc> data;
+  ReadStringEx<T>(process,
+                  regions,
+                  address,
+                  std::back_inserter(data),
+                  detail::ReadStringTraits<T>::kChunkLen,
+                  nullptr);
+  return data;
+}
+
 template <typename T, typename OutputIterator>
 void ReadStringBounded(Process const& process,
                        PVOID address,
@@ -249,6 +324,27 @@ inline std::vector<T, Alloc>
   return ReadVectorEx<T, Alloc>(process, address, count, ReadFlags::kNone);
 }
 
+template <typename T, typename Alloc = std::allocator<T>>
+inline std::vector<T, Alloc> ReadVector(Process const& process,
+                                        RegionMap const& regions,
+                                        PVOID address,
+                                        std::size_t count)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_default_constructible<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(count ? address != nullptr : true);
+
+  if (!count)
+  {
+    return {};
+  }
+
+  std::vector<T, Alloc> data(count);
+  detail::ReadImpl(process, regions, address, data.data(), sizeof(T) * count);
+  return data;
+}
+
 template <typename T, typename OutputIterator>
 inline void ReadVector(Process const& process,
                        PVOID address,
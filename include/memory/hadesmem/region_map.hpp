@@ -0,0 +1,370 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/protect_guard.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
+// Point in time snapshot of the address space of a process, built in a single
+// sweep and stored as a flat vector sorted by address. Lookups are a binary
+// search rather than a VirtualQueryEx call, so code which touches lots of
+// addresses (or the same addresses repeatedly) can pass a RegionMap to Read,
+// Write, etc. instead of querying on every access.
+//
+// The snapshot is not updated when the target allocates, frees or
+// reprotects memory. Callers are responsible for taking a new snapshot when
+// that happens (Diff can be used to find out what changed). Addresses above
+// the last region in the snapshot are still queried directly.
+
+namespace hadesmem
+{
+// Zero matches anything. Otherwise a region matches if it has any of the
+// given bits set, e.g. {MEM_COMMIT, 0, MEM_IMAGE | MEM_MAPPED}.
+struct RegionFilter
+{
+  DWORD state;
+  DWORD protect;
+  DWORD type;
+};
+
+struct RegionMapDiff
+{
+  // Regions only in the new snapshot.
+  std::vector<MEMORY_BASIC_INFORMATION> added;
+  // Regions only in the old snapshot.
+  std::vector<MEMORY_BASIC_INFORMATION> removed;
+  // Regions with the same bounds in both snapshots but a different state,
+  // protection or type. Contains the new values.
+  std::vector<MEMORY_BASIC_INFORMATION> changed;
+};
+
+class RegionMap
+{
+public:
+  using value_type = MEMORY_BASIC_INFORMATION;
+  using iterator = std::vector<MEMORY_BASIC_INFORMATION>::const_iterator;
+  using const_iterator = std::vector<MEMORY_BASIC_INFORMATION>::const_iterator;
+
+  // FilteredIterator satisfies the requirements of a forward iterator
+  // (C++ Standard, 24.2.5, Forward Iterators [forward.iterators]).
+  class FilteredIterator
+    : public std::iterator<std::forward_iterator_tag,
+                           MEMORY_BASIC_INFORMATION const>
+  {
+  public:
+    FilteredIterator() noexcept
+    {
+    }
+
+    explicit FilteredIterator(const_iterator cur,
+                              const_iterator end,
+                              RegionFilter const& filter) noexcept
+      : cur_{cur}, end_{end}, filter_(filter)
+    {
+      SkipFiltered();
+    }
+
+    reference operator*() const noexcept
+    {
+      return *cur_;
+    }
+
+    pointer operator->() const noexcept
+    {
+      return &*cur_;
+    }
+
+    FilteredIterator& operator++() noexcept
+    {
+      ++cur_;
+      SkipFiltered();
+      return *this;
+    }
+
+    FilteredIterator operator++(int) noexcept
+    {
+      FilteredIterator const iter{*this};
+      ++*this;
+      return iter;
+    }
+
+    bool operator==(FilteredIterator const& other) const noexcept
+    {
+      return cur_ == other.cur_;
+    }
+
+    bool operator!=(FilteredIterator const& other) const noexcept
+    {
+      return !(*this == other);
+    }
+
+  private:
+    void SkipFiltered() noexcept
+    {
+      while (cur_ != end_ && !IsMatch(*cur_, filter_))
+      {
+        ++cur_;
+      }
+    }
+
+    const_iterator cur_{};
+    const_iterator end_{};
+    RegionFilter filter_{};
+  };
+
+  class FilteredRange
+  {
+  public:
+    explicit FilteredRange(FilteredIterator beg, FilteredIterator end) noexcept
+      : beg_{beg}, end_{end}
+    {
+    }
+
+    FilteredIterator begin() const noexcept
+    {
+      return beg_;
+    }
+
+    FilteredIterator end() const noexcept
+    {
+      return end_;
+    }
+
+  private:
+    FilteredIterator beg_;
+    FilteredIterator end_;
+  };
+
+  explicit RegionMap(Process const& process) : process_{&process}
+  {
+    MEMORY_BASIC_INFORMATION mbi{};
+    try
+    {
+      mbi = detail::Query(process, nullptr);
+    }
+    catch (hadesmem::Error const& e)
+    {
+      // VirtualQuery can fail with ERROR_ACCESS_DENIED for 'zombie' processes.
+      auto const last_error_ptr =
+        boost::get_error_info<hadesmem::ErrorCodeWinLast>(e);
+      if (!last_error_ptr || *last_error_ptr != ERROR_ACCESS_DENIED)
+      {
+        throw;
+      }
+
+      return;
+    }
+
+    for (;;)
+    {
+      regions_.push_back(mbi);
+
+      auto const next = static_cast<std::uint8_t const*>(mbi.BaseAddress) +
+                        mbi.RegionSize;
+      try
+      {
+        mbi = detail::Query(process, next);
+      }
+      catch (hadesmem::Error const& e)
+      {
+        auto const last_error_ptr =
+          boost::get_error_info<hadesmem::ErrorCodeWinLast>(e);
+        if (!last_error_ptr || *last_error_ptr != ERROR_INVALID_PARAMETER)
+        {
+          throw;
+        }
+
+        break;
+      }
+    }
+  }
+
+  explicit RegionMap(Process const&& process) = delete;
+
+  // Returns nullptr if the address is above the last region in the snapshot.
+  MEMORY_BASIC_INFORMATION const* Find(void const* address) const noexcept
+  {
+    auto const iter = FindIter(address);
+    return iter == regions_.end() ? nullptr : &*iter;
+  }
+
+  // Same as detail::Query, but served from the snapshot if possible.
+  MEMORY_BASIC_INFORMATION Query(void const* address) const
+  {
+    MEMORY_BASIC_INFORMATION const* const mbi = Find(address);
+    return mbi ? *mbi : detail::Query(*process_, address);
+  }
+
+  // For Read, Write, etc. The snapshot is only a hint. If it says the access
+  // can go ahead without a protection change, its region is returned clipped
+  // to [address, region end). Otherwise the region is queried live, so a
+  // ProtectGuard never changes (and later restores) the protection of pages
+  // which were freed, reallocated or reprotected since the snapshot.
+  MEMORY_BASIC_INFORMATION QueryForAccess(void const* address,
+                                          detail::ProtectGuardType type) const
+  {
+    MEMORY_BASIC_INFORMATION const* const hint = Find(address);
+    if (!hint || detail::IsBadProtect(*hint) ||
+        !(type == detail::ProtectGuardType::kRead ? detail::CanRead(*hint)
+                                                   : detail::CanWrite(*hint)))
+    {
+      return detail::Query(*process_, address);
+    }
+
+    MEMORY_BASIC_INFORMATION mbi = *hint;
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+    mbi.RegionSize -= address_num - GetBase(mbi);
+    mbi.BaseAddress = const_cast<void*>(address);
+    return mbi;
+  }
+
+  // Regions matching the filter.
+  FilteredRange Filter(RegionFilter const& filter) const noexcept
+  {
+    return FilteredRange{
+      FilteredIterator{regions_.begin(), regions_.end(), filter},
+      FilteredIterator{regions_.end(), regions_.end(), filter}};
+  }
+
+  // Regions matching the filter which overlap [beg, end).
+  FilteredRange Filter(RegionFilter const& filter,
+                       void const* beg,
+                       void const* end) const noexcept
+  {
+    auto const first = FindIter(beg);
+    auto const last = std::lower_bound(
+      first,
+      regions_.end(),
+      reinterpret_cast<std::uintptr_t>(end),
+      [](MEMORY_BASIC_INFORMATION const& mbi, std::uintptr_t address) {
+        return GetBase(mbi) < address;
+      });
+    return FilteredRange{FilteredIterator{first, last, filter},
+                         FilteredIterator{last, last, filter}};
+  }
+
+  // Changes since an older snapshot of the same process. Linear in the total
+  // number of regions.
+  RegionMapDiff Diff(RegionMap const& previous) const
+  {
+    RegionMapDiff diff;
+
+    auto old_iter = previous.regions_.begin();
+    auto new_iter = regions_.begin();
+    while (old_iter != previous.regions_.end() || new_iter != regions_.end())
+    {
+      if (new_iter == regions_.end() ||
+          (old_iter != previous.regions_.end() &&
+           GetBase(*old_iter) < GetBase(*new_iter)))
+      {
+        diff.removed.push_back(*old_iter++);
+      }
+      else if (old_iter == previous.regions_.end() ||
+               GetBase(*new_iter) < GetBase(*old_iter))
+      {
+        diff.added.push_back(*new_iter++);
+      }
+      else if (old_iter->RegionSize != new_iter->RegionSize ||
+               old_iter->AllocationBase != new_iter->AllocationBase)
+      {
+        diff.removed.push_back(*old_iter++);
+        diff.added.push_back(*new_iter++);
+      }
+      else
+      {
+        if (old_iter->State != new_iter->State ||
+            old_iter->Protect != new_iter->Protect ||
+            old_iter->Type != new_iter->Type ||
+            old_iter->AllocationProtect != new_iter->AllocationProtect)
+        {
+          diff.changed.push_back(*new_iter);
+        }
+
+        ++old_iter;
+        ++new_iter;
+      }
+    }
+
+    return diff;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return regions_.size();
+  }
+
+  bool empty() const noexcept
+  {
+    return regions_.empty();
+  }
+
+  const_iterator begin() const noexcept
+  {
+    return regions_.begin();
+  }
+
+  const_iterator cbegin() const noexcept
+  {
+    return regions_.cbegin();
+  }
+
+  const_iterator end() const noexcept
+  {
+    return regions_.end();
+  }
+
+  const_iterator cend() const noexcept
+  {
+    return regions_.cend();
+  }
+
+private:
+  static std::uintptr_t GetBase(MEMORY_BASIC_INFORMATION const& mbi) noexcept
+  {
+    return reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+  }
+
+  static bool IsMatch(MEMORY_BASIC_INFORMATION const& mbi,
+                      RegionFilter const& filter) noexcept
+  {
+    return (!filter.state || !!(mbi.State & filter.state)) &&
+           (!filter.protect || !!(mbi.Protect & filter.protect)) &&
+           (!filter.type || !!(mbi.Type & filter.type));
+  }
+
+  const_iterator FindIter(void const* address) const noexcept
+  {
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+    auto iter = std::upper_bound(
+      regions_.begin(),
+      regions_.end(),
+      address_num,
+      [](std::uintptr_t lhs, MEMORY_BASIC_INFORMATION const& rhs) {
+        return lhs < GetBase(rhs);
+      });
+    if (iter == regions_.begin())
+    {
+      return regions_.end();
+    }
+
+    --iter;
+    return address_num - GetBase(*iter) < iter->RegionSize ? iter
+                                                          : regions_.end();
+  }
+
+  Process const* process_;
+  std::vector<MEMORY_BASIC_INFORMATION> regions_;
+};
+}
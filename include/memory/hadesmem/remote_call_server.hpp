@@ -0,0 +1,728 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <asmjit/asmjit.h>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/call.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/call_ring.hpp>
+#include <hadesmem/detail/call_stub_cache.hpp>
+#include <hadesmem/detail/shared_section.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/find_procedure.hpp>
+#include <hadesmem/flush.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_snapshot.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/write.hpp>
+
+// Opt-in alternative to Call/CallMulti for callers making lots of calls into
+// the same process. Instead of generating code, allocating memory and creating
+// a thread for every call, a single thread is started in the target which
+// waits on a request ring in a section shared with us. A call is then a write
+// into the ring, an event set to wake the server, and a wait for the result
+// (which is read straight out of the shared section).
+//
+// The code which makes each call only depends on the calling convention and
+// argument kinds, so it is generated once per signature and cached for the
+// lifetime of the server.
+//
+// Not thread-safe. Calls are made one after the other on the server thread,
+// so a call which blocks will block all calls after it (including the
+// shutdown in the destructor).
+
+// TODO: Support timeouts. The problem is the same as for Call, except that a
+// call which never returns also means the server can never be stopped.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct CallServerImports
+{
+  DWORD_PTR wait_for_single_object;
+  DWORD_PTR set_event;
+};
+
+inline void GenerateCallServer32(asmjit::X86Assembler* assembler,
+                                 std::size_t num_slots,
+                                 std::size_t slot_size,
+                                 CallServerImports const& imports)
+{
+  HADESMEM_DETAIL_TRACE_A("GenerateCallServer32 called.");
+
+  asmjit::Label label_loop(assembler->newLabel());
+  asmjit::Label label_run(assembler->newLabel());
+  asmjit::Label label_exit(assembler->newLabel());
+
+  std::int32_t const slots_end =
+    ToDisp(CallRing::kHeaderSize + num_slots * slot_size);
+  std::int32_t const slot_state = ToDisp(offsetof(CallRingSlotHeader, state));
+  std::int32_t const slot_stub = ToDisp(offsetof(CallRingSlotHeader, stub));
+  std::int32_t const stop = ToDisp(offsetof(CallRingHeader, stop));
+  std::int32_t const request_event =
+    ToDisp(offsetof(CallRingHeader, request_event));
+  std::int32_t const done_event = ToDisp(offsetof(CallRingHeader, done_event));
+
+  // ebx = ring header, edi = current slot.
+  assembler->push(asmjit::x86::ebx);
+  assembler->push(asmjit::x86::edi);
+  assembler->mov(asmjit::x86::ebx,
+                 asmjit::x86::dword_ptr(asmjit::x86::esp, 12));
+  assembler->lea(asmjit::x86::edi,
+                 asmjit::x86::dword_ptr(asmjit::x86::ebx,
+                                        ToDisp(CallRing::kHeaderSize)));
+
+  assembler->bind(label_loop);
+  assembler->cmp(asmjit::x86::dword_ptr(asmjit::x86::edi, slot_state),
+                 asmjit::imm_u(CallRing::kPending));
+  assembler->je(label_run);
+
+  assembler->cmp(asmjit::x86::dword_ptr(asmjit::x86::ebx, stop),
+                 asmjit::imm_u(0));
+  assembler->jne(label_exit);
+
+  assembler->push(asmjit::imm_u(INFINITE));
+  assembler->push(asmjit::x86::dword_ptr(asmjit::x86::ebx, request_event));
+  assembler->mov(asmjit::x86::eax,
+                 asmjit::imm_u(imports.wait_for_single_object));
+  assembler->call(asmjit::x86::eax);
+  assembler->jmp(label_loop);
+
+  assembler->bind(label_run);
+  assembler->lea(asmjit::x86::eax,
+                 asmjit::x86::dword_ptr(asmjit::x86::edi,
+                                        ToDisp(CallRing::kSlotHeaderSize)));
+  assembler->push(asmjit::x86::eax);
+  assembler->mov(asmjit::x86::eax,
+                 asmjit::x86::dword_ptr(asmjit::x86::edi, slot_stub));
+  assembler->call(asmjit::x86::eax);
+
+  assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::edi, slot_state),
+                 asmjit::imm_u(CallRing::kDone));
+
+  assembler->push(asmjit::x86::dword_ptr(asmjit::x86::ebx, done_event));
+  assembler->mov(asmjit::x86::eax, asmjit::imm_u(imports.set_event));
+  assembler->call(asmjit::x86::eax);
+
+  assembler->add(asmjit::x86::edi, asmjit::imm_u(slot_size));
+  assembler->lea(asmjit::x86::eax,
+                 asmjit::x86::dword_ptr(asmjit::x86::ebx, slots_end));
+  assembler->cmp(asmjit::x86::edi, asmjit::x86::eax);
+  assembler->jb(label_loop);
+  assembler->lea(asmjit::x86::edi,
+                 asmjit::x86::dword_ptr(asmjit::x86::ebx,
+                                        ToDisp(CallRing::kHeaderSize)));
+  assembler->jmp(label_loop);
+
+  assembler->bind(label_exit);
+  assembler->mov(asmjit::x86::eax, 0);
+  assembler->pop(asmjit::x86::edi);
+  assembler->pop(asmjit::x86::ebx);
+
+  assembler->ret(0x4);
+}
+
+inline void GenerateCallServer64(asmjit::X86Assembler* assembler,
+                                 std::size_t num_slots,
+                                 std::size_t slot_size,
+                                 CallServerImports const& imports)
+{
+  HADESMEM_DETAIL_TRACE_A("GenerateCallServer64 called.");
+
+  asmjit::Label label_loop(assembler->newLabel());
+  asmjit::Label label_run(assembler->newLabel());
+  asmjit::Label label_exit(assembler->newLabel());
+
+  std::int32_t const slots_end =
+    ToDisp(CallRing::kHeaderSize + num_slots * slot_size);
+  std::int32_t const slot_state = ToDisp(offsetof(CallRingSlotHeader, state));
+  std::int32_t const slot_stub = ToDisp(offsetof(CallRingSlotHeader, stub));
+  std::int32_t const stop = ToDisp(offsetof(CallRingHeader, stop));
+  std::int32_t const request_event =
+    ToDisp(offsetof(CallRingHeader, request_event));
+  std::int32_t const done_event = ToDisp(offsetof(CallRingHeader, done_event));
+
+  // rbx = ring header, rdi = current slot. Two pushes plus 0x28 bytes of
+  // ghost space keeps the stack aligned for our calls.
+  assembler->push(asmjit::x86::rbx);
+  assembler->push(asmjit::x86::rdi);
+  assembler->sub(asmjit::x86::rsp, asmjit::imm_u(0x28));
+  assembler->mov(asmjit::x86::rbx, asmjit::x86::rcx);
+  assembler->lea(asmjit::x86::rdi,
+                 asmjit::x86::qword_ptr(asmjit::x86::rbx,
+                                        ToDisp(CallRing::kHeaderSize)));
+
+  assembler->bind(label_loop);
+  assembler->cmp(asmjit::x86::dword_ptr(asmjit::x86::rdi, slot_state),
+                 asmjit::imm_u(CallRing::kPending));
+  assembler->je(label_run);
+
+  assembler->cmp(asmjit::x86::dword_ptr(asmjit::x86::rbx, stop),
+                 asmjit::imm_u(0));
+  assembler->jne(label_exit);
+
+  assembler->mov(asmjit::x86::rcx,
+                 asmjit::x86::qword_ptr(asmjit::x86::rbx, request_event));
+  assembler->mov(asmjit::x86::rdx, asmjit::imm_u(INFINITE));
+  assembler->mov(asmjit::x86::rax,
+                 asmjit::imm_u(imports.wait_for_single_object));
+  assembler->call(asmjit::x86::rax);
+  assembler->jmp(label_loop);
+
+  assembler->bind(label_run);
+  assembler->lea(asmjit::x86::rcx,
+                 asmjit::x86::qword_ptr(asmjit::x86::rdi,
+                                        ToDisp(CallRing::kSlotHeaderSize)));
+  assembler->mov(asmjit::x86::rax,
+                 asmjit::x86::qword_ptr(asmjit::x86::rdi, slot_stub));
+  assembler->call(asmjit::x86::rax);
+
+  assembler->mov(asmjit::x86::dword_ptr(asmjit::x86::rdi, slot_state),
+                 asmjit::imm_u(CallRing::kDone));
+
+  assembler->mov(asmjit::x86::rcx,
+                 asmjit::x86::qword_ptr(asmjit::x86::rbx, done_event));
+  assembler->mov(asmjit::x86::rax, asmjit::imm_u(imports.set_event));
+  assembler->call(asmjit::x86::rax);
+
+  assembler->add(asmjit::x86::rdi, asmjit::imm_u(slot_size));
+  assembler->lea(asmjit::x86::rax,
+                 asmjit::x86::qword_ptr(asmjit::x86::rbx, slots_end));
+  assembler->cmp(asmjit::x86::rdi, asmjit::x86::rax);
+  assembler->jb(label_loop);
+  assembler->lea(asmjit::x86::rdi,
+                 asmjit::x86::qword_ptr(asmjit::x86::rbx,
+                                        ToDisp(CallRing::kHeaderSize)));
+  assembler->jmp(label_loop);
+
+  assembler->bind(label_exit);
+  assembler->mov(asmjit::x86::rax, 0);
+  assembler->add(asmjit::x86::rsp, asmjit::imm_u(0x28));
+  assembler->pop(asmjit::x86::rdi);
+  assembler->pop(asmjit::x86::rbx);
+
+  assembler->ret();
+}
+
+inline Allocator GenerateCallServer(Process const& process,
+                                    ModuleSnapshot const& modules,
+                                    std::size_t num_slots,
+                                    std::size_t slot_size)
+{
+  HADESMEM_DETAIL_TRACE_A("GenerateCallServer called.");
+
+  Module const& kernel32 = GetSnapshotModule(modules, L"kernel32.dll");
+  CallServerImports imports;
+  imports.wait_for_single_object = reinterpret_cast<DWORD_PTR>(
+    FindProcedure(process, kernel32, "WaitForSingleObject"));
+  imports.set_event =
+    reinterpret_cast<DWORD_PTR>(FindProcedure(process, kernel32, "SetEvent"));
+
+  asmjit::JitRuntime runtime;
+  asmjit::X86Assembler assembler{&runtime};
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  GenerateCallServer64(&assembler, num_slots, slot_size, imports);
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  GenerateCallServer32(&assembler, num_slots, slot_size, imports);
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+
+  DWORD_PTR const code_size = assembler.getCodeSize();
+
+  Allocator code_remote{process, code_size};
+
+  std::vector<BYTE> code_real(code_size);
+  assembler.relocCode(code_real.data(),
+                      reinterpret_cast<DWORD_PTR>(code_remote.GetBase()));
+
+  WriteVector(process, code_remote.GetBase(), code_real);
+
+  FlushInstructionCache(process, code_remote.GetBase(), code_size);
+
+  return code_remote;
+}
+
+inline SmartHandle CreateAutoResetEvent()
+{
+  SmartHandle event{::CreateEventW(nullptr, FALSE, FALSE, nullptr)};
+  if (!event.IsValid())
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"CreateEventW failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+
+  return event;
+}
+
+inline HANDLE DuplicateHandleRemote(Process const& process,
+                                    HANDLE handle,
+                                    DWORD access)
+{
+  HANDLE remote_handle = nullptr;
+  if (!::DuplicateHandle(::GetCurrentProcess(),
+                         handle,
+                         process.GetHandle(),
+                         &remote_handle,
+                         access,
+                         FALSE,
+                         0))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"DuplicateHandle failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+
+  return remote_handle;
+}
+
+inline void CloseHandleRemote(Process const& process, HANDLE handle)
+{
+  if (!::DuplicateHandle(process.GetHandle(),
+                         handle,
+                         nullptr,
+                         nullptr,
+                         0,
+                         FALSE,
+                         DUPLICATE_CLOSE_SOURCE))
+  {
+    DWORD const last_error = ::GetLastError();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"DuplicateHandle failed."}
+                                    << ErrorCodeWinLast{last_error});
+  }
+}
+}
+
+class RemoteCallServer
+{
+public:
+  explicit RemoteCallServer(Process const& process,
+                            std::size_t num_slots = 16,
+                            std::size_t max_args = 16)
+    : RemoteCallServer{process, ModuleSnapshot{process}, num_slots, max_args}
+  {
+  }
+
+  // The call stubs and the server both need kernel32.dll, so share one walk
+  // of the loader list (or the caller's, if it already has one).
+  RemoteCallServer(Process const& process,
+                   ModuleSnapshot const& modules,
+                   std::size_t num_slots = 16,
+                   std::size_t max_args = 16)
+    : process_{&process},
+      max_args_{max_args},
+      section_{process,
+               detail::CallRing::GetRequiredSize(
+                 num_slots, detail::CallDataLayout::GetSize(max_args))},
+      ring_{FormatRing(section_, num_slots, max_args)},
+      request_event_{detail::CreateAutoResetEvent()},
+      done_event_{detail::CreateAutoResetEvent()},
+      imports_(detail::GetCallStubImports(process, modules)),
+      server_code_{detail::GenerateCallServer(
+        process,
+        modules,
+        num_slots,
+        detail::CallRing::GetSlotSize(
+          detail::CallDataLayout::GetSize(max_args)))}
+  {
+    try
+    {
+      DWORD const access = SYNCHRONIZE | EVENT_MODIFY_STATE;
+      request_event_remote_ = detail::DuplicateHandleRemote(
+        process, request_event_.GetHandle(), access);
+      done_event_remote_ = detail::DuplicateHandleRemote(
+        process, done_event_.GetHandle(), access);
+      detail::CallRingHeader& header = ring_.GetHeader();
+      header.request_event =
+        reinterpret_cast<std::uintptr_t>(request_event_remote_);
+      header.done_event =
+        reinterpret_cast<std::uintptr_t>(done_event_remote_);
+
+      HADESMEM_DETAIL_TRACE_A("Creating remote call server thread.");
+
+      server_thread_ =
+        ::CreateRemoteThread(process.GetHandle(),
+                             nullptr,
+                             0,
+                             reinterpret_cast<LPTHREAD_START_ROUTINE>(
+                               reinterpret_cast<DWORD_PTR>(
+                                 server_code_.GetBase())),
+                             section_.GetRemoteBase(),
+                             0,
+                             nullptr);
+      if (!server_thread_.IsValid())
+      {
+        DWORD const last_error = ::GetLastError();
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"CreateRemoteThread failed."}
+                  << ErrorCodeWinLast{last_error});
+      }
+    }
+    catch (...)
+    {
+      CloseRemoteHandlesUnchecked();
+      throw;
+    }
+  }
+
+  explicit RemoteCallServer(Process const&& process,
+                            std::size_t num_slots = 16,
+                            std::size_t max_args = 16) = delete;
+
+  RemoteCallServer(Process const&& process,
+                   ModuleSnapshot const& modules,
+                   std::size_t num_slots = 16,
+                   std::size_t max_args = 16) = delete;
+
+  RemoteCallServer(RemoteCallServer const& other) = delete;
+
+  RemoteCallServer& operator=(RemoteCallServer const& other) = delete;
+
+  RemoteCallServer(RemoteCallServer&& other) noexcept
+    : process_{other.process_},
+      max_args_{other.max_args_},
+      section_{std::move(other.section_)},
+      ring_(other.ring_),
+      request_event_{std::move(other.request_event_)},
+      done_event_{std::move(other.done_event_)},
+      request_event_remote_{other.request_event_remote_},
+      done_event_remote_{other.done_event_remote_},
+      imports_(other.imports_),
+      server_code_{std::move(other.server_code_)},
+      server_thread_{std::move(other.server_thread_)},
+      stubs_{std::move(other.stubs_)}
+  {
+    other.process_ = nullptr;
+    other.request_event_remote_ = nullptr;
+    other.done_event_remote_ = nullptr;
+  }
+
+  RemoteCallServer& operator=(RemoteCallServer&& other) = delete;
+
+  ~RemoteCallServer()
+  {
+    StopUnchecked();
+  }
+
+  // Stops the server thread and frees everything in the target. Waits for
+  // any call in progress to finish.
+  void Stop()
+  {
+    if (!process_)
+    {
+      return;
+    }
+
+    HADESMEM_DETAIL_TRACE_A("Stopping remote call server.");
+
+    if (server_thread_.IsValid())
+    {
+      ring_.RequestStop();
+      Wake();
+
+      if (::WaitForSingleObject(server_thread_.GetHandle(), INFINITE) !=
+          WAIT_OBJECT_0)
+      {
+        DWORD const last_error = ::GetLastError();
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"WaitForSingleObject failed."}
+                  << ErrorCodeWinLast{last_error});
+      }
+    }
+
+    CloseRemoteHandles();
+
+    stubs_.Clear();
+    server_code_.Free();
+    section_.Unmap();
+    server_thread_.Cleanup();
+    process_ = nullptr;
+  }
+
+  template <typename ArgsForwardIterator>
+  CallResultRaw CallRaw(void* address,
+                        CallConv call_conv,
+                        ArgsForwardIterator args_beg,
+                        ArgsForwardIterator args_end)
+  {
+    void* const addresses[] = {address};
+    CallConv const call_convs[] = {call_conv};
+    std::vector<CallArg> const args_full[] = {
+      std::vector<CallArg>(args_beg, args_end)};
+    std::vector<CallResultRaw> results;
+    CallMulti(std::begin(addresses),
+              std::end(addresses),
+              std::begin(call_convs),
+              std::begin(args_full),
+              std::back_inserter(results));
+    HADESMEM_DETAIL_ASSERT(results.size() == 1);
+    return results.front();
+  }
+
+  template <typename FuncT, typename... Args>
+  CallResult<detail::FuncResultT<FuncT>>
+    Call(void* address, CallConv call_conv, Args&&... args)
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::FuncArity<FuncT>::value ==
+                                  sizeof...(args));
+
+    std::vector<CallArg> call_args;
+    call_args.reserve(sizeof...(args));
+    detail::BuildCallArgs<FuncT, 0>(std::back_inserter(call_args),
+                                    std::forward<Args>(args)...);
+
+    CallResultRaw const ret =
+      CallRaw(address, call_conv, std::begin(call_args), std::end(call_args));
+    using ResultT = detail::FuncResultT<FuncT>;
+    return detail::CallResultRawToCallResult<ResultT>(ret);
+  }
+
+  template <typename FuncT, typename... Args>
+  CallResult<detail::FuncResultT<FuncT>>
+    Call(FuncT address, CallConv call_conv, Args&&... args)
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::IsFunction<FuncT>::value);
+
+    return Call<FuncT>(detail::FuncToPointer(address),
+                       call_conv,
+                       std::forward<Args>(args)...);
+  }
+
+  // Posts every call before waiting for any of them, so the server can work
+  // through them back to back. If there are more calls than slots we wait for
+  // the oldest outstanding call whenever the ring is full. If an exception
+  // escapes, calls which were already posted are left to finish, and their
+  // slots are reclaimed when the ring next gets to them.
+  template <typename AddressesForwardIterator,
+            typename ConvForwardIterator,
+            typename ArgsForwardIterator,
+            typename ResultsOutputIterator>
+  void CallMulti(AddressesForwardIterator addresses_beg,
+                 AddressesForwardIterator addresses_end,
+                 ConvForwardIterator call_convs_beg,
+                 ArgsForwardIterator args_full_beg,
+                 ResultsOutputIterator results)
+  {
+    using ResultsOutputIteratorCategory =
+      typename std::iterator_traits<ResultsOutputIterator>::iterator_category;
+    HADESMEM_DETAIL_STATIC_ASSERT(
+      std::is_base_of<std::output_iterator_tag,
+                      ResultsOutputIteratorCategory>::value);
+
+    HADESMEM_DETAIL_ASSERT(process_ != nullptr);
+
+    std::deque<Outstanding> outstanding;
+    for (; addresses_beg != addresses_end;
+         ++addresses_beg, ++call_convs_beg, ++args_full_beg)
+    {
+      auto const& args = *args_full_beg;
+      if (static_cast<std::size_t>(std::distance(
+            std::begin(args), std::end(args))) > max_args_)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Too many arguments for remote call server."});
+      }
+
+      detail::CallSignature signature{detail::MakeCallSignature(
+        1, call_convs_beg, args_full_beg)};
+      Allocator const& stub = GetStub(signature);
+      detail::CallDataLayout layout{signature};
+
+      std::size_t slot = 0;
+      while (!ring_.TryAcquire(&slot))
+      {
+        if (outstanding.empty())
+        {
+          // Left behind by an earlier call which failed part way through
+          // (possibly before the server was woken for it).
+          std::size_t const abandoned = ring_.GetNextSlot();
+          Wake();
+          WaitForDone(abandoned);
+          ring_.Release(abandoned);
+          continue;
+        }
+
+        CallResultRaw const result{Complete(outstanding.front())};
+        outstanding.pop_front();
+        *results = result;
+        ++results;
+      }
+
+      void* const data = ring_.GetData(slot);
+      detail::PackCallData(layout, 1, addresses_beg, args_full_beg, data);
+      ring_.Post(slot, reinterpret_cast<DWORD_PTR>(stub.GetBase()));
+      outstanding.emplace_back(Outstanding{slot, std::move(layout)});
+
+      Wake();
+    }
+
+    while (!outstanding.empty())
+    {
+      CallResultRaw const result{Complete(outstanding.front())};
+      outstanding.pop_front();
+      *results = result;
+      ++results;
+    }
+  }
+
+  std::size_t GetNumCachedStubs() const noexcept
+  {
+    return stubs_.size();
+  }
+
+private:
+  struct Outstanding
+  {
+    std::size_t slot;
+    detail::CallDataLayout layout;
+  };
+
+  static void* FormatRing(detail::SharedSection const& section,
+                          std::size_t num_slots,
+                          std::size_t max_args)
+  {
+    HADESMEM_DETAIL_ASSERT(num_slots != 0);
+
+    detail::CallRing::Format(section.GetLocalBase(),
+                             num_slots,
+                             detail::CallDataLayout::GetSize(max_args));
+    return section.GetLocalBase();
+  }
+
+  Allocator const& GetStub(detail::CallSignature const& signature)
+  {
+    return stubs_.GetOrCreate(
+      signature, [&](detail::CallSignature const& s) {
+        return detail::GenerateCallStub(*process_, s, imports_);
+      });
+  }
+
+  void Wake()
+  {
+    if (!::SetEvent(request_event_.GetHandle()))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{"SetEvent failed."}
+                                              << ErrorCodeWinLast{last_error});
+    }
+  }
+
+  void WaitForDone(std::size_t slot)
+  {
+    HANDLE const handles[] = {done_event_.GetHandle(),
+                              server_thread_.GetHandle()};
+    while (!ring_.IsDone(slot))
+    {
+      DWORD const wait_res =
+        ::WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+      if (wait_res == WAIT_OBJECT_0 + 1)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Remote call server exited."});
+      }
+      else if (wait_res != WAIT_OBJECT_0)
+      {
+        DWORD const last_error = ::GetLastError();
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"WaitForMultipleObjects failed."}
+                  << ErrorCodeWinLast{last_error});
+      }
+    }
+  }
+
+  CallResultRaw Complete(Outstanding const& call)
+  {
+    WaitForDone(call.slot);
+
+    CallResultRaw const result{
+      detail::UnpackCallResult(call.layout, 0, ring_.GetData(call.slot))};
+    ring_.Release(call.slot);
+    return result;
+  }
+
+  void CloseRemoteHandles()
+  {
+    if (request_event_remote_)
+    {
+      detail::CloseHandleRemote(*process_, request_event_remote_);
+      request_event_remote_ = nullptr;
+    }
+
+    if (done_event_remote_)
+    {
+      detail::CloseHandleRemote(*process_, done_event_remote_);
+      done_event_remote_ = nullptr;
+    }
+  }
+
+  void CloseRemoteHandlesUnchecked() noexcept
+  {
+    try
+    {
+      CloseRemoteHandles();
+    }
+    catch (...)
+    {
+      // WARNING: Handles in the remote process are leaked if
+      // 'CloseRemoteHandles' fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+  }
+
+  void StopUnchecked() noexcept
+  {
+    try
+    {
+      Stop();
+    }
+    catch (...)
+    {
+      // WARNING: Server thread, code and ring are leaked if 'Stop' fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+
+      process_ = nullptr;
+    }
+  }
+
+  Process const* process_;
+  std::size_t max_args_;
+  detail::SharedSection section_;
+  detail::CallRing ring_;
+  detail::SmartHandle request_event_;
+  detail::SmartHandle done_event_;
+  HANDLE request_event_remote_{};
+  HANDLE done_event_remote_{};
+  detail::CallStubImports imports_;
+  Allocator server_code_;
+  detail::SmartHandle server_thread_;
+  detail::CallStubCache<Allocator> stubs_;
+};
+}
@@ -0,0 +1,232 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/heap_arena.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/protect.hpp>
+
+// Small allocations in another process without a VirtualAllocEx (and a 64KB
+// reservation) each. Memory is reserved in large chunks and split up locally,
+// nothing is stored in the target. Blocks are plain addresses, so they can be
+// used with Read/Write etc. like any other remote memory.
+
+// TODO: Decommit chunks which have no live blocks left.
+
+namespace hadesmem
+{
+// TODO: Type safety.
+struct RemoteHeapFlags
+{
+  enum : std::uint32_t
+  {
+    kNone = 0,
+    kExecutable = 1 << 0,
+    kInvalidFlagMaxValue = 1 << 1
+  };
+};
+
+// Not thread-safe. Everything is freed when the heap is destroyed.
+class RemoteHeap
+{
+public:
+  static SIZE_T const kDefaultChunkSize = 0x10000;
+
+  explicit RemoteHeap(Process const& process,
+                      std::uint32_t flags = RemoteHeapFlags::kNone,
+                      SIZE_T chunk_size = kDefaultChunkSize)
+    : process_{&process}, flags_{flags}, chunk_size_{chunk_size}
+  {
+    HADESMEM_DETAIL_ASSERT(
+      !(flags & ~(RemoteHeapFlags::kInvalidFlagMaxValue - 1UL)));
+    HADESMEM_DETAIL_ASSERT(chunk_size_ >= detail::HeapArena::kMaxBlockSize);
+  }
+
+  explicit RemoteHeap(Process const&& process,
+                      std::uint32_t flags = RemoteHeapFlags::kNone,
+                      SIZE_T chunk_size = kDefaultChunkSize) = delete;
+
+  RemoteHeap(RemoteHeap const& other) = delete;
+
+  RemoteHeap& operator=(RemoteHeap const& other) = delete;
+
+  RemoteHeap(RemoteHeap&& other) noexcept
+    : process_{other.process_},
+      flags_{other.flags_},
+      chunk_size_{other.chunk_size_},
+      arena_(std::move(other.arena_)),
+      chunks_{std::move(other.chunks_)},
+      large_{std::move(other.large_)}
+  {
+    other.process_ = nullptr;
+  }
+
+  RemoteHeap& operator=(RemoteHeap&& other) noexcept
+  {
+    FreeAllUnchecked();
+
+    process_ = other.process_;
+    other.process_ = nullptr;
+
+    flags_ = other.flags_;
+    chunk_size_ = other.chunk_size_;
+    arena_ = std::move(other.arena_);
+    chunks_ = std::move(other.chunks_);
+    large_ = std::move(other.large_);
+
+    return *this;
+  }
+
+  ~RemoteHeap()
+  {
+    FreeAllUnchecked();
+  }
+
+  // Blocks are at least 16 byte aligned. Requests larger than a page get
+  // their own allocation.
+  PVOID Alloc(SIZE_T size)
+  {
+    HADESMEM_DETAIL_ASSERT(process_ != nullptr);
+    HADESMEM_DETAIL_ASSERT(size != 0);
+
+    if (size > detail::HeapArena::kMaxBlockSize)
+    {
+      Allocator large{*process_, size};
+      SetProtect(large);
+      PVOID const base = large.GetBase();
+      large_.emplace(base, std::move(large));
+      return base;
+    }
+
+    std::uintptr_t address = arena_.Allocate(size);
+    if (!address)
+    {
+      AddChunk();
+      address = arena_.Allocate(size);
+      HADESMEM_DETAIL_ASSERT(address != 0);
+    }
+
+    return reinterpret_cast<PVOID>(address);
+  }
+
+  void Free(PVOID address)
+  {
+    HADESMEM_DETAIL_ASSERT(process_ != nullptr);
+
+    auto const large_iter = large_.find(address);
+    if (large_iter != std::end(large_))
+    {
+      large_iter->second.Free();
+      large_.erase(large_iter);
+      return;
+    }
+
+    if (!arena_.Free(reinterpret_cast<std::uintptr_t>(address)))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid or already freed address."});
+    }
+  }
+
+  // Frees every block but keeps the chunks around, for reuse by later
+  // allocations.
+  void Reset()
+  {
+    arena_.Reset();
+    for (auto& large : large_)
+    {
+      large.second.Free();
+    }
+    large_.clear();
+  }
+
+  // Frees every block and releases all the memory back to the target.
+  void FreeAll()
+  {
+    if (!process_)
+    {
+      return;
+    }
+
+    Reset();
+    for (auto& chunk : chunks_)
+    {
+      chunk.Free();
+    }
+    chunks_.clear();
+    arena_.Clear();
+  }
+
+  bool IsExecutable() const noexcept
+  {
+    return !!(flags_ & RemoteHeapFlags::kExecutable);
+  }
+
+  std::size_t GetNumChunks() const noexcept
+  {
+    return chunks_.size();
+  }
+
+  std::size_t GetNumBlocks() const noexcept
+  {
+    return arena_.GetNumBlocks() + large_.size();
+  }
+
+private:
+  void AddChunk()
+  {
+    HADESMEM_DETAIL_TRACE_A("Allocating remote heap chunk.");
+
+    Allocator chunk{*process_, chunk_size_};
+    SetProtect(chunk);
+    arena_.AddChunk(reinterpret_cast<std::uintptr_t>(chunk.GetBase()),
+                    chunk_size_);
+    chunks_.emplace_back(std::move(chunk));
+  }
+
+  // Alloc always gives us RWX.
+  void SetProtect(Allocator const& allocator)
+  {
+    if (!IsExecutable())
+    {
+      Protect(*process_, allocator.GetBase(), PAGE_READWRITE);
+    }
+  }
+
+  void FreeAllUnchecked() noexcept
+  {
+    try
+    {
+      FreeAll();
+    }
+    catch (...)
+    {
+      // WARNING: Memory in remote process is leaked if 'FreeAll' fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+  }
+
+  Process const* process_;
+  std::uint32_t flags_;
+  SIZE_T chunk_size_;
+  detail::HeapArena arena_;
+  std::vector<Allocator> chunks_;
+  std::map<PVOID, Allocator> large_;
+};
+}
@@ -0,0 +1,414 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/shared_ring.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/error.hpp>
+
+// Named pagefile backed section mapped by a controller and by a module
+// injected into another process (e.g. a Cerberus plugin). It contains a
+// shared struct area, whose contents are up to the user, and two message
+// rings: one from the controller to the module and one from the module to the
+// controller. Once both sides have the section mapped nothing goes through
+// the kernel, so data is exchanged without any Read/Write/Call.
+//
+// Waking the other side is left to the user (e.g. polling, or a named event).
+//
+// The controller owns the layout. The module side checks every offset and
+// size in the header against the size of its view when it attaches, and only
+// ever uses its own validated copies, so a corrupt (or hostile) controller
+// can't point it outside the section.
+
+// TODO: Support setting a security descriptor on the section.
+
+namespace hadesmem
+{
+namespace detail
+{
+struct SharedChannelHeader
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t size;
+  std::uint64_t struct_offset;
+  std::uint64_t struct_size;
+  std::uint64_t to_module_offset;
+  std::uint64_t to_controller_offset;
+};
+
+HADESMEM_DETAIL_STATIC_ASSERT(
+  std::is_standard_layout<SharedChannelHeader>::value);
+
+// Offsets are from the start of the view.
+struct SharedChannelLayout
+{
+  std::size_t struct_offset;
+  std::size_t struct_size;
+  std::size_t to_module_offset;
+  std::size_t to_module_size;
+  std::size_t to_controller_offset;
+  std::size_t to_controller_size;
+};
+}
+
+class SharedChannel
+{
+public:
+  static std::uint32_t const kMagic = 0x4E484353; // 'SCHN'
+  static std::uint32_t const kVersion = 1;
+
+  // Creates the channel (controller side). The name is the name of the
+  // section, so it's subject to the usual object namespace rules (e.g.
+  // "Local\\" vs "Global\\"). Both rings have the same capacity.
+  explicit SharedChannel(
+    std::wstring const& name,
+    std::size_t struct_size,
+    std::size_t num_slots = 256,
+    std::size_t max_message_size = 240,
+    detail::SharedRingMode mode = detail::SharedRingMode::kMpsc)
+    : is_controller_{true},
+      section_{CreateSection(
+        name, GetRequiredSize(struct_size, num_slots, max_message_size))},
+      view_{MapSection(section_)},
+      layout_(Format(
+        view_.GetHandle(), struct_size, num_slots, max_message_size, mode)),
+      to_module_{OpenRing(
+        view_.GetHandle(), layout_.to_module_offset, layout_.to_module_size)},
+      to_controller_{OpenRing(view_.GetHandle(),
+                              layout_.to_controller_offset,
+                              layout_.to_controller_size)}
+  {
+  }
+
+  // Opens a channel created by the controller (module side).
+  explicit SharedChannel(std::wstring const& name)
+    : is_controller_{false},
+      section_{OpenSection(name)},
+      view_{MapSection(section_)},
+      layout_(Attach(view_.GetHandle(), GetViewSize(view_.GetHandle()))),
+      to_module_{OpenRing(
+        view_.GetHandle(), layout_.to_module_offset, layout_.to_module_size)},
+      to_controller_{OpenRing(view_.GetHandle(),
+                              layout_.to_controller_offset,
+                              layout_.to_controller_size)}
+  {
+  }
+
+  SharedChannel(SharedChannel const& other) = delete;
+
+  SharedChannel& operator=(SharedChannel const& other) = delete;
+
+  SharedChannel(SharedChannel&& other) noexcept
+    : is_controller_{other.is_controller_},
+      section_{std::move(other.section_)},
+      view_{std::move(other.view_)},
+      layout_(other.layout_),
+      to_module_(other.to_module_),
+      to_controller_(other.to_controller_)
+  {
+  }
+
+  SharedChannel& operator=(SharedChannel&& other) = delete;
+
+  bool IsController() const noexcept
+  {
+    return is_controller_;
+  }
+
+  void* GetStruct() const noexcept
+  {
+    return GetRegion(view_.GetHandle(), layout_.struct_offset);
+  }
+
+  std::size_t GetStructSize() const noexcept
+  {
+    return layout_.struct_size;
+  }
+
+  std::size_t GetMaxMessageSize() const noexcept
+  {
+    return to_module_.GetMaxMessageSize();
+  }
+
+  // Returns false if the other side hasn't caught up and the ring is full.
+  bool TrySend(void const* data, std::size_t size)
+  {
+    return GetSendRing().TryWrite(data, size);
+  }
+
+  // Writes the message in place. Func is called with a pointer to size bytes
+  // to fill in.
+  template <typename Func> bool TrySend(std::size_t size, Func const& func)
+  {
+    return GetSendRing().TryProduce(size, func);
+  }
+
+  // The buffer must be at least GetMaxMessageSize bytes. Returns false if
+  // there are no messages.
+  bool TryReceive(void* data, std::size_t* size)
+  {
+    return CheckReceive(GetReceiveRing().TryRead(data, size));
+  }
+
+  // Reads the message in place. Func is called with a pointer to the message
+  // and its size, and the message is gone once it returns.
+  template <typename Func> bool TryReceive(Func const& func)
+  {
+    return CheckReceive(GetReceiveRing().TryConsume(func));
+  }
+
+  std::size_t GetNumPendingSend() const noexcept
+  {
+    return is_controller_ ? to_module_.GetNumPending()
+                          : to_controller_.GetNumPending();
+  }
+
+  std::size_t GetNumPendingReceive() const noexcept
+  {
+    return is_controller_ ? to_controller_.GetNumPending()
+                          : to_module_.GetNumPending();
+  }
+
+private:
+  static std::size_t const kHeaderSize = detail::SharedRing::kSlotAlignment;
+
+  HADESMEM_DETAIL_STATIC_ASSERT(sizeof(detail::SharedChannelHeader) <=
+                                kHeaderSize);
+
+  static std::size_t Align(std::size_t size) noexcept
+  {
+    std::size_t const alignment = detail::SharedRing::kSlotAlignment;
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  static std::size_t GetRequiredSize(std::size_t struct_size,
+                                     std::size_t num_slots,
+                                     std::size_t max_message_size) noexcept
+  {
+    return kHeaderSize + Align(struct_size) +
+           2 * detail::SharedRing::GetRequiredSize(num_slots,
+                                                   max_message_size);
+  }
+
+  static detail::SmartHandle CreateSection(std::wstring const& name,
+                                           std::size_t size)
+  {
+    auto const size_64 = static_cast<std::uint64_t>(size);
+    detail::SmartHandle section{
+      ::CreateFileMappingW(INVALID_HANDLE_VALUE,
+                           nullptr,
+                           PAGE_READWRITE | SEC_COMMIT,
+                           static_cast<DWORD>(size_64 >> 32),
+                           static_cast<DWORD>(size_64 & 0xFFFFFFFF),
+                           name.c_str())};
+    DWORD const last_error = ::GetLastError();
+    if (!section.IsValid())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"CreateFileMappingW failed."}
+                << ErrorCodeWinLast{last_error});
+    }
+
+    // We'd be formatting memory someone else is already using.
+    if (last_error == ERROR_ALREADY_EXISTS)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Shared channel already exists."}
+                << ErrorCodeWinLast{last_error});
+    }
+
+    return section;
+  }
+
+  static detail::SmartHandle OpenSection(std::wstring const& name)
+  {
+    detail::SmartHandle section{::OpenFileMappingW(
+      FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name.c_str())};
+    if (!section.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"OpenFileMappingW failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    return section;
+  }
+
+  static detail::SmartMappedFileHandle
+    MapSection(detail::SmartHandle const& section)
+  {
+    detail::SmartMappedFileHandle view{::MapViewOfFile(
+      section.GetHandle(), FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0)};
+    if (!view.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"MapViewOfFile failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    return view;
+  }
+
+  static std::size_t GetViewSize(void* base)
+  {
+    MEMORY_BASIC_INFORMATION mbi{};
+    if (::VirtualQuery(base, &mbi, sizeof(mbi)) != sizeof(mbi))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"VirtualQuery failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    return mbi.RegionSize;
+  }
+
+  static detail::SharedChannelLayout Format(void* base,
+                                            std::size_t struct_size,
+                                            std::size_t num_slots,
+                                            std::size_t max_message_size,
+                                            detail::SharedRingMode mode)
+  {
+    std::size_t const ring_size =
+      detail::SharedRing::GetRequiredSize(num_slots, max_message_size);
+
+    detail::SharedChannelLayout layout;
+    layout.struct_offset = kHeaderSize;
+    layout.struct_size = struct_size;
+    layout.to_module_offset = kHeaderSize + Align(struct_size);
+    layout.to_module_size = ring_size;
+    layout.to_controller_offset = layout.to_module_offset + ring_size;
+    layout.to_controller_size = ring_size;
+
+    auto const header = static_cast<detail::SharedChannelHeader*>(base);
+    header->version = kVersion;
+    header->size = GetRequiredSize(struct_size, num_slots, max_message_size);
+    header->struct_offset = layout.struct_offset;
+    header->struct_size = layout.struct_size;
+    header->to_module_offset = layout.to_module_offset;
+    header->to_controller_offset = layout.to_controller_offset;
+
+    detail::SharedRing::Format(GetRegion(base, layout.to_module_offset),
+                               num_slots,
+                               max_message_size,
+                               mode);
+    detail::SharedRing::Format(GetRegion(base, layout.to_controller_offset),
+                               num_slots,
+                               max_message_size,
+                               mode);
+
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = kMagic;
+
+    return layout;
+  }
+
+  // The regions must be in the order Format lays them out, must not overlap,
+  // and must all be inside the view. Each field is read once.
+  static detail::SharedChannelLayout Attach(void* base, std::size_t view_size)
+  {
+    auto const header = static_cast<detail::SharedChannelHeader*>(base);
+    if (view_size < kHeaderSize || header->magic != kMagic ||
+        header->version != kVersion)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid or uninitialized shared channel."});
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    std::uint64_t const size = header->size;
+    std::uint64_t const struct_offset = header->struct_offset;
+    std::uint64_t const struct_size = header->struct_size;
+    std::uint64_t const to_module_offset = header->to_module_offset;
+    std::uint64_t const to_controller_offset = header->to_controller_offset;
+
+    std::uint64_t const alignment = detail::SharedRing::kSlotAlignment;
+    if (size > view_size || struct_offset < kHeaderSize ||
+        struct_offset > size || struct_size > size - struct_offset ||
+        to_module_offset < struct_offset + struct_size ||
+        to_module_offset % alignment != 0 ||
+        to_controller_offset <= to_module_offset ||
+        to_controller_offset % alignment != 0 || to_controller_offset >= size)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Shared channel has an invalid layout."});
+    }
+
+    detail::SharedChannelLayout layout;
+    layout.struct_offset = static_cast<std::size_t>(struct_offset);
+    layout.struct_size = static_cast<std::size_t>(struct_size);
+    layout.to_module_offset = static_cast<std::size_t>(to_module_offset);
+    layout.to_module_size =
+      static_cast<std::size_t>(to_controller_offset - to_module_offset);
+    layout.to_controller_offset =
+      static_cast<std::size_t>(to_controller_offset);
+    layout.to_controller_size =
+      static_cast<std::size_t>(size - to_controller_offset);
+    return layout;
+  }
+
+  // The ring checks its own geometry against the space it was given.
+  static detail::SharedRing
+    OpenRing(void* base, std::size_t offset, std::size_t size)
+  {
+    detail::SharedRing ring{GetRegion(base, offset), size};
+    if (ring.IsCorrupted())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Shared channel has an invalid ring."});
+    }
+
+    return ring;
+  }
+
+  static void* GetRegion(void* base, std::size_t offset) noexcept
+  {
+    return static_cast<std::uint8_t*>(base) + offset;
+  }
+
+  detail::SharedRing& GetSendRing() noexcept
+  {
+    return is_controller_ ? to_module_ : to_controller_;
+  }
+
+  detail::SharedRing& GetReceiveRing() noexcept
+  {
+    return is_controller_ ? to_controller_ : to_module_;
+  }
+
+  bool CheckReceive(bool received)
+  {
+    if (!received && GetReceiveRing().IsCorrupted())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Shared channel is corrupted."});
+    }
+
+    return received;
+  }
+
+  bool is_controller_;
+  detail::SmartHandle section_;
+  detail::SmartMappedFileHandle view_;
+  detail::SharedChannelLayout layout_;
+  detail::SharedRing to_module_;
+  detail::SharedRing to_controller_;
+};
+}
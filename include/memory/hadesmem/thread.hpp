@@ -27,6 +27,15 @@ public:
   {
   }
 
+  // Takes ownership of an existing handle to the thread (e.g. one returned by
+  // NtGetNextThread). Must not be used for the current thread.
+  explicit Thread(DWORD id, detail::SmartHandle&& handle) noexcept
+    : handle_{std::move(handle)},
+      id_{id}
+  {
+    HADESMEM_DETAIL_ASSERT(id_ != ::GetCurrentThreadId());
+  }
+
   Thread(Thread const& other)
     : handle_{DuplicateHandle(other.id_, other.handle_.GetHandle())},
       id_{other.id_}
@@ -14,10 +14,12 @@
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
 #include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/thread_enum.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/winapi.hpp>
 #include <hadesmem/detail/winternl.hpp>
 #include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
 #include <hadesmem/thread.hpp>
 #include <hadesmem/thread_entry.hpp>
 #include <hadesmem/thread_list.hpp>
@@ -169,6 +171,11 @@ public:
     SuspendThread(thread_);
   }
 
+  explicit SuspendedThread(Thread&& thread) : thread_(std::move(thread))
+  {
+    SuspendThread(thread_);
+  }
+
   SuspendedThread(SuspendedThread const& other) = delete;
 
   SuspendedThread& operator=(SuspendedThread const& other) = delete;
@@ -292,6 +299,81 @@ public:
     }
   }
 
+  // Walks the thread list of the process directly rather than taking a
+  // system-wide snapshot, and suspends each thread as soon as it's found using
+  // the handle the enumeration gives us (so there's no TID reuse race, and
+  // nothing to reopen or verify). Retries continue from the last thread seen
+  // (new threads are always added to the end of the list), so each retry only
+  // costs as much as the number of threads created since the previous pass.
+  explicit SuspendedProcess(Process const& process, DWORD retries = 5)
+  {
+    DWORD const access = THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT |
+                         THREAD_QUERY_LIMITED_INFORMATION;
+    DWORD const current_thread_id = ::GetCurrentThreadId();
+
+    // Threads we're not suspending. Their handles are kept open because we
+    // may need to continue the enumeration from them.
+    std::vector<detail::SmartHandle> skipped;
+    std::set<DWORD> skipped_tids;
+    HANDLE last = nullptr;
+
+    bool need_retry = false;
+    do
+    {
+      need_retry = false;
+
+      for (;;)
+      {
+        detail::SmartHandle handle =
+          detail::GetNextThread(process.GetHandle(), last, access);
+        if (!handle.IsValid())
+        {
+          break;
+        }
+
+        DWORD const tid = ::GetThreadId(handle.GetHandle());
+        if (!tid || tid == current_thread_id || skipped_tids.count(tid))
+        {
+          last = handle.GetHandle();
+          skipped.emplace_back(std::move(handle));
+          continue;
+        }
+
+        need_retry = true;
+
+        HANDLE const thread_handle = handle.GetHandle();
+        try
+        {
+          threads_.emplace_back(Thread{tid, std::move(handle)});
+          last = thread_handle;
+        }
+        catch (std::exception const& e)
+        {
+          (void)e;
+          HADESMEM_DETAIL_TRACE_FORMAT_A(
+            "WARNING! Error while suspending thread. TID: [%lu]. Error: "
+            "[%s].",
+            tid,
+            boost::current_exception_diagnostic_information().c_str());
+          // The handle is gone (the thread is probably exiting), so we'll see
+          // the thread again when we continue from the previous one. Skip it
+          // then.
+          skipped_tids.insert(tid);
+        }
+      }
+    } while (need_retry && retries--);
+
+    if (need_retry)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error() << ErrorString("Failed to suspend all threads in process "
+                               "(too many retries)."));
+    }
+  }
+
+  explicit SuspendedProcess(Process const&& process,
+                            DWORD retries = 5) = delete;
+
   SuspendedProcess(SuspendedProcess const& other) = delete;
 
   SuspendedProcess& operator=(SuspendedProcess const& other) = delete;
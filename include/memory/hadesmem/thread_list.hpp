@@ -3,9 +3,11 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <utility>
 #include <iterator>
+#include <vector>
 
 #include <windows.h>
 #include <tlhelp32.h>
@@ -17,6 +19,7 @@
 #include <hadesmem/detail/optional.hpp>
 #include <hadesmem/detail/toolhelp.hpp>
 #include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/detail/thread_enum.hpp>
 
 namespace hadesmem
 {
@@ -43,6 +46,15 @@ public:
   {
     HADESMEM_DETAIL_ASSERT(impl_.get());
 
+    // Only use a system-wide snapshot when we actually want every thread in
+    // the system.
+    if (pid_ != static_cast<DWORD>(-1))
+    {
+      impl_->entries_ = detail::GetProcessThreadEntries(pid_);
+      Advance();
+      return;
+    }
+
     impl_->snap_ = detail::CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
 
     hadesmem::detail::Optional<THREADENTRY32> const entry =
@@ -104,6 +116,18 @@ public:
 private:
   void Advance()
   {
+    if (!impl_->snap_.IsValid())
+    {
+      if (impl_->next_ == impl_->entries_.size())
+      {
+        impl_.reset();
+        return;
+      }
+
+      impl_->thread_ = ThreadEntry{impl_->entries_[impl_->next_++]};
+      return;
+    }
+
     for (;;)
     {
       hadesmem::detail::Optional<THREADENTRY32> const entry =
@@ -130,6 +154,8 @@ private:
   struct Impl
   {
     detail::SmartSnapHandle snap_;
+    std::vector<THREADENTRY32> entries_;
+    std::size_t next_{};
     hadesmem::detail::Optional<ThreadEntry> thread_;
   };
 
@@ -15,6 +15,7 @@
 #include <hadesmem/detail/write_impl.hpp>
 #include <hadesmem/detail/type_traits.hpp>
 #include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/region_map.hpp>
 
 namespace hadesmem
 {
@@ -28,6 +29,20 @@ inline void Write(Process const& process, PVOID address, T const& data)
   detail::WriteImpl(process, address, data);
 }
 
+template <typename T>
+inline void Write(Process const& process,
+                  RegionMap const& regions,
+                  PVOID address,
+                  T const& data)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+
+  detail::WriteImpl(
+    process, regions, address, std::addressof(data), sizeof(data));
+}
+
 template <typename T>
 inline void
   Write(Process const& process, PVOID address, T const* ptr, std::size_t count)
@@ -96,4 +111,19 @@ inline void WriteVector(Process const& process,
   std::size_t const raw_size = data.size() * sizeof(T);
   detail::WriteImpl(process, address, data.data(), raw_size);
 }
+
+template <typename T, typename Alloc = std::allocator<T>>
+inline void WriteVector(Process const& process,
+                        RegionMap const& regions,
+                        PVOID address,
+                        std::vector<T, Alloc> const& data)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+  HADESMEM_DETAIL_ASSERT(!data.empty());
+
+  std::size_t const raw_size = data.size() * sizeof(T);
+  detail::WriteImpl(process, regions, address, data.data(), raw_size);
+}
 }
@@ -0,0 +1,311 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/protect_guard.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/read_impl.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/type_traits.hpp>
+#include <hadesmem/detail/write_impl.hpp>
+#include <hadesmem/detail/write_runs.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/region_map.hpp>
+
+// Collects lots of small writes and applies them together. Writes which touch
+// or overlap are merged, and everything is written in address order with one
+// region query and (at most) one protection change and restore per region,
+// rather than per write as with Write. Where writes overlap the one added
+// last wins.
+//
+// With kAtomic the original bytes are read before they are overwritten. If
+// any part of the commit fails everything already written is put back before
+// the exception is propagated, and after a successful commit the whole batch
+// can be undone.
+
+namespace hadesmem
+{
+struct WriteBatchFlags
+{
+  enum : std::uint32_t
+  {
+    kNone = 0,
+    kAtomic = 1 << 0,
+    kInvalidFlagMaxValue = 1 << 1
+  };
+};
+
+class WriteBatch
+{
+public:
+  explicit WriteBatch(Process const& process,
+                      std::uint32_t flags = WriteBatchFlags::kNone)
+    : process_{&process}, flags_{flags}
+  {
+    HADESMEM_DETAIL_ASSERT(flags < WriteBatchFlags::kInvalidFlagMaxValue);
+  }
+
+  explicit WriteBatch(Process const&& process,
+                      std::uint32_t flags = WriteBatchFlags::kNone) = delete;
+
+  WriteBatch(WriteBatch const& other) = delete;
+
+  WriteBatch& operator=(WriteBatch const& other) = delete;
+
+  WriteBatch(WriteBatch&& other) noexcept
+    : process_{other.process_},
+      flags_{other.flags_},
+      writes_(std::move(other.writes_)),
+      originals_(std::move(other.originals_)),
+      is_committed_{other.is_committed_}
+  {
+    other.process_ = nullptr;
+    other.is_committed_ = false;
+  }
+
+  WriteBatch& operator=(WriteBatch&& other) noexcept
+  {
+    process_ = other.process_;
+    other.process_ = nullptr;
+    flags_ = other.flags_;
+    writes_ = std::move(other.writes_);
+    originals_ = std::move(other.originals_);
+    is_committed_ = other.is_committed_;
+    other.is_committed_ = false;
+    return *this;
+  }
+
+  template <typename T> void Add(PVOID address, T const& data)
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+
+    Add(address, std::addressof(data), sizeof(data));
+  }
+
+  template <typename T>
+  void Add(PVOID address, T const* ptr, std::size_t count)
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+
+    Add(address, static_cast<void const*>(ptr), sizeof(T) * count);
+  }
+
+  void Add(PVOID address, void const* data, std::size_t len)
+  {
+    HADESMEM_DETAIL_ASSERT(address != nullptr);
+    HADESMEM_DETAIL_ASSERT(data != nullptr || !len);
+
+    writes_.Add(reinterpret_cast<std::uintptr_t>(address), data, len);
+  }
+
+  template <typename T,
+            typename Traits = std::char_traits<T>,
+            typename Alloc = std::allocator<T>>
+  void AddString(PVOID address,
+                 std::basic_string<T, Traits, Alloc> const& data)
+  {
+    HADESMEM_DETAIL_STATIC_ASSERT(detail::IsCharType<T>::value);
+
+    Add(address, data.c_str(), data.size() + 1);
+  }
+
+  // Number of separate runs the batch will be written as. Forces the writes
+  // to be coalesced.
+  std::size_t GetNumRuns()
+  {
+    writes_.Coalesce();
+    return writes_.GetRuns().size();
+  }
+
+  bool empty() const noexcept
+  {
+    return writes_.empty();
+  }
+
+  // Drops the pending writes. Doesn't affect anything already committed, so
+  // an Undo is still possible.
+  void Clear() noexcept
+  {
+    writes_.Clear();
+  }
+
+  // The pending writes are cleared on success, so the batch can be reused.
+  // On failure (and without kAtomic) some of the writes may have been done.
+  void Commit()
+  {
+    Commit([&](void const* address) {
+      return detail::Query(*process_, address);
+    });
+  }
+
+  // The snapshot is only a hint. Anywhere it doesn't say the memory is
+  // already writable is queried again before its protection is changed.
+  void Commit(RegionMap const& regions)
+  {
+    Commit([&](void const* address) {
+      return regions.QueryForAccess(address, detail::ProtectGuardType::kWrite);
+    });
+  }
+
+  bool CanUndo() const noexcept
+  {
+    return is_committed_;
+  }
+
+  // Puts back everything the last successful commit overwrote. Requires
+  // kAtomic.
+  void Undo()
+  {
+    HADESMEM_DETAIL_ASSERT(!!(flags_ & WriteBatchFlags::kAtomic));
+
+    if (!is_committed_)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Nothing to undo."});
+    }
+
+    originals_.Coalesce();
+    Apply(originals_,
+          nullptr,
+          [&](void const* address) {
+            return detail::Query(*process_, address);
+          });
+    originals_.Clear();
+    is_committed_ = false;
+  }
+
+private:
+  template <typename QueryFunc> void Commit(QueryFunc const& query)
+  {
+    HADESMEM_DETAIL_ASSERT(process_ != nullptr);
+
+    writes_.Coalesce();
+
+    if (!(flags_ & WriteBatchFlags::kAtomic))
+    {
+      Apply(writes_, nullptr, query);
+      writes_.Clear();
+      return;
+    }
+
+    detail::WriteRuns originals;
+    try
+    {
+      Apply(writes_, &originals, query);
+    }
+    catch (...)
+    {
+      RollbackUnchecked(originals, query);
+      throw;
+    }
+
+    originals_ = std::move(originals);
+    is_committed_ = true;
+    writes_.Clear();
+  }
+
+  template <typename QueryFunc>
+  void RollbackUnchecked(detail::WriteRuns& originals,
+                         QueryFunc const& query) noexcept
+  {
+    try
+    {
+      originals.Coalesce();
+      Apply(originals, nullptr, query);
+    }
+    catch (...)
+    {
+      // WARNING: Target is left with only part of the batch written.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+  }
+
+  // Writes the runs region by region. If originals is non-null the bytes
+  // about to be overwritten are added to it first (so a partial write can
+  // be rolled back too).
+  template <typename QueryFunc>
+  void Apply(detail::WriteRuns const& runs,
+             detail::WriteRuns* originals,
+             QueryFunc const& query)
+  {
+    HADESMEM_DETAIL_ASSERT(runs.IsCoalesced());
+
+    auto const& run_list = runs.GetRuns();
+    std::vector<std::uint8_t> original;
+    std::size_t index = 0;
+    std::size_t run_offset = 0;
+    while (index < run_list.size())
+    {
+      auto address = static_cast<std::uintptr_t>(run_list[index].address) +
+                     run_offset;
+      MEMORY_BASIC_INFORMATION const mbi =
+        query(reinterpret_cast<void const*>(address));
+      std::uintptr_t const region_end =
+        reinterpret_cast<std::uintptr_t>(mbi.BaseAddress) + mbi.RegionSize;
+
+      detail::ProtectGuard protect_guard{
+        *process_, mbi, detail::ProtectGuardType::kWrite};
+
+      // Everything (or the part of it) that falls in this region.
+      while (index < run_list.size() && address < region_end)
+      {
+        detail::WriteRun const& run = run_list[index];
+        std::size_t const len = static_cast<std::size_t>((std::min)(
+          static_cast<std::uintptr_t>(run.size - run_offset),
+          region_end - address));
+        auto const address_ptr = reinterpret_cast<PVOID>(address);
+
+        if (originals)
+        {
+          original.resize(len);
+          detail::ReadUnchecked(*process_, address_ptr, original.data(), len);
+          originals->Add(address, original.data(), len);
+        }
+
+        detail::WriteUnchecked(
+          *process_, address_ptr, runs.GetData(run) + run_offset, len);
+
+        run_offset += len;
+        if (run_offset == run.size)
+        {
+          run_offset = 0;
+          if (++index < run_list.size())
+          {
+            address = static_cast<std::uintptr_t>(run_list[index].address);
+          }
+        }
+        else
+        {
+          address += len;
+        }
+      }
+
+      protect_guard.Restore();
+    }
+  }
+
+  Process const* process_;
+  std::uint32_t flags_;
+  detail::WriteRuns writes_;
+  detail::WriteRuns originals_;
+  bool is_committed_{};
+};
+}
@@ -0,0 +1,127 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/async_writer.hpp>
+#include <hadesmem/detail/async_writer.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of PeDumper.
+
+void TestAsyncWriterOrder()
+{
+  std::vector<int> order;
+  {
+    hadesmem::detail::AsyncWriter writer{0x1000};
+    for (int i = 0; i < 100; ++i)
+    {
+      writer.Queue(0x10, [&order, i]() { order.push_back(i); });
+    }
+    writer.Flush();
+    BOOST_TEST_EQ(order.size(), 100UL);
+    BOOST_TEST_EQ(writer.GetPendingBytes(), 0UL);
+
+    // Queued but not flushed, so the destructor has to do it.
+    writer.Queue(0, [&order]() { order.push_back(100); });
+  }
+
+  BOOST_TEST_EQ(order.size(), 101UL);
+  for (std::size_t i = 0; i < order.size(); ++i)
+  {
+    BOOST_TEST_EQ(order[i], static_cast<int>(i));
+  }
+}
+
+void TestAsyncWriterErrors()
+{
+  hadesmem::detail::AsyncWriter writer{0x1000};
+  int num_written = 0;
+  writer.Queue(1, [&]() { ++num_written; });
+  writer.Queue(1, []() { throw std::runtime_error{"first"}; });
+  writer.Queue(1, []() { throw std::runtime_error{"second"}; });
+  writer.Queue(1, [&]() { ++num_written; });
+
+  bool caught = false;
+  try
+  {
+    writer.Flush();
+  }
+  catch (std::runtime_error const& e)
+  {
+    caught = true;
+    BOOST_TEST_EQ(std::string{e.what()}, std::string{"first"});
+  }
+  BOOST_TEST(caught);
+  BOOST_TEST_EQ(num_written, 2);
+
+  // The error is only reported once.
+  writer.Flush();
+}
+
+void TestAsyncWriterBackpressure()
+{
+  std::size_t const kMaxPending = 0x100;
+  std::atomic<std::size_t> held{0};
+  std::atomic<std::size_t> max_held{0};
+  {
+    hadesmem::detail::AsyncWriter writer{kMaxPending};
+    std::vector<std::thread> producers;
+    for (std::size_t t = 0; t < 4; ++t)
+    {
+      producers.emplace_back([&, t]() {
+        for (std::size_t i = 0; i < 50; ++i)
+        {
+          std::size_t const size = 0x10 + ((t * 50 + i) % 4) * 0x10;
+          auto const buffer = std::make_shared<std::vector<char>>(size);
+          std::size_t const now = (held += size);
+          std::size_t prev = max_held;
+          while (now > prev && !max_held.compare_exchange_weak(prev, now))
+          {
+          }
+          writer.Queue(size, [&held, buffer]() {
+            std::this_thread::yield();
+            held -= buffer->size();
+          });
+        }
+      });
+    }
+
+    for (auto& producer : producers)
+    {
+      producer.join();
+    }
+
+    writer.Flush();
+    BOOST_TEST_EQ(held.load(), 0UL);
+  }
+
+  // Producers count their buffer before it is queued, so allow for one in
+  // flight per producer on top of the limit.
+  BOOST_TEST(max_held.load() <= kMaxPending + 4 * 0x40);
+
+  // A single write bigger than the limit still goes through.
+  hadesmem::detail::AsyncWriter writer{0x10};
+  bool written = false;
+  writer.Queue(0x100, [&]() { written = true; });
+  writer.Queue(0x100, []() {});
+  writer.Flush();
+  BOOST_TEST(written);
+}
+
+int main()
+{
+  TestAsyncWriterOrder();
+  TestAsyncWriterErrors();
+  TestAsyncWriterBackpressure();
+  return boost::report_errors();
+}
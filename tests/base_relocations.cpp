@@ -0,0 +1,302 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/base_relocations.hpp>
+#include <hadesmem/detail/base_relocations.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/detail/pe_samples.hpp>
+
+// Only uses the OS independent parts of RelocationTable.
+
+namespace
+{
+// Lays the sample out the way the loader would (the headers, then the first
+// section at its RVA). Only the first section is needed by these tests.
+std::vector<std::uint8_t>
+  MapPeSample(hadesmem::detail::PeSampleBuilder const& builder)
+{
+  auto const file = builder.Build();
+  std::size_t const headers_size = builder.GetHeadersSize();
+  std::size_t const section_rva =
+    hadesmem::detail::PeSampleBuilder::kSectionRva;
+  std::vector<std::uint8_t> image(section_rva + file.size() - headers_size);
+  std::copy(
+    std::begin(file), std::begin(file) + headers_size, std::begin(image));
+  std::copy(std::begin(file) + headers_size,
+            std::end(file),
+            std::begin(image) + section_rva);
+  return image;
+}
+
+std::uint32_t GetRelocDirSize(std::vector<std::uint8_t> const& image,
+                              hadesmem::detail::PeSampleBuilder const& builder)
+{
+  auto const offset = builder.GetDataDirOffset(
+    hadesmem::detail::PeSampleBuilder::kDirBaseReloc);
+  return static_cast<std::uint32_t>(
+    hadesmem::detail::PeekPeSample(image, offset + 4, 4));
+}
+
+void PutWord(std::vector<std::uint8_t>& data, std::uint16_t value)
+{
+  data.push_back(static_cast<std::uint8_t>(value));
+  data.push_back(static_cast<std::uint8_t>(value >> 8));
+}
+
+void PutBlockHeader(std::vector<std::uint8_t>& data,
+                    std::uint32_t virtual_address,
+                    std::uint32_t size_of_block)
+{
+  PutWord(data, static_cast<std::uint16_t>(virtual_address));
+  PutWord(data, static_cast<std::uint16_t>(virtual_address >> 16));
+  PutWord(data, static_cast<std::uint16_t>(size_of_block));
+  PutWord(data, static_cast<std::uint16_t>(size_of_block >> 16));
+}
+}
+
+void TestDecodeRelocationEntry()
+{
+  auto const entry = hadesmem::detail::DecodeRelocationEntry(0xA123);
+  BOOST_TEST_EQ(entry.type, 10);
+  BOOST_TEST_EQ(entry.offset, 0x123);
+
+  auto const absolute = hadesmem::detail::DecodeRelocationEntry(0x0000);
+  BOOST_TEST_EQ(absolute.type, 0);
+  BOOST_TEST_EQ(absolute.offset, 0);
+
+  std::uint8_t const raw[] = {0xFF, 0x3F, 0x00, 0x10};
+  std::vector<hadesmem::detail::RelocationEntry> entries;
+  hadesmem::detail::AppendRelocationEntries(raw, 2, entries);
+  BOOST_TEST_EQ(entries.size(), 2UL);
+  BOOST_TEST_EQ(entries[0].type, 3);
+  BOOST_TEST_EQ(entries[0].offset, 0xFFF);
+  BOOST_TEST_EQ(entries[1].type, 1);
+  BOOST_TEST_EQ(entries[1].offset, 0);
+}
+
+void TestBaseRelocationsSample()
+{
+  for (bool const is_64 : {false, true})
+  {
+    hadesmem::detail::PeSampleBuilder builder{is_64};
+    auto const blocks = hadesmem::detail::AddPeSampleRelocations(builder);
+    auto image = MapPeSample(builder);
+    auto const ptr_size = builder.GetPtrSize();
+    std::uint8_t const type = is_64 ? 10 : 3;
+
+    hadesmem::detail::BaseRelocations const relocs{
+      image.data() + blocks, GetRelocDirSize(image, builder)};
+    BOOST_TEST(!relocs.IsTruncated());
+    BOOST_TEST_EQ(relocs.GetNumBlocks(), 2UL);
+    BOOST_TEST_EQ(relocs.GetNumEntries(), 6UL);
+    BOOST_TEST_EQ(relocs.GetBlock(0).size_of_block, 16UL);
+    BOOST_TEST_EQ(relocs.GetEntries(0).size(), 4UL);
+    BOOST_TEST_EQ(relocs.GetEntries(1).size(), 2UL);
+    BOOST_TEST_EQ(relocs.GetEntries(0)[3].type, 0);
+    for (auto const& entry : relocs.GetEntries(1))
+    {
+      BOOST_TEST_EQ(entry.type, type);
+    }
+
+    auto const page = relocs.GetBlock(0).virtual_address;
+    std::uint32_t const targets = page + relocs.GetEntries(0)[0].offset;
+    auto const image_base = builder.GetImageBase();
+    std::uint64_t const delta = is_64 ? 0x123456789000ULL : 0x10000000ULL;
+    auto const result = hadesmem::detail::ApplyRelocations(
+      image.data(), image.size(), relocs, delta);
+    BOOST_TEST_EQ(result.num_applied, 5UL);
+    BOOST_TEST_EQ(result.num_skipped, 1UL);
+    BOOST_TEST_EQ(result.num_out_of_bounds, 0UL);
+    BOOST_TEST_EQ(result.num_unsupported, 0UL);
+
+    // The second block relocates the first pointer twice more.
+    auto const get = [&](std::size_t i) {
+      return hadesmem::detail::PeekPeSample(
+        image, targets + i * ptr_size, ptr_size);
+    };
+    std::uint64_t const mask = is_64 ? ~0ULL : 0xFFFFFFFFULL;
+    BOOST_TEST_EQ(get(0), (image_base + targets + 3 * delta) & mask);
+    BOOST_TEST_EQ(get(1), (image_base + targets + delta) & mask);
+    BOOST_TEST_EQ(get(2), (image_base + targets + delta) & mask);
+  }
+}
+
+void TestBaseRelocationsMalformed()
+{
+  // SizeOfBlock of zero is an empty block, and the walk carries on.
+  std::vector<std::uint8_t> zero;
+  PutBlockHeader(zero, 0x1000, 0);
+  PutBlockHeader(zero, 0x2000, 10);
+  PutWord(zero, 0x3004);
+  hadesmem::detail::BaseRelocations const zero_relocs{zero.data(),
+                                                      zero.size()};
+  BOOST_TEST(!zero_relocs.IsTruncated());
+  BOOST_TEST_EQ(zero_relocs.GetNumBlocks(), 2UL);
+  BOOST_TEST(zero_relocs.GetEntries(0).empty());
+  BOOST_TEST_EQ(zero_relocs.GetEntries(1).size(), 1UL);
+
+  // Runs past the end of the directory.
+  std::vector<std::uint8_t> oob;
+  PutBlockHeader(oob, 0x1000, 12);
+  PutWord(oob, 0x3000);
+  PutWord(oob, 0x3004);
+  PutBlockHeader(oob, 0x2000, 0xFFFFFFF0);
+  PutWord(oob, 0x3000);
+  hadesmem::detail::BaseRelocations const oob_relocs{oob.data(), oob.size()};
+  BOOST_TEST(oob_relocs.IsTruncated());
+  BOOST_TEST_EQ(oob_relocs.GetNumBlocks(), 1UL);
+  BOOST_TEST_EQ(oob_relocs.GetNumEntries(), 2UL);
+
+  // Too small to hold its own header.
+  std::vector<std::uint8_t> small;
+  PutBlockHeader(small, 0x1000, 4);
+  hadesmem::detail::BaseRelocations const small_relocs{small.data(),
+                                                       small.size()};
+  BOOST_TEST(small_relocs.IsTruncated());
+  BOOST_TEST_EQ(small_relocs.GetNumBlocks(), 0UL);
+
+  // Trailing partial header.
+  std::vector<std::uint8_t> partial;
+  PutBlockHeader(partial, 0x1000, 10);
+  PutWord(partial, 0x3000);
+  PutWord(partial, 0x1234);
+  hadesmem::detail::BaseRelocations const partial_relocs{partial.data(),
+                                                         partial.size()};
+  BOOST_TEST(partial_relocs.IsTruncated());
+  BOOST_TEST_EQ(partial_relocs.GetNumBlocks(), 1UL);
+
+  hadesmem::detail::BaseRelocations const empty_relocs{nullptr, 0};
+  BOOST_TEST(!empty_relocs.IsTruncated());
+  BOOST_TEST_EQ(empty_relocs.GetNumBlocks(), 0UL);
+}
+
+void TestApplyRelocationsRuns()
+{
+  // Runs of every length around the SSE2 batch sizes, with the odd entry of
+  // another type (or a gap) in between to break them up.
+  std::size_t const image_size = 0x3000;
+  std::vector<std::uint8_t> image(image_size);
+  for (std::size_t i = 0; i < image_size; ++i)
+  {
+    image[i] = static_cast<std::uint8_t>(i * 7);
+  }
+  auto const original = image;
+
+  std::vector<std::uint8_t> dir;
+  std::vector<std::uint16_t> words;
+  std::vector<std::pair<std::uint32_t, std::uint8_t>> expected;
+  std::uint16_t offset = 0;
+  for (std::size_t len = 1; len <= 9; ++len)
+  {
+    std::uint8_t const type = (len % 2) ? 3 : 10;
+    std::uint16_t const width = type == 3 ? 4 : 8;
+    for (std::size_t i = 0; i < len; ++i)
+    {
+      words.push_back(static_cast<std::uint16_t>((type << 12) | offset));
+      expected.emplace_back(0x1000 + offset, type);
+      offset = static_cast<std::uint16_t>(offset + width);
+    }
+    words.push_back(0);
+    // Misaligned, to make sure nothing relies on alignment.
+    offset = static_cast<std::uint16_t>(offset + 1);
+  }
+  // HIGH and LOW.
+  words.push_back(static_cast<std::uint16_t>((1 << 12) | 0x800));
+  words.push_back(static_cast<std::uint16_t>((2 << 12) | 0x802));
+  // Unsupported (IMAGE_REL_BASED_HIGHADJ).
+  words.push_back(static_cast<std::uint16_t>((4 << 12) | 0x900));
+  if (words.size() % 2)
+  {
+    words.push_back(0);
+  }
+
+  PutBlockHeader(
+    dir, 0x1000, static_cast<std::uint32_t>(8 + words.size() * 2));
+  for (auto const word : words)
+  {
+    PutWord(dir, word);
+  }
+  // A fixup which starts inside the image and ends outside of it.
+  PutBlockHeader(dir, 0x2000, 8 + 4 * 2);
+  PutWord(dir, static_cast<std::uint16_t>((10 << 12) | 0xFE8));
+  PutWord(dir, static_cast<std::uint16_t>((10 << 12) | 0xFF0));
+  PutWord(dir, static_cast<std::uint16_t>((10 << 12) | 0x000));
+  PutWord(dir, static_cast<std::uint16_t>((3 << 12) | 0xFFE));
+
+  hadesmem::detail::BaseRelocations const relocs{dir.data(), dir.size()};
+  BOOST_TEST(!relocs.IsTruncated());
+
+  std::uint64_t const delta = 0xFEDCBA9876543211ULL;
+  auto const result = hadesmem::detail::ApplyRelocations(
+    image.data(), image_size, relocs, delta);
+  BOOST_TEST_EQ(result.num_applied, expected.size() + 2 + 3);
+  BOOST_TEST_EQ(result.num_unsupported, 1UL);
+  BOOST_TEST_EQ(result.num_out_of_bounds, 1UL);
+
+  auto const peek = [](std::vector<std::uint8_t> const& data,
+                       std::size_t rva,
+                       std::size_t size) {
+    return hadesmem::detail::PeekPeSample(data, rva, size);
+  };
+  for (auto const& e : expected)
+  {
+    if (e.second == 3)
+    {
+      BOOST_TEST_EQ(peek(image, e.first, 4),
+                    (peek(original, e.first, 4) + delta) & 0xFFFFFFFFULL);
+    }
+    else
+    {
+      BOOST_TEST_EQ(peek(image, e.first, 8),
+                    peek(original, e.first, 8) + delta);
+    }
+  }
+
+  BOOST_TEST_EQ(peek(image, 0x1800, 2),
+                (peek(original, 0x1800, 2) + ((delta >> 16) & 0xFFFF)) &
+                  0xFFFF);
+  BOOST_TEST_EQ(peek(image, 0x1802, 2),
+                (peek(original, 0x1802, 2) + (delta & 0xFFFF)) & 0xFFFF);
+  BOOST_TEST_EQ(peek(image, 0x1900, 2), peek(original, 0x1900, 2));
+
+  BOOST_TEST_EQ(peek(image, 0x2FE8, 8), peek(original, 0x2FE8, 8) + delta);
+  BOOST_TEST_EQ(peek(image, 0x2FF0, 8), peek(original, 0x2FF0, 8) + delta);
+  BOOST_TEST_EQ(peek(image, 0x2000, 8), peek(original, 0x2000, 8) + delta);
+  BOOST_TEST_EQ(peek(image, 0x2FFE, 2), peek(original, 0x2FFE, 2));
+
+  // The same fixups against a smaller image, which cuts the last run short.
+  auto truncated = original;
+  auto const truncated_result = hadesmem::detail::ApplyRelocations(
+    truncated.data(), 0x2FF4, relocs, delta);
+  BOOST_TEST_EQ(truncated_result.num_out_of_bounds, 2UL);
+  BOOST_TEST_EQ(peek(truncated, 0x2FE8, 8),
+                peek(original, 0x2FE8, 8) + delta);
+  BOOST_TEST_EQ(peek(truncated, 0x2FF0, 8), peek(original, 0x2FF0, 8));
+
+  // Nothing outside of the fixups was touched.
+  std::size_t num_changed = 0;
+  for (std::size_t i = 0; i < image_size; ++i)
+  {
+    num_changed += image[i] != original[i];
+  }
+  BOOST_TEST(num_changed <= expected.size() * 8 + 2 + 2 + 3 * 8);
+}
+
+int main()
+{
+  TestDecodeRelocationEntry();
+  TestBaseRelocationsSample();
+  TestBaseRelocationsMalformed();
+  TestApplyRelocationsRuns();
+  return boost::report_errors();
+}
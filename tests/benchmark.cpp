@@ -0,0 +1,114 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/benchmark.hpp>
+#include <hadesmem/detail/benchmark.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of the benchmark suite. Time comes from
+// a fake clock which each call to the benchmark advances, so the results are
+// exact.
+
+void TestBenchmarkRunner()
+{
+  std::chrono::nanoseconds now{};
+  auto const clock = [&]() { return now; };
+
+  hadesmem::detail::BenchmarkRunner runner{
+    std::chrono::milliseconds{100}, clock, clock};
+
+  std::uint64_t calls = 0;
+  BOOST_TEST(runner.Run("one_ms", 10, 0x100000, [&]() {
+    ++calls;
+    now += std::chrono::milliseconds{1};
+  }));
+
+  auto const& results = runner.GetResults();
+  BOOST_TEST_EQ(results.size(), 1UL);
+  auto const& r = results[0];
+  BOOST_TEST_EQ(r.name, "one_ms");
+  // Batches grow by at most 10x, and only the last one counts.
+  BOOST_TEST(r.iterations >= 100);
+  BOOST_TEST(r.iterations < calls);
+  BOOST_TEST_EQ(r.real_time_ns, 1e6);
+  BOOST_TEST(r.has_cpu_time);
+  BOOST_TEST_EQ(r.cpu_time_ns, 1e6);
+  BOOST_TEST_EQ(r.items_per_second, 10000.0);
+  BOOST_TEST_EQ(r.bytes_per_second, 1024.0 * 1024 * 1000);
+
+  // A benchmark which doesn't move the clock still finishes.
+  BOOST_TEST(runner.Run("free", 1, 0, []() {}));
+  BOOST_TEST_EQ(runner.GetResults().back().iterations, 1000000000ULL);
+}
+
+void TestBenchmarkFilter()
+{
+  std::chrono::nanoseconds now{};
+  hadesmem::detail::BenchmarkRunner runner{
+    std::chrono::milliseconds{1}, nullptr, [&]() { return now; }};
+  auto const step = [&]() { now += std::chrono::milliseconds{1}; };
+
+  runner.SetFilter("^parse/.*/small$");
+  BOOST_TEST(runner.IsEnabled("parse/export_list/small"));
+  BOOST_TEST(!runner.IsEnabled("parse/export_list/huge"));
+  BOOST_TEST(!runner.Run("dump/huge", 1, 1, step));
+  BOOST_TEST(runner.Run("parse/tls_dir/small", 1, 1, step));
+  BOOST_TEST_EQ(runner.GetResults().size(), 1UL);
+  BOOST_TEST(!runner.GetResults()[0].has_cpu_time);
+
+  runner.SetFilter("");
+  BOOST_TEST(runner.IsEnabled("dump/huge"));
+}
+
+void TestBenchmarkJson()
+{
+  std::chrono::nanoseconds now{};
+  hadesmem::detail::BenchmarkRunner runner{
+    std::chrono::milliseconds{1}, nullptr, [&]() { return now; }};
+  runner.Run("a\"b\\c\x01", 2, 0, [&]() {
+    now += std::chrono::milliseconds{1};
+  });
+
+  std::ostringstream log;
+  runner.SetLog(&log);
+  runner.Run("logged", 1, 1, [&]() { now += std::chrono::milliseconds{1}; });
+  BOOST_TEST_EQ(log.str().compare(0, 6, "logged"), 0);
+
+  std::ostringstream out;
+  out.precision(3);
+  runner.WriteJson(out, {{"version", "1.0"}, {"arch", "x64"}});
+  auto const json = out.str();
+  // Restored afterwards.
+  BOOST_TEST_EQ(out.precision(), 3);
+
+  BOOST_TEST(json.find("\"version\": \"1.0\",\n    \"arch\": \"x64\"") !=
+             std::string::npos);
+  BOOST_TEST(json.find("\"name\": \"a\\\"b\\\\c\\u0001\"") !=
+             std::string::npos);
+  BOOST_TEST(json.find("\"real_time\": 1000000,") != std::string::npos);
+  BOOST_TEST(json.find("\"items_per_second\": 2000,") != std::string::npos);
+  BOOST_TEST(json.find("\"time_unit\": \"ns\"") != std::string::npos);
+  BOOST_TEST(json.find("cpu_time") == std::string::npos);
+  BOOST_TEST_EQ(json.back(), '\n');
+
+  BOOST_TEST_EQ(hadesmem::detail::EscapeJsonString("plain"), "plain");
+  BOOST_TEST_EQ(hadesmem::detail::EscapeJsonString("\n\t"), "\\n\\t");
+}
+
+int main()
+{
+  TestBenchmarkRunner();
+  TestBenchmarkFilter();
+  TestBenchmarkJson();
+  return boost::report_errors();
+}
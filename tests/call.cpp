@@ -4,7 +4,11 @@
 #include <hadesmem/call.hpp>
 #include <hadesmem/call.hpp>
 
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
@@ -14,6 +18,7 @@
 #include <hadesmem/detail/static_assert.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
+#include <hadesmem/remote_call_server.hpp>
 
 // TODO: Test argument combinations more thoroughly.
 
@@ -446,8 +451,149 @@ void TestCall()
   BOOST_TEST_EQ(multi_call_ret[3].GetReturnValue<DWORD_PTR>(), 0x1234U);
 }
 
+void TestCallStubCache()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::FlushCallStubCache(process);
+
+  // Same signature, different values. Only the first call should generate
+  // a stub.
+  for (std::uint32_t i = 0; i < 3; ++i)
+  {
+    auto const call_ret = hadesmem::Call(
+      process, &MultiThreadSet, hadesmem::CallConv::kDefault, 0x1000UL + i);
+    BOOST_TEST_EQ(call_ret.GetLastError(), 0x1000UL + i);
+  }
+  auto const cache = hadesmem::detail::GetCallStubProcessCache(process);
+  BOOST_TEST_EQ(cache->GetNumStubs(), 1UL);
+
+  auto const call_ret =
+    hadesmem::Call(process, &TestCallDoubleRet, hadesmem::CallConv::kDefault);
+  BOOST_TEST_EQ(call_ret.GetReturnValue(), 9.876);
+  BOOST_TEST_EQ(cache->GetNumStubs(), 2UL);
+
+  hadesmem::FlushCallStubCache(process);
+  BOOST_TEST(hadesmem::detail::GetCallStubProcessCache(process) != cache);
+}
+
+// Fails the first time a result is written out.
+struct ThrowingOutputIterator
+  : std::iterator<std::output_iterator_tag, void, void, void, void>
+{
+  ThrowingOutputIterator& operator*()
+  {
+    return *this;
+  }
+
+  ThrowingOutputIterator& operator++()
+  {
+    return *this;
+  }
+
+  ThrowingOutputIterator& operator=(hadesmem::CallResultRaw const& /*result*/)
+  {
+    throw std::runtime_error{"ThrowingOutputIterator"};
+  }
+};
+
+void TestRemoteCallServer()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::RemoteCallServer server{process, 2};
+
+  // More calls than slots, and the same signatures repeatedly, so we exercise
+  // both the ring wrapping and the stub cache.
+  for (std::size_t i = 0; i < 5; ++i)
+  {
+    auto const call_int_ret = server.Call(&TestInteger,
+                                          hadesmem::CallConv::kDefault,
+                                          0xAAAAAAAAU,
+                                          0xBBBBBBBBU,
+                                          0xCCCCCCCCU,
+                                          0xDDDDDDDDU,
+                                          0xEEEEEEEEU,
+                                          0xFFFFFFFFU);
+    BOOST_TEST_EQ(call_int_ret.GetReturnValue(), 0x12345678UL);
+    BOOST_TEST_EQ(call_int_ret.GetLastError(), 0x87654321UL);
+
+    auto const call_double_ret = server.Call(&TestDouble,
+                                             hadesmem::CallConv::kDefault,
+                                             1.11111,
+                                             2.22222,
+                                             3.33333,
+                                             4.44444,
+                                             5.55555,
+                                             6.66666);
+    BOOST_TEST_EQ(call_double_ret.GetReturnValue(), 1.23456);
+  }
+  BOOST_TEST_EQ(server.GetNumCachedStubs(), 2UL);
+
+  auto const call_float_ret = server.Call(&TestFloat,
+                                          hadesmem::CallConv::kDefault,
+                                          1.11111f,
+                                          2.22222f,
+                                          3.33333f,
+                                          4.44444f,
+                                          5.55555f,
+                                          6.66666f);
+  BOOST_TEST_EQ(call_float_ret.GetReturnValue(), 1.23456f);
+  BOOST_TEST_EQ(server.GetNumCachedStubs(), 3UL);
+
+  void* const addresses[] = {reinterpret_cast<void*>(&MultiThreadSet),
+                             reinterpret_cast<void*>(&MultiThreadGet),
+                             reinterpret_cast<void*>(&MultiThreadSet),
+                             reinterpret_cast<void*>(&MultiThreadGet)};
+  hadesmem::CallConv const call_convs[] = {hadesmem::CallConv::kDefault,
+                                           hadesmem::CallConv::kDefault,
+                                           hadesmem::CallConv::kDefault,
+                                           hadesmem::CallConv::kDefault};
+  std::vector<hadesmem::CallArg> const args_full[] = {
+    {hadesmem::CallArg{static_cast<DWORD>(0x1337UL)}},
+    {},
+    {hadesmem::CallArg{static_cast<DWORD>(0x1234UL)}},
+    {}};
+  std::vector<hadesmem::CallResultRaw> multi_call_ret;
+  server.CallMulti(std::begin(addresses),
+                   std::end(addresses),
+                   std::begin(call_convs),
+                   std::begin(args_full),
+                   std::back_inserter(multi_call_ret));
+  BOOST_TEST_EQ(multi_call_ret.size(), 4UL);
+  BOOST_TEST_EQ(multi_call_ret[0].GetLastError(), 0x1337UL);
+  BOOST_TEST_EQ(multi_call_ret[1].GetReturnValue<DWORD_PTR>(), 0x1337U);
+  BOOST_TEST_EQ(multi_call_ret[2].GetLastError(), 0x1234UL);
+  BOOST_TEST_EQ(multi_call_ret[3].GetReturnValue<DWORD_PTR>(), 0x1234U);
+
+  // A failure after some of the calls were posted mustn't leave the ring
+  // unusable.
+  BOOST_TEST_THROWS(server.CallMulti(std::begin(addresses),
+                                     std::end(addresses),
+                                     std::begin(call_convs),
+                                     std::begin(args_full),
+                                     ThrowingOutputIterator{}),
+                    std::runtime_error);
+  for (std::size_t i = 0; i < 5; ++i)
+  {
+    auto const call_float_ret_2 = server.Call(&TestFloat,
+                                              hadesmem::CallConv::kDefault,
+                                              1.11111f,
+                                              2.22222f,
+                                              3.33333f,
+                                              4.44444f,
+                                              5.55555f,
+                                              6.66666f);
+    BOOST_TEST_EQ(call_float_ret_2.GetReturnValue(), 1.23456f);
+  }
+
+  server.Stop();
+}
+
 int main()
 {
   TestCall();
+  TestCallStubCache();
+  TestRemoteCallServer();
   return boost::report_errors();
 }
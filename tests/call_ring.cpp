@@ -0,0 +1,223 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/call_ring.hpp>
+#include <hadesmem/detail/call_ring.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/detail/call_stub_cache.hpp>
+
+// Only uses the OS independent parts of the remote call server, with a local
+// thread standing in for the server thread in the target.
+
+namespace
+{
+std::uint64_t ReadSlot(void const* data, std::size_t offset)
+{
+  std::uint64_t value = 0;
+  std::memcpy(&value, static_cast<std::uint8_t const*>(data) + offset, 8);
+  return value;
+}
+
+// The 'stub' is the number of 64-bit integer arguments. The 'call' adds them
+// to the address.
+hadesmem::detail::CallSignature MakeSumSignature(std::size_t num_args)
+{
+  hadesmem::detail::CallSignature signature;
+  signature.AddCall(0);
+  for (std::size_t i = 0; i < num_args; ++i)
+  {
+    signature.AddArg(hadesmem::detail::CallArgKind::kInt64);
+  }
+  return signature;
+}
+
+void ServeSum(std::uint64_t stub, void* data)
+{
+  hadesmem::detail::CallDataLayout const layout{
+    MakeSumSignature(static_cast<std::size_t>(stub))};
+  std::uint64_t sum = ReadSlot(data, layout.GetAddressOffset(0));
+  for (std::size_t i = 0; i < stub; ++i)
+  {
+    sum += ReadSlot(data, layout.GetArgOffset(0, i));
+  }
+  std::memcpy(
+    static_cast<std::uint8_t*>(data) + layout.GetResultOffset(0), &sum, 8);
+}
+}
+
+void TestCallSignature()
+{
+  using hadesmem::detail::CallArgKind;
+  using hadesmem::detail::CallSignature;
+
+  CallSignature a;
+  a.AddCall(1);
+  a.AddArg(CallArgKind::kInt32);
+  a.AddArg(CallArgKind::kFloat64);
+  CallSignature b;
+  b.AddCall(1);
+  b.AddArg(CallArgKind::kInt32);
+  b.AddArg(CallArgKind::kFloat64);
+  BOOST_TEST(a == b);
+  BOOST_TEST_EQ(a.GetHash(), b.GetHash());
+
+  CallSignature c;
+  c.AddCall(2);
+  c.AddArg(CallArgKind::kInt32);
+  c.AddArg(CallArgKind::kFloat64);
+  BOOST_TEST(a != c);
+
+  // Same argument list split differently between calls.
+  CallSignature d;
+  d.AddCall(1);
+  d.AddArg(CallArgKind::kInt32);
+  d.AddCall(1);
+  d.AddArg(CallArgKind::kFloat64);
+  BOOST_TEST(a != d);
+  BOOST_TEST_EQ(d.GetNumCalls(), 2UL);
+  BOOST_TEST_EQ(d.GetMaxNumArgs(), 1UL);
+  BOOST_TEST(d.GetArg(1, 0) == CallArgKind::kFloat64);
+
+  hadesmem::detail::CallDataLayout const layout{d};
+  BOOST_TEST_EQ(layout.GetAddressOffset(0), 0UL);
+  BOOST_TEST_EQ(layout.GetArgOffset(0, 0), 8UL);
+  BOOST_TEST_EQ(layout.GetResultOffset(0), 16UL);
+  BOOST_TEST_EQ(layout.GetAddressOffset(1),
+                16UL + hadesmem::detail::CallDataLayout::kResultSize);
+  BOOST_TEST_EQ(layout.GetSize(),
+                2 * hadesmem::detail::CallDataLayout::GetSize(1));
+
+  hadesmem::detail::CallStubCache<int> cache;
+  int num_generated = 0;
+  auto const factory = [&](CallSignature const& /*signature*/) {
+    return ++num_generated;
+  };
+  int const& stub_a = cache.GetOrCreate(a, factory);
+  BOOST_TEST_EQ(cache.GetOrCreate(b, factory), stub_a);
+  BOOST_TEST_EQ(cache.GetOrCreate(c, factory), 2);
+  BOOST_TEST_EQ(cache.GetOrCreate(d, factory), 3);
+  BOOST_TEST_EQ(cache.GetOrCreate(a, factory), 1);
+  BOOST_TEST_EQ(num_generated, 3);
+  BOOST_TEST_EQ(cache.size(), 3UL);
+  BOOST_TEST(cache.Find(b) == &stub_a);
+  BOOST_TEST(cache.Find(CallSignature{}) == nullptr);
+  cache.Clear();
+  BOOST_TEST(cache.empty());
+}
+
+void TestCallRing()
+{
+  std::size_t const kNumSlots = 4;
+  std::size_t const kMaxArgs = 4;
+  std::size_t const data_size =
+    hadesmem::detail::CallDataLayout::GetSize(kMaxArgs);
+  std::vector<std::uint64_t> memory(
+    hadesmem::detail::CallRing::GetRequiredSize(kNumSlots, data_size) /
+      sizeof(std::uint64_t) +
+    1);
+  hadesmem::detail::CallRing::Format(memory.data(), kNumSlots, data_size);
+
+  hadesmem::detail::CallRing client{memory.data()};
+  BOOST_TEST_EQ(client.GetNumSlots(), kNumSlots);
+  BOOST_TEST(client.GetDataSize() >= data_size);
+  BOOST_TEST_EQ(reinterpret_cast<std::uintptr_t>(client.GetData(1)) -
+                  reinterpret_cast<std::uintptr_t>(client.GetData(0)),
+                hadesmem::detail::CallRing::GetSlotSize(data_size));
+
+  std::atomic<std::size_t> num_served{0};
+  std::thread server_thread{[&]() {
+    hadesmem::detail::CallRing server{memory.data()};
+    for (;;)
+    {
+      if (server.TryServe(&ServeSum))
+      {
+        ++num_served;
+        continue;
+      }
+
+      if (server.IsStopRequested())
+      {
+        break;
+      }
+
+      std::this_thread::yield();
+    }
+  }};
+
+  // More calls than slots, so we have to wait on old calls to post new ones.
+  std::size_t const kNumCalls = 100;
+  std::deque<std::size_t> outstanding;
+  std::vector<std::uint64_t> results;
+  auto const complete = [&]() {
+    std::size_t const slot = outstanding.front();
+    outstanding.pop_front();
+    while (!client.IsDone(slot))
+    {
+      std::this_thread::yield();
+    }
+    results.push_back(ReadSlot(
+      client.GetData(slot),
+      hadesmem::detail::CallDataLayout{MakeSumSignature(kMaxArgs)}
+        .GetResultOffset(0)));
+    client.Release(slot);
+  };
+
+  for (std::size_t i = 0; i < kNumCalls; ++i)
+  {
+    std::size_t slot = 0;
+    while (!client.TryAcquire(&slot))
+    {
+      BOOST_TEST(!outstanding.empty());
+      complete();
+    }
+    BOOST_TEST_EQ(slot, i % kNumSlots);
+
+    hadesmem::detail::CallDataLayout const layout{MakeSumSignature(kMaxArgs)};
+    void* const data = client.GetData(slot);
+    std::uint64_t const address = i * 1000;
+    hadesmem::detail::WriteCallDataSlot(
+      data, layout.GetAddressOffset(0), &address, sizeof(address));
+    for (std::size_t j = 0; j < kMaxArgs; ++j)
+    {
+      std::uint32_t const arg = static_cast<std::uint32_t>(j + 1);
+      hadesmem::detail::WriteCallDataSlot(
+        data, layout.GetArgOffset(0, j), &arg, sizeof(arg));
+    }
+    client.Post(slot, kMaxArgs);
+    outstanding.push_back(slot);
+  }
+
+  while (!outstanding.empty())
+  {
+    complete();
+  }
+
+  client.RequestStop();
+  server_thread.join();
+
+  BOOST_TEST_EQ(num_served.load(), kNumCalls);
+  BOOST_TEST_EQ(results.size(), kNumCalls);
+  for (std::size_t i = 0; i < results.size(); ++i)
+  {
+    BOOST_TEST_EQ(results[i], i * 1000 + 1 + 2 + 3 + 4);
+  }
+}
+
+int main()
+{
+  TestCallSignature();
+  TestCallRing();
+  return boost::report_errors();
+}
@@ -0,0 +1,139 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/export_index.hpp>
+#include <hadesmem/detail/export_index.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of the PeDumper memory scan.
+
+void TestAddressRangeSet()
+{
+  hadesmem::detail::AddressRangeSet ranges;
+  BOOST_TEST(ranges.empty());
+  ranges.Add(0x3000, 0x4000);
+  ranges.Add(0x1000, 0x2000);
+  ranges.Add(0x2000, 0x2800);
+  ranges.Add(0x5000, 0x5000);
+  ranges.Finalize();
+  BOOST_TEST_EQ(ranges.size(), 2UL);
+  BOOST_TEST(!ranges.Contains(0x0FFF));
+  BOOST_TEST(ranges.Contains(0x1000));
+  BOOST_TEST(ranges.Contains(0x27FF));
+  BOOST_TEST(!ranges.Contains(0x2800));
+  BOOST_TEST(ranges.Contains(0x3FFF));
+  BOOST_TEST(!ranges.Contains(0x4000));
+  BOOST_TEST(!ranges.Contains(0x5000));
+}
+
+void TestExportIndex()
+{
+  using hadesmem::detail::ExportIndex;
+  std::size_t const not_found = ExportIndex::kNotFound;
+
+  ExportIndex const empty;
+  BOOST_TEST(empty.empty());
+  BOOST_TEST(!empty.MayContain(0));
+  BOOST_TEST_EQ(empty.Find(0x1000), not_found);
+
+  ExportIndex const index{{0x7FF00030, 0x7FF00010, 0x7FF00030, 0x10000000}};
+  BOOST_TEST_EQ(index.size(), 3UL);
+  BOOST_TEST_EQ(index.GetVa(0), 0x10000000ULL);
+  BOOST_TEST_EQ(index.Find(0x10000000), 0UL);
+  BOOST_TEST_EQ(index.Find(0x7FF00010), 1UL);
+  BOOST_TEST_EQ(index.Find(0x7FF00030), 2UL);
+  BOOST_TEST_EQ(index.Find(0x7FF00020), not_found);
+  BOOST_TEST(!index.MayContain(0x0FFFFFFF));
+  BOOST_TEST(!index.MayContain(0x7FF00031));
+  BOOST_TEST(index.MayContain(0x7FF00020));
+
+  // The page filter should reject nearly everything in between.
+  std::size_t num_maybe = 0;
+  for (std::uint64_t va = 0x10001000; va < 0x7FF00000; va += 0x1000)
+  {
+    num_maybe += index.MayContain(va);
+  }
+  BOOST_TEST(num_maybe < 0x6FEFF / 100);
+}
+
+// Checks the threaded scan against a simple one.
+void TestScanForExports(std::size_t ptr_size)
+{
+  using hadesmem::detail::ExportIndex;
+
+  std::mt19937_64 rng{ptr_size};
+  std::uint64_t const ptr_mask = ptr_size == 8 ? ~0ULL : 0xFFFFFFFFULL;
+
+  std::vector<std::uint64_t> vas;
+  for (std::size_t i = 0; i < 5000; ++i)
+  {
+    vas.push_back((0x70000000 + (rng() % 0x800000)) & ptr_mask);
+  }
+  ExportIndex const index{vas};
+
+  hadesmem::detail::AddressRangeSet extra;
+  extra.Add(0x40000000, 0x40010000);
+  extra.Finalize();
+
+  std::vector<std::uint8_t> image(0x100000 + 6);
+  for (std::size_t i = 0; i + 4 <= image.size(); i += 4)
+  {
+    std::uint32_t value = static_cast<std::uint32_t>(rng());
+    std::memcpy(&image[i], &value, sizeof(value));
+  }
+  std::set<std::size_t> planted;
+  for (std::size_t i = 0; i < 2000; ++i)
+  {
+    std::size_t const offset = (rng() % (image.size() - 8)) & ~std::size_t{3};
+    std::uint64_t const value = (rng() % 4) ? vas[rng() % vas.size()]
+                                            : 0x40000000 + (rng() % 0x10000);
+    std::memcpy(&image[offset], &value, ptr_size);
+    planted.insert(offset);
+  }
+
+  std::vector<hadesmem::detail::ExportScanHit> expected;
+  for (std::size_t offset = 0; offset + ptr_size <= image.size(); offset += 4)
+  {
+    std::uint64_t value = 0;
+    std::memcpy(&value, &image[offset], ptr_size);
+    std::size_t const i = index.Find(value);
+    if (i != ExportIndex::kNotFound || extra.Contains(value))
+    {
+      expected.push_back(hadesmem::detail::ExportScanHit{offset, i});
+    }
+  }
+  BOOST_TEST(expected.size() >= planted.size() / 2);
+
+  for (std::size_t num_threads : {1, 2, 3, 8})
+  {
+    auto const hits = hadesmem::detail::ScanForExports(
+      image.data(), image.size(), ptr_size, index, extra, num_threads);
+    BOOST_TEST_EQ(hits.size(), expected.size());
+    bool same = hits.size() == expected.size();
+    for (std::size_t i = 0; same && i < hits.size(); ++i)
+    {
+      same = hits[i].offset == expected[i].offset &&
+             hits[i].index == expected[i].index;
+    }
+    BOOST_TEST(same);
+  }
+}
+
+int main()
+{
+  TestAddressRangeSet();
+  TestExportIndex();
+  TestScanForExports(4);
+  TestScanForExports(8);
+  return boost::report_errors();
+}
@@ -0,0 +1,160 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/export_name_table.hpp>
+#include <hadesmem/detail/export_name_table.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/detail/pe_samples.hpp>
+
+// Only uses the OS independent parts of ManualMap.
+
+void TestParseExportForwarder()
+{
+  hadesmem::detail::ExportForwarder forwarder;
+  BOOST_TEST(hadesmem::detail::ParseExportForwarder("NTDLL.RtlGetVersion",
+                                                    &forwarder));
+  BOOST_TEST_EQ(forwarder.module, "NTDLL");
+  BOOST_TEST_EQ(forwarder.function, "RtlGetVersion");
+  BOOST_TEST(!forwarder.by_ordinal);
+
+  // Split at the last dot, same as Export.
+  BOOST_TEST(hadesmem::detail::ParseExportForwarder(
+    "api-ms-win-core-a.b.#123", &forwarder));
+  BOOST_TEST_EQ(forwarder.module, "api-ms-win-core-a.b");
+  BOOST_TEST(forwarder.by_ordinal);
+  BOOST_TEST_EQ(forwarder.ordinal, 123);
+
+  BOOST_TEST(!hadesmem::detail::ParseExportForwarder("NTDLL", &forwarder));
+  BOOST_TEST(!hadesmem::detail::ParseExportForwarder(".Foo", &forwarder));
+  BOOST_TEST(!hadesmem::detail::ParseExportForwarder("NTDLL.", &forwarder));
+  BOOST_TEST(!hadesmem::detail::ParseExportForwarder("NTDLL.#", &forwarder));
+  BOOST_TEST(
+    !hadesmem::detail::ParseExportForwarder("NTDLL.#65536", &forwarder));
+  BOOST_TEST(!hadesmem::detail::ParseExportForwarder("NTDLL.#1x", &forwarder));
+}
+
+void TestExportNameTableSample()
+{
+  hadesmem::detail::PeSampleBuilder builder{true};
+  auto const dir = hadesmem::detail::AddPeSampleExports(builder);
+  auto const data = builder.Build();
+
+  // The section is the only thing needed, and it starts at its RVA.
+  std::uint32_t const section_rva =
+    hadesmem::detail::PeSampleBuilder::kSectionRva;
+  auto const section = data.data() + builder.RvaToOffset(section_rva);
+  std::size_t const section_size = data.size() - builder.GetHeadersSize();
+  auto const dir_size_offset =
+    builder.GetDataDirOffset(hadesmem::detail::PeSampleBuilder::kDirExport) + 4;
+  auto const dir_size = static_cast<std::uint32_t>(
+    hadesmem::detail::PeekPeSample(data, dir_size_offset, 4));
+
+  hadesmem::detail::ExportNameTable table;
+  BOOST_TEST(table.Parse(section, section_rva, section_size, dir, dir_size));
+  BOOST_TEST_EQ(table.GetOrdinalBase(), 5UL);
+  BOOST_TEST_EQ(table.GetNumFunctions(), 3UL);
+  BOOST_TEST_EQ(table.GetNumNames(), 2UL);
+
+  hadesmem::detail::ExportTarget alpha;
+  BOOST_TEST(table.FindByName("alpha", 0, &alpha));
+  BOOST_TEST(alpha.rva != 0);
+  BOOST_TEST(alpha.forwarder.empty());
+
+  // A bad hint only costs a search.
+  hadesmem::detail::ExportTarget alpha_bad_hint;
+  BOOST_TEST(table.FindByName("alpha", 1, &alpha_bad_hint));
+  BOOST_TEST_EQ(alpha_bad_hint.rva, alpha.rva);
+  BOOST_TEST(table.FindByName("alpha", 0xFFFF, &alpha_bad_hint));
+  BOOST_TEST_EQ(alpha_bad_hint.rva, alpha.rva);
+
+  hadesmem::detail::ExportTarget beta;
+  BOOST_TEST(table.FindByName("beta", 1, &beta));
+  BOOST_TEST_EQ(beta.rva, 0UL);
+  BOOST_TEST_EQ(beta.forwarder, "NTDLL.RtlGetVersion");
+
+  hadesmem::detail::ExportTarget by_ordinal;
+  BOOST_TEST(table.FindByOrdinal(7, &by_ordinal));
+  BOOST_TEST_EQ(by_ordinal.rva, alpha.rva);
+  BOOST_TEST(table.FindByOrdinal(6, &by_ordinal));
+  BOOST_TEST_EQ(by_ordinal.forwarder, "NTDLL.RtlGetVersion");
+  BOOST_TEST(!table.FindByOrdinal(4, &by_ordinal));
+  BOOST_TEST(!table.FindByOrdinal(8, &by_ordinal));
+  BOOST_TEST(!table.FindByName("gamma", 0, &by_ordinal));
+  BOOST_TEST(!table.FindByName("Alpha", 0, &by_ordinal));
+
+  // Anything outside of the data means a bigger read is needed.
+  hadesmem::detail::ExportNameTable partial;
+  BOOST_TEST(
+    !partial.Parse(section, section_rva, dir + 40 - section_rva, dir, 40));
+  BOOST_TEST_EQ(partial.GetNumFunctions(), 0UL);
+  // Everything but the strings.
+  BOOST_TEST(
+    !partial.Parse(section, section_rva, dir + 64 - section_rva, dir, 40));
+}
+
+void TestExportNameTableUnsorted()
+{
+  // Names out of order, and a hole in the function table.
+  std::vector<std::uint8_t> data(0x100);
+  auto const put = [&](std::size_t offset, std::uint32_t value, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      data[offset + i] = static_cast<std::uint8_t>(value >> (i * 8));
+    }
+  };
+  std::uint32_t const base = 0x3000;
+  put(16, 1, 4);
+  put(20, 3, 4);
+  put(24, 3, 4);
+  put(28, base + 0x40, 4);
+  put(32, base + 0x50, 4);
+  put(36, base + 0x60, 4);
+  put(0x40, 0x1000, 4);
+  put(0x44, 0, 4);
+  put(0x48, 0x1008, 4);
+  put(0x50, base + 0x80, 4);
+  put(0x54, base + 0x88, 4);
+  put(0x58, base + 0x90, 4);
+  put(0x60, 2, 2);
+  put(0x62, 1, 2);
+  put(0x64, 0, 2);
+  std::string const names[] = {"zeta", "hole", "alpha"};
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    std::copy(std::begin(names[i]), std::end(names[i]), &data[0x80 + i * 8]);
+  }
+
+  hadesmem::detail::ExportNameTable table;
+  BOOST_TEST(table.Parse(data.data(), base, data.size(), base, 40));
+
+  hadesmem::detail::ExportTarget target;
+  BOOST_TEST(table.FindByName("zeta", 2, &target));
+  BOOST_TEST_EQ(target.rva, 0x1008UL);
+  BOOST_TEST(table.FindByName("alpha", 0, &target));
+  BOOST_TEST_EQ(target.rva, 0x1000UL);
+  // Named, but there's nothing there.
+  BOOST_TEST(!table.FindByName("hole", 1, &target));
+  BOOST_TEST(!table.FindByOrdinal(2, &target));
+
+  // The name table runs off the end.
+  put(24, 0x40000000, 4);
+  BOOST_TEST(!table.Parse(data.data(), base, data.size(), base, 40));
+}
+
+int main()
+{
+  TestParseExportForwarder();
+  TestExportNameTableSample();
+  TestExportNameTableUnsorted();
+  return boost::report_errors();
+}
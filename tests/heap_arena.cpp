@@ -0,0 +1,151 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/heap_arena.hpp>
+#include <hadesmem/detail/heap_arena.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses made up addresses, so this runs anywhere.
+
+void TestHeapArena()
+{
+  using hadesmem::detail::HeapArena;
+
+  BOOST_TEST_EQ(HeapArena::GetSizeClass(1), 0UL);
+  BOOST_TEST_EQ(HeapArena::GetSizeClass(0x10), 0UL);
+  BOOST_TEST_EQ(HeapArena::GetSizeClass(0x11), 1UL);
+  BOOST_TEST_EQ(HeapArena::GetSizeClass(0x1000),
+                HeapArena::kNumSizeClasses - 1);
+  BOOST_TEST_EQ(HeapArena::GetClassSize(3), 0x80UL);
+
+  HeapArena arena;
+  BOOST_TEST_EQ(arena.Allocate(1), 0U);
+
+  arena.AddChunk(0x10000, 0x2000);
+  std::uintptr_t const a = arena.Allocate(8);
+  std::uintptr_t const b = arena.Allocate(0x20);
+  std::uintptr_t const c = arena.Allocate(0x1000);
+  BOOST_TEST_EQ(a, 0x10000U);
+  BOOST_TEST_EQ(b, 0x10010U);
+  BOOST_TEST_EQ(c, 0x10030U);
+  BOOST_TEST_EQ(arena.GetBlockSize(b), 0x20UL);
+  BOOST_TEST_EQ(arena.GetNumBlocks(), 3UL);
+  BOOST_TEST_EQ(arena.GetBytesAllocated(), 0x1030UL);
+
+  // Freed blocks are reused by the same size class only.
+  BOOST_TEST(arena.Free(b));
+  BOOST_TEST(!arena.Free(b));
+  BOOST_TEST(!arena.Free(b + 1));
+  BOOST_TEST_EQ(arena.GetBlockSize(b), 0UL);
+  BOOST_TEST_EQ(arena.Allocate(0x1F), b);
+  BOOST_TEST(arena.Allocate(0x10) != b);
+
+  // The chunk can't fit another max size block.
+  BOOST_TEST_EQ(arena.Allocate(0x1000), 0U);
+  arena.AddChunk(0x20000, 0x1000);
+  BOOST_TEST_EQ(arena.Allocate(0x1000), 0x20000U);
+  BOOST_TEST_EQ(arena.GetChunks().size(), 2UL);
+
+  arena.Reset();
+  BOOST_TEST_EQ(arena.GetNumBlocks(), 0UL);
+  BOOST_TEST_EQ(arena.GetBytesAllocated(), 0UL);
+  BOOST_TEST_EQ(arena.GetChunks().size(), 2UL);
+  BOOST_TEST_EQ(arena.Allocate(0x100), 0x10000U);
+
+  arena.Clear();
+  BOOST_TEST(arena.GetChunks().empty());
+  BOOST_TEST_EQ(arena.Allocate(0x100), 0U);
+}
+
+// Random allocations and frees checked against a simple model. Live blocks
+// must never overlap, must be inside a chunk and must be big enough.
+void TestHeapArenaRandom()
+{
+  using hadesmem::detail::HeapArena;
+
+  std::mt19937 rng{1337};
+  std::uniform_int_distribution<std::size_t> size_dist{
+    1, HeapArena::kMaxBlockSize};
+  std::uniform_int_distribution<int> op_dist{0, 99};
+
+  HeapArena arena;
+  std::uintptr_t next_chunk = 0x100000;
+  std::size_t const chunk_size = 0x10000;
+  std::map<std::uintptr_t, std::size_t> live;
+
+  auto const check_block = [&](std::uintptr_t address, std::size_t size) {
+    auto const next = live.lower_bound(address);
+    if (next != std::end(live))
+    {
+      BOOST_TEST(address + size <= next->first);
+    }
+    if (next != std::begin(live))
+    {
+      auto const prev = std::prev(next);
+      BOOST_TEST(prev->first + prev->second <= address);
+    }
+    BOOST_TEST(address % HeapArena::kMinBlockSize == 0);
+    BOOST_TEST(address >= 0x100000 && address + size <= next_chunk);
+  };
+
+  for (std::size_t i = 0; i < 20000; ++i)
+  {
+    int const op = op_dist(rng);
+    if (op < 5)
+    {
+      arena.Reset();
+      live.clear();
+    }
+    else if (op < 55 || live.empty())
+    {
+      std::size_t const size = size_dist(rng);
+      std::uintptr_t address = arena.Allocate(size);
+      if (!address)
+      {
+        arena.AddChunk(next_chunk, chunk_size);
+        next_chunk += chunk_size;
+        address = arena.Allocate(size);
+      }
+      BOOST_TEST(address != 0);
+      std::size_t const block_size = arena.GetBlockSize(address);
+      BOOST_TEST(block_size >= size);
+      check_block(address, block_size);
+      live[address] = block_size;
+    }
+    else
+    {
+      std::uniform_int_distribution<std::size_t> index_dist{0,
+                                                            live.size() - 1};
+      auto const iter = std::next(std::begin(live), index_dist(rng));
+      BOOST_TEST(arena.Free(iter->first));
+      BOOST_TEST(!arena.Free(iter->first));
+      live.erase(iter);
+    }
+
+    BOOST_TEST_EQ(arena.GetNumBlocks(), live.size());
+  }
+
+  std::size_t bytes = 0;
+  for (auto const& block : live)
+  {
+    bytes += block.second;
+  }
+  BOOST_TEST_EQ(arena.GetBytesAllocated(), bytes);
+}
+
+int main()
+{
+  TestHeapArena();
+  TestHeapArenaRandom();
+  return boost::report_errors();
+}
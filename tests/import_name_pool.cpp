@@ -0,0 +1,161 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/import_name_pool.hpp>
+#include <hadesmem/detail/import_name_pool.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of ImportTable.
+
+void TestDecodeImportThunk()
+{
+  auto const by_name = hadesmem::detail::DecodeImportThunk(0x2010, false);
+  BOOST_TEST(!by_name.by_ordinal);
+  BOOST_TEST_EQ(by_name.name_rva, 0x2010UL);
+
+  auto const by_ordinal_32 =
+    hadesmem::detail::DecodeImportThunk(0x80000123ULL, false);
+  BOOST_TEST(by_ordinal_32.by_ordinal);
+  BOOST_TEST_EQ(by_ordinal_32.ordinal, 0x123);
+  BOOST_TEST_EQ(by_ordinal_32.name_rva, 0UL);
+
+  // The 32-bit flag is just a big RVA in a 64-bit file.
+  BOOST_TEST(
+    !hadesmem::detail::DecodeImportThunk(0x80000123ULL, true).by_ordinal);
+  auto const by_ordinal_64 =
+    hadesmem::detail::DecodeImportThunk(0x8000000000000010ULL, true);
+  BOOST_TEST(by_ordinal_64.by_ordinal);
+  BOOST_TEST_EQ(by_ordinal_64.ordinal, 0x10);
+}
+
+void TestAppendImportThunks()
+{
+  std::uint8_t const data_32[] = {
+    0x10, 0x20, 0, 0, 0x23, 0x01, 0, 0x80, 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF};
+  std::vector<std::uint64_t> thunks;
+  BOOST_TEST(hadesmem::detail::AppendImportThunks(
+    data_32, sizeof(data_32), false, thunks));
+  BOOST_TEST_EQ(thunks.size(), 2UL);
+  BOOST_TEST_EQ(thunks[0], 0x2010ULL);
+  BOOST_TEST_EQ(thunks[1], 0x80000123ULL);
+
+  // Split across two reads, with a partial thunk at the end of the first.
+  thunks.clear();
+  BOOST_TEST(
+    !hadesmem::detail::AppendImportThunks(data_32, 6, false, thunks));
+  BOOST_TEST_EQ(thunks.size(), 1UL);
+  BOOST_TEST(hadesmem::detail::AppendImportThunks(
+    data_32 + 4, sizeof(data_32) - 4, false, thunks));
+  BOOST_TEST_EQ(thunks.size(), 2UL);
+
+  std::uint8_t const data_64[] = {
+    0x10, 0x20, 0, 0, 0, 0, 0, 0, 0x10, 0, 0, 0, 0, 0, 0, 0x80};
+  thunks.clear();
+  BOOST_TEST(!hadesmem::detail::AppendImportThunks(
+    data_64, sizeof(data_64), true, thunks));
+  BOOST_TEST_EQ(thunks.size(), 2UL);
+  BOOST_TEST_EQ(thunks[1], 0x8000000000000010ULL);
+  BOOST_TEST_EQ(hadesmem::detail::GetImportThunkValue(data_64 + 8, true),
+                0x8000000000000010ULL);
+  BOOST_TEST_EQ(hadesmem::detail::GetImportThunkValue(data_64 + 8, false),
+                0x10ULL);
+}
+
+void TestIsEqualImportName()
+{
+  std::string const a = "KERNEL32.dll";
+  std::string const b = "kernel32.DLL";
+  BOOST_TEST(hadesmem::detail::IsEqualImportName(
+    a.data(), a.size(), b.data(), b.size(), true));
+  BOOST_TEST(!hadesmem::detail::IsEqualImportName(
+    a.data(), a.size(), b.data(), b.size(), false));
+  BOOST_TEST(hadesmem::detail::IsEqualImportName(
+    a.data(), a.size(), a.data(), a.size(), false));
+  BOOST_TEST(!hadesmem::detail::IsEqualImportName(
+    a.data(), a.size(), b.data(), b.size() - 1, true));
+  // Only ASCII letters are folded.
+  BOOST_TEST(!hadesmem::detail::IsEqualImportName("@", 1, "`", 1, true));
+}
+
+void TestGetImportNameRegion()
+{
+  std::vector<hadesmem::detail::ImportNameSpan> const spans = {
+    {0x1000, 0x2000}, {0x2000, 0x3000}};
+
+  // Most of the names are in the second span.
+  std::vector<std::uint32_t> const rvas = {0x1800, 0x2100, 0x2010, 0x2E80};
+  auto const region = hadesmem::detail::GetImportNameRegion(rvas, spans);
+  BOOST_TEST_EQ(region.first, 0x2010UL);
+  // The tail is cut off at the end of the span.
+  BOOST_TEST_EQ(region.second, 0x3000UL);
+
+  auto const small = hadesmem::detail::GetImportNameRegion(
+    std::vector<std::uint32_t>{0x1100, 0x1200}, spans);
+  std::uint32_t const tail = hadesmem::detail::kImportNameTail;
+  BOOST_TEST_EQ(small.first, 0x1100UL);
+  BOOST_TEST_EQ(small.second, 0x1200UL + tail);
+
+  auto const none = hadesmem::detail::GetImportNameRegion(
+    std::vector<std::uint32_t>{0x5000}, spans);
+  BOOST_TEST_EQ(none.first, none.second);
+  auto const empty =
+    hadesmem::detail::GetImportNameRegion(std::vector<std::uint32_t>{}, spans);
+  BOOST_TEST_EQ(empty.first, empty.second);
+}
+
+void TestImportNamePool()
+{
+  std::string const names{"\x1F\x01GetTickCount\0kernel32.dll\0trunc", 33};
+  hadesmem::detail::ImportNamePool const pool{
+    0x2000, std::vector<std::uint8_t>(names.begin(), names.end())};
+  BOOST_TEST_EQ(pool.GetBaseRva(), 0x2000UL);
+  BOOST_TEST_EQ(pool.GetSize(), 33UL);
+  BOOST_TEST(pool.Contains(0x2000));
+  BOOST_TEST(pool.Contains(0x2020));
+  BOOST_TEST(!pool.Contains(0x2021));
+  BOOST_TEST(!pool.Contains(0x1FFF));
+
+  std::uint16_t hint = 0;
+  BOOST_TEST(pool.GetHint(0x2000, &hint));
+  BOOST_TEST_EQ(hint, 0x11F);
+  // Only one byte left.
+  BOOST_TEST(!pool.GetHint(0x2020, &hint));
+
+  std::string str;
+  BOOST_TEST(pool.GetString(0x2002, &str));
+  BOOST_TEST_EQ(str, "GetTickCount");
+  BOOST_TEST(pool.GetString(0x200F, &str));
+  BOOST_TEST_EQ(str, "kernel32.dll");
+  std::size_t len = 0;
+  char const* const s = pool.GetString(0x200F, &len);
+  BOOST_TEST(s != nullptr);
+  BOOST_TEST_EQ(len, 12UL);
+  // Empty strings are fine, unterminated ones aren't.
+  BOOST_TEST(pool.GetString(0x201B, &str));
+  BOOST_TEST_EQ(str, "");
+  BOOST_TEST(!pool.GetString(0x201C, &str));
+  BOOST_TEST(!pool.GetString(0x3000, &str));
+
+  hadesmem::detail::ImportNamePool const empty;
+  BOOST_TEST(!empty.Contains(0));
+  BOOST_TEST(!empty.GetString(0, &str));
+}
+
+int main()
+{
+  TestDecodeImportThunk();
+  TestAppendImportThunks();
+  TestIsEqualImportName();
+  TestGetImportNameRegion();
+  TestImportNamePool();
+  return boost::report_errors();
+}
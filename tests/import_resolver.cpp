@@ -0,0 +1,230 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/import_resolver.hpp>
+#include <hadesmem/detail/import_resolver.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of PeDumper.
+
+namespace
+{
+// Pretend target memory starting at kMemoryBase.
+std::uint64_t const kMemoryBase = 0x10000;
+
+std::vector<std::uint8_t> MakeOverwatchStub(std::uint64_t o, std::int32_t n)
+{
+  std::vector<std::uint8_t> stub{0x48, 0xB8};
+  stub.resize(stub.size() + sizeof(o));
+  std::memcpy(&stub[2], &o, sizeof(o));
+  stub.push_back(0x48);
+  stub.push_back(0x05);
+  stub.resize(stub.size() + sizeof(n));
+  std::memcpy(&stub[0xC], &n, sizeof(n));
+  stub.push_back(0xFF);
+  stub.push_back(0xE0);
+  return stub;
+}
+
+// jmp [rip+0] followed by the target.
+class JmpIndirectResolver : public hadesmem::detail::RedirectedImportResolver
+{
+public:
+  JmpIndirectResolver()
+    : patterns_{hadesmem::detail::MakeStubPattern(
+        "FF 25 00 00 00 00 ?? ?? ?? ?? ?? ?? ?? ??")}
+  {
+  }
+
+  virtual char const* GetName() const override
+  {
+    return "JmpIndirect";
+  }
+
+  virtual std::vector<hadesmem::detail::StubPattern> const&
+    GetPatterns() const override
+  {
+    return patterns_;
+  }
+
+  virtual std::uint64_t Resolve(std::uint64_t /*va*/,
+                                std::uint8_t const* stub,
+                                std::size_t /*size*/) const override
+  {
+    std::uint64_t target = 0;
+    std::memcpy(&target, stub + 6, sizeof(target));
+    return target;
+  }
+
+private:
+  std::vector<hadesmem::detail::StubPattern> patterns_;
+};
+}
+
+void TestStubPattern()
+{
+  using hadesmem::detail::MakeStubPattern;
+  using hadesmem::detail::MatchStubPattern;
+
+  auto const pattern = MakeStubPattern("48 b8 ?? FF");
+  BOOST_TEST_EQ(pattern.data.size(), 4UL);
+  BOOST_TEST_EQ(pattern.mask[2], 0);
+  BOOST_TEST_EQ(pattern.data[3], 0xFF);
+
+  std::uint8_t const match[] = {0x48, 0xB8, 0x12, 0xFF, 0x00};
+  std::uint8_t const no_match[] = {0x48, 0xB8, 0x12, 0xFE};
+  BOOST_TEST(MatchStubPattern(pattern, match, sizeof(match)));
+  BOOST_TEST(!MatchStubPattern(pattern, no_match, sizeof(no_match)));
+  // Too short.
+  BOOST_TEST(!MatchStubPattern(pattern, match, 3));
+}
+
+void TestOverwatchResolver()
+{
+  hadesmem::detail::OverwatchImportResolver const resolver;
+  auto const stub = MakeOverwatchStub(0x00007FFEB7341315ULL, 0x397B);
+  BOOST_TEST_EQ(stub.size(), 0x12UL);
+  BOOST_TEST(hadesmem::detail::MatchStubPattern(
+    resolver.GetPatterns().front(), stub.data(), stub.size()));
+  BOOST_TEST_EQ(resolver.Resolve(0, stub.data(), stub.size()),
+                0x00007FFEB7344C90ULL);
+
+  auto const negative = MakeOverwatchStub(0x1000, -0x10);
+  BOOST_TEST_EQ(resolver.Resolve(0, negative.data(), negative.size()),
+                0xFF0ULL);
+}
+
+void TestBlockReadCache()
+{
+  std::vector<std::uint8_t> memory(0x3000);
+  for (std::size_t i = 0; i < memory.size(); ++i)
+  {
+    memory[i] = static_cast<std::uint8_t>(i * 7);
+  }
+
+  hadesmem::detail::AddressRangeSet ranges;
+  // Two ranges with a gap between them.
+  ranges.Add(kMemoryBase, kMemoryBase + 0x1800);
+  ranges.Add(kMemoryBase + 0x2000, kMemoryBase + 0x3000);
+  ranges.Finalize();
+
+  std::size_t bad_reads = 0;
+  hadesmem::detail::BlockReadCache cache{
+    ranges,
+    [&](std::uint64_t address, void* buffer, std::size_t len) {
+      if (address < kMemoryBase ||
+          address + len > kMemoryBase + memory.size())
+      {
+        ++bad_reads;
+        return false;
+      }
+      // Unreadable page.
+      if (address <= kMemoryBase + 0x2800 &&
+          address + len > kMemoryBase + 0x2800)
+      {
+        return false;
+      }
+      std::memcpy(buffer, &memory[address - kMemoryBase], len);
+      return true;
+    },
+    0x1000};
+
+  std::uint8_t buffer[0x20];
+  // Spans two blocks.
+  BOOST_TEST_EQ(cache.Read(kMemoryBase + 0xFF0, buffer, sizeof(buffer)),
+                sizeof(buffer));
+  BOOST_TEST(std::memcmp(buffer, &memory[0xFF0], sizeof(buffer)) == 0);
+  BOOST_TEST_EQ(cache.GetNumReads(), 2UL);
+
+  // Already cached.
+  BOOST_TEST_EQ(cache.Read(kMemoryBase + 0x1000, buffer, 4), 4UL);
+  BOOST_TEST_EQ(cache.GetNumReads(), 2UL);
+
+  // Stops at the end of the range.
+  BOOST_TEST_EQ(cache.Read(kMemoryBase + 0x17F8, buffer, sizeof(buffer)), 8UL);
+  BOOST_TEST(std::memcmp(buffer, &memory[0x17F8], 8) == 0);
+
+  // Not in a range.
+  BOOST_TEST_EQ(cache.Read(kMemoryBase + 0x1900, buffer, 4), 0UL);
+  BOOST_TEST_EQ(cache.Read(kMemoryBase - 0x10, buffer, 4), 0UL);
+
+  // Block can't be read.
+  BOOST_TEST_EQ(cache.Read(kMemoryBase + 0x2900, buffer, 4), 0UL);
+  BOOST_TEST_EQ(bad_reads, 0UL);
+}
+
+void TestResolverChain()
+{
+  using hadesmem::detail::ImportResolverChain;
+
+  std::vector<std::uint8_t> memory(0x2000, 0xCC);
+  std::vector<std::uint64_t> vas;
+  std::vector<std::uint64_t> expected;
+
+  auto const add_stub = [&](std::size_t offset,
+                            std::vector<std::uint8_t> const& stub,
+                            std::uint64_t resolved) {
+    std::copy(std::begin(stub), std::end(stub), &memory[offset]);
+    vas.push_back(kMemoryBase + offset);
+    expected.push_back(resolved);
+  };
+
+  add_stub(0x10, MakeOverwatchStub(0x1000, 0x10), 0x1010);
+  std::vector<std::uint8_t> jmp{0xFF, 0x25, 0, 0, 0, 0};
+  std::uint64_t const jmp_target = 0x7FF00001234ULL;
+  jmp.resize(jmp.size() + sizeof(jmp_target));
+  std::memcpy(&jmp[6], &jmp_target, sizeof(jmp_target));
+  add_stub(0x100, jmp, jmp_target);
+  // Straddles a block.
+  add_stub(0xFFA, MakeOverwatchStub(0x2000, 0x20), 0x2020);
+  // Doesn't match anything.
+  add_stub(0x1100, std::vector<std::uint8_t>{0x90, 0x90}, 0);
+  // Truncated by the end of memory.
+  add_stub(0x1FF0, std::vector<std::uint8_t>{0x48, 0xB8}, 0);
+
+  hadesmem::detail::AddressRangeSet ranges;
+  ranges.Add(kMemoryBase, kMemoryBase + memory.size());
+  ranges.Finalize();
+  hadesmem::detail::BlockReadCache cache{
+    ranges,
+    [&](std::uint64_t address, void* buffer, std::size_t len) {
+      std::memcpy(buffer, &memory[address - kMemoryBase], len);
+      return true;
+    },
+    0x1000};
+
+  ImportResolverChain chain;
+  BOOST_TEST(chain.empty());
+  BOOST_TEST(chain.ResolveBatch(vas, cache) ==
+             std::vector<std::uint64_t>(vas.size()));
+  BOOST_TEST_EQ(cache.GetNumReads(), 0UL);
+
+  chain.Add(std::make_unique<hadesmem::detail::OverwatchImportResolver>());
+  chain.Add(std::make_unique<JmpIndirectResolver>());
+  BOOST_TEST_EQ(chain.size(), 2UL);
+
+  auto const resolved = chain.ResolveBatch(vas, cache);
+  BOOST_TEST(resolved == expected);
+  // One read per block, no matter how many stubs are in it.
+  BOOST_TEST_EQ(cache.GetNumReads(), 2UL);
+}
+
+int main()
+{
+  TestStubPattern();
+  TestOverwatchResolver();
+  TestBlockReadCache();
+  TestResolverChain();
+  return boost::report_errors();
+}
@@ -4,6 +4,10 @@
 #include <hadesmem/injector.hpp>
 #include <hadesmem/injector.hpp>
 
+#include <iterator>
+#include <string>
+#include <vector>
+
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
@@ -68,6 +72,52 @@ void TestInjector()
   // Free kernel32.dll in remote process.
   hadesmem::FreeDll(process, kernel32_mod_new_2);
 
+  // Bulk injection. The missing module should fail without affecting the
+  // others.
+  {
+    std::vector<std::wstring> const paths{
+      L"kernel32.dll", L"hadesmem_missing.dll", L"ntdll.dll"};
+    hadesmem::InjectTimings timings{};
+    std::vector<hadesmem::InjectDllResult> const results =
+      hadesmem::InjectDlls(process,
+                           std::begin(paths),
+                           std::end(paths),
+                           hadesmem::InjectFlags::kNone,
+                           &timings);
+    BOOST_TEST_EQ(results.size(), 3UL);
+    BOOST_TEST_EQ(results[0].module, kernel32_mod);
+    BOOST_TEST_EQ(results[1].module, static_cast<HMODULE>(nullptr));
+    BOOST_TEST_EQ(results[1].last_error,
+                  static_cast<DWORD>(ERROR_MOD_NOT_FOUND));
+    BOOST_TEST_EQ(results[2].module, ::GetModuleHandleW(L"ntdll.dll"));
+    BOOST_TEST(timings.load.count() > 0);
+    hadesmem::FreeDll(process, results[0].module);
+    hadesmem::FreeDll(process, results[2].module);
+
+    DWORD const pids[] = {::GetCurrentProcessId(), ::GetCurrentProcessId()};
+    std::vector<hadesmem::InjectDllsProcessResult> const multi_results =
+      hadesmem::InjectDllsMulti(std::begin(pids),
+                                std::end(pids),
+                                std::begin(paths),
+                                std::end(paths),
+                                hadesmem::InjectFlags::kNone,
+                                2);
+    BOOST_TEST_EQ(multi_results.size(), 2UL);
+    for (auto const& result : multi_results)
+    {
+      BOOST_TEST_EQ(result.pid, ::GetCurrentProcessId());
+      BOOST_TEST(!result.error);
+      BOOST_TEST_EQ(result.modules.size(), 3UL);
+      if (result.modules.size() == 3)
+      {
+        BOOST_TEST_EQ(result.modules[0].module, kernel32_mod);
+        BOOST_TEST_EQ(result.modules[1].module, static_cast<HMODULE>(nullptr));
+        hadesmem::FreeDll(process, result.modules[0].module);
+        hadesmem::FreeDll(process, result.modules[2].module);
+      }
+    }
+  }
+
   {
     std::vector<std::wstring> args;
     hadesmem::CreateAndInjectData const inject_data{
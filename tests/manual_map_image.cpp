@@ -0,0 +1,363 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/manual_map_image.hpp>
+#include <hadesmem/detail/manual_map_image.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/detail/pe_samples.hpp>
+
+// Only uses the OS independent parts of ManualMap.
+
+namespace
+{
+bool ParseHeaders(std::vector<std::uint8_t> const& data,
+                  hadesmem::detail::ManualMapHeaders* headers)
+{
+  return !hadesmem::detail::ParseManualMapHeaders(
+    data.data(), data.size(), headers);
+}
+
+std::vector<std::uint8_t> Map(std::vector<std::uint8_t> const& data,
+                              hadesmem::detail::ManualMapHeaders* headers)
+{
+  BOOST_TEST(ParseHeaders(data, headers));
+  return hadesmem::detail::MapManualMapImage(
+    data.data(), data.size(), *headers);
+}
+}
+
+void TestManualMapHeaders()
+{
+  for (bool const is_64 : {false, true})
+  {
+    hadesmem::detail::PeSampleBuilder builder{is_64, 2};
+    auto const code = hadesmem::detail::AddPeSampleCode(builder);
+    builder.SetEntryPoint(code);
+    builder.SetDll(true);
+    auto const data = builder.Build();
+
+    hadesmem::detail::ManualMapHeaders headers;
+    BOOST_TEST(ParseHeaders(data, &headers));
+    BOOST_TEST_EQ(headers.is_64, is_64);
+    BOOST_TEST_EQ(headers.machine, is_64 ? 0x8664 : 0x14C);
+    BOOST_TEST(!!(headers.characteristics & 0x2000));
+    BOOST_TEST_EQ(headers.image_base, builder.GetImageBase());
+    BOOST_TEST_EQ(headers.entry_point, code);
+    BOOST_TEST_EQ(headers.size_of_headers, builder.GetHeadersSize());
+    BOOST_TEST_EQ(headers.sections.size(), 3UL);
+    std::uint32_t const section_rva =
+      hadesmem::detail::PeSampleBuilder::kSectionRva;
+    BOOST_TEST_EQ(headers.sections[0].virtual_address, section_rva);
+    BOOST_TEST_EQ(headers.size_of_image,
+                  headers.sections[2].virtual_address + 0x1000);
+  }
+
+  for (auto const& sample : hadesmem::detail::GetPeSamples())
+  {
+    hadesmem::detail::ManualMapHeaders headers;
+    bool const valid = ParseHeaders(sample.data, &headers);
+    if (sample.name == "lfanew_oob" || sample.name == "truncated_headers")
+    {
+      BOOST_TEST(!valid);
+    }
+    else if (sample.name.compare(0, 3, "all") == 0)
+    {
+      BOOST_TEST(valid);
+      BOOST_TEST(headers.data_dirs[hadesmem::detail::kManualMapDirImport].rva);
+      BOOST_TEST(headers.data_dirs[hadesmem::detail::kManualMapDirTls].rva);
+    }
+  }
+
+  // Section with its raw data past the end of the file.
+  hadesmem::detail::PeSampleBuilder builder{false};
+  hadesmem::detail::AddPeSampleCode(builder);
+  auto data = builder.Build();
+  hadesmem::detail::PokePeSample(
+    data, builder.GetSectionHeaderOffset() + 20, 0x10000, 4);
+  hadesmem::detail::ManualMapHeaders headers;
+  BOOST_TEST(!ParseHeaders(data, &headers));
+}
+
+void TestManualMapLayout()
+{
+  hadesmem::detail::PeSampleBuilder builder{true};
+  auto const code = hadesmem::detail::AddPeSampleCode(builder);
+  auto const data = builder.Build();
+
+  hadesmem::detail::ManualMapHeaders headers;
+  auto const image = Map(data, &headers);
+  BOOST_TEST_EQ(image.size(), static_cast<std::size_t>(headers.size_of_image));
+  BOOST_TEST(std::equal(std::begin(data),
+                        std::begin(data) + headers.size_of_headers,
+                        std::begin(image)));
+  BOOST_TEST_EQ(image[code], 0xC3);
+  // The gap between the headers and the section is zero filled.
+  auto const gap_end = std::begin(image) + headers.sections[0].virtual_address;
+  BOOST_TEST(std::all_of(std::begin(image) + headers.size_of_headers,
+                         gap_end,
+                         [](std::uint8_t b) { return b == 0; }));
+}
+
+void TestManualMapRelocate()
+{
+  for (bool const is_64 : {false, true})
+  {
+    hadesmem::detail::PeSampleBuilder builder{is_64};
+    auto const blocks = hadesmem::detail::AddPeSampleRelocations(builder);
+    auto const data = builder.Build();
+    auto const ptr_size = builder.GetPtrSize();
+
+    hadesmem::detail::ManualMapHeaders headers;
+    auto image = Map(data, &headers);
+    // The first relocation is the first of the three pointers.
+    std::uint32_t const targets =
+      (hadesmem::detail::PeekPeSample(image, blocks, 4)) +
+      (hadesmem::detail::PeekPeSample(image, blocks + 8, 2) & 0xFFF);
+
+    std::uint64_t const new_base = is_64 ? 0x7FF600000000ULL : 0x10000000ULL;
+    BOOST_TEST(!hadesmem::detail::RelocateManualMapImage(
+      image, headers, new_base));
+    std::uint64_t const delta = new_base - headers.image_base;
+    std::uint64_t const mask = is_64 ? ~0ULL : 0xFFFFFFFFULL;
+    BOOST_TEST_EQ(
+      hadesmem::detail::PeekPeSample(image, targets, ptr_size),
+      (headers.image_base + targets + 3 * delta) & mask);
+    BOOST_TEST_EQ(
+      hadesmem::detail::PeekPeSample(image, targets + ptr_size, ptr_size),
+      (headers.image_base + targets + delta) & mask);
+    BOOST_TEST_EQ(hadesmem::detail::PeekPeSample(
+                    image, headers.image_base_offset, ptr_size),
+                  new_base);
+  }
+
+  // Nothing to relocate with, which is only a problem if it has to move.
+  hadesmem::detail::PeSampleBuilder builder{false};
+  hadesmem::detail::AddPeSampleCode(builder);
+  auto const data = builder.Build();
+  hadesmem::detail::ManualMapHeaders headers;
+  auto image = Map(data, &headers);
+  BOOST_TEST(!hadesmem::detail::RelocateManualMapImage(
+    image, headers, headers.image_base));
+  BOOST_TEST(hadesmem::detail::RelocateManualMapImage(
+    image, headers, headers.image_base + 0x10000));
+}
+
+void TestManualMapImports()
+{
+  for (bool const with_ilt : {false, true})
+  {
+    hadesmem::detail::PeSampleBuilder builder{true};
+    hadesmem::detail::AddPeSampleImports(builder, with_ilt);
+    auto const data = builder.Build();
+
+    hadesmem::detail::ManualMapHeaders headers;
+    auto image = Map(data, &headers);
+    std::vector<hadesmem::detail::ManualMapImportModule> modules;
+    BOOST_TEST(
+      !hadesmem::detail::GetManualMapImports(image, headers, &modules));
+    BOOST_TEST_EQ(modules.size(), 2UL);
+    if (modules.size() != 2)
+    {
+      continue;
+    }
+
+    BOOST_TEST_EQ(modules[0].name, "kernel32.dll");
+    BOOST_TEST_EQ(modules[0].imports.size(), 2UL);
+    BOOST_TEST(!modules[0].imports[0].by_ordinal);
+    BOOST_TEST_EQ(modules[0].imports[0].name, "GetTickCount");
+    BOOST_TEST_EQ(modules[0].imports[0].hint, 0x1F0);
+    BOOST_TEST(modules[0].imports[1].by_ordinal);
+    BOOST_TEST_EQ(modules[0].imports[1].ordinal, 0x10);
+    BOOST_TEST_EQ(modules[0].imports[1].iat_rva,
+                  modules[0].imports[0].iat_rva + 8);
+    BOOST_TEST_EQ(modules[1].name, "user32.dll");
+    BOOST_TEST_EQ(modules[1].imports.size(), 1UL);
+    BOOST_TEST_EQ(modules[1].imports[0].name, "MessageBoxA");
+    BOOST_TEST_EQ(modules[1].imports[0].hint, 0x21C);
+
+    hadesmem::detail::SetManualMapImport(
+      image, headers, modules[1].imports[0], 0x7FFE12345678ULL);
+    BOOST_TEST_EQ(
+      hadesmem::detail::PeekPeSample(image, modules[1].imports[0].iat_rva, 8),
+      0x7FFE12345678ULL);
+    // Without an ILT the names come from the IAT, so they have to be listed
+    // before anything is written to it.
+    std::vector<hadesmem::detail::ManualMapImportModule> after;
+    BOOST_TEST_EQ(
+      !hadesmem::detail::GetManualMapImports(image, headers, &after),
+      with_ilt);
+  }
+
+  // Thunk which points outside of the image.
+  hadesmem::detail::PeSampleBuilder builder{false};
+  auto const descs = builder.Alloc(40);
+  auto const name = builder.AddString("kernel32.dll");
+  auto const thunks = builder.Alloc(8);
+  builder.Put(descs + 12, name, 4);
+  builder.Put(descs + 16, thunks, 4);
+  builder.Put(thunks, 0x41414141, 4);
+  builder.Put(thunks + 4, 0x41414141, 4);
+  builder.SetDataDir(
+    hadesmem::detail::PeSampleBuilder::kDirImport, descs, 40);
+  auto const data = builder.Build();
+  hadesmem::detail::ManualMapHeaders headers;
+  auto const image = Map(data, &headers);
+  std::vector<hadesmem::detail::ManualMapImportModule> modules;
+  BOOST_TEST(hadesmem::detail::GetManualMapImports(image, headers, &modules));
+}
+
+void TestManualMapTls()
+{
+  for (bool const is_64 : {false, true})
+  {
+    hadesmem::detail::PeSampleBuilder builder{is_64};
+    auto const callbacks = hadesmem::detail::AddPeSampleTls(builder);
+    auto const data = builder.Build();
+
+    hadesmem::detail::ManualMapHeaders headers;
+    auto const image = Map(data, &headers);
+    auto const code =
+      hadesmem::detail::PeekPeSample(image, callbacks, builder.GetPtrSize());
+
+    std::vector<std::uint64_t> vas;
+    BOOST_TEST(!hadesmem::detail::GetManualMapTlsCallbacks(
+      image, headers, headers.image_base, &vas));
+    BOOST_TEST_EQ(vas.size(), 2UL);
+    BOOST_TEST(std::all_of(std::begin(vas),
+                           std::end(vas),
+                           [&](std::uint64_t va) { return va == code; }));
+
+    // The sample has no relocations for its TLS directory, so at any other
+    // base the callbacks point outside of the image.
+    BOOST_TEST(hadesmem::detail::GetManualMapTlsCallbacks(
+      image, headers, headers.image_base + 0x10000, &vas));
+  }
+}
+
+void TestManualMapCommitPlan()
+{
+  BOOST_TEST_EQ(hadesmem::detail::GetManualMapProtect(0x60000020),
+                hadesmem::detail::kManualMapExecuteRead);
+  BOOST_TEST_EQ(hadesmem::detail::GetManualMapProtect(0xE0000020),
+                hadesmem::detail::kManualMapExecuteReadWrite);
+  BOOST_TEST_EQ(hadesmem::detail::GetManualMapProtect(0x20000020),
+                hadesmem::detail::kManualMapExecute);
+  BOOST_TEST_EQ(hadesmem::detail::GetManualMapProtect(0xC0000040),
+                hadesmem::detail::kManualMapReadWrite);
+  BOOST_TEST_EQ(hadesmem::detail::GetManualMapProtect(0x40000040),
+                hadesmem::detail::kManualMapReadOnly);
+  BOOST_TEST_EQ(hadesmem::detail::GetManualMapProtect(0),
+                hadesmem::detail::kManualMapNoAccess);
+
+  // Headers, code (RWX in the sample), then .s0 as read only and .s1 and .s2
+  // as read/write.
+  hadesmem::detail::PeSampleBuilder builder{true, 3};
+  hadesmem::detail::AddPeSampleCode(builder);
+  builder.Alloc(0x2000);
+  auto data = builder.Build();
+  for (std::size_t i = 1; i < 4; ++i)
+  {
+    hadesmem::detail::PokePeSample(data,
+                                   builder.GetSectionHeaderOffset() + i * 40 +
+                                     36,
+                                   i == 1 ? 0x40000040 : 0xC0000040,
+                                   4);
+  }
+
+  hadesmem::detail::ManualMapHeaders headers;
+  auto const image = Map(data, &headers);
+  auto const regions = hadesmem::detail::PlanManualMapCommit(image, headers);
+  BOOST_TEST_EQ(regions.size(), 4UL);
+  if (regions.size() != 4)
+  {
+    return;
+  }
+
+  BOOST_TEST_EQ(regions[0].rva, 0UL);
+  BOOST_TEST_EQ(regions[0].size, 0x1000UL);
+  BOOST_TEST_EQ(regions[0].protect, hadesmem::detail::kManualMapReadOnly);
+  BOOST_TEST(regions[0].write_size <= headers.size_of_headers);
+
+  BOOST_TEST_EQ(regions[1].rva, 0x1000UL);
+  BOOST_TEST_EQ(regions[1].protect,
+                hadesmem::detail::kManualMapExecuteReadWrite);
+  // The code is at the start, the rest of the section is zero.
+  BOOST_TEST_EQ(regions[1].write_size, 1UL);
+
+  BOOST_TEST_EQ(regions[2].rva, headers.sections[1].virtual_address);
+  BOOST_TEST_EQ(regions[2].size, 0x1000UL);
+  BOOST_TEST_EQ(regions[2].protect, hadesmem::detail::kManualMapReadOnly);
+  BOOST_TEST_EQ(regions[2].write_size,
+                std::string{"hadesmem extra section 0"}.size());
+
+  // Adjacent sections with the same protection are merged, and the write
+  // runs up to the last non-zero byte.
+  BOOST_TEST_EQ(regions[3].rva, headers.sections[2].virtual_address);
+  BOOST_TEST_EQ(regions[3].size, 0x2000UL);
+  BOOST_TEST_EQ(regions[3].protect, hadesmem::detail::kManualMapReadWrite);
+  BOOST_TEST_EQ(regions[3].write_size,
+                0x1000 + std::string{"hadesmem extra section 2"}.size());
+
+  std::uint32_t end = 0;
+  for (auto const& region : regions)
+  {
+    BOOST_TEST_EQ(region.rva, end);
+    end = region.rva + region.size;
+  }
+  BOOST_TEST_EQ(end, headers.size_of_image);
+
+  // The single write covers every region's data.
+  BOOST_TEST_EQ(hadesmem::detail::GetManualMapWriteSize(regions),
+                regions[3].rva + regions[3].write_size);
+}
+
+void TestManualMapRegressionCorpus()
+{
+  // Malformed files only need to be rejected (or not) without crashing.
+  for (auto const& sample : hadesmem::detail::GetPeRegressionCorpus(64))
+  {
+    hadesmem::detail::ManualMapHeaders headers;
+    if (!ParseHeaders(sample.data, &headers) ||
+        headers.size_of_image > 0x4000000)
+    {
+      continue;
+    }
+
+    auto image = hadesmem::detail::MapManualMapImage(
+      sample.data.data(), sample.data.size(), headers);
+    std::uint64_t const new_base = headers.image_base + 0x10000;
+    if (hadesmem::detail::RelocateManualMapImage(image, headers, new_base))
+    {
+      continue;
+    }
+
+    std::vector<hadesmem::detail::ManualMapImportModule> modules;
+    (void)hadesmem::detail::GetManualMapImports(image, headers, &modules);
+    std::vector<std::uint64_t> callbacks;
+    (void)hadesmem::detail::GetManualMapTlsCallbacks(
+      image, headers, new_base, &callbacks);
+    (void)hadesmem::detail::PlanManualMapCommit(image, headers);
+  }
+}
+
+int main()
+{
+  TestManualMapHeaders();
+  TestManualMapLayout();
+  TestManualMapRelocate();
+  TestManualMapImports();
+  TestManualMapTls();
+  TestManualMapCommitPlan();
+  TestManualMapRegressionCorpus();
+  return boost::report_errors();
+}
@@ -0,0 +1,88 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/module_scan.hpp>
+#include <hadesmem/detail/module_scan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of PeDumper module discovery.
+
+void TestFindModuleCandidates()
+{
+  using hadesmem::detail::ModuleCandidate;
+  using hadesmem::detail::ModuleCandidateType;
+  using hadesmem::detail::ModuleScanFlags;
+
+  std::size_t const kPageSize = 0x1000;
+  std::vector<std::uint8_t> buffer(kPageSize * 6 + 0x10);
+
+  // Regular module.
+  buffer[kPageSize * 1] = 'M';
+  buffer[kPageSize * 1 + 1] = 'Z';
+
+  // Erased DOS header with e_lfanew intact.
+  std::uint32_t const lfanew = 0xE8;
+  std::memcpy(&buffer[kPageSize * 3 + 0x3C], &lfanew, sizeof(lfanew));
+  std::memcpy(&buffer[kPageSize * 3 + lfanew], "PE\0\0", 4);
+
+  // e_lfanew pointing outside the page.
+  std::uint32_t const bad_lfanew = kPageSize;
+  std::memcpy(&buffer[kPageSize * 4 + 0x3C], &bad_lfanew, sizeof(bad_lfanew));
+
+  // Not at the start of a page.
+  buffer[kPageSize * 5 + 4] = 'M';
+  buffer[kPageSize * 5 + 5] = 'Z';
+
+  // In the trailing partial page, which isn't scanned.
+  buffer[kPageSize * 6] = 'M';
+  buffer[kPageSize * 6 + 1] = 'Z';
+
+  std::vector<ModuleCandidate> candidates;
+  hadesmem::detail::FindModuleCandidates(buffer.data(),
+                                         buffer.size(),
+                                         kPageSize,
+                                         0x10000,
+                                         ModuleScanFlags::kNone,
+                                         candidates);
+  BOOST_TEST_EQ(candidates.size(), 1UL);
+  BOOST_TEST_EQ(candidates[0].offset, 0x11000UL);
+  BOOST_TEST(candidates[0].type == ModuleCandidateType::kMz);
+
+  candidates.clear();
+  hadesmem::detail::FindModuleCandidates(buffer.data(),
+                                         buffer.size(),
+                                         kPageSize,
+                                         0,
+                                         ModuleScanFlags::kStrippedHeaders,
+                                         candidates);
+  BOOST_TEST_EQ(candidates.size(), 2UL);
+  BOOST_TEST_EQ(candidates[0].offset, kPageSize);
+  BOOST_TEST_EQ(candidates[1].offset, kPageSize * 3);
+  BOOST_TEST(candidates[1].type == ModuleCandidateType::kStrippedHeaders);
+}
+
+void TestModuleScanStats()
+{
+  hadesmem::detail::ModuleScanStats stats;
+  BOOST_TEST_EQ(stats.regions_total.load(), 0ULL);
+  stats.regions_total = 10;
+  stats.bytes_done += 0x1000;
+  stats.Reset();
+  BOOST_TEST_EQ(stats.regions_total.load(), 0ULL);
+  BOOST_TEST_EQ(stats.bytes_done.load(), 0ULL);
+}
+
+int main()
+{
+  TestFindModuleCandidates();
+  TestModuleScanStats();
+  return boost::report_errors();
+}
@@ -0,0 +1,86 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/module_snapshot.hpp>
+#include <hadesmem/module_snapshot.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/module_enum.hpp>
+#include <hadesmem/detail/to_upper_ordinal.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/process.hpp>
+
+void TestModuleSnapshot()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  hadesmem::ModuleSnapshot const snapshot{process};
+  BOOST_TEST(!snapshot.empty());
+  BOOST_TEST_EQ(*std::begin(snapshot), (hadesmem::Module{process, nullptr}));
+
+  hadesmem::Module const ntdll_mod{process, L"ntdll.dll"};
+  hadesmem::Module const* const ntdll_by_name = snapshot.Find(L"NtDll.DlL");
+  BOOST_TEST(ntdll_by_name != nullptr);
+  BOOST_TEST_EQ(*ntdll_by_name, ntdll_mod);
+  BOOST_TEST_EQ(ntdll_by_name->GetSize(), ntdll_mod.GetSize());
+  BOOST_TEST(snapshot.Find(ntdll_mod.GetHandle()) == ntdll_by_name);
+
+  std::wstring ntdll_path = ntdll_mod.GetPath();
+  std::transform(std::begin(ntdll_path),
+                 std::end(ntdll_path),
+                 std::begin(ntdll_path),
+                 [](wchar_t c) { return c == L'\\' ? L'/' : c; });
+  BOOST_TEST(snapshot.Find(hadesmem::detail::ToUpperOrdinal(ntdll_path)) ==
+             ntdll_by_name);
+
+  auto const rtl_random = reinterpret_cast<void const*>(
+    ::GetProcAddress(ntdll_mod.GetHandle(), "RtlRandom"));
+  BOOST_TEST(snapshot.FindByAddress(rtl_random) == ntdll_by_name);
+
+  BOOST_TEST(snapshot.Find(L"non_existant_module.dll") == nullptr);
+  BOOST_TEST(snapshot.Find(L"C:\\non_existant_module.dll") == nullptr);
+  BOOST_TEST(snapshot.Find(L"") == nullptr);
+  BOOST_TEST(snapshot.FindByAddress(nullptr) == nullptr);
+
+  // The loader list and Toolhelp should agree.
+  hadesmem::ModuleList const module_list{process};
+  std::size_t num_modules = 0;
+  for (auto const& module : module_list)
+  {
+    hadesmem::Module const* const found = snapshot.Find(module.GetName());
+    BOOST_TEST(found != nullptr);
+    BOOST_TEST(snapshot.Find(module.GetHandle()) != nullptr);
+    ++num_modules;
+  }
+  BOOST_TEST_EQ(num_modules, snapshot.size());
+
+  std::vector<hadesmem::detail::ModuleData> const toolhelp_modules =
+    hadesmem::detail::GetModulesFromToolhelp(process);
+  BOOST_TEST_EQ(toolhelp_modules.size(), snapshot.size());
+  for (auto const& data : toolhelp_modules)
+  {
+    hadesmem::Module const* const found = snapshot.Find(data.handle);
+    BOOST_TEST(found != nullptr);
+    if (found)
+    {
+      BOOST_TEST_EQ(found->GetSize(), data.size);
+      BOOST_TEST(hadesmem::detail::IsEqualOrdinalNoCase(found->GetName(),
+                                                        data.name));
+    }
+  }
+}
+
+int main()
+{
+  TestModuleSnapshot();
+  return boost::report_errors();
+}
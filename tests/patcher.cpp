@@ -9,6 +9,7 @@
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
@@ -18,6 +19,7 @@
 #include <asmjit/asmjit.h>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
+#include <hadesmem/alloc.hpp>
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
 #include <hadesmem/detail/self_path.hpp>
@@ -198,6 +200,156 @@ void TestPatchDetour2()
   BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
 }
 
+void TestPatchDetourChain()
+{
+  auto volatile const scratch_fn = &Scratch;
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
+
+  hadesmem::PatchDetourChain<decltype(Scratch)> chain{GetThisProcess(),
+                                                      scratch_fn};
+  chain.Apply();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
+
+  std::string order;
+  chain.RegisterPre([&](int, float, void*, bool*, int*) { order += "b"; }, 1);
+  chain.RegisterPre([&](int, float, void*, bool*, int*) { order += "a"; }, 0);
+  auto const short_circuit_id =
+    chain.RegisterPre([&](int a, float, void*, bool* handled, int* retval) {
+      order += "c";
+      if (a == 1)
+      {
+        *handled = true;
+        *retval = 0x42;
+      }
+    }, 2);
+  chain.RegisterPost([&](int, float, void*, int* retval) {
+    order += "y";
+    *retval += 1;
+  }, 0);
+  chain.RegisterPost([&](int, float, void*, int* retval) {
+    order += "z";
+    *retval *= 2;
+  }, 1);
+
+  // Post callbacks run in the reverse order of the pre callbacks.
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337 * 2 + 1);
+  BOOST_TEST_EQ(order, "abczy");
+
+  // The original is skipped, but post callbacks still run.
+  order.clear();
+  BOOST_TEST_EQ(chain.CallOriginal(-42, 2.f, nullptr), 0x1337);
+  BOOST_TEST_EQ(scratch_fn(1, 2.f, nullptr), 0x42 * 2 + 1);
+  BOOST_TEST_EQ(order, "abczy");
+
+  BOOST_TEST(chain.Unregister(short_circuit_id));
+  order.clear();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337 * 2 + 1);
+  BOOST_TEST_EQ(order, "abzy");
+
+  // Unknown (here, already unregistered) IDs are rejected.
+  BOOST_TEST(!chain.Unregister(short_circuit_id));
+  order.clear();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337 * 2 + 1);
+  BOOST_TEST_EQ(order, "abzy");
+
+  chain.Remove();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
+  chain.Apply();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337 * 2 + 1);
+}
+
+void*& GetRemoteTrampoline()
+{
+  static void* trampoline = nullptr;
+  return trampoline;
+}
+
+extern "C" int __stdcall ScratchRemoteDetour(int a, float b, void* c)
+{
+  auto const orig =
+    hadesmem::detail::AliasCast<decltype(&Scratch)>(GetRemoteTrampoline());
+  BOOST_TEST_EQ(orig(a, b, c), 0x1337);
+  return 0x2468;
+}
+
+void TestPatchDetourRemote()
+{
+  auto volatile const scratch_fn = &Scratch;
+  void* const target = hadesmem::detail::AliasCast<void*>(scratch_fn);
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
+
+  hadesmem::RemoteCounters counters{GetThisProcess()};
+
+  {
+    hadesmem::PatchDetourRemote detour{
+      GetThisProcess(),
+      target,
+      hadesmem::detail::AliasCast<void*>(&ScratchRemoteDetour),
+      &counters};
+    detour.Apply();
+    GetRemoteTrampoline() = detour.GetTrampoline();
+    BOOST_TEST_EQ(detour.GetHitCount(), 0U);
+    BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x2468);
+    BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x2468);
+    BOOST_TEST_EQ(detour.GetHitCount(), 2U);
+    detour.Remove();
+    BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
+    BOOST_TEST_EQ(detour.GetHitCount(), 2U);
+  }
+
+  // Counters are handed back when a detour is destroyed, so we can go through
+  // more detours than there are counters, and reused counters start at zero.
+  std::size_t const capacity = counters.GetCapacity();
+  void* const remote_detour =
+    hadesmem::detail::AliasCast<void*>(&ScratchRemoteDetour);
+  for (std::size_t i = 0; i < capacity * 2; ++i)
+  {
+    hadesmem::PatchDetourRemote detour{
+      GetThisProcess(), target, remote_detour, &counters};
+    BOOST_TEST_EQ(detour.GetHitCount(), 0U);
+  }
+
+  {
+    std::vector<hadesmem::PatchDetourRemote> detours;
+    for (std::size_t i = 0; i < capacity; ++i)
+    {
+      detours.emplace_back(
+        GetThisProcess(), target, remote_detour, &counters);
+    }
+    BOOST_TEST_THROWS(hadesmem::PatchDetourRemote(
+                        GetThisProcess(), target, remote_detour, &counters),
+                      hadesmem::Error);
+  }
+
+  auto const gen_detour = [](void* /*address*/, void* /*trampoline*/) {
+    // clang-format off
+    return std::vector<std::uint8_t>{
+      // MOV EAX, 0x1234
+      0xB8, 0x34, 0x12, 0x00, 0x00,
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+      // RET
+      0xC3
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+      // RET 0xC
+      0xC2, 0x0C, 0x00
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+    };
+    // clang-format on
+  };
+  hadesmem::PatchDetourRemote detour{
+    GetThisProcess(), target, gen_detour, &counters};
+  detour.Apply();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1234);
+  BOOST_TEST_EQ(detour.GetHitCount(), 1U);
+  detour.Remove();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1337);
+  detour.Apply();
+  BOOST_TEST_EQ(scratch_fn(-42, 2.f, nullptr), 0x1234);
+  BOOST_TEST_EQ(detour.GetHitCount(), 2U);
+}
+
 void TestPatchRaw()
 {
   hadesmem::Process const& process = GetThisProcess();
@@ -484,6 +636,65 @@ void TestPatchDr()
   TestPatchDetourJmp<hadesmem::PatchDr<decltype(&HookMe)>>();
 }
 
+void TestPatchPage(hadesmem::PageHookMode mode)
+{
+  hadesmem::Process const& process = GetThisProcess();
+  hadesmem::Allocator const data{process, 0x2000};
+  auto const page_1 = static_cast<std::uint32_t volatile*>(data.GetBase());
+  auto const page_2 = reinterpret_cast<std::uint32_t volatile*>(
+    static_cast<std::uint8_t*>(data.GetBase()) + 0x1000);
+
+  std::uint32_t reads = 0;
+  std::uint32_t writes = 0;
+  hadesmem::PatchPage patch{process, mode};
+  patch.Add(const_cast<std::uint32_t*>(page_1),
+            sizeof(std::uint32_t),
+            hadesmem::PageAccess::kRead,
+            [&](hadesmem::PageHookEvent& event) {
+              BOOST_TEST_EQ(event.access,
+                            static_cast<std::uint32_t>(
+                              hadesmem::PageAccess::kRead));
+              ++reads;
+            });
+  patch.Add(const_cast<std::uint32_t*>(page_2),
+            sizeof(std::uint32_t),
+            hadesmem::PageAccess::kWrite,
+            [&](hadesmem::PageHookEvent& event) {
+              BOOST_TEST_EQ(event.target,
+                            const_cast<std::uint32_t*>(page_2));
+              ++writes;
+            });
+  patch.Apply();
+  BOOST_TEST(patch.IsApplied());
+
+  page_1[0] = 0x1234;
+  BOOST_TEST_EQ(page_1[0], 0x1234UL);
+  page_2[0] = 0x5678;
+  page_2[0] = 0x9ABC;
+  // Unwatched address on a watched page.
+  page_1[1] = 0;
+  BOOST_TEST_EQ(reads, 1UL);
+  BOOST_TEST_EQ(writes, 2UL);
+
+  patch.Remove();
+  BOOST_TEST(!patch.IsApplied());
+  BOOST_TEST_EQ(page_1[0], 0x1234UL);
+  page_2[0] = 0;
+  BOOST_TEST_EQ(reads, 1UL);
+  BOOST_TEST_EQ(writes, 2UL);
+
+  MEMORY_BASIC_INFORMATION mbi{};
+  BOOST_TEST(::VirtualQuery(data.GetBase(), &mbi, sizeof(mbi)));
+  BOOST_TEST_EQ(mbi.Protect, static_cast<DWORD>(PAGE_EXECUTE_READWRITE));
+  BOOST_TEST_EQ(mbi.RegionSize, 0x2000UL);
+}
+
+void TestPatchPage()
+{
+  TestPatchPage(hadesmem::PageHookMode::kNoAccess);
+  TestPatchPage(hadesmem::PageHookMode::kGuard);
+}
+
 __declspec(noinline) void TestGetLastErrorOrig()
 {
   ::SetLastError(0x1234);
@@ -530,7 +741,10 @@ int main()
   TestPatchDetour();
   TestPatchInt3();
   TestPatchDr();
+  TestPatchPage();
   TestPatchDetour2();
+  TestPatchDetourChain();
+  TestPatchDetourRemote();
   TestPatchIat();
   return boost::report_errors();
 }
@@ -0,0 +1,361 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/pe_image_writer.hpp>
+#include <hadesmem/detail/pe_image_writer.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of PeDumper.
+
+namespace
+{
+std::uint32_t const kNtHeadersOffset = 0x80;
+std::uint32_t const kFileHeaderOffset = kNtHeadersOffset + 4;
+std::uint32_t const kOptionalHeaderOffset = kFileHeaderOffset + 20;
+std::uint32_t const kSizeOfOptionalHeader = 0xF0;
+std::uint32_t const kSectionTableOffset =
+  kOptionalHeaderOffset + kSizeOfOptionalHeader;
+std::uint32_t const kSectionHeaderSize = 40;
+
+template <typename T>
+T Get(std::vector<std::uint8_t> const& buf, std::size_t offset)
+{
+  T value;
+  std::memcpy(&value, &buf[offset], sizeof(value));
+  return value;
+}
+
+template <typename T>
+void Set(std::vector<std::uint8_t>& buf, std::size_t offset, T value)
+{
+  std::memcpy(&buf[offset], &value, sizeof(value));
+}
+
+struct SyntheticSection
+{
+  std::uint32_t virtual_size;
+  std::uint32_t size_of_raw_data;
+  std::uint32_t pointer_to_raw_data;
+};
+
+// Builds a (PE32+) module in its in-memory layout, with each section full of
+// non-zero data up to its raw size and zeros after that.
+std::vector<std::uint8_t>
+  MakeImage(std::vector<SyntheticSection> const& sections,
+            std::uint32_t size_of_headers,
+            std::uint32_t file_alignment,
+            std::uint32_t section_alignment)
+{
+  std::uint32_t size_of_image = static_cast<std::uint32_t>(
+    hadesmem::detail::AlignUp(size_of_headers, section_alignment));
+  for (auto const& section : sections)
+  {
+    size_of_image += static_cast<std::uint32_t>(hadesmem::detail::AlignUp(
+      section.virtual_size, section_alignment));
+  }
+
+  std::vector<std::uint8_t> image(size_of_image);
+  image[0] = 'M';
+  image[1] = 'Z';
+  Set<std::uint32_t>(image, 0x3C, kNtHeadersOffset);
+  std::memcpy(&image[kNtHeadersOffset], "PE\0\0", 4);
+  Set<std::uint16_t>(image, kFileHeaderOffset + 2,
+                     static_cast<std::uint16_t>(sections.size()));
+  Set<std::uint16_t>(image, kFileHeaderOffset + 16, kSizeOfOptionalHeader);
+  Set<std::uint16_t>(image, kOptionalHeaderOffset, 0x20B);
+  Set<std::uint32_t>(image, kOptionalHeaderOffset + 32, section_alignment);
+  Set<std::uint32_t>(image, kOptionalHeaderOffset + 36, file_alignment);
+  Set<std::uint32_t>(image, kOptionalHeaderOffset + 56, size_of_image);
+  Set<std::uint32_t>(image, kOptionalHeaderOffset + 60, size_of_headers);
+
+  std::uint32_t va = static_cast<std::uint32_t>(
+    hadesmem::detail::AlignUp(size_of_headers, section_alignment));
+  for (std::size_t i = 0; i < sections.size(); ++i)
+  {
+    auto const& section = sections[i];
+    std::size_t const header = kSectionTableOffset + i * kSectionHeaderSize;
+    image[header] = '.';
+    image[header + 1] = static_cast<std::uint8_t>('a' + i);
+    Set<std::uint32_t>(image, header + 8, section.virtual_size);
+    Set<std::uint32_t>(image, header + 12, va);
+    Set<std::uint32_t>(image, header + 16, section.size_of_raw_data);
+    Set<std::uint32_t>(image, header + 20, section.pointer_to_raw_data);
+
+    auto const data_size =
+      (std::min)(section.size_of_raw_data, section.virtual_size);
+    for (std::uint32_t j = 0; j < data_size; ++j)
+    {
+      image[va + j] = static_cast<std::uint8_t>(1 + (i * 31 + j) % 255);
+    }
+
+    va += static_cast<std::uint32_t>(
+      hadesmem::detail::AlignUp(section.virtual_size, section_alignment));
+  }
+
+  return image;
+}
+
+// Does what PeDumper does with the layout: headers and sections go into
+// one buffer allocated at its final size, and the extra data is streamed
+// after it as its own part.
+std::vector<std::uint8_t> Rebuild(std::vector<std::uint8_t> const& image,
+                                  std::vector<std::uint8_t> const& extra,
+                                  hadesmem::detail::PeLayout& layout)
+{
+  auto const num_sections = Get<std::uint16_t>(image, kFileHeaderOffset + 2);
+  auto const section_alignment =
+    Get<std::uint32_t>(image, kOptionalHeaderOffset + 32);
+  auto const file_alignment =
+    Get<std::uint32_t>(image, kOptionalHeaderOffset + 36);
+  auto const size_of_headers =
+    Get<std::uint32_t>(image, kOptionalHeaderOffset + 60);
+
+  std::vector<hadesmem::detail::PeLayoutSectionIn> sections_in;
+  for (std::size_t i = 0; i < num_sections; ++i)
+  {
+    std::size_t const header = kSectionTableOffset + i * kSectionHeaderSize;
+    sections_in.push_back(hadesmem::detail::PeLayoutSectionIn{
+      Get<std::uint32_t>(image, header + 12),
+      Get<std::uint32_t>(image, header + 8),
+      Get<std::uint32_t>(image, header + 16),
+      Get<std::uint32_t>(image, header + 20)});
+  }
+
+  layout = hadesmem::detail::PlanPeLayout(size_of_headers,
+                                          file_alignment,
+                                          section_alignment,
+                                          image.size(),
+                                          sections_in);
+
+  std::vector<std::uint8_t> raw_new(static_cast<std::size_t>(layout.file_size));
+  std::memcpy(raw_new.data(), image.data(), size_of_headers);
+  for (std::size_t i = 0; i < num_sections; ++i)
+  {
+    auto const& planned = layout.sections[i];
+    std::memcpy(&raw_new[planned.pointer_to_raw_data],
+                &image[sections_in[i].virtual_address],
+                planned.copy_size);
+
+    std::size_t const header = kSectionTableOffset + i * kSectionHeaderSize;
+    Set<std::uint32_t>(raw_new, header + 16,
+                       hadesmem::detail::GetTrimmedRawSize(
+                         &raw_new[planned.pointer_to_raw_data],
+                         planned.file_size,
+                         sections_in[i].size_of_raw_data,
+                         file_alignment));
+    Set<std::uint32_t>(raw_new, header + 20, planned.pointer_to_raw_data);
+  }
+
+  auto const extra_offset =
+    hadesmem::detail::AlignUp(layout.file_size, file_alignment);
+  hadesmem::detail::PeImageWriter writer;
+  writer.AddPart(0, raw_new.data(), raw_new.size());
+  writer.AddPart(extra_offset, extra.data(), extra.size());
+  writer.SetFileSize(
+    hadesmem::detail::AlignUp(extra_offset + extra.size(), file_alignment));
+
+  std::vector<std::uint8_t> file(
+    static_cast<std::size_t>(writer.GetFileSize()));
+  writer.Write(file.data());
+
+  // Both ways of writing should give the same bytes.
+  std::ostringstream out;
+  writer.Write(out);
+  BOOST_TEST(out.str() == std::string(file.begin(), file.end()));
+
+  return file;
+}
+
+void CheckRoundTrip(std::vector<std::uint8_t> const& image,
+                    std::vector<std::uint8_t> const& file,
+                    std::vector<std::uint8_t> const& extra,
+                    hadesmem::detail::PeLayout const& layout)
+{
+  auto const num_sections = Get<std::uint16_t>(file, kFileHeaderOffset + 2);
+  BOOST_TEST_EQ(num_sections, Get<std::uint16_t>(image, kFileHeaderOffset + 2));
+  BOOST_TEST(std::memcmp(file.data(), "MZ", 2) == 0);
+
+  std::uint32_t prev_end = Get<std::uint32_t>(file, kOptionalHeaderOffset + 60);
+  for (std::size_t i = 0; i < num_sections; ++i)
+  {
+    std::size_t const header = kSectionTableOffset + i * kSectionHeaderSize;
+    auto const va = Get<std::uint32_t>(file, header + 12);
+    auto const raw_size = Get<std::uint32_t>(file, header + 16);
+    auto const ptr = Get<std::uint32_t>(file, header + 20);
+
+    BOOST_TEST_EQ(ptr, layout.sections[i].pointer_to_raw_data);
+    BOOST_TEST(ptr >= prev_end);
+    BOOST_TEST(raw_size <= layout.sections[i].file_size);
+    BOOST_TEST(ptr + layout.sections[i].file_size <= file.size());
+    prev_end = ptr + layout.sections[i].file_size;
+
+    // The whole section made it into the file, not just the raw part.
+    for (std::uint32_t j = 0; j < layout.sections[i].file_size; ++j)
+    {
+      std::uint8_t const expected = va + j < image.size() ? image[va + j] : 0;
+      if (file[ptr + j] != expected)
+      {
+        BOOST_ERROR("Section data mismatch.");
+        break;
+      }
+    }
+
+    // Nothing non-zero was trimmed off.
+    for (std::uint32_t j = raw_size; j < layout.sections[i].file_size; ++j)
+    {
+      if (file[ptr + j])
+      {
+        BOOST_ERROR("Trimmed non-zero section data.");
+        break;
+      }
+    }
+  }
+
+  auto const file_alignment =
+    Get<std::uint32_t>(file, kOptionalHeaderOffset + 36);
+  auto const extra_offset = static_cast<std::size_t>(
+    hadesmem::detail::AlignUp(layout.file_size, file_alignment));
+  BOOST_TEST(std::equal(
+    extra.begin(), extra.end(), file.begin() + extra_offset));
+  BOOST_TEST_EQ(file.size() % file_alignment, 0UL);
+}
+}
+
+void TestPeImageWriterParts()
+{
+  std::uint8_t const a[] = {1, 2, 3, 4};
+  std::uint8_t const b[] = {5, 6};
+
+  hadesmem::detail::PeImageWriter writer;
+  writer.AddPart(0, a, sizeof(a));
+  // Truncates the first part.
+  writer.AddPart(2, b, sizeof(b));
+  // Zero fill, with a gap before it.
+  writer.AddPart(6, nullptr, 2);
+  BOOST_TEST_EQ(writer.GetFileSize(), 8ULL);
+
+  std::vector<std::uint8_t> out(8, 0xCC);
+  writer.Write(out.data());
+  std::vector<std::uint8_t> const expected{1, 2, 5, 6, 0, 0, 0, 0};
+  BOOST_TEST(out == expected);
+
+  // Padding.
+  writer.SetFileSize(0x2345);
+  std::vector<std::uint8_t> padded(0x2345, 0xCC);
+  writer.Write(padded.data());
+  BOOST_TEST(std::equal(expected.begin(), expected.end(), padded.begin()));
+  BOOST_TEST(std::all_of(
+    padded.begin() + 8, padded.end(), [](std::uint8_t c) { return !c; }));
+
+  // Truncation.
+  writer.SetFileSize(3);
+  std::ostringstream out_str;
+  writer.Write(out_str);
+  BOOST_TEST(out_str.str() == std::string("\x01\x02\x05", 3));
+}
+
+void TestTrimmedRawSize()
+{
+  std::vector<std::uint8_t> data(0x3000);
+  data[0x1233] = 1;
+  BOOST_TEST_EQ(hadesmem::detail::GetTrimmedRawSize(
+                  data.data(), 0x3000, 0x200, 0x200),
+                0x1400U);
+  // Never below the original raw size.
+  BOOST_TEST_EQ(hadesmem::detail::GetTrimmedRawSize(
+                  data.data(), 0x3000, 0x2000, 0x200),
+                0x2000U);
+  // All zero.
+  std::vector<std::uint8_t> zeros(0x1000);
+  BOOST_TEST_EQ(
+    hadesmem::detail::GetTrimmedRawSize(zeros.data(), 0x1000, 0, 0x200), 0U);
+}
+
+void TestPeLayoutRoundTrip()
+{
+  std::vector<SyntheticSection> const sections{
+    {0x1800, 0x1600, 0x400},
+    // Raw pointer overlaps the previous section, so it has to move.
+    {0x500, 0x200, 0x800},
+    // Virtual size bigger than raw size.
+    {0x3000, 0x400, 0x2000},
+    // No raw data at all.
+    {0x1000, 0, 0}};
+  auto const image = MakeImage(sections, 0x400, 0x200, 0x1000);
+  std::vector<std::uint8_t> const extra{'i', 'm', 'p', 'o', 'r', 't', 's'};
+
+  hadesmem::detail::PeLayout layout;
+  auto const file = Rebuild(image, extra, layout);
+  CheckRoundTrip(image, file, extra, layout);
+
+  BOOST_TEST_EQ(layout.sections.size(), 4UL);
+  BOOST_TEST_EQ(layout.sections[0].pointer_to_raw_data, 0x400U);
+  BOOST_TEST_EQ(layout.sections[0].file_size, 0x2000U);
+  BOOST_TEST_EQ(layout.sections[1].pointer_to_raw_data, 0x2400U);
+  BOOST_TEST_EQ(layout.sections[2].pointer_to_raw_data, 0x3400U);
+}
+
+void TestPeLayoutOutOfBounds()
+{
+  std::vector<hadesmem::detail::PeLayoutSectionIn> const sections{
+    {0x1000, 0x1000, 0x200, 0x400},
+    // VA past the end of the image.
+    {0x9000, 0x1000, 0x200, 0x4000}};
+  auto const layout =
+    hadesmem::detail::PlanPeLayout(0x400, 0x200, 0x1000, 0x2000, sections);
+  BOOST_TEST_EQ(layout.sections[1].file_size, 0U);
+  BOOST_TEST_EQ(layout.sections[1].copy_size, 0U);
+  // The gap up to its raw pointer is kept, but no data is reserved.
+  BOOST_TEST_EQ(layout.file_size, 0x4000ULL);
+}
+
+void TestPeLayoutRandom()
+{
+  std::mt19937 rng{0x5EC7};
+  for (int iteration = 0; iteration < 200; ++iteration)
+  {
+    std::uint32_t const file_alignment = 0x200U << (rng() % 3);
+    std::uint32_t const section_alignment = 0x1000;
+    std::vector<SyntheticSection> sections(1 + rng() % 6);
+    for (auto& section : sections)
+    {
+      section.virtual_size = 1 + rng() % 0x4000;
+      section.size_of_raw_data = static_cast<std::uint32_t>(
+        hadesmem::detail::AlignUp(rng() % 0x4000, file_alignment));
+      section.pointer_to_raw_data = (rng() % 0x10) * file_alignment;
+    }
+    auto const size_of_headers =
+      static_cast<std::uint32_t>(hadesmem::detail::AlignUp(
+        kSectionTableOffset + sections.size() * kSectionHeaderSize,
+        file_alignment));
+    auto const image =
+      MakeImage(sections, size_of_headers, file_alignment, section_alignment);
+    std::vector<std::uint8_t> extra(rng() % 0x300, 0xEE);
+
+    hadesmem::detail::PeLayout layout;
+    auto const file = Rebuild(image, extra, layout);
+    CheckRoundTrip(image, file, extra, layout);
+  }
+}
+
+int main()
+{
+  TestPeImageWriterParts();
+  TestTrimmedRawSize();
+  TestPeLayoutRoundTrip();
+  TestPeLayoutOutOfBounds();
+  TestPeLayoutRandom();
+  return boost::report_errors();
+}
@@ -0,0 +1,291 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/pe_samples.hpp>
+#include <hadesmem/detail/pe_samples.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of the PeLib fuzz harness. The samples
+// are checked with a minimal reader here, so a mistake in the generator
+// doesn't quietly turn every sample into a malformed one.
+
+namespace
+{
+using hadesmem::detail::PeSample;
+using hadesmem::detail::PeSampleBuilder;
+using hadesmem::detail::PeekPeSample;
+
+PeSample const& FindSample(std::vector<PeSample> const& samples,
+                           std::string const& name)
+{
+  auto const iter =
+    std::find_if(std::begin(samples),
+                 std::end(samples),
+                 [&](PeSample const& sample) { return sample.name == name; });
+  BOOST_TEST(iter != std::end(samples));
+  return *iter;
+}
+
+// All of the samples checked here have a single section.
+std::size_t RvaToOffset(std::uint32_t rva)
+{
+  return PeSampleBuilder{false}.RvaToOffset(rva);
+}
+
+std::uint32_t Read32(PeSample const& sample, std::size_t offset)
+{
+  return static_cast<std::uint32_t>(PeekPeSample(sample.data, offset, 4));
+}
+
+std::uint32_t ReadRva32(PeSample const& sample, std::uint32_t rva)
+{
+  return Read32(sample, RvaToOffset(rva));
+}
+
+std::string ReadRvaString(PeSample const& sample, std::uint32_t rva)
+{
+  auto const beg = std::begin(sample.data) + RvaToOffset(rva);
+  return std::string(beg, std::find(beg, std::end(sample.data), 0));
+}
+
+std::uint32_t GetDataDirRva(PeSample const& sample,
+                            bool is_64,
+                            std::size_t index)
+{
+  return Read32(sample, PeSampleBuilder{is_64}.GetDataDirOffset(index));
+}
+
+std::uint32_t GetDataDirSize(PeSample const& sample,
+                             bool is_64,
+                             std::size_t index)
+{
+  return Read32(sample, PeSampleBuilder{is_64}.GetDataDirOffset(index) + 4);
+}
+}
+
+void TestHeaders()
+{
+  auto const samples = hadesmem::detail::GetPeSamples();
+  BOOST_TEST(!samples.empty());
+
+  std::set<std::string> names;
+  for (auto const& sample : samples)
+  {
+    BOOST_TEST(names.insert(sample.name).second);
+    BOOST_TEST(sample.data.size() >= 0x40);
+    BOOST_TEST_EQ(PeekPeSample(sample.data, 0, 2), 0x5A4DULL);
+  }
+
+  for (bool const is_64 : {false, true})
+  {
+    auto const& tiny = FindSample(samples, is_64 ? "tiny64" : "tiny32");
+    std::size_t const nt_headers_offset = PeSampleBuilder::kNtHeadersOffset;
+    std::size_t const opt_offset = PeSampleBuilder::kOptionalHeaderOffset;
+    BOOST_TEST_EQ(Read32(tiny, 0x3C), nt_headers_offset);
+    BOOST_TEST_EQ(Read32(tiny, nt_headers_offset), 0x4550UL);
+    BOOST_TEST_EQ(PeekPeSample(tiny.data, nt_headers_offset + 4, 2),
+                  is_64 ? 0x8664ULL : 0x14CULL);
+    BOOST_TEST_EQ(PeekPeSample(tiny.data, opt_offset, 2),
+                  is_64 ? 0x20BULL : 0x10BULL);
+    BOOST_TEST_EQ(tiny.data.size(), 0x400UL);
+
+    auto const sec = PeSampleBuilder{is_64}.GetSectionHeaderOffset();
+    BOOST_TEST_EQ(Read32(tiny, sec + 12), 0x1000UL);
+    BOOST_TEST_EQ(Read32(tiny, sec + 16), 0x200UL);
+    BOOST_TEST_EQ(Read32(tiny, sec + 20), 0x200UL);
+    // The entry point is a ret.
+    BOOST_TEST_EQ(tiny.data[RvaToOffset(
+                    Read32(tiny, opt_offset + 16))],
+                  0xC3);
+  }
+
+  auto const& truncated = FindSample(samples, "truncated_headers");
+  BOOST_TEST(truncated.data.size() < 0x200);
+  auto const& lfanew = FindSample(samples, "lfanew_oob");
+  BOOST_TEST(Read32(lfanew, 0x3C) > lfanew.data.size());
+}
+
+void TestDirectories()
+{
+  auto const samples = hadesmem::detail::GetPeSamples();
+
+  for (bool const is_64 : {false, true})
+  {
+    auto const& all = FindSample(samples, is_64 ? "all64" : "all32");
+    std::size_t const ptr_size = is_64 ? 8 : 4;
+
+    auto const export_dir =
+      GetDataDirRva(all, is_64, PeSampleBuilder::kDirExport);
+    BOOST_TEST_EQ(ReadRvaString(all, ReadRva32(all, export_dir + 12)),
+                  "sample.dll");
+    BOOST_TEST_EQ(ReadRva32(all, export_dir + 20), 3UL);
+    auto const names = ReadRva32(all, export_dir + 32);
+    BOOST_TEST_EQ(ReadRvaString(all, ReadRva32(all, names)), "alpha");
+    BOOST_TEST_EQ(ReadRvaString(all, ReadRva32(all, names + 4)), "beta");
+    auto const forwarder = ReadRva32(all, ReadRva32(all, export_dir + 28) + 4);
+    BOOST_TEST(forwarder >= export_dir &&
+               forwarder < export_dir +
+                             GetDataDirSize(
+                               all, is_64, PeSampleBuilder::kDirExport));
+    BOOST_TEST_EQ(ReadRvaString(all, forwarder), "NTDLL.RtlGetVersion");
+
+    auto const import_dir =
+      GetDataDirRva(all, is_64, PeSampleBuilder::kDirImport);
+    BOOST_TEST_EQ(ReadRvaString(all, ReadRva32(all, import_dir + 12)),
+                  "kernel32.dll");
+    BOOST_TEST_EQ(ReadRvaString(all, ReadRva32(all, import_dir + 20 + 12)),
+                  "user32.dll");
+    // Terminator.
+    BOOST_TEST_EQ(ReadRva32(all, import_dir + 40 + 12), 0UL);
+    auto const ilt = ReadRva32(all, import_dir);
+    auto const by_name = static_cast<std::uint32_t>(
+      PeekPeSample(all.data, RvaToOffset(ilt), ptr_size));
+    BOOST_TEST_EQ(ReadRvaString(all, by_name + 2), "GetTickCount");
+    auto const by_ordinal = PeekPeSample(
+      all.data, RvaToOffset(ilt) + ptr_size, ptr_size);
+    BOOST_TEST_EQ(by_ordinal >> (ptr_size * 8 - 1), 1ULL);
+    BOOST_TEST_EQ(by_ordinal & 0xFFFF, 0x10ULL);
+
+    // The blocks exactly fill the directory.
+    auto const relocs =
+      GetDataDirRva(all, is_64, PeSampleBuilder::kDirBaseReloc);
+    auto const relocs_size =
+      GetDataDirSize(all, is_64, PeSampleBuilder::kDirBaseReloc);
+    std::uint32_t num_blocks = 0;
+    std::uint32_t offset = 0;
+    while (offset < relocs_size)
+    {
+      auto const size_of_block = ReadRva32(all, relocs + offset + 4);
+      BOOST_TEST(size_of_block >= 8);
+      offset += size_of_block;
+      ++num_blocks;
+    }
+    BOOST_TEST_EQ(offset, relocs_size);
+    BOOST_TEST_EQ(num_blocks, 2UL);
+
+    auto const image_base = PeSampleBuilder{is_64}.GetImageBase();
+    auto const tls = GetDataDirRva(all, is_64, PeSampleBuilder::kDirTls);
+    auto const callbacks_va = PeekPeSample(
+      all.data, RvaToOffset(tls) + 3 * ptr_size, ptr_size);
+    auto const callbacks =
+      RvaToOffset(static_cast<std::uint32_t>(callbacks_va - image_base));
+    BOOST_TEST(PeekPeSample(all.data, callbacks, ptr_size) != 0);
+    BOOST_TEST(PeekPeSample(all.data, callbacks + ptr_size, ptr_size) != 0);
+    BOOST_TEST_EQ(PeekPeSample(all.data, callbacks + 2 * ptr_size, ptr_size),
+                  0ULL);
+
+    auto const bound =
+      GetDataDirRva(all, is_64, PeSampleBuilder::kDirBoundImport);
+    auto const bound_name = static_cast<std::uint32_t>(PeekPeSample(
+      all.data, RvaToOffset(bound) + 4, 2));
+    BOOST_TEST_EQ(ReadRvaString(all, bound + bound_name), "kernel32.dll");
+
+    // The overlay follows the only section.
+    auto const sec = PeSampleBuilder{is_64}.GetSectionHeaderOffset();
+    BOOST_TEST_EQ(all.data.size() - Read32(all, sec + 20) -
+                    Read32(all, sec + 16),
+                  7UL);
+  }
+}
+
+void TestMutations()
+{
+  auto const samples = hadesmem::detail::GetPeSamples();
+  auto const& tiny = FindSample(samples, "tiny32");
+
+  std::size_t num_changed = 0;
+  for (std::uint32_t seed = 0; seed < 0x100; ++seed)
+  {
+    auto const mutated = hadesmem::detail::MutatePeSample(tiny.data, seed);
+    BOOST_TEST(mutated == hadesmem::detail::MutatePeSample(tiny.data, seed));
+    BOOST_TEST(!mutated.empty() && mutated.size() <= tiny.data.size());
+    num_changed += mutated != tiny.data;
+  }
+  // Poking a value which happens to already be there is a no-op, but that
+  // should be rare.
+  BOOST_TEST(num_changed > 0xF0);
+
+  BOOST_TEST(hadesmem::detail::MutatePeSample(std::vector<std::uint8_t>{}, 1)
+               .empty());
+
+  auto const corpus = hadesmem::detail::GetPeRegressionCorpus(4);
+  BOOST_TEST_EQ(corpus.size(), samples.size() * 5);
+  std::set<std::string> names;
+  for (auto const& sample : corpus)
+  {
+    BOOST_TEST(names.insert(sample.name).second);
+  }
+  BOOST_TEST(FindSample(corpus, "tiny32.mut3").data ==
+             hadesmem::detail::MutatePeSample(tiny.data, 3));
+}
+
+void TestBenchmarkCorpus()
+{
+  auto const corpus = hadesmem::detail::GetPeBenchmarkCorpus();
+  BOOST_TEST_EQ(corpus.size(), 4UL);
+
+  auto const& huge = FindSample(corpus, "huge");
+  BOOST_TEST(huge.data.size() > 32 * 1024 * 1024);
+
+  auto const& many_exports = FindSample(corpus, "many_exports");
+  auto const export_dir =
+    GetDataDirRva(many_exports, false, PeSampleBuilder::kDirExport);
+  BOOST_TEST_EQ(ReadRva32(many_exports, export_dir + 20), 0x4000UL);
+  BOOST_TEST_EQ(ReadRva32(many_exports, export_dir + 24), 0x4000UL);
+  auto const names = ReadRva32(many_exports, export_dir + 32);
+  BOOST_TEST_EQ(ReadRvaString(many_exports, ReadRva32(many_exports, names)),
+                "Export00000000");
+  BOOST_TEST_EQ(
+    ReadRvaString(many_exports,
+                  ReadRva32(many_exports, names + 0x3FFF * 4)),
+    "Export00016383");
+
+  auto const& many_sections = FindSample(corpus, "many_sections");
+  PeSampleBuilder const builder{false, 90};
+  std::size_t const nt_headers_offset = PeSampleBuilder::kNtHeadersOffset;
+  std::size_t const opt_offset = PeSampleBuilder::kOptionalHeaderOffset;
+  BOOST_TEST_EQ(PeekPeSample(many_sections.data, nt_headers_offset + 6, 2),
+                91ULL);
+  BOOST_TEST_EQ(Read32(many_sections, opt_offset + 60),
+                builder.GetHeadersSize());
+  // The sections are laid out back to back, in order, after the headers.
+  std::uint32_t prev_rva = 0;
+  std::uint32_t prev_end = 0;
+  for (std::size_t i = 0; i < builder.GetNumSections(); ++i)
+  {
+    auto const sec = builder.GetSectionHeaderOffset() + i * 40;
+    auto const rva = Read32(many_sections, sec + 12);
+    auto const raw_size = Read32(many_sections, sec + 16);
+    auto const raw_offset = Read32(many_sections, sec + 20);
+    BOOST_TEST(rva > prev_rva);
+    BOOST_TEST_EQ(raw_offset, i ? prev_end : builder.GetHeadersSize());
+    BOOST_TEST(raw_offset + raw_size <= many_sections.data.size());
+    prev_rva = rva;
+    prev_end = raw_offset + raw_size;
+  }
+  auto const last = builder.GetSectionHeaderOffset() + 90 * 40;
+  auto const last_data =
+    std::begin(many_sections.data) + Read32(many_sections, last + 20);
+  BOOST_TEST_EQ(std::string(last_data, last_data + 25),
+                "hadesmem extra section 89");
+}
+
+int main()
+{
+  TestHeaders();
+  TestDirectories();
+  TestMutations();
+  TestBenchmarkCorpus();
+  return boost::report_errors();
+}
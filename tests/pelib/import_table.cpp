@@ -0,0 +1,223 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/pelib/import_table.hpp>
+#include <hadesmem/pelib/import_table.hpp>
+
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/pe_samples.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/pelib/import_dir.hpp>
+#include <hadesmem/pelib/import_dir_list.hpp>
+#include <hadesmem/pelib/import_thunk.hpp>
+#include <hadesmem/pelib/import_thunk_list.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+
+namespace
+{
+// Everything ImportTable reports has to match what the lists report.
+void CheckAgainstLists(hadesmem::Process const& process,
+                       hadesmem::PeFile const& pe_file)
+{
+  hadesmem::ImportTable const table{process, pe_file};
+  hadesmem::ImportDirList const import_dirs{process, pe_file};
+
+  std::size_t i = 0;
+  for (auto const& dir : import_dirs)
+  {
+    BOOST_TEST(i < table.GetNumModules());
+    if (i >= table.GetNumModules())
+    {
+      return;
+    }
+
+    BOOST_TEST_EQ(table.GetModuleName(i), dir.GetName());
+    BOOST_TEST_EQ(table.GetOriginalFirstThunk(i), dir.GetOriginalFirstThunk());
+    BOOST_TEST_EQ(table.GetFirstThunk(i), dir.GetFirstThunk());
+    BOOST_TEST_EQ(table.GetTimeDateStamp(i), dir.GetTimeDateStamp());
+    BOOST_TEST_EQ(table.FindModule(dir.GetName()), i);
+
+    bool const use_ilt = table.GetOriginalFirstThunk(i) &&
+                         table.GetOriginalFirstThunk(i) !=
+                           table.GetFirstThunk(i);
+    hadesmem::ImportThunkList const thunks{
+      process,
+      pe_file,
+      use_ilt ? dir.GetOriginalFirstThunk() : dir.GetFirstThunk()};
+    std::size_t j = 0;
+    for (auto const& thunk : thunks)
+    {
+      BOOST_TEST(j < table.GetNumThunks(i));
+      if (j >= table.GetNumThunks(i))
+      {
+        break;
+      }
+
+      BOOST_TEST_EQ(table.GetOrdinalRaw(i, j), thunk.GetOrdinalRaw());
+      if (!table.HasNames(i))
+      {
+        ++j;
+        continue;
+      }
+
+      BOOST_TEST_EQ(table.ByOrdinal(i, j), thunk.ByOrdinal());
+      if (thunk.ByOrdinal())
+      {
+        BOOST_TEST_EQ(table.GetOrdinal(i, j), thunk.GetOrdinal());
+        // The same module can be imported by more than one descriptor.
+        auto const entry = table.FindImport(dir.GetName(), thunk.GetOrdinal());
+        BOOST_TEST(entry.module <= i);
+      }
+      else
+      {
+        BOOST_TEST_EQ(table.GetHint(i, j), thunk.GetHint());
+        BOOST_TEST_EQ(table.GetName(i, j), thunk.GetName());
+        auto const entry = table.FindImport(dir.GetName(), thunk.GetName());
+        BOOST_TEST(entry.module < i || (entry.module == i && entry.thunk <= j));
+      }
+      ++j;
+    }
+    BOOST_TEST_EQ(j, table.GetNumThunks(i));
+
+    ++i;
+  }
+  BOOST_TEST_EQ(i, table.GetNumModules());
+}
+}
+
+void TestImportTableSamples()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+  std::size_t const not_found = hadesmem::ImportTable::kNotFound;
+
+  for (auto const& sample : hadesmem::detail::GetPeSamples())
+  {
+    std::vector<std::uint8_t> buf{sample.data};
+    hadesmem::PeFile const pe_file{process,
+                                   buf.data(),
+                                   hadesmem::PeFileType::kData,
+                                   static_cast<DWORD>(buf.size())};
+    if (sample.name.compare(0, 3, "all") &&
+        sample.name.compare(0, 7, "imports"))
+    {
+      continue;
+    }
+
+    CheckAgainstLists(process, pe_file);
+
+    hadesmem::ImportTable const table{process, pe_file};
+
+    BOOST_TEST_EQ(table.GetNumModules(), 2UL);
+    BOOST_TEST_EQ(table.GetModuleName(0), "kernel32.dll");
+    BOOST_TEST_EQ(table.FindModule("KERNEL32.DLL"), 0UL);
+    BOOST_TEST_EQ(table.FindModule("ntdll.dll"), not_found);
+    BOOST_TEST_EQ(table.GetNumThunks(0), 2UL);
+    BOOST_TEST_EQ(table.GetNumThunks(1), 1UL);
+    BOOST_TEST(table.HasNames(0));
+
+    auto const entry = table.FindImport("Kernel32.dll", "GetTickCount");
+    BOOST_TEST_EQ(entry.module, 0UL);
+    BOOST_TEST_EQ(entry.thunk, 0UL);
+    BOOST_TEST_EQ(table.GetHint(0, 0), 0x1F0);
+    BOOST_TEST(table.ByOrdinal(0, 1));
+    BOOST_TEST_EQ(table.GetOrdinal(0, 1), 0x10);
+    BOOST_TEST_EQ(table.FindImport("kernel32.dll", 0x10).thunk, 1UL);
+    BOOST_TEST_EQ(table.GetName(1, 0), "MessageBoxA");
+    // Case sensitive, unlike the module name.
+    BOOST_TEST_EQ(table.FindImport("kernel32.dll", "gettickcount").module,
+                  not_found);
+    BOOST_TEST_EQ(table.FindImport("user32.dll", "GetTickCount").module,
+                  not_found);
+
+    // The IAT slot is where ImportThunkList says it is.
+    hadesmem::ImportThunkList const iat{
+      process, pe_file, table.GetFirstThunk(0)};
+    BOOST_TEST_EQ(static_cast<void*>(table.GetFunctionPtr(0, 0)),
+                  std::begin(iat)->GetBase());
+    BOOST_TEST_EQ(table.GetFunction(0, 0), std::begin(iat)->GetFunction());
+  }
+
+  // Malformed files only need to not crash. Names which can't be read are
+  // reported as errors, the same as with ImportThunk.
+  for (auto const& sample : hadesmem::detail::GetPeRegressionCorpus(16))
+  {
+    std::vector<std::uint8_t> buf{sample.data};
+    hadesmem::PeFile const pe_file{process,
+                                   buf.data(),
+                                   hadesmem::PeFileType::kData,
+                                   static_cast<DWORD>(buf.size())};
+    hadesmem::ImportTable const table{process, pe_file};
+    for (std::size_t i = 0; i < table.GetNumModules(); ++i)
+    {
+      try
+      {
+        (void)table.GetModuleName(i);
+      }
+      catch (hadesmem::Error const& /*e*/)
+      {
+      }
+
+      for (std::size_t j = 0; j < table.GetNumThunks(i); ++j)
+      {
+        try
+        {
+          if (!table.ByOrdinal(i, j))
+          {
+            (void)table.GetHint(i, j);
+            (void)table.GetName(i, j);
+          }
+          (void)table.GetFunction(i, j);
+        }
+        catch (hadesmem::Error const& /*e*/)
+        {
+        }
+      }
+    }
+  }
+}
+
+void TestImportTableModules()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  hadesmem::ModuleList const modules{process};
+  for (auto const& mod : modules)
+  {
+    hadesmem::PeFile const pe_file{
+      process, mod.GetHandle(), hadesmem::PeFileType::kImage, 0};
+    CheckAgainstLists(process, pe_file);
+  }
+
+  hadesmem::PeFile const self{
+    process, ::GetModuleHandleW(nullptr), hadesmem::PeFileType::kImage, 0};
+  hadesmem::ImportTable const table{process, self};
+  auto const module = table.FindModule("kernel32.dll");
+  BOOST_TEST(module != hadesmem::ImportTable::kNotFound);
+  auto const entry =
+    table.FindImport(table.GetModuleName(module), "GetCurrentProcessId");
+  BOOST_TEST_EQ(entry.module, module);
+  // Bound by the loader.
+  BOOST_TEST_EQ(table.GetFunction(entry.module, entry.thunk),
+                reinterpret_cast<ULONGLONG>(&::GetCurrentProcessId));
+  BOOST_TEST_EQ(*table.GetFunctionPtr(entry.module, entry.thunk),
+                table.GetFunction(entry.module, entry.thunk));
+}
+
+int main()
+{
+  TestImportTableSamples();
+  TestImportTableModules();
+  return boost::report_errors();
+}
@@ -0,0 +1,123 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/pe_fuzz.hpp>
+#include <hadesmem/detail/pe_fuzz.hpp>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/pe_samples.hpp>
+#include <hadesmem/error.hpp>
+
+// Replays the regression corpus (the synthetic samples plus deterministic
+// mutations of them) through every PeLib component. Same as running
+// "pefuzz --regression", but as part of the test suite.
+
+namespace
+{
+hadesmem::detail::PeFuzzResult
+  RunSample(hadesmem::detail::PeSample const& sample, std::uint32_t components)
+{
+  try
+  {
+    return hadesmem::detail::FuzzPeBuffer(
+      sample.data.data(),
+      sample.data.size(),
+      hadesmem::detail::GetDefaultPeFuzzBudget(),
+      components);
+  }
+  catch (...)
+  {
+    std::cerr << "Unexpected exception: " << sample.name << '\n';
+    std::cerr << boost::current_exception_diagnostic_information() << '\n';
+    BOOST_TEST(false);
+    return hadesmem::detail::PeFuzzResult{};
+  }
+}
+}
+
+void TestPeFuzzSamples()
+{
+  for (auto const& sample : hadesmem::detail::GetPeSamples())
+  {
+    auto const result =
+      RunSample(sample, hadesmem::detail::PeFuzzComponent::kAll);
+    BOOST_TEST(!result.budget_exhausted);
+
+    // Everything in these is well formed, so nothing should be rejected.
+    if (sample.name == "all32" || sample.name == "all64")
+    {
+      BOOST_TEST_EQ(result.num_errors, 0UL);
+      BOOST_TEST(result.num_items > 20);
+    }
+  }
+}
+
+void TestPeFuzzComponents()
+{
+  for (auto const& sample : hadesmem::detail::GetPeSamples())
+  {
+    for (auto const& target : hadesmem::detail::GetPeFuzzTargets())
+    {
+      auto const result = RunSample(sample, target.component);
+      BOOST_TEST(!result.budget_exhausted);
+      BOOST_TEST(result.num_errors <= 1);
+    }
+  }
+}
+
+void TestPeFuzzRegressionCorpus()
+{
+  for (auto const& sample : hadesmem::detail::GetPeRegressionCorpus(64))
+  {
+    auto const result =
+      RunSample(sample, hadesmem::detail::PeFuzzComponent::kAll);
+    if (result.budget_exhausted)
+    {
+      std::cerr << "Budget exhausted: " << sample.name << '\n';
+    }
+    BOOST_TEST(!result.budget_exhausted);
+  }
+}
+
+void TestPeFuzzBudget()
+{
+  auto const samples = hadesmem::detail::GetPeSamples();
+  for (auto const& sample : samples)
+  {
+    if (sample.name != "all32")
+    {
+      continue;
+    }
+
+    hadesmem::detail::PeFuzzBudget budget =
+      hadesmem::detail::GetDefaultPeFuzzBudget();
+    budget.max_items = 4;
+    auto const result = hadesmem::detail::FuzzPeBuffer(
+      sample.data.data(), sample.data.size(), budget);
+    BOOST_TEST(result.budget_exhausted);
+    BOOST_TEST_EQ(result.num_items, 5UL);
+  }
+
+  // Nothing to do for an empty buffer.
+  auto const empty = hadesmem::detail::FuzzPeBuffer(
+    "", 0, hadesmem::detail::GetDefaultPeFuzzBudget());
+  BOOST_TEST_EQ(empty.num_items, 0UL);
+  BOOST_TEST(!empty.budget_exhausted);
+}
+
+int main()
+{
+  TestPeFuzzSamples();
+  TestPeFuzzComponents();
+  TestPeFuzzRegressionCorpus();
+  TestPeFuzzBudget();
+  return boost::report_errors();
+}
@@ -0,0 +1,181 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/pelib/relocation_table.hpp>
+#include <hadesmem/pelib/relocation_table.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/pe_samples.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/pelib/relocation.hpp>
+#include <hadesmem/pelib/relocation_block.hpp>
+#include <hadesmem/pelib/relocation_block_list.hpp>
+#include <hadesmem/pelib/relocation_list.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+namespace
+{
+// Everything RelocationTable reports has to match what the lists report.
+void CheckAgainstLists(hadesmem::Process const& process,
+                       hadesmem::PeFile const& pe_file)
+{
+  hadesmem::RelocationTable const table{process, pe_file};
+  hadesmem::RelocationBlockList const blocks{process, pe_file};
+
+  std::size_t i = 0;
+  for (auto const& block : blocks)
+  {
+    BOOST_TEST(i < table.GetNumBlocks());
+    if (i >= table.GetNumBlocks())
+    {
+      return;
+    }
+
+    BOOST_TEST_EQ(table.GetVirtualAddress(i), block.GetVirtualAddress());
+    BOOST_TEST_EQ(table.GetSizeOfBlock(i), block.GetSizeOfBlock());
+
+    auto const entries = table.GetEntries(i);
+    BOOST_TEST_EQ(entries.size(),
+                  static_cast<std::size_t>(block.GetNumberOfRelocations()));
+    hadesmem::RelocationList const relocs{process,
+                                          pe_file,
+                                          block.GetRelocationDataStart(),
+                                          block.GetNumberOfRelocations()};
+    std::size_t j = 0;
+    for (auto const& reloc : relocs)
+    {
+      BOOST_TEST(j < entries.size());
+      if (j >= entries.size())
+      {
+        break;
+      }
+
+      BOOST_TEST_EQ(entries[j].type, reloc.GetType());
+      BOOST_TEST_EQ(entries[j].offset, reloc.GetOffset());
+      ++j;
+    }
+    BOOST_TEST_EQ(j, entries.size());
+
+    ++i;
+  }
+  BOOST_TEST_EQ(i, table.GetNumBlocks());
+}
+}
+
+void TestRelocationTableSamples()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  for (auto const& sample : hadesmem::detail::GetPeSamples())
+  {
+    std::vector<std::uint8_t> buf{sample.data};
+    hadesmem::PeFile const pe_file{process,
+                                   buf.data(),
+                                   hadesmem::PeFileType::kData,
+                                   static_cast<DWORD>(buf.size())};
+    if (sample.name.compare(0, 3, "all") && sample.name.compare(0, 5, "reloc"))
+    {
+      continue;
+    }
+
+    CheckAgainstLists(process, pe_file);
+
+    hadesmem::RelocationTable const table{process, pe_file};
+    if (sample.name == "reloc_block_oob")
+    {
+      BOOST_TEST(table.IsTruncated());
+      BOOST_TEST_EQ(table.GetNumBlocks(), 0UL);
+    }
+    else if (sample.name == "reloc_zero_block")
+    {
+      // The empty block is followed by what was meant to be its entries,
+      // which don't make a valid block header.
+      BOOST_TEST(table.IsTruncated());
+      BOOST_TEST_EQ(table.GetNumBlocks(), 1UL);
+      BOOST_TEST(table.GetEntries(0).empty());
+    }
+    else
+    {
+      BOOST_TEST(!table.IsTruncated());
+      BOOST_TEST_EQ(table.GetNumBlocks(), 2UL);
+      BOOST_TEST_EQ(table.GetNumEntries(), 6UL);
+      BOOST_TEST_EQ(table.GetEntries(0)[3].type, 0);
+    }
+  }
+
+  // Malformed files only need to not crash.
+  for (auto const& sample : hadesmem::detail::GetPeRegressionCorpus(16))
+  {
+    std::vector<std::uint8_t> buf{sample.data};
+    try
+    {
+      hadesmem::PeFile const pe_file{process,
+                                     buf.data(),
+                                     hadesmem::PeFileType::kData,
+                                     static_cast<DWORD>(buf.size())};
+      hadesmem::RelocationTable const table{process, pe_file};
+      for (std::size_t i = 0; i < table.GetNumBlocks(); ++i)
+      {
+        for (auto const& entry : table.GetEntries(i))
+        {
+          (void)entry;
+        }
+      }
+    }
+    catch (hadesmem::Error const& /*e*/)
+    {
+    }
+  }
+}
+
+void TestRelocationTableModules()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  hadesmem::ModuleList const modules{process};
+  for (auto const& mod : modules)
+  {
+    hadesmem::PeFile const pe_file{
+      process, mod.GetHandle(), hadesmem::PeFileType::kImage, 0};
+    CheckAgainstLists(process, pe_file);
+  }
+
+  // Rebasing a copy of a loaded module back to where it already is has to
+  // leave it unchanged, and rebasing it somewhere else and back again has to
+  // as well.
+  hadesmem::Module const ntdll{process, L"ntdll.dll"};
+  hadesmem::PeFile const pe_file{
+    process, ntdll.GetHandle(), hadesmem::PeFileType::kImage, 0};
+  hadesmem::RelocationTable const table{process, pe_file};
+  BOOST_TEST(table.GetNumEntries() != 0);
+  auto const image = hadesmem::ReadVector<std::uint8_t>(
+    process, ntdll.GetHandle(), ntdll.GetSize());
+  auto copy = image;
+  auto const result = table.ApplyRelocations(copy.data(), copy.size(), 0);
+  BOOST_TEST_EQ(result.num_out_of_bounds, 0UL);
+  BOOST_TEST_EQ(result.num_unsupported, 0UL);
+  BOOST_TEST(copy == image);
+  std::uint64_t const delta = 0x10000;
+  (void)table.ApplyRelocations(copy.data(), copy.size(), delta);
+  BOOST_TEST(copy != image);
+  (void)table.ApplyRelocations(copy.data(), copy.size(), 0 - delta);
+  BOOST_TEST(copy == image);
+}
+
+int main()
+{
+  TestRelocationTableSamples();
+  TestRelocationTableModules();
+  return boost::report_errors();
+}
@@ -0,0 +1,120 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/process_snapshot.hpp>
+#include <hadesmem/process_snapshot.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/write.hpp>
+
+namespace
+{
+bool IsInRanges(std::vector<hadesmem::detail::SnapshotDiffRange> const& ranges,
+                void const* address)
+{
+  auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+  for (auto const& range : ranges)
+  {
+    if (address_num >= range.base && address_num - range.base < range.size)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+}
+
+void TestProcessSnapshot(std::uint32_t flags)
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::wstring const str{L"Hello snapshot"};
+
+  hadesmem::Allocator allocator{process, 0x2000};
+  auto const base = static_cast<std::uint8_t*>(allocator.GetBase());
+  auto const page_2 = base + 0x1000;
+  hadesmem::Write(process, base, 0x12345678U);
+  hadesmem::Write(process, page_2, 0xDEADBEEFU);
+
+  hadesmem::ProcessSnapshot const snapshot_1{process, flags};
+  BOOST_TEST_EQ(snapshot_1.GetProcessId(), process.GetId());
+  BOOST_TEST(snapshot_1.GetNumRegions() != 0);
+  BOOST_TEST(snapshot_1.IsCaptured(base, 0x2000));
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(snapshot_1, base), 0x12345678U);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(snapshot_1, page_2),
+                0xDEADBEEFU);
+  auto const vec = hadesmem::ReadVector<std::uint8_t>(snapshot_1, base, 0x10);
+  BOOST_TEST_EQ(vec.size(), 0x10UL);
+  BOOST_TEST_EQ(vec[0], 0x78);
+  BOOST_TEST_EQ(vec[4], 0);
+  BOOST_TEST_EQ(hadesmem::ReadString<wchar_t>(
+                  snapshot_1, const_cast<wchar_t*>(str.c_str())),
+                str);
+
+  // Changes to the target don't show up in an existing snapshot.
+  hadesmem::Write(process, page_2, 0xCAFEBABEU);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(snapshot_1, page_2),
+                0xDEADBEEFU);
+
+  hadesmem::ProcessSnapshot snapshot_2{process, flags};
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(snapshot_2, page_2),
+                0xCAFEBABEU);
+  auto const diff_2 = snapshot_2.Diff(snapshot_1);
+  BOOST_TEST(IsInRanges(diff_2.changed, page_2));
+  BOOST_TEST(!IsInRanges(diff_2.changed, base));
+
+  allocator.Free();
+
+  hadesmem::ProcessSnapshot snapshot_3{process, flags};
+  BOOST_TEST(!snapshot_3.IsCaptured(base, 1));
+  BOOST_TEST_THROWS(hadesmem::Read<std::uint32_t>(snapshot_3, base),
+                    hadesmem::Error);
+  auto const diff_3 = snapshot_3.Diff(snapshot_2);
+  BOOST_TEST(IsInRanges(diff_3.removed, base));
+  BOOST_TEST(IsInRanges(diff_3.removed, page_2));
+
+  hadesmem::ProcessSnapshot const snapshot_4{std::move(snapshot_2)};
+  BOOST_TEST_EQ(snapshot_2.GetProcessId(), 0UL);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(snapshot_4, page_2),
+                0xCAFEBABEU);
+}
+
+void TestProcessSnapshotClone()
+{
+  // Not supported before Windows 8.1.
+  if (!::GetProcAddress(::GetModuleHandleW(L"kernel32.dll"),
+                        "PssCaptureSnapshot"))
+  {
+    hadesmem::Process const process(::GetCurrentProcessId());
+    BOOST_TEST_THROWS(hadesmem::ProcessSnapshot(
+                        process, hadesmem::ProcessSnapshotFlags::kClone),
+                      hadesmem::Error);
+    return;
+  }
+
+  TestProcessSnapshot(hadesmem::ProcessSnapshotFlags::kClone);
+  TestProcessSnapshot(hadesmem::ProcessSnapshotFlags::kClone |
+                      hadesmem::ProcessSnapshotFlags::kSpillToFile);
+}
+
+int main()
+{
+  TestProcessSnapshot(hadesmem::ProcessSnapshotFlags::kNone);
+  TestProcessSnapshot(hadesmem::ProcessSnapshotFlags::kSpillToFile);
+  TestProcessSnapshotClone();
+  return boost::report_errors();
+}
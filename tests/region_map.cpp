@@ -0,0 +1,181 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/region_map.hpp>
+#include <hadesmem/region_map.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/region_alloc_size.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/protect.hpp>
+#include <hadesmem/read.hpp>
+#include <hadesmem/region.hpp>
+#include <hadesmem/region_list.hpp>
+#include <hadesmem/write.hpp>
+
+void TestRegionMap()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::RegionMap const regions{process};
+  BOOST_TEST(!regions.empty());
+
+  // Should match a walk with RegionList.
+  hadesmem::RegionList const region_list{process};
+  std::size_t num_regions = 0;
+  for (auto const& region : region_list)
+  {
+    MEMORY_BASIC_INFORMATION const* const mbi =
+      regions.Find(region.GetBase());
+    BOOST_TEST(mbi != nullptr);
+    if (mbi)
+    {
+      BOOST_TEST_EQ(mbi->BaseAddress, region.GetBase());
+      BOOST_TEST_EQ(mbi->RegionSize, region.GetSize());
+      BOOST_TEST_EQ(mbi->State, region.GetState());
+      BOOST_TEST_EQ(mbi->Type, region.GetType());
+      BOOST_TEST(regions.Find(static_cast<std::uint8_t*>(region.GetBase()) +
+                              region.GetSize() - 1) == mbi);
+    }
+    ++num_regions;
+  }
+  BOOST_TEST_EQ(num_regions, regions.size());
+
+  for (auto iter = std::begin(regions), next = std::next(iter);
+       next != std::end(regions);
+       ++iter, ++next)
+  {
+    BOOST_TEST_EQ(static_cast<void*>(static_cast<std::uint8_t*>(
+                    iter->BaseAddress) + iter->RegionSize),
+                  next->BaseAddress);
+  }
+
+  hadesmem::Module const this_mod{process, nullptr};
+  MEMORY_BASIC_INFORMATION const* const this_mod_mbi =
+    regions.Find(this_mod.GetHandle());
+  BOOST_TEST(this_mod_mbi != nullptr);
+  BOOST_TEST_EQ(this_mod_mbi->AllocationBase,
+                static_cast<void*>(this_mod.GetHandle()));
+  BOOST_TEST_EQ(
+    hadesmem::detail::GetModuleRegionSize(regions, this_mod.GetHandle()),
+    hadesmem::detail::GetModuleRegionSize(process, this_mod.GetHandle()));
+
+  std::size_t num_image = 0;
+  for (auto const& mbi :
+       regions.Filter(hadesmem::RegionFilter{MEM_COMMIT, 0, MEM_IMAGE}))
+  {
+    BOOST_TEST_EQ(mbi.State, static_cast<DWORD>(MEM_COMMIT));
+    BOOST_TEST_EQ(mbi.Type, static_cast<DWORD>(MEM_IMAGE));
+    ++num_image;
+  }
+  BOOST_TEST(num_image != 0);
+
+  std::size_t num_this_mod = 0;
+  auto const this_mod_end =
+    static_cast<std::uint8_t*>(static_cast<void*>(this_mod.GetHandle())) +
+    this_mod.GetSize();
+  for (auto const& mbi : regions.Filter(hadesmem::RegionFilter{0, 0, 0},
+                                        this_mod.GetHandle(),
+                                        this_mod_end))
+  {
+    BOOST_TEST_EQ(mbi.AllocationBase,
+                  static_cast<void*>(this_mod.GetHandle()));
+    ++num_this_mod;
+  }
+  BOOST_TEST(num_this_mod != 0);
+
+  BOOST_TEST(regions.Diff(regions).added.empty());
+  BOOST_TEST(regions.Diff(regions).removed.empty());
+  BOOST_TEST(regions.Diff(regions).changed.empty());
+
+  // Allocations and protection changes should show up in the diff.
+  hadesmem::Allocator const allocator{process, 0x10000};
+  hadesmem::Protect(process, allocator.GetBase(), PAGE_READONLY);
+  hadesmem::RegionMap const regions_new{process};
+  hadesmem::RegionMapDiff const diff = regions_new.Diff(regions);
+  bool found_alloc = false;
+  for (auto const& mbi : diff.added)
+  {
+    if (mbi.BaseAddress == allocator.GetBase())
+    {
+      BOOST_TEST_EQ(mbi.Protect, static_cast<DWORD>(PAGE_READONLY));
+      found_alloc = true;
+    }
+  }
+  BOOST_TEST(found_alloc);
+
+  hadesmem::Protect(process, allocator.GetBase(), PAGE_READWRITE);
+  hadesmem::RegionMapDiff const diff_protect =
+    hadesmem::RegionMap{process}.Diff(regions_new);
+  bool found_protect = false;
+  for (auto const& mbi : diff_protect.changed)
+  {
+    if (mbi.BaseAddress == allocator.GetBase())
+    {
+      BOOST_TEST_EQ(mbi.Protect, static_cast<DWORD>(PAGE_READWRITE));
+      found_protect = true;
+    }
+  }
+  BOOST_TEST(found_protect);
+
+  // Read/Write served from the snapshot.
+  hadesmem::RegionMap const regions_rw{process};
+  hadesmem::Write(process, regions_rw, allocator.GetBase(), 0x12345678UL);
+  BOOST_TEST_EQ(
+    hadesmem::Read<unsigned long>(process, regions_rw, allocator.GetBase()),
+    0x12345678UL);
+  BOOST_TEST_EQ(
+    hadesmem::Read<unsigned long>(process, allocator.GetBase()),
+    0x12345678UL);
+
+  std::vector<int> const int_vec{1, 2, 3, 4, 5};
+  hadesmem::WriteVector(process, regions_rw, allocator.GetBase(), int_vec);
+  BOOST_TEST(hadesmem::ReadVector<int>(
+               process, regions_rw, allocator.GetBase(), int_vec.size()) ==
+             int_vec);
+
+  std::string const str{"Hello, RegionMap!"};
+  hadesmem::WriteString(process, allocator.GetBase(), str);
+  BOOST_TEST_EQ(
+    hadesmem::ReadString<char>(process, regions_rw, allocator.GetBase()),
+    str);
+
+  // A stale snapshot must not be used to change (or restore) the protection
+  // of pages which have changed since it was taken.
+  DWORD old_protect = 0;
+  BOOST_TEST(::VirtualProtect(
+    allocator.GetBase(), 0x10000, PAGE_READONLY, &old_protect));
+  hadesmem::RegionMap const regions_stale{process};
+  auto const second_page = static_cast<std::uint8_t*>(allocator.GetBase()) +
+                           0x1000;
+  BOOST_TEST(
+    ::VirtualProtect(second_page, 0x1000, PAGE_READWRITE, &old_protect));
+  hadesmem::Write(process, regions_stale, allocator.GetBase(), 0x87654321UL);
+  BOOST_TEST_EQ(
+    hadesmem::Read<unsigned long>(process, allocator.GetBase()),
+    0x87654321UL);
+  BOOST_TEST_EQ(hadesmem::detail::Query(process, allocator.GetBase()).Protect,
+                static_cast<DWORD>(PAGE_READONLY));
+  BOOST_TEST_EQ(hadesmem::detail::Query(process, second_page).Protect,
+                static_cast<DWORD>(PAGE_READWRITE));
+}
+
+int main()
+{
+  TestRegionMap();
+  return boost::report_errors();
+}
@@ -0,0 +1,81 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/remote_heap.hpp>
+#include <hadesmem/remote_heap.hpp>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/protect.hpp>
+#include <hadesmem/read.hpp>
+#include <hadesmem/write.hpp>
+
+void TestRemoteHeap()
+{
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  hadesmem::RemoteHeap heap{process};
+  BOOST_TEST(!heap.IsExecutable());
+
+  // Lots of small blocks should share a single chunk.
+  std::vector<void*> blocks;
+  for (std::size_t i = 0; i < 100; ++i)
+  {
+    void* const block = heap.Alloc(0x20);
+    BOOST_TEST_EQ(reinterpret_cast<std::uintptr_t>(block) % 0x10, 0U);
+    hadesmem::Write(process, block, i);
+    blocks.push_back(block);
+  }
+  BOOST_TEST_EQ(heap.GetNumChunks(), 1UL);
+  BOOST_TEST_EQ(heap.GetNumBlocks(), 100UL);
+  for (std::size_t i = 0; i < blocks.size(); ++i)
+  {
+    BOOST_TEST_EQ(hadesmem::Read<std::size_t>(process, blocks[i]), i);
+  }
+  BOOST_TEST(hadesmem::CanWrite(process, blocks[0]));
+  BOOST_TEST(!hadesmem::CanExecute(process, blocks[0]));
+
+  std::string const str{"Hello, RemoteHeap!"};
+  void* const str_block = heap.Alloc(str.size() + 1);
+  hadesmem::WriteString(process, str_block, str);
+  BOOST_TEST_EQ(hadesmem::ReadString<char>(process, str_block), str);
+
+  heap.Free(blocks[0]);
+  BOOST_TEST_THROWS(heap.Free(blocks[0]), hadesmem::Error);
+  BOOST_TEST_EQ(heap.Alloc(0x18), blocks[0]);
+
+  void* const large = heap.Alloc(0x10000);
+  hadesmem::Write(process, large, 0x12345678UL);
+  BOOST_TEST_EQ(hadesmem::Read<unsigned long>(process, large), 0x12345678UL);
+  heap.Free(large);
+
+  heap.Reset();
+  BOOST_TEST_EQ(heap.GetNumBlocks(), 0UL);
+  BOOST_TEST_EQ(heap.GetNumChunks(), 1UL);
+
+  hadesmem::RemoteHeap heap_moved{std::move(heap)};
+  BOOST_TEST_EQ(heap_moved.GetNumChunks(), 1UL);
+  heap_moved.FreeAll();
+  BOOST_TEST_EQ(heap_moved.GetNumChunks(), 0UL);
+
+  hadesmem::RemoteHeap exec_heap{process,
+                                 hadesmem::RemoteHeapFlags::kExecutable};
+  BOOST_TEST(exec_heap.IsExecutable());
+  BOOST_TEST(hadesmem::CanExecute(process, exec_heap.Alloc(0x10)));
+}
+
+int main()
+{
+  TestRemoteHeap();
+  return boost::report_errors();
+}
@@ -0,0 +1,120 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/shared_channel.hpp>
+#include <hadesmem/shared_channel.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/error.hpp>
+
+struct SharedState
+{
+  std::uint32_t counter;
+  std::uint32_t flags;
+};
+
+void TestSharedChannel()
+{
+  std::wstring const name =
+    L"Local\\hadesmem_shared_channel_test_" +
+    hadesmem::detail::NumToStr<wchar_t>(::GetCurrentProcessId());
+
+  BOOST_TEST_THROWS(hadesmem::SharedChannel{name}, hadesmem::Error);
+
+  hadesmem::SharedChannel controller{name, sizeof(SharedState), 16, 64};
+  BOOST_TEST(controller.IsController());
+  BOOST_TEST_EQ(controller.GetStructSize(), sizeof(SharedState));
+  BOOST_TEST_EQ(controller.GetMaxMessageSize(), 64UL);
+
+  BOOST_TEST_THROWS(
+    hadesmem::SharedChannel(name, sizeof(SharedState), 16, 64),
+    hadesmem::Error);
+
+  // Normally this would be in the injected module. Both sides map the same
+  // section at different addresses.
+  hadesmem::SharedChannel module{name};
+  BOOST_TEST(!module.IsController());
+  BOOST_TEST_EQ(module.GetStructSize(), sizeof(SharedState));
+  BOOST_TEST(module.GetStruct() != controller.GetStruct());
+
+  static_cast<SharedState*>(module.GetStruct())->counter = 1234;
+  BOOST_TEST_EQ(static_cast<SharedState*>(controller.GetStruct())->counter,
+                1234U);
+
+  char buf[64] = {};
+  std::size_t size = 0;
+  BOOST_TEST(!module.TryReceive(buf, &size));
+  BOOST_TEST(!controller.TryReceive(buf, &size));
+
+  BOOST_TEST(controller.TrySend("command", 7));
+  BOOST_TEST_EQ(controller.GetNumPendingSend(), 1UL);
+  BOOST_TEST_EQ(module.GetNumPendingReceive(), 1UL);
+  BOOST_TEST(!controller.TryReceive(buf, &size));
+  BOOST_TEST(module.TryReceive(buf, &size));
+  BOOST_TEST_EQ(size, 7UL);
+  BOOST_TEST(std::memcmp(buf, "command", 7) == 0);
+
+  for (std::uint32_t i = 0; i < 16; ++i)
+  {
+    BOOST_TEST(module.TrySend(sizeof(i), [&](void* data) {
+      std::memcpy(data, &i, sizeof(i));
+    }));
+  }
+  BOOST_TEST(!module.TrySend("full", 4));
+
+  for (std::uint32_t i = 0; i < 16; ++i)
+  {
+    BOOST_TEST(controller.TryReceive([&](void const* data, std::size_t len) {
+      std::uint32_t value = 0;
+      BOOST_TEST_EQ(len, sizeof(value));
+      std::memcpy(&value, data, sizeof(value));
+      BOOST_TEST_EQ(value, i);
+    }));
+  }
+  BOOST_TEST(!controller.TryReceive(buf, &size));
+
+  // The module side doesn't trust the header (the first ring aligned block of
+  // the section), and doesn't re-read it after attaching.
+  std::size_t const header_size = hadesmem::detail::SharedRing::kSlotAlignment;
+  auto const header = reinterpret_cast<hadesmem::detail::SharedChannelHeader*>(
+    static_cast<std::uint8_t*>(controller.GetStruct()) - header_size);
+  auto const header_good = *header;
+  header->to_controller_offset = 0x7FFFFFFF00000000ULL;
+  BOOST_TEST_THROWS(hadesmem::SharedChannel{name}, hadesmem::Error);
+  *header = header_good;
+  header->struct_size = header->size;
+  BOOST_TEST_THROWS(hadesmem::SharedChannel{name}, hadesmem::Error);
+  *header = header_good;
+  header->size = 0xFFFFFFFFFFFFFFFFULL;
+  BOOST_TEST_THROWS(hadesmem::SharedChannel{name}, hadesmem::Error);
+  *header = header_good;
+  header->struct_size = 0x1000;
+  BOOST_TEST_EQ(module.GetStructSize(), sizeof(SharedState));
+  *header = header_good;
+
+  // Neither does a ring.
+  auto const ring_header =
+    reinterpret_cast<hadesmem::detail::SharedRingHeader*>(
+      reinterpret_cast<std::uint8_t*>(header) + header->to_module_offset);
+  ring_header->num_slots = 0x1000;
+  BOOST_TEST_THROWS(hadesmem::SharedChannel{name}, hadesmem::Error);
+  ring_header->num_slots = 16;
+  hadesmem::SharedChannel const module_2{name};
+  BOOST_TEST_EQ(module_2.GetStructSize(), sizeof(SharedState));
+}
+
+int main()
+{
+  TestSharedChannel();
+  return boost::report_errors();
+}
@@ -0,0 +1,231 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/shared_ring.hpp>
+#include <hadesmem/detail/shared_ring.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of SharedChannel, with local threads
+// standing in for the two processes.
+
+namespace
+{
+struct Message
+{
+  std::uint32_t producer;
+  std::uint32_t sequence;
+};
+
+std::vector<std::uint64_t> MakeRingMemory(std::size_t num_slots,
+                                          std::size_t max_message_size)
+{
+  return std::vector<std::uint64_t>(
+    hadesmem::detail::SharedRing::GetRequiredSize(num_slots,
+                                                  max_message_size) /
+      sizeof(std::uint64_t) +
+    1);
+}
+}
+
+void TestSharedRingBasic()
+{
+  using hadesmem::detail::SharedRing;
+
+  auto memory = MakeRingMemory(4, 16);
+  BOOST_TEST(!SharedRing::IsFormatted(memory.data()));
+  SharedRing::Format(
+    memory.data(), 4, 16, hadesmem::detail::SharedRingMode::kSpsc);
+  BOOST_TEST(SharedRing::IsFormatted(memory.data()));
+
+  SharedRing ring{memory.data(), memory.size() * sizeof(std::uint64_t)};
+  BOOST_TEST_EQ(ring.GetNumSlots(), 4UL);
+  BOOST_TEST_EQ(ring.GetMaxMessageSize(), 16UL);
+
+  char buf[16] = {};
+  std::size_t size = 0;
+  BOOST_TEST(!ring.TryRead(buf, &size));
+
+  BOOST_TEST(ring.TryWrite("a", 1));
+  BOOST_TEST(ring.TryWrite("bb", 2));
+  BOOST_TEST(ring.TryWrite(nullptr, 0));
+  BOOST_TEST(ring.TryProduce(3, [](void* data) {
+    std::memcpy(data, "ccc", 3);
+  }));
+  BOOST_TEST(!ring.TryWrite("d", 1));
+  BOOST_TEST_EQ(ring.GetNumPending(), 4UL);
+
+  BOOST_TEST(ring.TryRead(buf, &size));
+  BOOST_TEST_EQ(size, 1UL);
+  BOOST_TEST_EQ(buf[0], 'a');
+
+  // Room again now the oldest message is gone.
+  BOOST_TEST(ring.TryWrite("d", 1));
+
+  BOOST_TEST(ring.TryRead(buf, &size));
+  BOOST_TEST_EQ(size, 2UL);
+  BOOST_TEST(std::memcmp(buf, "bb", 2) == 0);
+  BOOST_TEST(ring.TryRead(buf, &size));
+  BOOST_TEST_EQ(size, 0UL);
+  BOOST_TEST(ring.TryConsume([](void const* data, std::size_t data_size) {
+    BOOST_TEST_EQ(data_size, 3UL);
+    BOOST_TEST(std::memcmp(data, "ccc", 3) == 0);
+  }));
+  BOOST_TEST(ring.TryRead(buf, &size));
+  BOOST_TEST_EQ(buf[0], 'd');
+  BOOST_TEST(!ring.TryRead(buf, &size));
+  BOOST_TEST_EQ(ring.GetNumPending(), 0UL);
+}
+
+void TestSharedRingCorrupted()
+{
+  using hadesmem::detail::SharedRing;
+
+  auto memory = MakeRingMemory(4, 16);
+  SharedRing::Format(
+    memory.data(), 4, 16, hadesmem::detail::SharedRingMode::kSpsc);
+  SharedRing ring{memory.data(), memory.size() * sizeof(std::uint64_t)};
+  BOOST_TEST(ring.TryWrite("a", 1));
+  BOOST_TEST(ring.TryWrite("b", 1));
+
+  // The other side claims the first message is bigger than a slot.
+  auto const slot_header =
+    reinterpret_cast<hadesmem::detail::SharedRingSlotHeader*>(
+      reinterpret_cast<std::uint8_t*>(memory.data()) + SharedRing::kHeaderSize);
+  slot_header->size = 0x10000;
+
+  char buf[16] = {};
+  std::size_t size = 0;
+  BOOST_TEST(!ring.IsCorrupted());
+  BOOST_TEST(!ring.TryRead(buf, &size));
+  BOOST_TEST(ring.IsCorrupted());
+  BOOST_TEST_EQ(size, 0UL);
+  // Nothing else is read once it's corrupted.
+  slot_header->size = 1;
+  BOOST_TEST(!ring.TryRead(buf, &size));
+}
+
+void TestSharedRingBadGeometry()
+{
+  using hadesmem::detail::SharedRing;
+  using hadesmem::detail::SharedRingHeader;
+
+  auto memory = MakeRingMemory(4, 16);
+  std::size_t const memory_size = memory.size() * sizeof(std::uint64_t);
+  auto const header = reinterpret_cast<SharedRingHeader*>(memory.data());
+
+  BOOST_TEST(SharedRing(memory.data(), memory_size).IsCorrupted());
+
+  auto const format = [&]() {
+    SharedRing::Format(
+      memory.data(), 4, 16, hadesmem::detail::SharedRingMode::kSpsc);
+  };
+  format();
+  BOOST_TEST(!SharedRing(memory.data(), memory_size).IsCorrupted());
+
+  // Doesn't fit in the memory it was given.
+  BOOST_TEST(SharedRing(memory.data(), memory_size / 2).IsCorrupted());
+  BOOST_TEST(SharedRing(memory.data(), 8).IsCorrupted());
+
+  // The other side lies about the geometry.
+  header->num_slots = 3;
+  BOOST_TEST(SharedRing(memory.data(), memory_size).IsCorrupted());
+  format();
+  header->num_slots = 0x10000000;
+  BOOST_TEST(SharedRing(memory.data(), memory_size).IsCorrupted());
+  format();
+  header->slot_size = 0;
+  BOOST_TEST(SharedRing(memory.data(), memory_size).IsCorrupted());
+  format();
+  header->max_message_size = 0xFFFFFFFF;
+  BOOST_TEST(SharedRing(memory.data(), memory_size).IsCorrupted());
+  format();
+  header->mode = static_cast<hadesmem::detail::SharedRingMode>(2);
+  BOOST_TEST(SharedRing(memory.data(), memory_size).IsCorrupted());
+
+  // A corrupted ring is never touched.
+  SharedRing ring{memory.data(), memory_size};
+  char buf[16] = {};
+  std::size_t size = 0;
+  BOOST_TEST(!ring.TryWrite("a", 1));
+  BOOST_TEST(!ring.TryRead(buf, &size));
+  BOOST_TEST_EQ(ring.GetNumPending(), 0UL);
+}
+
+void TestSharedRingThreaded(hadesmem::detail::SharedRingMode mode,
+                            std::uint32_t num_producers)
+{
+  using hadesmem::detail::SharedRing;
+
+  std::uint32_t const kNumMessages = 50000;
+
+  auto memory = MakeRingMemory(64, sizeof(Message));
+  SharedRing::Format(memory.data(), 64, sizeof(Message), mode);
+
+  std::vector<std::thread> producers;
+  for (std::uint32_t i = 0; i < num_producers; ++i)
+  {
+    producers.emplace_back([&memory, i, kNumMessages]() {
+      SharedRing ring{memory.data(), memory.size() * sizeof(std::uint64_t)};
+      for (std::uint32_t j = 0; j < kNumMessages; ++j)
+      {
+        Message const message{i, j};
+        while (!ring.TryWrite(&message, sizeof(message)))
+        {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Messages from any one producer must arrive in order.
+  SharedRing ring{memory.data(), memory.size() * sizeof(std::uint64_t)};
+  std::vector<std::uint32_t> next(num_producers);
+  std::uint32_t num_received = 0;
+  bool in_order = true;
+  while (num_received < kNumMessages * num_producers)
+  {
+    Message message{};
+    std::size_t size = 0;
+    if (!ring.TryRead(&message, &size))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    BOOST_TEST_EQ(size, sizeof(Message));
+    in_order = in_order && message.producer < num_producers &&
+               message.sequence == next[message.producer]++;
+    ++num_received;
+  }
+
+  for (auto& producer : producers)
+  {
+    producer.join();
+  }
+
+  BOOST_TEST(in_order);
+  BOOST_TEST_EQ(ring.GetNumPending(), 0UL);
+  for (auto const n : next)
+  {
+    BOOST_TEST_EQ(n, kNumMessages);
+  }
+}
+
+int main()
+{
+  TestSharedRingBasic();
+  TestSharedRingCorrupted();
+  TestSharedRingBadGeometry();
+  TestSharedRingThreaded(hadesmem::detail::SharedRingMode::kSpsc, 1);
+  TestSharedRingThreaded(hadesmem::detail::SharedRingMode::kMpsc, 4);
+  return boost::report_errors();
+}
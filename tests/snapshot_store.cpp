@@ -0,0 +1,152 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/snapshot_store.hpp>
+#include <hadesmem/detail/snapshot_store.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of ProcessSnapshot, with local buffers
+// standing in for the memory of the target.
+
+namespace
+{
+std::size_t const kPageSize = hadesmem::detail::SnapshotStore::kPageSize;
+
+void FillStore(hadesmem::detail::SnapshotStore& store,
+               std::vector<std::uint8_t>& storage,
+               std::uint8_t seed)
+{
+  storage.resize(store.GetDataSize());
+  store.Attach(storage.data());
+  for (std::size_t i = 0; i < storage.size(); ++i)
+  {
+    storage[i] = static_cast<std::uint8_t>(seed + i / kPageSize);
+  }
+}
+}
+
+void TestSnapshotStoreRead()
+{
+  using hadesmem::detail::SnapshotStore;
+
+  SnapshotStore store;
+  store.AddRegion(0x10000, 2 * kPageSize, 0x04);
+  store.AddRegion(0x12000, kPageSize, 0x02);
+  store.AddRegion(0x20000, kPageSize, 0x04);
+  BOOST_TEST_EQ(store.GetNumRegions(), 3UL);
+  BOOST_TEST_EQ(store.GetDataSize(), 4 * kPageSize);
+
+  std::vector<std::uint8_t> storage;
+  FillStore(store, storage, 1);
+  store.HashPages();
+
+  BOOST_TEST_EQ(store.FindRegion(0x0FFFF), 3UL);
+  BOOST_TEST_EQ(store.FindRegion(0x10000), 0UL);
+  BOOST_TEST_EQ(store.FindRegion(0x12FFF), 1UL);
+  BOOST_TEST_EQ(store.FindRegion(0x13000), 3UL);
+  BOOST_TEST_EQ(store.FindRegion(0x20000), 2UL);
+  BOOST_TEST_EQ(store.GetRegion(1).protect, 0x02U);
+
+  std::uint8_t buf[kPageSize * 2] = {};
+  BOOST_TEST(store.Read(0x10FFE, buf, 4));
+  BOOST_TEST_EQ(buf[0], 1);
+  BOOST_TEST_EQ(buf[1], 1);
+  BOOST_TEST_EQ(buf[2], 2);
+  BOOST_TEST_EQ(buf[3], 2);
+
+  // Adjacent regions read as one.
+  BOOST_TEST(store.Read(0x11800, buf, kPageSize));
+  BOOST_TEST_EQ(buf[0], 2);
+  BOOST_TEST_EQ(buf[kPageSize - 1], 3);
+
+  // Gaps and the end of the snapshot aren't readable.
+  std::memset(buf, 0xCC, sizeof(buf));
+  BOOST_TEST(!store.Read(0x12800, buf, kPageSize));
+  BOOST_TEST_EQ(buf[0], 0xCC);
+  BOOST_TEST(!store.Read(0x20FFF, buf, 2));
+  BOOST_TEST(store.Read(0x20FFF, buf, 1));
+  BOOST_TEST(store.Read(0x30000, buf, 0));
+
+  store.SetRegionValid(1, false);
+  BOOST_TEST(!store.Read(0x11800, buf, kPageSize));
+  BOOST_TEST(!store.IsCaptured(0x12000, 1));
+  BOOST_TEST(store.IsCaptured(0x11000, kPageSize));
+}
+
+void TestSnapshotStoreDiff()
+{
+  using hadesmem::detail::SnapshotStore;
+
+  SnapshotStore old_store;
+  old_store.AddRegion(0x10000, 4 * kPageSize, 0x04);
+  old_store.AddRegion(0x20000, kPageSize, 0x04);
+  old_store.AddRegion(0x30000, kPageSize, 0x04);
+  std::vector<std::uint8_t> old_storage;
+  FillStore(old_store, old_storage, 0);
+
+  SnapshotStore new_store;
+  new_store.AddRegion(0x10000, 4 * kPageSize, 0x04);
+  new_store.AddRegion(0x30000, kPageSize, 0x04);
+  new_store.AddRegion(0x40000, 2 * kPageSize, 0x04);
+  std::vector<std::uint8_t> new_storage;
+  FillStore(new_store, new_storage, 0);
+
+  // A single byte anywhere in a page is enough.
+  new_storage[kPageSize + 17] ^= 1;
+  new_storage[2 * kPageSize + kPageSize - 1] ^= 0x80;
+  new_storage[4 * kPageSize] = 0xFF;
+
+  old_store.HashPages();
+  new_store.HashPages();
+
+  auto const diff = SnapshotStore::Diff(old_store, new_store);
+  BOOST_TEST_EQ(diff.changed.size(), 2UL);
+  BOOST_TEST_EQ(diff.changed[0].base, 0x11000ULL);
+  BOOST_TEST_EQ(diff.changed[0].size, 2ULL * kPageSize);
+  BOOST_TEST_EQ(diff.changed[1].base, 0x30000ULL);
+  BOOST_TEST_EQ(diff.changed[1].size, 1ULL * kPageSize);
+  BOOST_TEST_EQ(diff.removed.size(), 1UL);
+  BOOST_TEST_EQ(diff.removed[0].base, 0x20000ULL);
+  BOOST_TEST_EQ(diff.added.size(), 1UL);
+  BOOST_TEST_EQ(diff.added[0].base, 0x40000ULL);
+  BOOST_TEST_EQ(diff.added[0].size, 2ULL * kPageSize);
+
+  auto const same = SnapshotStore::Diff(new_store, new_store);
+  BOOST_TEST(same.added.empty());
+  BOOST_TEST(same.removed.empty());
+  BOOST_TEST(same.changed.empty());
+
+  // Regions we failed to capture are treated as absent.
+  new_store.SetRegionValid(2, false);
+  auto const invalid = SnapshotStore::Diff(old_store, new_store);
+  BOOST_TEST(invalid.added.empty());
+}
+
+void TestSnapshotStoreEmpty()
+{
+  using hadesmem::detail::SnapshotStore;
+
+  SnapshotStore store;
+  store.Attach(nullptr);
+  store.HashPages();
+  char c = 0;
+  BOOST_TEST(!store.Read(0x1000, &c, 1));
+  auto const diff = SnapshotStore::Diff(store, store);
+  BOOST_TEST(diff.changed.empty());
+}
+
+int main()
+{
+  TestSnapshotStoreRead();
+  TestSnapshotStoreDiff();
+  TestSnapshotStoreEmpty();
+  return boost::report_errors();
+}
@@ -15,6 +15,7 @@
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/smart_handle.hpp>
 #include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
 #include <hadesmem/thread_helpers.hpp>
 
 // TODO: Clean up this mess and write a proper scope exit wrapper for use in the
@@ -119,6 +120,15 @@ void TestThisThread()
     {
       hadesmem::SuspendedProcess const suspend_process(::GetCurrentProcessId());
     }
+
+    {
+      hadesmem::Process const process(::GetCurrentProcessId());
+      hadesmem::SuspendedProcess const suspend_process(process);
+      BOOST_TEST_EQ(hadesmem::SuspendThread(other_thread), 1UL);
+      BOOST_TEST_EQ(hadesmem::ResumeThread(other_thread), 2UL);
+    }
+    BOOST_TEST_EQ(hadesmem::SuspendThread(other_thread), 0UL);
+    BOOST_TEST_EQ(hadesmem::ResumeThread(other_thread), 1UL);
   }
 }
 
@@ -0,0 +1,131 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/write_batch.hpp>
+#include <hadesmem/write_batch.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/protect.hpp>
+#include <hadesmem/read.hpp>
+#include <hadesmem/region_map.hpp>
+
+void TestWriteBatch()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::Allocator const allocator{process, 0x3000};
+  auto const base = static_cast<std::uint8_t*>(allocator.GetBase());
+  std::memset(base, 0, 0x3000);
+
+  // Make the middle page read-only so the batch has to span regions with
+  // different protections.
+  hadesmem::Protect(process, base + 0x1000, PAGE_READONLY);
+
+  hadesmem::WriteBatch batch{process};
+  BOOST_TEST(batch.empty());
+  batch.Add(base + 0x10, 0x11111111U);
+  batch.Add(base + 0x14, 0x22222222U);
+  batch.Add(base + 0xFFE, 0x33333333U);
+  batch.Add(base + 0x1FFC, 0x44444444U);
+  batch.Add(base + 0x12, static_cast<std::uint16_t>(0x5555));
+  batch.AddString(base + 0x2800, std::string{"batch"});
+  BOOST_TEST_EQ(batch.GetNumRuns(), 4UL);
+  batch.Commit();
+  BOOST_TEST(batch.empty());
+  BOOST_TEST(!batch.CanUndo());
+
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0x10),
+                0x55551111U);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0x14),
+                0x22222222U);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0xFFE),
+                0x33333333U);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0x1FFC),
+                0x44444444U);
+  BOOST_TEST_EQ(hadesmem::ReadString<char>(process, base + 0x2800),
+                "batch");
+
+  // Protection is put back.
+  hadesmem::RegionMap const regions{process};
+  BOOST_TEST_EQ(regions.Query(base + 0x1000).Protect,
+                static_cast<DWORD>(PAGE_READONLY));
+  BOOST_TEST_EQ(regions.Query(base).Protect,
+                static_cast<DWORD>(PAGE_EXECUTE_READWRITE));
+
+  // Same again with a RegionMap, so writable regions aren't queried again.
+  batch.Add(base + 0x1FFC, 0x66666666U);
+  batch.Commit(regions);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0x1FFC),
+                0x66666666U);
+
+  // A stale snapshot must not be used to change (or restore) the protection
+  // of pages which have changed since it was taken.
+  hadesmem::Protect(process, base, PAGE_READONLY);
+  hadesmem::Protect(process, base + 0x1000, PAGE_READONLY);
+  hadesmem::Protect(process, base + 0x2000, PAGE_READONLY);
+  hadesmem::RegionMap const regions_stale{process};
+  hadesmem::Protect(process, base + 0x1000, PAGE_READWRITE);
+  batch.Add(base + 0xFFE, 0x77777777U);
+  batch.Commit(regions_stale);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0xFFE),
+                0x77777777U);
+  BOOST_TEST_EQ(hadesmem::detail::Query(process, base).Protect,
+                static_cast<DWORD>(PAGE_READONLY));
+  BOOST_TEST_EQ(hadesmem::detail::Query(process, base + 0x1000).Protect,
+                static_cast<DWORD>(PAGE_READWRITE));
+}
+
+void TestWriteBatchAtomic()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::Allocator const allocator{process, 0x2000};
+  auto const base = static_cast<std::uint8_t*>(allocator.GetBase());
+  std::memset(base, 0xAA, 0x2000);
+
+  hadesmem::WriteBatch batch{process, hadesmem::WriteBatchFlags::kAtomic};
+  batch.Add(base + 0x100, 0x12345678U);
+  batch.Add(base + 0xFFE, 0x12345678U);
+  batch.Commit();
+  BOOST_TEST(batch.CanUndo());
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0x100),
+                0x12345678U);
+
+  batch.Undo();
+  BOOST_TEST(!batch.CanUndo());
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0x100),
+                0xAAAAAAAAU);
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0xFFE),
+                0xAAAAAAAAU);
+  BOOST_TEST_THROWS(batch.Undo(), hadesmem::Error);
+
+  // Guard pages are refused, so the commit fails part way through and the
+  // first write has to be rolled back.
+  hadesmem::Protect(process, base + 0x1000, PAGE_READWRITE | PAGE_GUARD);
+  batch.Add(base + 0x100, 0x12345678U);
+  batch.Add(base + 0x1000, 0x12345678U);
+  BOOST_TEST_THROWS(batch.Commit(), hadesmem::Error);
+  BOOST_TEST(!batch.CanUndo());
+  BOOST_TEST_EQ(hadesmem::Read<std::uint32_t>(process, base + 0x100),
+                0xAAAAAAAAU);
+  hadesmem::Protect(process, base + 0x1000, PAGE_READWRITE);
+}
+
+int main()
+{
+  TestWriteBatch();
+  TestWriteBatchAtomic();
+  return boost::report_errors();
+}
@@ -0,0 +1,134 @@
+// Copyright (C) 2010-2015 Joshua Boyce
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/write_runs.hpp>
+#include <hadesmem/detail/write_runs.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+// Only uses the OS independent parts of WriteBatch.
+
+void TestWriteRunsBasic()
+{
+  using hadesmem::detail::WriteRuns;
+
+  WriteRuns runs;
+  BOOST_TEST(runs.empty());
+  BOOST_TEST(runs.IsCoalesced());
+
+  // Already in order and not touching.
+  runs.Add(0x1000, "ab", 2);
+  runs.Add(0x1003, "c", 1);
+  runs.Add(0x1000, "", 0);
+  BOOST_TEST(runs.IsCoalesced());
+  BOOST_TEST_EQ(runs.GetRuns().size(), 2UL);
+
+  // Touches the first run, so the two get merged.
+  runs.Add(0x1002, "x", 1);
+  BOOST_TEST(!runs.IsCoalesced());
+  runs.Coalesce();
+  BOOST_TEST(runs.IsCoalesced());
+  BOOST_TEST_EQ(runs.GetRuns().size(), 1UL);
+  auto const& run = runs.GetRuns()[0];
+  BOOST_TEST_EQ(run.address, 0x1000ULL);
+  BOOST_TEST_EQ(run.size, 4UL);
+  BOOST_TEST(std::memcmp(runs.GetData(run), "abxc", 4) == 0);
+
+  runs.Clear();
+  BOOST_TEST(runs.empty());
+  BOOST_TEST_EQ(runs.GetNumBytes(), 0UL);
+}
+
+void TestWriteRunsOverlap()
+{
+  using hadesmem::detail::WriteRuns;
+
+  WriteRuns runs;
+  runs.Add(0x2000, "44444444", 8);
+  runs.Add(0x1000, "1111", 4);
+  runs.Add(0x2002, "55", 2);
+  runs.Add(0x1FFE, "3333", 4);
+  runs.Add(0x1002, "22", 2);
+  runs.Add(0x3000, "6", 1);
+  runs.Coalesce();
+
+  auto const& list = runs.GetRuns();
+  BOOST_TEST_EQ(list.size(), 3UL);
+  BOOST_TEST_EQ(list[0].address, 0x1000ULL);
+  BOOST_TEST(std::memcmp(runs.GetData(list[0]), "1122", 4) == 0);
+  BOOST_TEST_EQ(list[1].address, 0x1FFEULL);
+  BOOST_TEST_EQ(list[1].size, 10UL);
+  BOOST_TEST(std::memcmp(runs.GetData(list[1]), "3333554444", 10) == 0);
+  BOOST_TEST_EQ(list[2].address, 0x3000ULL);
+  BOOST_TEST_EQ(runs.GetNumBytes(), 15UL);
+
+  // Nothing to do the second time around.
+  runs.Coalesce();
+  BOOST_TEST_EQ(runs.GetRuns().size(), 3UL);
+}
+
+// Checks the runs against doing the writes one at a time.
+void TestWriteRunsRandom()
+{
+  using hadesmem::detail::WriteRuns;
+
+  std::mt19937 rng{1234};
+  for (int iteration = 0; iteration < 200; ++iteration)
+  {
+    WriteRuns runs;
+    std::map<std::uint64_t, std::uint8_t> model;
+    std::size_t const num_writes = rng() % 50;
+    for (std::size_t i = 0; i < num_writes; ++i)
+    {
+      std::uint64_t const address = 0x10000 + rng() % 512;
+      std::vector<std::uint8_t> data(1 + rng() % 16);
+      for (auto& b : data)
+      {
+        b = static_cast<std::uint8_t>(rng());
+      }
+      runs.Add(address, data.data(), data.size());
+      for (std::size_t j = 0; j < data.size(); ++j)
+      {
+        model[address + j] = data[j];
+      }
+    }
+    runs.Coalesce();
+
+    std::size_t num_bytes = 0;
+    std::uint64_t prev_end = 0;
+    bool valid = true;
+    for (auto const& run : runs.GetRuns())
+    {
+      // Sorted, with a gap between runs.
+      valid = valid && run.size != 0 && (!prev_end || run.address > prev_end);
+      prev_end = run.address + run.size;
+      for (std::size_t j = 0; j < run.size; ++j)
+      {
+        auto const iter = model.find(run.address + j);
+        valid = valid && iter != model.end() &&
+                iter->second == runs.GetData(run)[j];
+      }
+      num_bytes += run.size;
+    }
+    BOOST_TEST(valid);
+    BOOST_TEST_EQ(num_bytes, model.size());
+    BOOST_TEST_EQ(runs.GetNumBytes(), model.size());
+  }
+}
+
+int main()
+{
+  TestWriteRunsBasic();
+  TestWriteRunsOverlap();
+  TestWriteRunsRandom();
+  return boost::report_errors();
+}